@@ -263,6 +263,9 @@ FIND_PACKAGE(X11)
 IF(X11_FOUND)
   GET_CONFIG(xt 1.0 XT XT_FOUND)
   ADD_DEFINITIONS(-DHAVE_X11=1)
+  IF(X11_XShm_FOUND)
+    ADD_DEFINITIONS(-DHAVE_XSHM=1)
+  ENDIF(X11_XShm_FOUND)
 ELSE(X11_FOUND)
   SET(GGL_BUILD_GTKMOZ_BROWSER_ELEMENT 0)
   SET(GGL_BUILD_GTK_FLASH_ELEMENT 0)
@@ -275,7 +278,7 @@ IF(NOT LIBXML2_FOUND AND GGL_BUILD_LIBXML2_XML_PARSER)
   SET(GGL_BUILD_LIBXML2_XML_PARSER 0)
 ENDIF(NOT LIBXML2_FOUND AND GGL_BUILD_LIBXML2_XML_PARSER)
 
-GET_CONFIG(libcurl 7.15 LIBCURL LIBCURL_FOUND)
+GET_CONFIG(libcurl 7.16.3 LIBCURL LIBCURL_FOUND)
 IF(NOT LIBCURL_FOUND)
   IF(GGL_BUILD_CURL_XML_HTTP_REQUEST)
     MESSAGE("Library curl is not available, curl-xml-http-request extension won't be built.")
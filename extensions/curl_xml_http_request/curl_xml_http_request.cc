@@ -18,9 +18,11 @@
 #include <cstring>
 #include <curl/curl.h>
 #include <pthread.h>
+#include <utility>
 #include <vector>
 
 #include <ggadget/gadget_consts.h>
+#include <ggadget/light_map.h>
 #include <ggadget/main_loop_interface.h>
 #include <ggadget/logger.h>
 #include <ggadget/scriptable_binary_data.h>
@@ -38,6 +40,11 @@ namespace curl {
 
 static const long kMaxRedirections = 10;
 static const long kConnectTimeoutSec = 20;
+// Maximum number of idle connections kept open by each connection pool.
+static const long kMaxCachedConnections = 16;
+// Maximum number of simultaneous connections to a single host. More requests
+// to the same host will be queued by curl.
+static const long kMaxConnectionsPerHost = 4;
 
 static const Variant kOpenDefaultArgs[] = {
   Variant(), Variant(),
@@ -78,15 +85,220 @@ static const char *ReformatHttpHeaderValue(const char *value) {
 }
 #endif
 
+// Runs the asynchronous requests of a session on a curl multi handle, which
+// is driven by the IO and timeout watches of the main loop. Requests in the
+// same pool reuse the connections to the same host, and no worker thread is
+// needed.
+class ConnectionPool {
+ public:
+  explicit ConnectionPool(MainLoopInterface *main_loop)
+      : main_loop_(main_loop),
+        multi_(curl_multi_init()),
+        timer_watch_(0),
+        ref_count_(1) {
+    if (multi_) {
+      curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+      curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+      curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+      curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+      curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, kMaxCachedConnections);
+#if LIBCURL_VERSION_NUM >= 0x071e00
+      curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                        kMaxConnectionsPerHost);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+      // Multiplex requests to the same host over one HTTP/2 connection.
+      curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    } else {
+      DLOG("ConnectionPool: curl_multi_init failed");
+    }
+  }
+
+  void Ref() {
+    ++ref_count_;
+  }
+
+  void Unref() {
+    ASSERT(ref_count_ > 0);
+    if (--ref_count_ == 0)
+      delete this;
+  }
+
+  // Starts an asynchronous transfer. The done_slot will be called with the
+  // CURLcode result when the transfer finishes or is cancelled, and will be
+  // deleted afterwards.
+  bool AddTransfer(CURL *curl, Slot1<void, int> *done_slot) {
+    if (!multi_ || curl_multi_add_handle(multi_, curl) != CURLM_OK) {
+      delete done_slot;
+      return false;
+    }
+    transfers_[curl] = done_slot;
+    return true;
+  }
+
+  // Cancels an active transfer. Nothing happens if the transfer has already
+  // finished. Must not be called from inside curl callbacks.
+  void CancelTransfer(CURL *curl) {
+    FinishTransfer(curl, CURLE_ABORTED_BY_CALLBACK);
+  }
+
+ private:
+  ~ConnectionPool() {
+    ASSERT(transfers_.empty());
+    if (multi_)
+      curl_multi_cleanup(multi_);
+    for (Sockets::iterator it = sockets_.begin(); it != sockets_.end(); ++it) {
+      if (it->second.first)
+        main_loop_->RemoveWatch(it->second.first);
+      if (it->second.second)
+        main_loop_->RemoveWatch(it->second.second);
+    }
+    if (timer_watch_)
+      main_loop_->RemoveWatch(timer_watch_);
+  }
+
+  // Calls curl when a socket is ready for reading or writing.
+  class SocketTask : public WatchCallbackInterface {
+   public:
+    SocketTask(ConnectionPool *pool, curl_socket_t socket, int action)
+        : pool_(pool), socket_(socket), action_(action) {
+    }
+    virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+      GGL_UNUSED(main_loop);
+      GGL_UNUSED(watch_id);
+      // This watch may be removed during the call, but the main loop won't
+      // delete it until the call returns.
+      pool_->SocketAction(socket_, action_);
+      return true;
+    }
+    virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+      GGL_UNUSED(main_loop);
+      GGL_UNUSED(watch_id);
+      delete this;
+    }
+
+   private:
+    ConnectionPool *pool_;
+    curl_socket_t socket_;
+    int action_;
+  };
+
+  static int SocketCallback(CURL *curl, curl_socket_t socket, int what,
+                            void *user_p, void *socket_p) {
+    GGL_UNUSED(curl);
+    GGL_UNUSED(socket_p);
+    static_cast<ConnectionPool *>(user_p)->WatchSocket(socket, what);
+    return 0;
+  }
+
+  void WatchSocket(curl_socket_t socket, int what) {
+    SocketWatches &watches = sockets_[socket];
+    UpdateWatch(&watches.first, socket, CURL_CSELECT_IN,
+                what == CURL_POLL_IN || what == CURL_POLL_INOUT);
+    UpdateWatch(&watches.second, socket, CURL_CSELECT_OUT,
+                what == CURL_POLL_OUT || what == CURL_POLL_INOUT);
+    if (what == CURL_POLL_REMOVE)
+      sockets_.erase(socket);
+  }
+
+  void UpdateWatch(int *watch, curl_socket_t socket, int action,
+                   bool wanted) {
+    if (wanted && !*watch) {
+      SocketTask *task = new SocketTask(this, socket, action);
+      *watch = action == CURL_CSELECT_IN ?
+               main_loop_->AddIOReadWatch(socket, task) :
+               main_loop_->AddIOWriteWatch(socket, task);
+      if (*watch <= 0) {
+        DLOG("ConnectionPool: Failed to watch socket %d", socket);
+        delete task;
+        *watch = 0;
+      }
+    } else if (!wanted && *watch) {
+      main_loop_->RemoveWatch(*watch);
+      *watch = 0;
+    }
+  }
+
+  static int TimerCallback(CURLM *multi, long timeout_ms, void *user_p) {
+    GGL_UNUSED(multi);
+    static_cast<ConnectionPool *>(user_p)->SetTimer(timeout_ms);
+    return 0;
+  }
+
+  void SetTimer(long timeout_ms) {
+    if (timer_watch_) {
+      main_loop_->RemoveWatch(timer_watch_);
+      timer_watch_ = 0;
+    }
+    if (timeout_ms >= 0) {
+      timer_watch_ = main_loop_->AddTimeoutWatch(
+          static_cast<int>(timeout_ms),
+          new WatchCallbackSlot(NewSlot(this, &ConnectionPool::OnTimer)));
+    }
+  }
+
+  bool OnTimer(int watch_id) {
+    // A new timer may be set during SocketAction().
+    if (timer_watch_ == watch_id)
+      timer_watch_ = 0;
+    SocketAction(CURL_SOCKET_TIMEOUT, 0);
+    return false;
+  }
+
+  void SocketAction(curl_socket_t socket, int action) {
+    int running = 0;
+    curl_multi_socket_action(multi_, socket, action, &running);
+
+    int queued = 0;
+    CURLMsg *msg;
+    while ((msg = curl_multi_info_read(multi_, &queued)) != NULL) {
+      if (msg->msg == CURLMSG_DONE) {
+        // msg becomes invalid after removing the handle.
+        CURL *curl = msg->easy_handle;
+        CURLcode code = msg->data.result;
+        FinishTransfer(curl, code);
+      }
+    }
+  }
+
+  void FinishTransfer(CURL *curl, CURLcode code) {
+    Transfers::iterator it = transfers_.find(curl);
+    if (it != transfers_.end()) {
+      Slot1<void, int> *done_slot = it->second;
+      transfers_.erase(it);
+      curl_multi_remove_handle(multi_, curl);
+      (*done_slot)(code);
+      delete done_slot;
+    }
+  }
+
+  typedef LightMap<CURL *, Slot1<void, int> *> Transfers;
+  // The read and write watch ids of a socket.
+  typedef std::pair<int, int> SocketWatches;
+  typedef LightMap<curl_socket_t, SocketWatches> Sockets;
+
+  MainLoopInterface *main_loop_;
+  CURLM *multi_;
+  Transfers transfers_;
+  Sockets sockets_;
+  int timer_watch_;
+  int ref_count_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ConnectionPool);
+};
+
 class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
  public:
   DEFINE_CLASS_ID(0xda25f528f28a4319, XMLHttpRequestInterface);
 
-  XMLHttpRequest(CURLSH *share, MainLoopInterface *main_loop,
+  XMLHttpRequest(CURLSH *share, ConnectionPool *pool,
+                 MainLoopInterface *main_loop,
                  XMLParserInterface *xml_parser,
                  const std::string &default_user_agent)
       : curl_(NULL),
         share_(share),
+        pool_(pool),
         main_loop_(main_loop),
         xml_parser_(xml_parser),
         response_dom_(NULL),
@@ -99,8 +311,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
         succeeded_(false) {
     VERIFY_M(EnsureXHRBackoffOptions(main_loop->GetCurrentTime()),
              ("Required options module have not been loaded"));
-    pthread_attr_init(&thread_attr_);
-    pthread_attr_setdetachstate(&thread_attr_, PTHREAD_CREATE_DETACHED);
+    pool_->Ref();
   }
 
   virtual void DoClassRegister() {
@@ -141,7 +352,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
   ~XMLHttpRequest() {
     Abort();
-    pthread_attr_destroy(&thread_attr_);
+    pool_->Unref();
   }
 
   virtual Connection *ConnectOnReadyStateChange(Slot0<void> *handler) {
@@ -212,7 +423,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     if (!default_user_agent_.empty())
       curl_easy_setopt(curl_, CURLOPT_USERAGENT, default_user_agent_.c_str());
 
-    // Disable curl using signals because we use curl in multiple threads.
+    // Disable curl using signals, which would interrupt the main loop.
     curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1);
     if (share_)
       curl_easy_setopt(curl_, CURLOPT_SHARE, share_);
@@ -390,8 +601,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     curl_easy_setopt(curl_, CURLOPT_VERBOSE, 1);
   #endif
     curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, context->request_headers);
-    curl_easy_setopt(curl_, CURLOPT_FRESH_CONNECT, 1);
-    curl_easy_setopt(curl_, CURLOPT_FORBID_REUSE, 1);
     curl_easy_setopt(curl_, CURLOPT_AUTOREFERER, 1);
     curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1);
     curl_easy_setopt(curl_, CURLOPT_MAXREDIRS, kMaxRedirections);
@@ -407,9 +616,8 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
       // this object from being GC'ed during the request.
       Ref();
       send_flag_ = true;
-      pthread_t thread;
-      if (pthread_create(&thread, &thread_attr_, Worker, context) != 0) {
-        DLOG("Failed to create worker thread");
+      if (!pool_->AddTransfer(curl_, NewSlot(TransferDone, context))) {
+        DLOG("Failed to start the transfer");
         Unref();
         send_flag_ = false;
         Abort();
@@ -422,11 +630,10 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
       }
     } else {
       send_flag_ = true;
-      // Run the worker directly in this thread.
-      // Returns NULL means failed.
-      void *result = Worker(context);
+      CURLcode code = curl_easy_perform(curl_);
+      TransferDone(code, context);
       send_flag_ = false;
-      if (!result)
+      if (code != CURLE_OK)
         return NETWORK_ERR;
     }
     return NO_ERR;
@@ -451,12 +658,9 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     *effective_url = url_ptr ? url_ptr : "";
   }
 
-  // If async, this method runs in a separate thread.
-  static void *Worker(void *arg) {
-    WorkerContext *context = static_cast<WorkerContext *>(arg);
-
-    CURLcode code = curl_easy_perform(context->curl);
-
+  // Called when the transfer of a request finishes. For async requests, it's
+  // called by the ConnectionPool.
+  static void TransferDone(int code, WorkerContext *context) {
     unsigned short status = 0;
     std::string effective_url;
     GetStatusAndEffectiveUrl(context->curl, &status, &effective_url);
@@ -467,15 +671,12 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     }
 
     if (code != CURLE_OK) {
-      DLOG("XMLHttpRequest: Send: curl_easy_perform failed: %s",
-           curl_easy_strerror(code));
+      DLOG("XMLHttpRequest: Send: transfer failed: %s",
+           curl_easy_strerror(static_cast<CURLcode>(code)));
     }
 
     WorkerDone(status, effective_url, context, code == CURLE_OK);
     delete context;
-
-    // Returns something that isn't NULL when success.
-    return code == CURLE_OK ? arg : NULL;
   }
 
   static size_t ReadCallback(void *ptr, size_t size, size_t mem_block,
@@ -504,7 +705,8 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     return data_size;
   }
 
-  // Passes the WriteHeader() request from worker thread to the main thread.
+  // Defers the WriteHeader() request out of the curl callback, because the
+  // script handlers must not be run inside curl callbacks.
   class WriteHeaderTask : public WatchCallbackInterface {
    public:
     WriteHeaderTask(const void *ptr, size_t size,
@@ -532,7 +734,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     WorkerContext worker_context_;
   };
 
-  // Passes the WriteBody() request from worker thread to the main thread.
+  // Defers the WriteBody() request out of the curl callback.
   class WriteBodyTask : public WriteHeaderTask {
    public:
     WriteBodyTask(const void *ptr, size_t size,
@@ -558,7 +760,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
     unsigned short status_;
   };
 
-  // Passes the Done() request from worker thread to the main thread.
+  // Defers the Done() request out of the ConnectionPool.
   class DoneTask : public WriteBodyTask {
    public:
     DoneTask(unsigned short status, const std::string &effective_url,
@@ -568,6 +770,12 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
           succeeded_(succeeded) {
     }
     virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+      WriteBodyTask::Call(main_loop, watch_id);
+      if (worker_context_.this_p->curl_ == worker_context_.curl)
+        worker_context_.this_p->Done(false, succeeded_);
+
+      // Cleanup the curl handle after Done(), so that its address can't be
+      // reused by another request before this request is done.
       curl_easy_cleanup(worker_context_.curl);
       // This cleanup of share handle will only succeed if this request is the
       // final request that was active when the belonging session has been
@@ -577,9 +785,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
         DLOG("Hangover share handle successfully cleaned up");
       }
 
-      WriteBodyTask::Call(main_loop, watch_id);
-      if (worker_context_.this_p->curl_ == worker_context_.curl)
-        worker_context_.this_p->Done(false, succeeded_);
       // Remove the internal reference that was added when the request was
       // started.
       worker_context_.this_p->Unref();
@@ -593,7 +798,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
                          const std::string &effective_url,
                          WorkerContext *context, bool succeeded) {
     if (context->async) {
-      // Do actual work in the main thread. AddTimeoutWatch() is threadsafe.
       context->this_p->main_loop_->AddTimeoutWatch(
           0, new DoneTask(status, effective_url, context, succeeded));
     } else {
@@ -619,7 +823,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
         return 0;
       }
 
-      // Do actual work in the main thread. AddTimeoutWatch() is threadsafe.
+      // Do actual work out of the curl callback.
       context->this_p->main_loop_->AddTimeoutWatch(
           0, new WriteHeaderTask(ptr, data_size, context));
       return size * mem_block;
@@ -666,7 +870,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
         return 0;
       }
 
-      // Do actual work in the main thread. AddTimeoutWatch() is threadsafe.
+      // Do actual work out of the curl callback.
       context->this_p->main_loop_->AddTimeoutWatch(
           0, new WriteBodyTask(ptr, data_size, status, effective_url, context));
       return data_size;
@@ -713,14 +917,18 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
   void Done(bool aborting, bool succeeded) {
     if (curl_) {
+      CURL *curl = curl_;
+      curl_ = NULL;
       if (!send_flag_) {
         // This cleanup only happens if an XMLHttpRequest is opened but
         // no send() is called. For an active request, the curl handle will
-        // be cleaned up when the request finishes or is aborted by error
-        // return value of WriteHeader() and WriteBody().
-        curl_easy_cleanup(curl_);
+        // be cleaned up by DoneTask when the request finishes.
+        curl_easy_cleanup(curl);
+      } else if (async_) {
+        // Stop the transfer if it's still active, so that the connection
+        // can be released immediately.
+        pool_->CancelTransfer(curl);
       }
-      curl_ = NULL;
     }
 
     request_headers_map_.clear();
@@ -1006,6 +1214,7 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
   CURL *curl_;
   CURLSH *share_;
+  ConnectionPool *pool_;
   MainLoopInterface *main_loop_;
   XMLParserInterface *xml_parser_;
   DOMDocumentInterface *response_dom_;
@@ -1024,7 +1233,6 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
   std::string response_body_;
   std::string response_text_;
   std::string default_user_agent_;
-  pthread_attr_t thread_attr_;
 
   unsigned short status_;
   State state_ : 3;
@@ -1041,7 +1249,20 @@ class XMLHttpRequest : public ScriptableHelper<XMLHttpRequestInterface> {
 
 class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
  public:
-  XMLHttpRequestFactory() : next_session_id_(1) {
+  XMLHttpRequestFactory() : default_pool_(NULL), next_session_id_(1) {
+  }
+
+  ~XMLHttpRequestFactory() {
+    ReleaseDefaultPool();
+  }
+
+  // Releases the pool of the requests that don't belong to any session. The
+  // pool will be actually destroyed when all requests using it are destroyed.
+  void ReleaseDefaultPool() {
+    if (default_pool_) {
+      default_pool_->Unref();
+      default_pool_ = NULL;
+    }
   }
 
   virtual int CreateSession() {
@@ -1057,6 +1278,7 @@ class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
       // Add a reference from "share_ref" to "share" to prevent "share" be
       // cleaned up by XMLHttpRequest instances.
       curl_easy_setopt(session->share_ref, CURLOPT_SHARE, share);
+      session->pool = new ConnectionPool(GetGlobalMainLoop());
       return result;
     }
     return -1;
@@ -1076,6 +1298,9 @@ class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
         DLOG("XMLHttpRequestFactory: Failed to DestroySession(): %s",
              curl_share_strerror(code));
       }
+      // The pool will be actually destroyed when all requests using it are
+      // destroyed.
+      session->pool->Unref();
       sessions_.erase(it);
     } else {
       DLOG("XMLHttpRequestFactory::DestroySession Invalid session: %d",
@@ -1086,13 +1311,16 @@ class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
   virtual XMLHttpRequestInterface *CreateXMLHttpRequest(
       int session_id, XMLParserInterface *parser) {
     if (session_id == 0) {
-      return new XMLHttpRequest(NULL, GetGlobalMainLoop(), parser,
-                                default_user_agent_);
+      if (!default_pool_)
+        default_pool_ = new ConnectionPool(GetGlobalMainLoop());
+      return new XMLHttpRequest(NULL, default_pool_, GetGlobalMainLoop(),
+                                parser, default_user_agent_);
     }
 
     Sessions::iterator it = sessions_.find(session_id);
     if (it != sessions_.end()) {
-      return new XMLHttpRequest(it->second.share, GetGlobalMainLoop(), parser,
+      return new XMLHttpRequest(it->second.share, it->second.pool,
+                                GetGlobalMainLoop(), parser,
                                 default_user_agent_);
     }
 
@@ -1112,6 +1340,8 @@ class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
     GGL_UNUSED(data);
     GGL_UNUSED(access);
     GGL_UNUSED(userptr);
+    // All requests are now performed in the main thread, but keep the lock in
+    // case the share handle is used by other threads.
     // This synchronization scope is bigger than optimal, but is much simpler.
     pthread_mutex_lock(&mutex_);
   }
@@ -1127,9 +1357,12 @@ class XMLHttpRequestFactory : public XMLHttpRequestFactoryInterface {
   struct Session {
     CURLSH *share;
     CURL *share_ref;
+    ConnectionPool *pool;
   };
 
   typedef LightMap<int, Session> Sessions;
+  // Pool of the requests that don't belong to any session.
+  ConnectionPool *default_pool_;
   Sessions sessions_;
   int next_session_id_;
   std::string default_user_agent_;
@@ -1154,5 +1387,8 @@ extern "C" {
 
   void Finalize() {
     LOGI("Finalize curl_xml_http_request extension.");
+    // The pool removes its watches from the main loop, so release it before
+    // the main loop is gone.
+    gFactory.ReleaseDefaultPool();
   }
 }
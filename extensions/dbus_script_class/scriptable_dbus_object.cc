@@ -148,6 +148,45 @@ class DBusSignal: public Signal {
 };
 
 class ScriptableDBusObject::Impl : public SmallObject<> {
+  // Helper class to receive elements of a script array.
+  class ArrayReceiver {
+   public:
+    bool Callback(int index, const Variant &value) {
+      GGL_UNUSED(index);
+      values_.push_back(value);
+      return true;
+    }
+    std::vector<Variant> values_;
+  };
+
+  // Passes the results of a batch of method calls to the script callback as
+  // a success flag and an array of results.
+  class BatchCallbackProxy : public DBusProxy::BatchResultCallback {
+   public:
+    explicit BatchCallbackProxy(Slot *callback) : callback_(callback) {}
+    virtual ~BatchCallbackProxy() { delete callback_; }
+    virtual ResultVariant Call(ScriptableInterface *object,
+                               int argc, const Variant argv[]) const {
+      ASSERT(argc == 3);
+      GGL_UNUSED(argc);
+      if (callback_) {
+        int count = VariantValue<int>()(argv[1]);
+        const Variant *results = VariantValue<const Variant *>()(argv[2]);
+        Variant params[2];
+        params[0] = argv[0];
+        params[1] = Variant(ScriptableArray::Create(results, results + count));
+        callback_->Call(object, 2, params);
+      }
+      return ResultVariant();
+    }
+    virtual bool operator==(const Slot &another) const {
+      GGL_UNUSED(another);
+      return false;
+    }
+   private:
+    Slot *callback_;
+  };
+
   // Helper class to receive enumerate result.
   class EnumerateReceiver {
    public:
@@ -292,6 +331,48 @@ class ScriptableDBusObject::Impl : public SmallObject<> {
     return receiver.CreateArray();
   }
 
+  // Each element of calls is an array containing a method name followed by
+  // the arguments of the method.
+  int CallMethods(ScriptableInterface *calls, Slot *callback) {
+    BatchCallbackProxy *proxy_callback = new BatchCallbackProxy(callback);
+    ArrayReceiver call_list;
+    if (!calls ||
+        !calls->EnumerateElements(
+            NewSlot(&call_list, &ArrayReceiver::Callback))) {
+      DLOG("$callMethods() expects an array of method calls.");
+      delete proxy_callback;
+      return 0;
+    }
+
+    size_t count = call_list.values_.size();
+    std::vector<ArrayReceiver> call_args(count);
+    std::vector<DBusProxy::MethodCall> method_calls(count);
+    for (size_t i = 0; i < count; ++i) {
+      ScriptableInterface *call = NULL;
+      if (call_list.values_[i].type() == Variant::TYPE_SCRIPTABLE)
+        call = VariantValue<ScriptableInterface *>()(call_list.values_[i]);
+      if (!call ||
+          !call->EnumerateElements(
+              NewSlot(&call_args[i], &ArrayReceiver::Callback)) ||
+          call_args[i].values_.empty() ||
+          !call_args[i].values_[0].ConvertToString(
+              &method_calls[i].method)) {
+        DLOG("Invalid method call at %zu for $callMethods().", i);
+        delete proxy_callback;
+        return 0;
+      }
+      method_calls[i].argc =
+          static_cast<int>(call_args[i].values_.size()) - 1;
+      method_calls[i].argv = &call_args[i].values_[0] + 1;
+    }
+    if (!count) {
+      delete proxy_callback;
+      return 0;
+    }
+    return proxy_->CallMethods(static_cast<int>(count), &method_calls[0],
+                               timeout_, proxy_callback);
+  }
+
   ScriptableInterface *GetChild(const std::string &name,
                                 const std::string &interface) {
     if (name.empty() || interface.empty()) return NULL;
@@ -489,6 +570,8 @@ void ScriptableDBusObject::DoClassRegister() {
 
   RegisterMethod("$callMethod",
                  new Impl::DBusCallMethodSlot());
+  RegisterMethod("$callMethods",
+                 NewSlot(&Impl::CallMethods, &ScriptableDBusObject::impl_));
   RegisterMethod("$cancelMethodCall",
                  NewSlot(&DBusProxy::CancelMethodCall, Impl::GetProxy));
   RegisterMethod("$isMethodCallPending",
@@ -102,10 +102,21 @@ class DefaultProcess : public ProcessInterface {
  public:
   virtual ProcessesInterface *EnumerateProcesses() { return &default_processes_; }
   virtual ProcessInfoInterface *GetForeground() { return NULL; }
+  virtual Connection *ConnectOnForegroundChanged(Slot0<void> *slot) {
+    delete slot;
+    return NULL;
+  }
   virtual ProcessInfoInterface *GetInfo(int pid) {
     GGL_UNUSED(pid);
     return NULL;
   }
+  virtual uint64_t GetChanges(uint64_t since, std::vector<int> *added,
+                              std::vector<int> *removed) {
+    GGL_UNUSED(since);
+    GGL_UNUSED(added);
+    GGL_UNUSED(removed);
+    return 0;
+  }
  private:
   DefaultProcesses default_processes_;
 };
@@ -371,7 +382,6 @@ static ScriptableMachine g_script_machine_(&g_machine_);
 static ScriptableMemory g_script_memory_(&g_memory_);
 static ScriptableNetwork g_script_network_(&g_network_);
 static ScriptablePower g_script_power_(&g_power_);
-static ScriptableProcess g_script_process_(&g_process_);
 static ScriptableProcessor g_script_processor_(&g_machine_);
 static ScriptableScreen g_script_screen_(&g_screen_);
 static ScriptableUser g_script_user_(&g_user_);
@@ -486,8 +496,9 @@ extern "C" {
                                         Variant(&g_script_network_));
     reg_system->RegisterVariantConstant("power",
                                         Variant(&g_script_power_));
-    reg_system->RegisterVariantConstant("process",
-                                        Variant(&g_script_process_));
+    // ScriptableProcess is per gadget, so create a new instance here.
+    ScriptableProcess *script_process = new ScriptableProcess(&g_process_);
+    reg_system->RegisterVariantConstant("process", Variant(script_process));
     reg_system->RegisterVariantConstant("processor",
                                         Variant(&g_script_processor_));
     reg_system->RegisterVariantConstant("screen",
@@ -14,7 +14,13 @@
   limitations under the License.
 */
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
+#include <set>
+#include <fcntl.h>
+#include <unistd.h>
 #include <ggadget/encryptor_interface.h>
 #include <ggadget/file_manager_factory.h>
 #include <ggadget/main_loop_interface.h>
@@ -35,6 +41,10 @@ static const int kAutoFlushIntervalVariant = 60000;
 static const size_t kDefaultOptionsSizeLimit = 0x100000; // 1MB.
 static const size_t kGlobalOptionsSizeLimit = 0x1000000; // 16MB.
 
+// The journal will be compacted into the options file when it's bigger than
+// both this size and the options file.
+static const size_t kMinJournalSizeToCompact = 0x4000; // 16KB.
+
 // An options file is an XML file in the following format:
 // <code>
 // <options>
@@ -58,6 +68,25 @@ static const size_t kGlobalOptionsSizeLimit = 0x1000000; // 16MB.
 //
 // Except for type="D", the convertion rule between typed value and string
 // is the same as Variant::ConvertTo...() and Variant::ConvertToString().
+//
+// To avoid rewriting the whole options file when only a few items changed,
+// Flush() appends the changed items to a journal file next to the options
+// file, if the journal file can be accessed directly. The journal is
+// compacted into the options file when it grows too big. The journal file is
+// in the following format, one record per line, with fields separated by tab
+// and escaped the same as values in the options file:
+// <code>
+// G generation
+// P type flags name value
+// R name
+// </code>
+// The first line is the generation of the options file this journal applies
+// to, which is stored in the generation attribute of the options element and
+// is increased on each compaction, so that a journal left by an interrupted
+// compaction won't be replayed over the newer options file. "P" records put
+// an item; flags is "i" for internal items, "e" for encrypted items and "-"
+// otherwise. "R" records remove an item. An incomplete last record caused by
+// crash is ignored.
 
 class DefaultOptions : public MemoryOptions {
  public:
@@ -69,7 +98,10 @@ class DefaultOptions : public MemoryOptions {
         encryptor_(GetEncryptor()),
         name_(name),
         location_(std::string(kOptionsFilePrefix) + name + ".xml"),
-        changed_(false),
+        generation_(0),
+        options_file_size_(0),
+        journal_size_(0),
+        compaction_needed_(false),
         ref_count_(0),
         timer_(0) {
     ASSERT(name && *name);
@@ -89,15 +121,37 @@ class DefaultOptions : public MemoryOptions {
     // Monitor options change.
     ConnectOnOptionChanged(NewSlot(this, &DefaultOptions::OnOptionChange));
 
+    std::string journal_location =
+        std::string(kOptionsFilePrefix) + name + ".journal";
+    if (!file_manager_->IsDirectlyAccessible(journal_location.c_str(),
+                                             &journal_path_)) {
+      // Can't append to the journal, always rewrite the whole options file.
+      journal_path_.clear();
+    }
+
+    Load();
+    // Items loaded needn't be flushed again.
+    changed_items_.clear();
+    changed_internal_items_.clear();
+  }
+
+  void Load() {
     std::string data;
     if (!file_manager_->ReadFile(location_.c_str(), &data)) {
-      // Not a fatal error, just leave this Options empty.
+      // Not a fatal error, just leave this Options empty. The journal, if
+      // any, is useless without the options file.
+      RemoveJournal();
       return;
     }
 
     StringMap table;
     if (parser_->ParseXMLIntoXPathMap(data, NULL, location_.c_str(),
                                       "options", NULL, NULL, &table)) {
+      options_file_size_ = data.size();
+      const char *generation = GetXPathValue(table, "@generation");
+      if (generation)
+        generation_ = static_cast<unsigned int>(strtoul(generation, NULL, 10));
+
       for (StringMap::const_iterator it = table.begin();
            it != table.end(); ++it) {
         const std::string &key = it->first;
@@ -142,6 +196,79 @@ class DefaultOptions : public MemoryOptions {
               name, location_.c_str());
         }
       }
+
+      if (!journal_path_.empty())
+        ReplayJournal();
+    }
+  }
+
+  // Splits a journal record into tab separated fields.
+  static void SplitRecord(const std::string &record,
+                          std::vector<std::string> *fields) {
+    fields->clear();
+    size_t start = 0;
+    while (true) {
+      size_t end = record.find('\t', start);
+      fields->push_back(record.substr(start, end - start));
+      if (end == record.npos)
+        break;
+      start = end + 1;
+    }
+  }
+
+  void ReplayJournal() {
+    std::string data;
+    if (!ReadFileContents(journal_path_.c_str(), &data) || data.empty())
+      return;
+
+    journal_size_ = data.size();
+    std::vector<std::string> fields;
+    size_t start = 0;
+    size_t end;
+    while ((end = data.find('\n', start)) != data.npos) {
+      std::string record(data, start, end - start);
+      start = end + 1;
+      SplitRecord(record, &fields);
+      if (fields[0] == "G" && fields.size() == 2) {
+        if (strtoul(fields[1].c_str(), NULL, 10) != generation_) {
+          DLOG("Ignore stale options journal: %s", journal_path_.c_str());
+          compaction_needed_ = true;
+          return;
+        }
+      } else if (fields[0] == "P" && fields.size() == 5) {
+        ReplayPutRecord(fields[1].c_str(), fields[2], UnescapeValue(fields[3]),
+                        UnescapeValue(fields[4]));
+      } else if (fields[0] == "R" && fields.size() == 2) {
+        Remove(UnescapeValue(fields[1]).c_str());
+      } else {
+        LOG("Invalid record in options journal '%s'", journal_path_.c_str());
+      }
+    }
+    // The last record is incomplete. New records can't be appended after it.
+    if (start < data.size())
+      compaction_needed_ = true;
+  }
+
+  void ReplayPutRecord(const char *type, const std::string &flags,
+                       const std::string &name, const std::string &value_str) {
+    bool internal = flags.find('i') != flags.npos;
+    bool encrypted = flags.find('e') != flags.npos;
+    std::string decrypted;
+    if (encrypted && !encryptor_->Decrypt(value_str, &decrypted)) {
+      LOG("Failed to decript value for item '%s' in options journal '%s'",
+          name.c_str(), journal_path_.c_str());
+      return;
+    }
+    Variant value = ParseValueStr(type, encrypted ? decrypted : value_str);
+    if (value.type() == Variant::TYPE_VOID) {
+      LOG("Failed to decode value for item '%s' in options journal '%s'",
+          name.c_str(), journal_path_.c_str());
+    } else if (internal) {
+      PutInternalValue(name.c_str(), value);
+    } else {
+      PutValue(name.c_str(), value);
+      if (encrypted)
+        EncryptValue(name.c_str());
     }
   }
 
@@ -161,8 +288,7 @@ class DefaultOptions : public MemoryOptions {
   }
 
   void OnOptionChange(const char *option) {
-    GGL_UNUSED(option);
-    changed_ = true;
+    changed_items_.insert(option);
   }
 
   static const char *GetXPathValue(const StringMap &table,
@@ -256,16 +382,7 @@ class DefaultOptions : public MemoryOptions {
     return result;
   }
 
-  void WriteItemCommon(const char *name, const Variant &value,
-                       bool internal, bool encrypted) {
-    out_data_ += " <item name=\"";
-    out_data_ += parser_->EncodeXMLString(EscapeValue(name).c_str());
-    out_data_ += "\" type=\"";
-    out_data_ += GetValueType(value);
-    out_data_ += "\"";
-    if (internal)
-      out_data_ += " internal=\"1\"";
-
+  std::string GetValueStr(const Variant &value, bool encrypted) {
     std::string str_value;
     // JSON and DATE types can't be converted to string by default logic.
     if (value.type() == Variant::TYPE_JSON)
@@ -276,15 +393,46 @@ class DefaultOptions : public MemoryOptions {
       value.ConvertToString(&str_value); // Errors are ignored.
 
     if (encrypted) {
-      out_data_ += " encrypted=\"1\"";
       std::string temp(str_value);
       encryptor_->Encrypt(temp, &str_value);
     }
+    return str_value;
+  }
+
+  void WriteItemCommon(const char *name, const Variant &value,
+                       bool internal, bool encrypted) {
+    out_data_ += " <item name=\"";
+    out_data_ += parser_->EncodeXMLString(EscapeValue(name).c_str());
+    out_data_ += "\" type=\"";
+    out_data_ += GetValueType(value);
+    out_data_ += "\"";
+    if (internal)
+      out_data_ += " internal=\"1\"";
+    if (encrypted)
+      out_data_ += " encrypted=\"1\"";
     out_data_ += ">";
-    out_data_ += parser_->EncodeXMLString(EscapeValue(str_value).c_str());
+    out_data_ += parser_->EncodeXMLString(
+        EscapeValue(GetValueStr(value, encrypted)).c_str());
     out_data_ += "</item>\n";
   }
 
+  void WritePutRecord(const std::string &name, const Variant &value,
+                      bool internal, bool encrypted) {
+    out_data_ += "P\t";
+    out_data_ += GetValueType(value);
+    out_data_ += internal ? "\ti\t" : encrypted ? "\te\t" : "\t-\t";
+    out_data_ += EscapeValue(name);
+    out_data_ += '\t';
+    out_data_ += EscapeValue(GetValueStr(value, encrypted));
+    out_data_ += '\n';
+  }
+
+  void WriteRemoveRecord(const std::string &name) {
+    out_data_ += "R\t";
+    out_data_ += EscapeValue(name);
+    out_data_ += '\n';
+  }
+
   bool WriteItem(const char *name, const Variant &value, bool encrypted) {
     WriteItemCommon(name, value, false, encrypted);
     return true;
@@ -297,39 +445,135 @@ class DefaultOptions : public MemoryOptions {
 
   virtual void PutInternalValue(const char *name, const Variant &value) {
     MemoryOptions::PutInternalValue(name, value);
-    changed_ = true;
+    changed_internal_items_.insert(name);
+  }
+
+  virtual void EncryptValue(const char *name) {
+    MemoryOptions::EncryptValue(name);
+    changed_items_.insert(name);
   }
 
   virtual bool Flush() {
     if (!file_manager_)
       return false;
-    if (!changed_)
+    if (changed_items_.empty() && changed_internal_items_.empty() &&
+        !compaction_needed_)
       return true;
 
+    if (journal_path_.empty() || compaction_needed_ ||
+        options_file_size_ == 0 || GetCount() == 0 ||
+        journal_size_ >= std::max(kMinJournalSizeToCompact,
+                                  options_file_size_) ||
+        !AppendJournal()) {
+      return Compact();
+    }
+    return true;
+  }
+
+  // Appends the changed items to the journal.
+  bool AppendJournal() {
+    DLOG("Append options journal: %s", journal_path_.c_str());
+    out_data_.clear();
+    if (journal_size_ == 0)
+      out_data_ = StringPrintf("G\t%u\n", generation_);
+    for (NameSet::const_iterator it = changed_items_.begin();
+         it != changed_items_.end(); ++it) {
+      const char *name = it->c_str();
+      if (Exists(name))
+        WritePutRecord(*it, GetValue(name), false, IsEncrypted(name));
+      else
+        WriteRemoveRecord(*it);
+    }
+    for (NameSet::const_iterator it = changed_internal_items_.begin();
+         it != changed_internal_items_.end(); ++it) {
+      WritePutRecord(*it, GetInternalValue(it->c_str()), true, false);
+    }
+
+    FILE *fp = fopen(journal_path_.c_str(), "ab");
+    bool result = false;
+    if (fp) {
+      result = fwrite(out_data_.c_str(), out_data_.size(), 1, fp) == 1;
+      result = fclose(fp) == 0 && result;
+    }
+    if (result) {
+      journal_size_ += out_data_.size();
+      changed_items_.clear();
+      changed_internal_items_.clear();
+    } else {
+      // The journal might end with a partial record.
+      LOG("Failed to append options journal: %s", journal_path_.c_str());
+      compaction_needed_ = true;
+    }
+    out_data_.clear();
+    return result;
+  }
+
+  // Rewrites the whole options file, and removes the journal.
+  bool Compact() {
     DLOG("Flush options file: %s", location_.c_str());
     out_data_.clear();
-    out_data_ = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<options>\n";
+    out_data_ = StringPrintf("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                             "<options generation=\"%u\">\n",
+                             generation_ + 1);
     size_t out_data_header_size = out_data_.size();
     EnumerateItems(NewSlot(this, &DefaultOptions::WriteItem));
     EnumerateInternalItems(NewSlot(this, &DefaultOptions::WriteInternalItem));
 
+    bool result;
     if (out_data_.size() == out_data_header_size) {
-      // There is no item, remove the options file.
+      // There is no item, remove the journal and the options file.
+      result = RemoveJournal();
       file_manager_->RemoveFile(location_.c_str());
-      return true;
+      generation_ = 0;
+      options_file_size_ = 0;
     } else {
       out_data_ += "</options>\n";
-      bool result = file_manager_->WriteFile(location_.c_str(), out_data_,
-                                             true);
-      out_data_.clear();
-      if (result)
-        changed_ = false;
-      return result;
+      result = file_manager_->WriteFile(location_.c_str(), out_data_, true);
+      if (result) {
+        generation_++;
+        options_file_size_ = out_data_.size();
+        // The journal of the old generation is ignored when loading, but
+        // records appended after its stale header would be lost, so the
+        // compaction fails and is retried if it can't be removed.
+        result = RemoveJournal();
+      }
+    }
+    out_data_.clear();
+    if (result) {
+      changed_items_.clear();
+      changed_internal_items_.clear();
+      compaction_needed_ = false;
     }
+    return result;
+  }
+
+  // Removes the journal, or truncates it if it can't be unlinked.
+  // Returns false and keeps journal_size_ if neither succeeds.
+  bool RemoveJournal() {
+    if (journal_path_.empty() ||
+        unlink(journal_path_.c_str()) == 0 || errno == ENOENT) {
+      journal_size_ = 0;
+      return true;
+    }
+
+    int fd = open(journal_path_.c_str(), O_WRONLY | O_TRUNC);
+    bool result = false;
+    if (fd >= 0) {
+      result = fsync(fd) == 0;
+      result = close(fd) == 0 && result;
+    }
+    if (result) {
+      journal_size_ = 0;
+    } else {
+      LOG("Failed to remove options journal: %s", journal_path_.c_str());
+      compaction_needed_ = true;
+    }
+    return result;
   }
 
   virtual void DeleteStorage() {
     MemoryOptions::DeleteStorage();
+    RemoveJournal();
     file_manager_->RemoveFile(location_.c_str());
     file_manager_ = NULL;
     // Delete it from the map to prevent it from being further used.
@@ -379,8 +623,17 @@ class DefaultOptions : public MemoryOptions {
   EncryptorInterface *encryptor_;
   std::string name_;
   std::string location_;
+  std::string journal_path_;  // Empty if the journal is not used.
   std::string out_data_;  // Only available during Flush().
-  bool changed_; // Whether changed since last Flush().
+  // Names of items changed since last Flush().
+  typedef std::set<std::string> NameSet;
+  NameSet changed_items_;
+  NameSet changed_internal_items_;
+  unsigned int generation_;
+  size_t options_file_size_;
+  size_t journal_size_;
+  // Whether the whole options file must be rewritten in next Flush().
+  bool compaction_needed_;
   int ref_count_;
   int timer_;
 
@@ -197,6 +197,107 @@ TEST(DefaultOptions, TestOptionsSharing) {
   delete options;
 }
 
+TEST(DefaultOptions, TestJournal) {
+  g_mocked_fm.data_.clear();
+  g_mocked_fm.path_ = TEST_DIRECTORY "/";
+  RemoveDirectory(TEST_DIRECTORY, true);
+  ASSERT_TRUE(EnsureDirectories(TEST_DIRECTORY "/profile://options"));
+  const std::string kXMLPath("profile://options/journal1.xml");
+  const std::string kJournalPath(TEST_DIRECTORY
+                                 "/profile://options/journal1.journal");
+  std::string journal;
+
+  OptionsInterface *options = CreateOptions("journal1");
+  options->PutValue("a", Variant(1));
+  options->PutValue("b", Variant("b"));
+  options->EncryptValue("b");
+  options->PutInternalValue("i", Variant(1));
+  // The first flush writes the whole options file.
+  ASSERT_TRUE(options->Flush());
+  const std::string xml = g_mocked_fm.data_[kXMLPath];
+  ASSERT_NE(std::string::npos, xml.find("generation=\"1\""));
+  ASSERT_FALSE(ReadFileContents(kJournalPath.c_str(), &journal));
+
+  // Later flushes only append the changed items to the journal.
+  options->PutValue("a", Variant(2));
+  options->Remove("b");
+  options->PutInternalValue("i", Variant(2));
+  options->PutValue("c", Variant("c\t\n"));
+  options->EncryptValue("c");
+  ASSERT_TRUE(options->Flush());
+  ASSERT_EQ(xml, g_mocked_fm.data_[kXMLPath]);
+  ASSERT_TRUE(ReadFileContents(kJournalPath.c_str(), &journal));
+  ASSERT_EQ(0U, journal.find("G\t1\n"));
+  size_t journal_size = journal.size();
+  // Nothing changed, nothing to append.
+  ASSERT_TRUE(options->Flush());
+  ASSERT_TRUE(ReadFileContents(kJournalPath.c_str(), &journal));
+  ASSERT_EQ(journal_size, journal.size());
+  delete options;
+
+  // The journal is replayed when the options is loaded.
+  options = CreateOptions("journal1");
+  EXPECT_EQ(Variant(2), options->GetValue("a"));
+  EXPECT_EQ(Variant(), options->GetValue("b"));
+  EXPECT_EQ(Variant("c\t\n"), options->GetValue("c"));
+  EXPECT_TRUE(options->IsEncrypted("c"));
+  EXPECT_EQ(Variant(2), options->GetInternalValue("i"));
+  EXPECT_EQ(2U, options->GetCount());
+
+  // The journal is compacted into the options file when it's too big.
+  const std::string big_string(20000, 'x');
+  options->PutValue("big", Variant(big_string));
+  ASSERT_TRUE(options->Flush());
+  ASSERT_EQ(xml, g_mocked_fm.data_[kXMLPath]);
+  options->PutValue("a", Variant(3));
+  ASSERT_TRUE(options->Flush());
+  ASSERT_NE(std::string::npos,
+            g_mocked_fm.data_[kXMLPath].find("generation=\"2\""));
+  ASSERT_FALSE(ReadFileContents(kJournalPath.c_str(), &journal));
+  delete options;
+
+  // A journal of an old generation or an incomplete record is ignored.
+  ASSERT_TRUE(WriteFileContents(kJournalPath.c_str(),
+                                "G\t1\nR\ta\n"));
+  options = CreateOptions("journal1");
+  EXPECT_EQ(Variant(3), options->GetValue("a"));
+  // The stale journal is removed by compaction.
+  delete options;
+  ASSERT_NE(std::string::npos,
+            g_mocked_fm.data_[kXMLPath].find("generation=\"3\""));
+  ASSERT_FALSE(ReadFileContents(kJournalPath.c_str(), &journal));
+  ASSERT_TRUE(WriteFileContents(kJournalPath.c_str(),
+                                "G\t3\nR\tbig\nR\ta"));
+  options = CreateOptions("journal1");
+  EXPECT_EQ(Variant(), options->GetValue("big"));
+  EXPECT_EQ(Variant(3), options->GetValue("a"));
+  // The options file is rewritten in the next flush.
+  ASSERT_TRUE(options->Flush());
+  ASSERT_NE(std::string::npos,
+            g_mocked_fm.data_[kXMLPath].find("generation=\"4\""));
+  ASSERT_FALSE(ReadFileContents(kJournalPath.c_str(), &journal));
+
+  // The compaction fails if the journal can't be removed, and is retried
+  // in the next flush.
+  ASSERT_TRUE(EnsureDirectories((kJournalPath + "/dir").c_str()));
+  options->PutValue("a", Variant(4));
+  ASSERT_FALSE(options->Flush());
+  ASSERT_FALSE(options->Flush());
+  RemoveDirectory(kJournalPath.c_str(), true);
+  ASSERT_TRUE(options->Flush());
+  ASSERT_NE(std::string::npos,
+            g_mocked_fm.data_[kXMLPath].find("generation=\"7\""));
+  options->PutValue("a", Variant(5));
+  ASSERT_TRUE(options->Flush());
+  ASSERT_TRUE(ReadFileContents(kJournalPath.c_str(), &journal));
+  ASSERT_EQ(0U, journal.find("G\t7\n"));
+
+  options->DeleteStorage();
+  delete options;
+  g_mocked_fm.path_.clear();
+  RemoveDirectory(TEST_DIRECTORY, true);
+}
+
 int main(int argc, char **argv) {
   SetGlobalMainLoop(&g_mocked_main_loop);
   SetGlobalFileManager(&g_mocked_fm);
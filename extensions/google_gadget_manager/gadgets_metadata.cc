@@ -16,7 +16,13 @@
 
 #include "gadgets_metadata.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
 #include <time.h>
 #include <ggadget/common.h>
 #include <ggadget/file_manager_factory.h>
@@ -40,6 +46,178 @@ static const char *kMonthNames[] = {
   "July", "August", "September", "October", "November", "December"
 };
 
+// Layout of the plugins cache file. All integers are 32-bit little endian.
+//   header: magic, version, gadget count, latest updated_date (low and high
+//       32 bits), string table offset and size.
+//   index: offsets of the records in the file, one for each gadget.
+//   records: for each gadget, sorted by id:
+//       id, updated_date (low and high 32 bits),
+//       attribute count, title count, description count,
+//       (name, value) pairs of attributes, then of titles and descriptions,
+//       whose names are locales.
+//   string table: NUL-terminated strings. Strings in records are offsets
+//       into the table, so that repeated strings are stored only once.
+// The file is mapped into memory, and a gadget is looked up with a binary
+// search in the index, so that only the gadgets used are decoded.
+static const char kPluginsCacheMagic[] = "GGLPLUGS";
+static const size_t kPluginsCacheMagicSize = sizeof(kPluginsCacheMagic) - 1;
+static const size_t kPluginsCacheHeaderSize = kPluginsCacheMagicSize + 24;
+
+static void WriteUInt32(uint32_t value, std::string *data) {
+  for (int i = 0; i < 4; i++) {
+    data->push_back(static_cast<char>(value & 0xff));
+    value >>= 8;
+  }
+}
+
+// Builds the index and the string table of the plugins cache file.
+class PluginsCacheWriter {
+ public:
+  // Must be called before appending the data of each gadget.
+  void BeginRecord() {
+    record_offsets_.push_back(static_cast<uint32_t>(records_.size()));
+  }
+
+  void AppendString(const std::string &str) {
+    StringIndex::iterator it = index_.find(str);
+    if (it == index_.end()) {
+      it = index_.insert(std::make_pair(
+          str, static_cast<uint32_t>(strings_.size()))).first;
+      strings_.append(str.c_str(), str.size() + 1);
+    }
+    WriteUInt32(it->second, &records_);
+  }
+
+  void AppendUInt32(uint32_t value) {
+    WriteUInt32(value, &records_);
+  }
+
+  void AppendStringMap(const StringMap &map) {
+    for (StringMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+      AppendString(it->first);
+      AppendString(it->second);
+    }
+  }
+
+  std::string GetContents(uint64_t latest_plugin_time) const {
+    uint32_t records_offset = static_cast<uint32_t>(
+        kPluginsCacheHeaderSize + record_offsets_.size() * 4);
+    std::string contents(kPluginsCacheMagic, kPluginsCacheMagicSize);
+    WriteUInt32(GadgetsMetadata::kPluginsCacheVersion, &contents);
+    WriteUInt32(static_cast<uint32_t>(record_offsets_.size()), &contents);
+    WriteUInt32(static_cast<uint32_t>(latest_plugin_time), &contents);
+    WriteUInt32(static_cast<uint32_t>(latest_plugin_time >> 32), &contents);
+    WriteUInt32(static_cast<uint32_t>(records_offset + records_.size()),
+                &contents);
+    WriteUInt32(static_cast<uint32_t>(strings_.size()), &contents);
+    contents.reserve(records_offset + records_.size() + strings_.size());
+    for (std::vector<uint32_t>::const_iterator it = record_offsets_.begin();
+         it != record_offsets_.end(); ++it) {
+      WriteUInt32(records_offset + *it, &contents);
+    }
+    contents += records_;
+    contents += strings_;
+    return contents;
+  }
+
+ private:
+  typedef LightMap<std::string, uint32_t> StringIndex;
+  StringIndex index_;
+  std::vector<uint32_t> record_offsets_;
+  std::string records_;
+  std::string strings_;
+};
+
+// Reads the plugins cache file in place with bounds checking.
+class PluginsCacheReader {
+ public:
+  PluginsCacheReader(const char *data, size_t size)
+      : data_(data), size_(size), pos_(0), records_offset_(0),
+        strings_(NULL), strings_size_(0) {
+  }
+
+  bool ReadHeader(uint32_t *gadget_count, uint64_t *latest_plugin_time) {
+    uint32_t version, time_low, time_high, strings_offset;
+    if (size_ < kPluginsCacheHeaderSize ||
+        memcmp(data_, kPluginsCacheMagic, kPluginsCacheMagicSize) != 0)
+      return false;
+    pos_ = kPluginsCacheMagicSize;
+    ReadUInt32(&version);
+    if (version != GadgetsMetadata::kPluginsCacheVersion) {
+      DLOG("Ignore plugins cache of version %u", version);
+      return false;
+    }
+    ReadUInt32(gadget_count);
+    ReadUInt32(&time_low);
+    ReadUInt32(&time_high);
+    ReadUInt32(&strings_offset);
+    ReadUInt32(&strings_size_);
+    // The string table must be at the end and end with a NUL, so that
+    // strings in it can't run out of the data.
+    if (strings_offset < kPluginsCacheHeaderSize ||
+        strings_offset > size_ || size_ - strings_offset != strings_size_ ||
+        (strings_size_ > 0 && data_[size_ - 1] != '\0') ||
+        (strings_offset - kPluginsCacheHeaderSize) / 4 < *gadget_count)
+      return false;
+    *latest_plugin_time = (static_cast<uint64_t>(time_high) << 32) | time_low;
+    records_offset_ = kPluginsCacheHeaderSize + *gadget_count * 4;
+    strings_ = data_ + strings_offset;
+    // Records can't overlap the string table.
+    size_ = strings_offset;
+    return true;
+  }
+
+  // Moves to the record of the index-th gadget. The caller must ensure that
+  // index is less than the gadget count.
+  bool SeekRecord(uint32_t index) {
+    uint32_t offset;
+    pos_ = kPluginsCacheHeaderSize + index * 4;
+    if (!ReadUInt32(&offset) || offset < records_offset_ || offset > size_)
+      return false;
+    pos_ = offset;
+    return true;
+  }
+
+  bool ReadUInt32(uint32_t *value) {
+    if (size_ - pos_ < 4)
+      return false;
+    const unsigned char *p =
+        reinterpret_cast<const unsigned char *>(data_ + pos_);
+    *value = p[0] | (p[1] << 8) | (p[2] << 16) |
+             (static_cast<uint32_t>(p[3]) << 24);
+    pos_ += 4;
+    return true;
+  }
+
+  bool ReadString(const char **str) {
+    uint32_t offset;
+    if (!ReadUInt32(&offset) || offset >= strings_size_)
+      return false;
+    *str = strings_ + offset;
+    return true;
+  }
+
+  bool ReadStringMap(uint32_t count, StringMap *map) {
+    const char *name, *value;
+    for (uint32_t i = 0; i < count; i++) {
+      if (!ReadString(&name) || !ReadString(&value))
+        return false;
+      // Names are sorted, so that they are always appended at the end.
+      map->insert(map->end(), std::make_pair(std::string(name),
+                                             std::string(value)));
+    }
+    return true;
+  }
+
+ private:
+  const char *data_;
+  size_t size_;
+  size_t pos_;
+  size_t records_offset_;
+  const char *strings_;
+  uint32_t strings_size_;
+};
+
 // Load gadget manifest and fill in GadgetInfo.
 static bool FillGadgetInfoFromManifest(const char *gadget_path,
                                        GadgetInfo *info) {
@@ -68,6 +246,11 @@ class GadgetsMetadata::Impl {
         file_manager_(GetGlobalFileManager()),
         latest_plugin_time_(0),
         full_download_(false),
+        initialized_(false),
+        all_loaded_(false),
+        cache_data_(NULL),
+        cache_size_(0),
+        cache_mapped_(false),
         on_update_done_(NULL) {
     ASSERT(parser_);
     ASSERT(file_manager_);
@@ -75,9 +258,23 @@ class GadgetsMetadata::Impl {
 
   void Init() {
     std::string contents;
+    plugins_.clear();
+    initialized_ = true;
+    all_loaded_ = false;
+    if (OpenPluginsCache()) {
+      // Gadgets in the cache are decoded when they are used.
+      LoadBuiltinGadgetsXML();
+      return;
+    }
+
+    all_loaded_ = true;
     if (file_manager_->ReadFile(kPluginsXMLLocation, &contents)) {
-      ParsePluginsXML(contents, true);
-      // ParsePluginsXML will also call LoadBuiltinGadgetsXML().
+      // plugins.xml is saved by old versions. Convert it into the cache.
+      if (ParsePluginsXML(contents, true)) {
+        if (SavePluginsCache())
+          file_manager_->RemoveFile(kPluginsXMLLocation);
+        LoadBuiltinGadgetsXML();
+      }
     } else {
       LoadBuiltinGadgetsXML();
     }
@@ -86,16 +283,30 @@ class GadgetsMetadata::Impl {
   ~Impl() {
     if (request_.Get())
       request_.Get()->Abort();
+    ClosePluginsCache();
   }
 
   void EnsureInitialized() {
-    if (plugins_.empty())
+    if (!initialized_ || (plugins_.empty() && !cache_data_))
       Init();
   }
 
+  // Ensures that plugins_ contains all gadgets, because they are going to be
+  // enumerated or replaced.
+  void EnsureAllLoaded() {
+    EnsureInitialized();
+    if (!all_loaded_) {
+      LoadPluginsCache();
+      all_loaded_ = true;
+    }
+  }
+
   void FreeMemory() {
-    if (!request_.Get())
+    if (!request_.Get()) {
       plugins_.clear();
+      ClosePluginsCache();
+      initialized_ = false;
+    }
   }
 
   // Get a value from a XPath map.
@@ -158,50 +369,169 @@ class GadgetsMetadata::Impl {
     return (local_time - (local_time_as_gm - local_time)) * UINT64_C(1000);
   }
 
-  bool SavePluginsXMLFile() {
-    std::string contents("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-                         "<plugins>\n");
+  bool SavePluginsCache() {
+    PluginsCacheWriter writer;
+    uint64_t latest_plugin_time = 0;
     for (GadgetInfoMap::const_iterator it = plugins_.begin();
-         it != plugins_.end(); ++ it) {
+         it != plugins_.end(); ++it) {
       const GadgetInfo &info = it->second;
       if (info.source != SOURCE_PLUGINS_XML)
         continue;
 
-      contents += " <plugin";
-      for (StringMap::const_iterator attr_it = info.attributes.begin();
-           attr_it != info.attributes.end(); ++attr_it) {
-        contents += " ";
-        contents += attr_it->first;
-        contents += "=\"";
-        contents += parser_->EncodeXMLString(attr_it->second.c_str());
-        contents += "\"";
+      if (info.updated_date > latest_plugin_time)
+        latest_plugin_time = info.updated_date;
+      writer.BeginRecord();
+      writer.AppendString(info.id);
+      writer.AppendUInt32(static_cast<uint32_t>(info.updated_date));
+      writer.AppendUInt32(static_cast<uint32_t>(info.updated_date >> 32));
+      writer.AppendUInt32(static_cast<uint32_t>(info.attributes.size()));
+      writer.AppendUInt32(static_cast<uint32_t>(info.titles.size()));
+      writer.AppendUInt32(static_cast<uint32_t>(info.descriptions.size()));
+      writer.AppendStringMap(info.attributes);
+      writer.AppendStringMap(info.titles);
+      writer.AppendStringMap(info.descriptions);
+    }
+    if (!file_manager_->WriteFile(kPluginsCacheLocation,
+                                  writer.GetContents(latest_plugin_time),
+                                  true)) {
+      LOG("Failed to save the plugins cache");
+      return false;
+    }
+    return true;
+  }
+
+  // Maps the plugins cache file into memory, or reads it if it can't be
+  // mapped, and checks its header.
+  bool OpenPluginsCache() {
+    ClosePluginsCache();
+#if defined(OS_POSIX)
+    std::string path;
+    if (file_manager_->IsDirectlyAccessible(kPluginsCacheLocation, &path)) {
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd >= 0) {
+        struct stat stat_value;
+        if (fstat(fd, &stat_value) == 0 && stat_value.st_size > 0) {
+          void *data = mmap(NULL, static_cast<size_t>(stat_value.st_size),
+                            PROT_READ, MAP_PRIVATE, fd, 0);
+          if (data != MAP_FAILED) {
+            cache_data_ = static_cast<const char *>(data);
+            cache_size_ = static_cast<size_t>(stat_value.st_size);
+            cache_mapped_ = true;
+          }
+        }
+        close(fd);
+      }
+    }
+#endif
+    if (!cache_data_) {
+      if (!file_manager_->ReadFile(kPluginsCacheLocation, &cache_contents_))
+        return false;
+      cache_data_ = cache_contents_.data();
+      cache_size_ = cache_contents_.size();
+    }
+
+    PluginsCacheReader reader(cache_data_, cache_size_);
+    uint32_t count;
+    uint64_t latest_plugin_time;
+    if (!reader.ReadHeader(&count, &latest_plugin_time)) {
+      ClosePluginsCache();
+      return false;
+    }
+    latest_plugin_time_ = latest_plugin_time;
+    return true;
+  }
+
+  void ClosePluginsCache() {
+#if defined(OS_POSIX)
+    if (cache_mapped_)
+      munmap(const_cast<char *>(cache_data_), cache_size_);
+#endif
+    cache_data_ = NULL;
+    cache_size_ = 0;
+    cache_mapped_ = false;
+    std::string().swap(cache_contents_);
+  }
+
+  // Decodes the rest of the record after its id.
+  static bool ReadCachedGadgetInfo(PluginsCacheReader *reader,
+                                   GadgetInfo *info) {
+    uint32_t date_low, date_high, attr_count, title_count, desc_count;
+    if (!reader->ReadUInt32(&date_low) || !reader->ReadUInt32(&date_high) ||
+        !reader->ReadUInt32(&attr_count) ||
+        !reader->ReadUInt32(&title_count) || !reader->ReadUInt32(&desc_count))
+      return false;
+    info->updated_date = (static_cast<uint64_t>(date_high) << 32) | date_low;
+    return reader->ReadStringMap(attr_count, &info->attributes) &&
+           reader->ReadStringMap(title_count, &info->titles) &&
+           reader->ReadStringMap(desc_count, &info->descriptions);
+  }
+
+  // Decodes all gadgets in the cache which haven't been decoded, and closes
+  // the cache.
+  void LoadPluginsCache() {
+    PluginsCacheReader reader(cache_data_, cache_size_);
+    uint32_t count;
+    uint64_t latest_plugin_time;
+    if (!cache_data_ || !reader.ReadHeader(&count, &latest_plugin_time))
+      return;
+
+    for (uint32_t i = 0; i < count; i++) {
+      const char *id;
+      if (!reader.SeekRecord(i) || !reader.ReadString(&id)) {
+        LOG("Corrupted plugins cache");
+        break;
+      }
+      // Gadgets decoded before, and built-in gadgets, are kept.
+      GadgetInfoMap::iterator it = plugins_.lower_bound(id);
+      if (it != plugins_.end() && it->first == id)
+        continue;
+
+      it = plugins_.insert(it, std::make_pair(std::string(id), GadgetInfo()));
+      it->second.id = it->first;
+      if (!ReadCachedGadgetInfo(&reader, &it->second)) {
+        LOG("Corrupted plugins cache");
+        plugins_.erase(it);
+        break;
+      }
+    }
+    ClosePluginsCache();
+  }
+
+  // Looks up a gadget in the cache with a binary search of the index, and
+  // decodes it into plugins_.
+  GadgetInfo *LoadCachedGadgetInfo(const char *gadget_id) {
+    PluginsCacheReader reader(cache_data_, cache_size_);
+    uint32_t count;
+    uint64_t latest_plugin_time;
+    if (!cache_data_ || !reader.ReadHeader(&count, &latest_plugin_time))
+      return NULL;
+
+    uint32_t low = 0, high = count;
+    while (low < high) {
+      uint32_t middle = low + (high - low) / 2;
+      const char *id;
+      if (!reader.SeekRecord(middle) || !reader.ReadString(&id)) {
+        LOG("Corrupted plugins cache");
+        return NULL;
       }
-      if (info.titles.empty() && info.descriptions.empty()) {
-        contents += "/>\n";
+      int result = strcmp(id, gadget_id);
+      if (result < 0) {
+        low = middle + 1;
+      } else if (result > 0) {
+        high = middle;
       } else {
-        contents += ">\n";
-        for (StringMap::const_iterator title_it = info.titles.begin();
-             title_it != info.titles.end(); ++title_it) {
-          contents += "  <title locale=\"";
-          contents += parser_->EncodeXMLString(title_it->first.c_str());
-          contents += "\">";
-          contents += parser_->EncodeXMLString(title_it->second.c_str());
-          contents += "</title>\n";
+        GadgetInfoMap::iterator it = plugins_.insert(
+            std::make_pair(std::string(id), GadgetInfo())).first;
+        it->second.id = it->first;
+        if (!ReadCachedGadgetInfo(&reader, &it->second)) {
+          LOG("Corrupted plugins cache");
+          plugins_.erase(it);
+          return NULL;
         }
-        for (StringMap::const_iterator desc_it =
-                 info.descriptions.begin();
-             desc_it != info.descriptions.end(); ++desc_it) {
-          contents += "  <description locale=\"";
-          contents += parser_->EncodeXMLString(desc_it->first.c_str());
-          contents += "\">";
-          contents += parser_->EncodeXMLString(desc_it->second.c_str());
-          contents += "</description>\n";
-        }
-        contents += " </plugin>\n";
+        return &it->second;
       }
     }
-    contents += "</plugins>\n";
-    return file_manager_->WriteFile(kPluginsXMLLocation, contents, true);
+    return NULL;
   }
 
   void ParseXMLGadgetInfo(const StringMap &plugins,
@@ -245,7 +575,7 @@ class GadgetsMetadata::Impl {
 
   bool ParsePluginsXML(const std::string &contents, bool full_update) {
     if (!full_update)
-      EnsureInitialized();
+      EnsureAllLoaded();
 
     StringMap new_plugins;
     if (!parser_->ParseXMLIntoXPathMap(contents, NULL, kPluginsXMLLocation,
@@ -279,7 +609,7 @@ class GadgetsMetadata::Impl {
           return false;
         } else if (org_info_it == plugins_.end()) {
           LOG("Can't find orignal plugin info when updating %s", id.c_str());
-          // This may be caused by corrupted cached plugins.xml file.
+          // This may be caused by corrupted plugins cache file.
           return false;
         } else {
           // This is a partial record which contains only an optional 'rank'
@@ -304,7 +634,6 @@ class GadgetsMetadata::Impl {
     }
 
     plugins_.swap(temp_plugins);
-    LoadBuiltinGadgetsXML();
     return true;
   }
 
@@ -383,8 +712,10 @@ class GadgetsMetadata::Impl {
                 XMLHttpRequestInterface::NO_ERR) {
           request_success = true;
           parsing_success = ParsePluginsXML(response_body, full_download_);
-          if (parsing_success)
-            SavePluginsXMLFile();
+          if (parsing_success) {
+            LoadBuiltinGadgetsXML();
+            SavePluginsCache();
+          }
         }
       }
 
@@ -405,7 +736,7 @@ class GadgetsMetadata::Impl {
     ASSERT(request);
     ASSERT(request->GetReadyState() == XMLHttpRequestInterface::UNSENT);
 
-    EnsureInitialized();
+    EnsureAllLoaded();
     // TODO: Check disk free space.
     if (request_.Get())
       request_.Get()->Abort();
@@ -428,10 +759,18 @@ class GadgetsMetadata::Impl {
   }
 
   GadgetInfoMap *GetAllGadgetInfo() {
-    EnsureInitialized();
+    EnsureAllLoaded();
     return &plugins_;
   }
 
+  GadgetInfo *GetGadgetInfo(const char *gadget_id) {
+    EnsureInitialized();
+    GadgetInfoMap::iterator it = plugins_.find(gadget_id);
+    if (it != plugins_.end())
+      return &it->second;
+    return all_loaded_ ? NULL : LoadCachedGadgetInfo(gadget_id);
+  }
+
   GadgetInfo *AddLocalGadgetInfo(const char *path) {
     ASSERT(path);
     std::string id(path);
@@ -450,10 +789,20 @@ class GadgetsMetadata::Impl {
   ScriptableHolder<XMLHttpRequestInterface> request_;
   uint64_t latest_plugin_time_;
   bool full_download_;
+  bool initialized_;
+  // Whether all gadgets in the plugins cache have been decoded into plugins_.
+  bool all_loaded_;
   GadgetInfoMap plugins_;
+  // The plugins cache file, mapped into memory or read into cache_contents_.
+  const char *cache_data_;
+  size_t cache_size_;
+  bool cache_mapped_;
+  std::string cache_contents_;
   Slot2<void, bool, bool> *on_update_done_;
 };
 
+const uint32_t GadgetsMetadata::kPluginsCacheVersion;
+
 GadgetsMetadata::GadgetsMetadata()
     : impl_(new Impl()) {
 }
@@ -485,6 +834,10 @@ const GadgetInfoMap *GadgetsMetadata::GetAllGadgetInfo() const {
   return impl_->GetAllGadgetInfo();
 }
 
+GadgetInfo *GadgetsMetadata::GetGadgetInfo(const char *gadget_id) {
+  return impl_->GetGadgetInfo(gadget_id);
+}
+
 const GadgetInfo *GadgetsMetadata::AddLocalGadgetInfo(const char *path) {
   return impl_->AddLocalGadgetInfo(path);
 }
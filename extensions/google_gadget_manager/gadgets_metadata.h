@@ -35,7 +35,13 @@ const char kPluginsXMLRequestPrefix[] =
     GGL_PLATFORM_SHORT "&cv=" GGL_API_VERSION;
 
 const char kBuiltinGadgetsXMLLocation[] = "resource://builtin_gadgets.xml";
+/**
+ * plugins.xml saved by old versions. It's converted into the plugins cache
+ * file and removed when it's loaded.
+ */
 const char kPluginsXMLLocation[] = "profile://plugins.xml";
+/** The binary file storing the parsed metadata of plugins.xml. */
+const char kPluginsCacheLocation[] = "profile://plugins.cache";
 
 enum GadgetSource {
   SOURCE_LOCAL_FILE,
@@ -101,8 +107,15 @@ typedef LightMap<std::string, GadgetInfo> GadgetInfoMap;
 class GadgetsMetadata {
  public:
   /**
-   * Constructs a @c GadgetMetaData instance. The cached plugins.xml file will
-   * be loaded into memory if it exists.
+   * Version of the plugins cache file format. Must be increased whenever
+   * the format or the content of @c GadgetInfo saved in it changes. Cache
+   * files of other versions are ignored.
+   */
+  static const uint32_t kPluginsCacheVersion = 2;
+
+  /**
+   * Constructs a @c GadgetMetaData instance. The plugins cache file will be
+   * loaded into memory if it exists.
    */
   GadgetsMetadata();
   ~GadgetsMetadata();
@@ -120,7 +133,7 @@ class GadgetsMetadata {
  public:
   /**
    * Asynchronously updates gadget metadata from the server. After a successful
-   * download, the updated data will be saved into the local plugins.xml file.
+   * download, the updated data will be saved into the plugins cache file.
    * @param full_download if @c true, a full download will be performed.
    * @param request a newly created XMLHttpRequestInterface instance. This
    *     parameter is provided to ease unittest.
@@ -142,6 +155,13 @@ class GadgetsMetadata {
   GadgetInfoMap *GetAllGadgetInfo();
   const GadgetInfoMap *GetAllGadgetInfo() const;
 
+  /**
+   * Returns the @c GadgetInfo of a gadget, or @c NULL if the gadget is
+   * unknown. Unlike @c GetAllGadgetInfo(), only the requested gadget is
+   * decoded from the plugins cache file.
+   */
+  GadgetInfo *GetGadgetInfo(const char *gadget_id);
+
   /**
    * Adds the metadata of a local gadget, so that the user can view and add
    * the gadget in the gadget browser.
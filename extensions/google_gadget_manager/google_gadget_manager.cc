@@ -649,10 +649,9 @@ const GadgetInfo *GoogleGadgetManager::GetGadgetInfo(const char *gadget_id) {
   if (!gadget_id || !*gadget_id)
     return NULL;
 
-  GadgetInfoMap *map = metadata_.GetAllGadgetInfo();
-  GadgetInfoMap::const_iterator it = map->find(gadget_id);
-  if (it != map->end())
-    return &it->second;
+  const GadgetInfo *info = metadata_.GetGadgetInfo(gadget_id);
+  if (info)
+    return info;
 
   if (GadgetIdIsFileLocation(gadget_id)) {
     // Ensure metadata of the local gadget file is loaded.
@@ -14,9 +14,16 @@
   limitations under the License.
 */
 
+#include <cstdio>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "extensions/google_gadget_manager/gadgets_metadata.h"
 #include "ggadget/file_manager_factory.h"
 #include "ggadget/logger.h"
+#include "ggadget/string_utils.h"
+#include "ggadget/system_utils.h"
+#include "ggadget/xml_parser_interface.h"
 #include "ggadget/tests/init_extensions.h"
 #include "ggadget/tests/mocked_file_manager.h"
 #include "ggadget/tests/mocked_xml_http_request.h"
@@ -149,14 +156,157 @@ void ExpectFileData(const GadgetsMetadata &data) {
 }
 
 TEST(GadgetsMetadata, InitialLoadData) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   ExpectFileData(data);
+  // plugins.xml has been converted into the cache.
+  EXPECT_TRUE(g_mocked_fm.data_.find(kPluginsXMLLocation) ==
+              g_mocked_fm.data_.end());
+  EXPECT_FALSE(g_mocked_fm.data_[kPluginsCacheLocation].empty());
   data.FreeMemory();
   ExpectFileData(data);
+  EXPECT_EQ(std::string(kBuiltinGadgetsXMLLocation),
+            g_mocked_fm.requested_file_);
+}
+
+TEST(GadgetsMetadata, LoadPluginsCache) {
+  g_mocked_fm.data_.clear();
+  g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
+  GadgetsMetadata data;
+  ExpectFileData(data);
+
+  // The cache is used instead of plugins.xml.
+  g_mocked_fm.data_[kPluginsXMLLocation] = xml_from_network;
+  GadgetsMetadata data1;
+  ExpectFileData(data1);
+  // And the latest update time is restored from it.
+  MockedXMLHttpRequest request(200, plugin_xml_network);
+  data1.UpdateFromServer(false, &request, NULL);
+  EXPECT_EQ(std::string(kPluginsXMLRequestPrefix) + "&diff_from_date=05092007",
+            request.requested_url_);
+}
+
+TEST(GadgetsMetadata, LoadBadPluginsCache) {
+  g_mocked_fm.data_.clear();
+  g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
+  GadgetsMetadata data;
+  ExpectFileData(data);
+  const std::string cache = g_mocked_fm.data_[kPluginsCacheLocation];
+
+  // Truncated cache files and cache files of other versions are ignored.
+  std::string bad_caches[] = {
+    cache.substr(0, cache.size() - 1),
+    cache.substr(0, cache.size() / 2),
+    cache.substr(0, 8),
+    cache,
+  };
+  bad_caches[3][8]++;
+  for (size_t i = 0; i < arraysize(bad_caches); i++) {
+    g_mocked_fm.data_.clear();
+    g_mocked_fm.data_[kPluginsCacheLocation] = bad_caches[i];
+    GadgetsMetadata data1;
+    EXPECT_EQ(0U, data1.GetAllGadgetInfo()->size());
+    // plugins.xml is used instead, and the cache is rebuilt.
+    g_mocked_fm.data_[kPluginsCacheLocation] = bad_caches[i];
+    g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
+    GadgetsMetadata data2;
+    ExpectFileData(data2);
+    EXPECT_EQ(cache, g_mocked_fm.data_[kPluginsCacheLocation]);
+  }
+}
+
+TEST(GadgetsMetadata, GetGadgetInfo) {
+  g_mocked_fm.data_.clear();
+  g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
+  GadgetsMetadata data;
+  ExpectFileData(data);
+
+  // Gadgets are looked up in the cache, and decoded only once.
+  GadgetsMetadata data1;
+  GadgetInfo *info = data1.GetGadgetInfo("/uu");
+  ASSERT_TRUE(info != NULL);
+  EXPECT_EQ(std::string("/uu"), info->id);
+  EXPECT_EQ(std::string("Author3"), info->attributes["author"]);
+  EXPECT_EQ(std::string("Title en"), info->titles["en"]);
+  EXPECT_EQ(std::string("Description nl"), info->descriptions["nl"]);
+  EXPECT_TRUE(info == data1.GetGadgetInfo("/uu"));
+  EXPECT_TRUE(data1.GetGadgetInfo("/u") == NULL);
+  EXPECT_TRUE(data1.GetGadgetInfo("/zz") == NULL);
+  EXPECT_TRUE(data1.GetGadgetInfo("") == NULL);
+
+  // Gadgets decoded before are kept when all gadgets are decoded.
+  info->accessed_date = 1234;
+  ExpectFileData(data1);
+  EXPECT_TRUE(info == &data1.GetAllGadgetInfo()->find("/uu")->second);
+  EXPECT_EQ(1234U, info->accessed_date);
+  EXPECT_EQ(std::string("/xx"), data1.GetGadgetInfo("/xx")->id);
+  EXPECT_TRUE(data1.GetGadgetInfo("/zz") == NULL);
+
+  data1.FreeMemory();
+  EXPECT_EQ(std::string("Author1"),
+            data1.GetGadgetInfo(GADGET_ID1)->attributes["author"]);
+}
+
+TEST(GadgetsMetadata, MappedPluginsCache) {
+  g_mocked_fm.data_.clear();
+  g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
+  GadgetsMetadata data;
+  ExpectFileData(data);
+  const std::string cache = g_mocked_fm.data_[kPluginsCacheLocation];
+
+  // The mocked file manager can't read the cache, so it must be mapped from
+  // the file.
+  char dir[] = "/tmp/gadgets_metadata_test.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  g_mocked_fm.path_ = std::string(dir) + "/";
+  std::string path = g_mocked_fm.GetFullPath(kPluginsCacheLocation);
+  std::string sub_dir = path.substr(0, path.rfind('/'));
+  ASSERT_EQ(0, mkdir(sub_dir.c_str(), 0700));
+  ASSERT_TRUE(WriteFileContents(path.c_str(), cache));
+  g_mocked_fm.data_.clear();
+
+  GadgetsMetadata data1;
+  GadgetInfo *info = data1.GetGadgetInfo("/uu");
+  ASSERT_TRUE(info != NULL);
+  EXPECT_EQ(std::string("Title nl\"<>&"), info->titles["nl"]);
+  ExpectFileData(data1);
+
+  unlink(path.c_str());
+  rmdir(sub_dir.c_str());
+  rmdir(dir);
+  g_mocked_fm.path_.clear();
+}
+
+// Checks that the plugins cache contains the same data as the plugins.xml.
+void ExpectSavedData(const char *expected_xml) {
+  const std::string cache = g_mocked_fm.data_[kPluginsCacheLocation];
+  g_mocked_fm.data_.clear();
+  g_mocked_fm.data_[kPluginsXMLLocation] = expected_xml;
+  GadgetsMetadata expected;
+  const GadgetInfoMap &expected_map = *expected.GetAllGadgetInfo();
+  g_mocked_fm.data_.clear();
+  g_mocked_fm.data_[kPluginsCacheLocation] = cache;
+  GadgetsMetadata saved;
+  const GadgetInfoMap &map = *saved.GetAllGadgetInfo();
+
+  ASSERT_LT(0U, expected_map.size());
+  ASSERT_EQ(expected_map.size(), map.size());
+  GadgetInfoMap::const_iterator expected_it = expected_map.begin();
+  for (GadgetInfoMap::const_iterator it = map.begin(); it != map.end();
+       ++it, ++expected_it) {
+    EXPECT_EQ(expected_it->first, it->first);
+    EXPECT_EQ(expected_it->second.id, it->second.id);
+    EXPECT_EQ(expected_it->second.source, it->second.source);
+    EXPECT_EQ(expected_it->second.updated_date, it->second.updated_date);
+    EXPECT_TRUE(expected_it->second.attributes == it->second.attributes);
+    EXPECT_TRUE(expected_it->second.titles == it->second.titles);
+    EXPECT_TRUE(expected_it->second.descriptions == it->second.descriptions);
+  }
 }
 
 TEST(GadgetsMetadata, IncrementalUpdateNULLCallback) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   EXPECT_EQ(std::string(kBuiltinGadgetsXMLLocation),
@@ -166,10 +316,9 @@ TEST(GadgetsMetadata, IncrementalUpdateNULLCallback) {
   // Different from real impl, the following UpdateFromServer will finish
   // synchronously.
   data.UpdateFromServer(false, &request, NULL);
-  EXPECT_EQ(std::string(kPluginsXMLLocation), g_mocked_fm.requested_file_);
+  EXPECT_EQ(std::string(kPluginsCacheLocation), g_mocked_fm.requested_file_);
   g_mocked_fm.requested_file_.clear();
-  EXPECT_EQ(std::string(expected_xml_file_merge_network),
-            g_mocked_fm.data_[kPluginsXMLLocation]);
+  ExpectSavedData(expected_xml_file_merge_network);
   EXPECT_EQ(std::string(kPluginsXMLRequestPrefix) + "&diff_from_date=05092007",
             request.requested_url_);
 }
@@ -184,6 +333,7 @@ void Callback(bool request_success, bool parsing_success) {
 }
 
 TEST(GadgetsMetadata, IncrementalUpdateWithCallback) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(200, plugin_xml_network);
@@ -194,13 +344,13 @@ TEST(GadgetsMetadata, IncrementalUpdateWithCallback) {
   EXPECT_TRUE(g_callback_called);
   EXPECT_TRUE(g_request_success);
   EXPECT_TRUE(g_parsing_success);
-  EXPECT_EQ(std::string(expected_xml_file_merge_network),
-            g_mocked_fm.data_[kPluginsXMLLocation]);
+  ExpectSavedData(expected_xml_file_merge_network);
   EXPECT_EQ(std::string(kPluginsXMLRequestPrefix) + "&diff_from_date=05092007",
             request.requested_url_);
 }
 
 TEST(GadgetsMetadata, IncrementalUpdateWithCallbackAfterFreeMemory) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(200, plugin_xml_network);
@@ -212,13 +362,13 @@ TEST(GadgetsMetadata, IncrementalUpdateWithCallbackAfterFreeMemory) {
   EXPECT_TRUE(g_callback_called);
   EXPECT_TRUE(g_request_success);
   EXPECT_TRUE(g_parsing_success);
-  EXPECT_EQ(std::string(expected_xml_file_merge_network),
-            g_mocked_fm.data_[kPluginsXMLLocation]);
+  ExpectSavedData(expected_xml_file_merge_network);
   EXPECT_EQ(std::string(kPluginsXMLRequestPrefix) + "&diff_from_date=05092007",
             request.requested_url_);
 }
 
 TEST(GadgetsMetadata, IncrementalUpdateRequestFail) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(404, plugin_xml_network);
@@ -237,6 +387,7 @@ TEST(GadgetsMetadata, IncrementalUpdateRequestFail) {
 }
 
 TEST(GadgetsMetadata, IncrementalUpdateParsingFail1) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(200, plugin_xml_network_bad);
@@ -255,6 +406,7 @@ TEST(GadgetsMetadata, IncrementalUpdateParsingFail1) {
 }
 
 TEST(GadgetsMetadata, IncrementalUpdateParsingFail2) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(200, plugin_xml_network_extra_plugin);
@@ -273,6 +425,7 @@ TEST(GadgetsMetadata, IncrementalUpdateParsingFail2) {
 }
 
 TEST(GadgetsMetadata, FullDownload) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(200, xml_from_network);
@@ -285,11 +438,11 @@ TEST(GadgetsMetadata, FullDownload) {
   EXPECT_TRUE(g_parsing_success);
   EXPECT_EQ(std::string(kPluginsXMLRequestPrefix) + "&diff_from_date=01011980",
             request.requested_url_);
-  EXPECT_EQ(std::string(xml_from_network),
-            g_mocked_fm.data_[kPluginsXMLLocation]);
+  ExpectSavedData(xml_from_network);
 }
 
 TEST(GadgetsMetadata, FullDownloadRequestFail) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(404, plugin_xml_network);
@@ -308,6 +461,7 @@ TEST(GadgetsMetadata, FullDownloadRequestFail) {
 }
 
 TEST(GadgetsMetadata, FullDownloadParsingFail) {
+  g_mocked_fm.data_.clear();
   g_mocked_fm.data_[kPluginsXMLLocation] = plugin_xml_file;
   GadgetsMetadata data;
   MockedXMLHttpRequest request(200, plugin_xml_network);
@@ -325,6 +479,70 @@ TEST(GadgetsMetadata, FullDownloadParsingFail) {
   ExpectFileData(data);
 }
 
+TEST(GadgetsMetadata, LoadBenchmark) {
+  // About the size of the real plugins.xml.
+  const size_t kPlugins = 4000;
+  static const char *kLocales[] = { "en", "de", "fr", "ja", "zh-CN" };
+  std::string xml("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<plugins>\n");
+  for (size_t i = 0; i < kPlugins; i++) {
+    xml += StringPrintf(
+        " <plugin author=\"Author %zu\" id=\"%zu\" rank=\"%zu.5\""
+        " category=\"tools,news\" creation_date=\"November 17, 2005\""
+        " updated_date=\"December 1, 2007\" version=\"1.0.%zu\""
+        " download_url=\"/ig/modules/gadget%zu.xml\" size_kilobytes=\"12\""
+        " screenshot=\"/screenshots/%zu.png\">\n", i, i, i, i, i, i);
+    for (size_t j = 0; j < arraysize(kLocales); j++) {
+      xml += StringPrintf(
+          "  <title locale=\"%s\">Gadget %zu title</title>\n"
+          "  <description locale=\"%s\">The description of gadget %zu,"
+          " which is usually a sentence or two.</description>\n",
+          kLocales[j], i, kLocales[j], i);
+    }
+    xml += " </plugin>\n";
+  }
+  xml += "</plugins>\n";
+
+  const int kRounds = 5;
+  clock_t start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    g_mocked_fm.data_.clear();
+    g_mocked_fm.data_[kPluginsXMLLocation] = xml;
+    GadgetsMetadata data;
+    ASSERT_EQ(kPlugins, data.GetAllGadgetInfo()->size());
+  }
+  double load_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  // Now the data is loaded from the plugins cache.
+  size_t cache_size = g_mocked_fm.data_[kPluginsCacheLocation].size();
+  start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    GadgetsMetadata data;
+    ASSERT_EQ(kPlugins, data.GetAllGadgetInfo()->size());
+  }
+  double cache_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  // Looking up a single gadget decodes only that gadget.
+  start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    GadgetsMetadata data;
+    ASSERT_TRUE(data.GetGadgetInfo("/ig/modules/gadget1234.xml") != NULL);
+  }
+  double lookup_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    StringMap table;
+    ASSERT_TRUE(GetXMLParser()->ParseXMLIntoXPathMap(
+        xml, NULL, kPluginsXMLLocation, "plugins", NULL, NULL, &table));
+  }
+  double parse_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  printf("plugins.xml of %zu bytes: load %.3fs, parse %.3fs per round\n",
+         xml.size(), load_time / kRounds, parse_time / kRounds);
+  printf("plugins cache of %zu bytes: load %.3fs, lookup %.6fs per round\n",
+         cache_size, cache_time / kRounds, lookup_time / kRounds);
+  g_mocked_fm.data_.clear();
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
 
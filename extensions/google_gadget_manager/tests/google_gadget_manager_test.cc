@@ -82,10 +82,9 @@ TEST(GoogleGadgetsManager, MetadataUpdate) {
   g_mocked_xml_http_request_requested_url.clear();
 
   // The update should succeed.
-  ASSERT_EQ(std::string(kPluginsXMLLocation), g_mocked_fm.requested_file_);
+  ASSERT_EQ(std::string(kPluginsCacheLocation), g_mocked_fm.requested_file_);
   g_mocked_fm.requested_file_.clear();
-  ASSERT_EQ(std::string(plugins_xml_network_full),
-            g_mocked_fm.data_[kPluginsXMLLocation]);
+  ASSERT_FALSE(g_mocked_fm.data_[kPluginsCacheLocation].empty());
   ASSERT_EQ(1U, manager->GetAllGadgetInfo().size());
   ASSERT_EQ(Variant(static_cast<int64_t>(kTimeBase)),
             global_options->GetValue(kLastUpdateTimeOption));
@@ -95,7 +94,7 @@ TEST(GoogleGadgetsManager, MetadataUpdate) {
   // Advance the time to a little earlier (smaller than the options flush
   // internal) than one week later.
   g_mocked_main_loop.AdvanceTime(kGadgetsMetadataUpdateInterval - 100);
-  ASSERT_NE(std::string(kPluginsXMLLocation), g_mocked_fm.requested_file_);
+  ASSERT_NE(std::string(kPluginsCacheLocation), g_mocked_fm.requested_file_);
   ASSERT_EQ(std::string(), g_mocked_xml_http_request_requested_url);
   g_mocked_xml_http_request_return_data = plugins_xml_network_incremental;
   g_mocked_main_loop.DoIteration(true);
@@ -137,7 +136,7 @@ TEST(GoogleGadgetsManager, MetadataUpdate) {
     g_mocked_fm.requested_file_.clear();
     g_mocked_xml_http_request_requested_url.clear();
     g_mocked_main_loop.AdvanceTime(actual_retry_timeout - 100);
-    ASSERT_NE(std::string(kPluginsXMLLocation), g_mocked_fm.requested_file_);
+    ASSERT_NE(std::string(kPluginsCacheLocation), g_mocked_fm.requested_file_);
     ASSERT_EQ(std::string(), g_mocked_xml_http_request_requested_url);
 
     g_mocked_main_loop.DoIteration(true);
@@ -232,6 +231,7 @@ void CheckGadgetInfo(const char *locale, GoogleGadgetManager *manager,
 
 TEST(GoogleGadgetsManager, GadgetAddRemove) {
   g_mocked_xml_http_request_requested_url.clear();
+  g_mocked_fm.data_.erase(kPluginsCacheLocation);
   g_mocked_fm.data_[kPluginsXMLLocation] = plugins_xml_file_two_gadgets;
   OptionsInterface *global_options = GetGlobalOptions();
   global_options->DeleteStorage();
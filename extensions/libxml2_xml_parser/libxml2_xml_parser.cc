@@ -16,10 +16,13 @@
 
 #include <cstring>
 #include <cmath>
+#include <utility>
+#include <vector>
 #include <libxml/encoding.h>
 #include <libxml/parser.h>
 // For xmlCreateMemoryParserCtxt and xmlParseName.
 #include <libxml/parserInternals.h>
+#include <libxml/SAX2.h>
 #include <libxml/tree.h>
 
 #include <ggadget/logger.h>
@@ -208,7 +211,12 @@ static void ReplaceXMLEncodingDecl(std::string *xml) {
                " encoding=\"UTF-8\"");
 }
 
+class DOMBuilder;
+class XPathMapBuilder;
+
 struct ContextData {
+  DOMBuilder *builder;
+  XPathMapBuilder *xpath_map_builder;
   const StringMap *extra_entities;
   getEntitySAXFunc original_get_entity_handler;
   entityDeclSAXFunc original_entity_decl_handler;
@@ -294,161 +302,6 @@ static bool IsBlankText(const char *text) {
   return true;
 }
 
-static bool IsTextNode(xmlNode *xmlnode) {
-  return xmlnode && (xmlnode->type == XML_TEXT_NODE ||
-                     xmlnode->type == XML_ENTITY_REF_NODE);
-}
-
-static void ConvertCharacterDataIntoDOM(DOMDocumentInterface *domdoc,
-                                        DOMNodeInterface *parent,
-                                        xmlNode *xmlnode) {
-  char *text = FromXmlCharPtr(xmlNodeGetContent(xmlnode));
-  UTF16String utf16_text;
-  if (text) {
-    if (domdoc->PreservesWhiteSpace() ||
-        xmlnode->type != XML_TEXT_NODE ||
-        IsTextNode(xmlnode->prev) || IsTextNode(xmlnode->next) ||
-        !IsBlankText(text)) {
-      // Don't trim the text. The caller can trim based on their own
-      // requirements.
-      ConvertStringUTF8ToUTF16(text, strlen(text), &utf16_text);
-    }
-    xmlFree(text);
-  }
-
-  DOMCharacterDataInterface *data = NULL;
-  switch (xmlnode->type) {
-    case XML_TEXT_NODE:
-      // Don't create empty text nodes.
-      if (!utf16_text.empty())
-        data = domdoc->CreateTextNode(utf16_text.c_str());
-      break;
-    case XML_ENTITY_REF_NODE:
-      data = domdoc->CreateTextNode(utf16_text.c_str());
-      break;
-    case XML_CDATA_SECTION_NODE:
-      data = domdoc->CreateCDATASection(utf16_text.c_str());
-      break;
-    case XML_COMMENT_NODE:
-      data = domdoc->CreateComment(utf16_text.c_str());
-      break;
-    default:
-      ASSERT(false);
-      break;
-  }
-  if (data) {
-    data->SetRow(static_cast<int>(xmlGetLineNo(xmlnode)));
-    parent->AppendChild(data);
-  }
-}
-
-static void ConvertPIIntoDOM(DOMDocumentInterface *domdoc,
-                             DOMNodeInterface *parent,
-                             xmlNode *xmlpi) {
-  const char *target = FromXmlCharPtr(xmlpi->name);
-  char *data = FromXmlCharPtr(xmlNodeGetContent(xmlpi));
-  DOMProcessingInstructionInterface *pi;
-  domdoc->CreateProcessingInstruction(target, data, &pi);
-  if (pi) {
-    pi->SetRow(static_cast<int>(xmlGetLineNo(xmlpi)));
-    parent->AppendChild(pi);
-  }
-  if (data)
-    xmlFree(data);
-}
-
-static void ConvertElementIntoDOM(DOMDocumentInterface *domdoc,
-                                  DOMNodeInterface *parent,
-                                  xmlNode *xmlele);
-
-static void ConvertChildrenIntoDOM(DOMDocumentInterface *domdoc,
-                                   DOMNodeInterface *parent,
-                                   xmlNode *xmlnode) {
-  for (xmlNode *child = xmlnode->children; child != NULL; child = child->next) {
-    switch (child->type) {
-      case XML_ELEMENT_NODE:
-        ConvertElementIntoDOM(domdoc, parent, child);
-        break;
-      case XML_TEXT_NODE:
-      case XML_ENTITY_REF_NODE:
-      case XML_CDATA_SECTION_NODE:
-      case XML_COMMENT_NODE:
-        ConvertCharacterDataIntoDOM(domdoc, parent, child);
-        break;
-      case XML_PI_NODE:
-        ConvertPIIntoDOM(domdoc, parent, child);
-        break;
-      case XML_DTD_NODE:
-        break;
-      default:
-        DLOG("Ignore XML Node of type %d", child->type);
-        break;
-    }
-  }
-}
-
-static void ConvertElementIntoDOM(DOMDocumentInterface *domdoc,
-                                  DOMNodeInterface *parent,
-                                  xmlNode *xmlele) {
-  DOMElementInterface *element;
-  domdoc->CreateElement(FromXmlCharPtr(xmlele->name), &element);
-  if (!element || DOM_NO_ERR != parent->AppendChild(element)) {
-    // Unlikely to happen.
-    DLOG("Failed to create DOM element or to add it to parent");
-    delete element;
-    return;
-  }
-
-  // We don't support full DOM2 namespaces, but we must keep all namespace
-  // related information in the result DOM.
-  if (xmlele->ns && xmlele->ns->prefix)
-    element->SetPrefix(FromXmlCharPtr(xmlele->ns->prefix));
-  for (xmlNsPtr ns = xmlele->nsDef; ns; ns = ns->next) {
-    DOMAttrInterface *attr;
-    if (ns->prefix && *ns->prefix) {
-      // xmlns:prefix="uri" case.
-      domdoc->CreateAttribute(FromXmlCharPtr(ns->prefix), &attr);
-      if (attr)
-        attr->SetPrefix("xmlns");
-    } else {
-      // xmlns="uri" case.
-      domdoc->CreateAttribute("xmlns", &attr);
-    }
-    if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
-      // Unlikely to happen.
-      DLOG("Failed to create xmlns attribute or to add it to element");
-      delete attr;
-      continue;
-    }
-    attr->SetValue(FromXmlCharPtr(ns->href));
-  }
-
-  // libxml2 doesn't support node column position for now.
-  element->SetRow(static_cast<int>(xmlGetLineNo(xmlele)));
-  for (xmlAttr *xmlattr = xmlele->properties; xmlattr != NULL;
-       xmlattr = xmlattr->next) {
-    const char *name = FromXmlCharPtr(xmlattr->name);
-    DOMAttrInterface *attr;
-    domdoc->CreateAttribute(name, &attr);
-    if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
-      // Unlikely to happen.
-      DLOG("Failed to create DOM attribute or to add it to element");
-      delete attr;
-      continue;
-    }
-
-    char *value = FromXmlCharPtr(
-        xmlNodeGetContent(reinterpret_cast<xmlNode *>(xmlattr)));
-    attr->SetValue(value);
-    if (xmlattr->ns)
-      attr->SetPrefix(FromXmlCharPtr(xmlattr->ns->prefix));
-    if (value)
-      xmlFree(value);
-  }
-
-  ConvertChildrenIntoDOM(domdoc, element, xmlele);
-}
-
 static const char* SkipSpaces(const char* str) {
   while (*str && isspace(*str))
     str++;
@@ -508,64 +361,6 @@ std::string GetHTMLCharset(const char* html_content) {
   return charset;
 }
 
-// Count the sequence of a child in the elements of the same tag name.
-static int CountTagSequence(const xmlNode *child, const char *tag) {
-  static xmlNode *last_parent = NULL;
-  static int last_count = 1;
-  static std::string last_tag;
-
-  if (last_parent == child->parent &&
-      GadgetStrCmp(last_tag.c_str(), tag) == 0) {
-    return ++last_count;
-  }
-
-  last_parent = child->parent;
-  last_count = 1;
-  last_tag = tag;
-  for (const xmlNode *node = child->prev; node != NULL; node = node->prev) {
-    if (node->type == XML_ELEMENT_NODE &&
-        GadgetStrCmp(tag, FromXmlCharPtr(node->name)) == 0)
-      last_count++;
-  }
-  return last_count;
-}
-
-static void ConvertElementIntoXPathMap(const xmlNode *element,
-                                       const std::string &prefix,
-                                       StringMap *table) {
-  for (xmlAttr *attribute = element->properties;
-       attribute != NULL; attribute = attribute->next) {
-    const char *name = FromXmlCharPtr(attribute->name);
-    char *value = FromXmlCharPtr(
-        xmlNodeGetContent(reinterpret_cast<xmlNode *>(attribute)));
-    (*table)[prefix + '@' + name] = std::string(value ? value : "");
-    if (value)
-      xmlFree(value);
-  }
-
-  for (xmlNode *child = element->children; child != NULL; child = child->next) {
-    if (child->type == XML_ELEMENT_NODE) {
-      const char *tag = FromXmlCharPtr(child->name);
-      char *text = FromXmlCharPtr(xmlNodeGetContent(child));
-      std::string key(prefix);
-      if (!prefix.empty()) key += '/';
-      key += tag;
-
-      if (table->find(key) != table->end()) {
-        // Postpend the sequence if there are multiple elements with the same
-        // name.
-        char buf[20];
-        snprintf(buf, sizeof(buf), "[%d]", CountTagSequence(child, tag));
-        key += buf;
-      }
-      (*table)[key] = text ? text : "";
-      if (text) xmlFree(text);
-
-      ConvertElementIntoXPathMap(child, key, table);
-    }
-  }
-}
-
 // Check if the content is XML according to XMLHttpRequest standard rule.
 static bool ContentTypeIsXML(const char *content_type) {
   size_t content_type_len = content_type ? strlen(content_type) : 0;
@@ -631,79 +426,806 @@ static bool ConvertToUTF8(const std::string &content, const char *filename,
   return result;
 }
 
-static xmlDoc *ParseXML(const std::string &xml,
-                        const StringMap *extra_entities,
-                        const char *filename,
-                        const char *encoding_hint,
-                        const char *encoding_fallback,
-                        std::string *encoding,
-                        std::string *utf8_content) {
-  xmlDoc *xmldoc = NULL;
-
+// Converts the XML content into UTF-8 and removes the original encoding
+// declaration, to let libxml2 parse the result without converting again.
+// Converts encoding before libxml2 parses the document, to make it possible
+// to recover from encoding conversion failures.
+static bool ConvertXMLToUTF8(const std::string &xml,
+                             const char *filename,
+                             const char *encoding_hint,
+                             const char *encoding_fallback,
+                             std::string *encoding,
+                             std::string *utf8_content,
+                             std::string *converted_xml) {
   if (encoding)
     encoding->clear();
   if (utf8_content)
     utf8_content->clear();
 
-  std::string converted_xml;
-  std::string use_encoding;
-
-  // Convert encoding before we let libxml2 parse the document, to make it
-  // possible to recover from encoding conversion failures.
   if (!ConvertToUTF8(xml, filename, NULL, encoding_hint, encoding_fallback,
-                     &use_encoding, &converted_xml)) {
+                     encoding, converted_xml)) {
     return false;
   }
 
   if (utf8_content)
-    *utf8_content = converted_xml;
-  // We have successfully converted the encoding to UTF8, insert a BOM and
-  // remove the original encoding declaration to prevent libxml2 from
-  // converting again.
-  ReplaceXMLEncodingDecl(&converted_xml);
-
-  xmlParserCtxt *ctxt = xmlCreateMemoryParserCtxt(
-      converted_xml.c_str(), static_cast<int>(converted_xml.length()));
-  if (!ctxt)
-    return NULL;
+    *utf8_content = *converted_xml;
+  ReplaceXMLEncodingDecl(converted_xml);
+  return true;
+}
 
+// Hooks the handlers of a parser context to provide extra entities and to
+// disable external entities.
+static void SetupParserContext(xmlParserCtxt *ctxt,
+                               const StringMap *extra_entities,
+                               ContextData *data) {
   ASSERT(ctxt->sax);
-  ContextData data;
-  ctxt->_private = &data;
+  data->builder = NULL;
+  data->xpath_map_builder = NULL;
+  ctxt->_private = data;
   if (extra_entities) {
     // Hook getEntity handler to provide extra entities.
-    data.extra_entities = extra_entities;
-    data.original_get_entity_handler = ctxt->sax->getEntity;
+    data->extra_entities = extra_entities;
+    data->original_get_entity_handler = ctxt->sax->getEntity;
     ctxt->sax->getEntity = GetEntityHandler;
   }
 
   // Disable external entities to avoid security troubles.
-  data.original_entity_decl_handler = ctxt->sax->entityDecl;
+  data->original_entity_decl_handler = ctxt->sax->entityDecl;
   ctxt->sax->entityDecl = EntityDeclHandler;
   ctxt->sax->resolveEntity = NULL;
+}
 
-  // Let the built-in libxml2 error reporter print the correct filename.
-  ctxt->input->filename = xmlMemStrdup(filename);
+static bool HasBOM(const char *content, size_t size) {
+  static const char kUTF8BOM[] = { '\xEF', '\xBB', '\xBF' };
+  static const char kUTF16LEBOM[] = { '\xFF', '\xFE' };
+  static const char kUTF16BEBOM[] = { '\xFE', '\xFF' };
+  static const char kUTF32BEBOM[] = { 0, 0, '\xFE', '\xFF' };
+  return STARTS_WITH(content, size, kUTF8BOM) ||
+         STARTS_WITH(content, size, kUTF16LEBOM) ||
+         STARTS_WITH(content, size, kUTF16BEBOM) ||
+         STARTS_WITH(content, size, kUTF32BEBOM);
+}
 
-  xmlGenericErrorFunc old_error_func = xmlGenericError;
-  xmlSetGenericErrorFunc(NULL, ErrorFunc);
-  xmlParseDocument(ctxt);
-  xmlSetGenericErrorFunc(NULL, old_error_func);
+// References to general entities are kept in the values of attributes
+// because entities are not substituted. Like the libxml2 tree builder,
+// assume there is no reference if the value is not copied by libxml2,
+// i.e. not terminated by 0.
+static std::string DecodeEntities(xmlParserCtxt *ctxt, const xmlChar *value,
+                                  size_t length) {
+  ctxt->depth++;
+  xmlChar *decoded = xmlStringLenDecodeEntities(
+      ctxt, value, static_cast<int>(length), XML_SUBSTITUTE_REF, 0, 0, 0);
+  ctxt->depth--;
+  std::string result(decoded ? FromXmlCharPtr(decoded) : "");
+  if (decoded)
+    xmlFree(decoded);
+  return result;
+}
 
-  if (ctxt->wellFormed) {
-    // Successfully parsed the document.
-    xmldoc = ctxt->myDoc;
-  } else {
-    xmlFreeDoc(ctxt->myDoc);
-    ctxt->myDoc = NULL;
-  }
-  xmlFreeParserCtxt(ctxt);
+static std::string GetAttributeValue(xmlParserCtxt *ctxt,
+                                     const xmlChar *value,
+                                     const xmlChar *end) {
+  size_t length = static_cast<size_t>(end - value);
+  if (*end != 0 || !memchr(value, '&', length))
+    return std::string(FromXmlCharPtr(value), length);
+  return DecodeEntities(ctxt, value, length);
+}
 
-  if (encoding)
-    *encoding = use_encoding;
-  return xmldoc;
+// Appends the text content of a referenced entity.
+static void AppendEntityContent(xmlParserCtxt *ctxt, const xmlChar *name,
+                                std::string *text) {
+  xmlEntity *entity = ctxt->sax->getEntity(ctxt, name);
+  if (!entity)
+    return;
+  if (!entity->children && entity->content &&
+      entity->etype == XML_INTERNAL_GENERAL_ENTITY) {
+    // libxml2 doesn't build the children of an entity which has been
+    // expanded in an attribute value. Such an entity contains no markup, so
+    // its replacement text is its text content.
+    text->append(DecodeEntities(
+        ctxt, entity->content,
+        strlen(FromXmlCharPtr(entity->content))));
+    return;
+  }
+  for (xmlNode *child = entity->children; child; child = child->next) {
+    char *content = FromXmlCharPtr(xmlNodeGetContent(child));
+    if (content) {
+      text->append(content);
+      xmlFree(content);
+    }
+  }
 }
 
+// Builds the DOM directly from the SAX2 events of libxml2, without building
+// a libxml2 tree first. The content of entities is still built into libxml2
+// trees by the default SAX2 handlers, and is added into the DOM as text when
+// the entities are referenced.
+class DOMBuilder : public XMLDOMBuilderInterface {
+ public:
+  DOMBuilder(const StringMap *extra_entities, const char *filename,
+             const char *encoding_hint, DOMDocumentInterface *domdoc)
+      : extra_entities_(extra_entities),
+        filename_(filename ? filename : ""),
+        encoding_hint_(encoding_hint ? encoding_hint : ""),
+        use_encoding_hint_(false),
+        domdoc_(domdoc),
+        ctxt_(NULL),
+        current_(domdoc),
+        skip_depth_(0),
+        text_type_(NO_TEXT),
+        text_has_entity_(false),
+        text_row_(0),
+        failed_(false) {
+    ASSERT(domdoc && !domdoc->HasChildNodes());
+  }
+
+  virtual ~DOMBuilder() {
+    if (ctxt_)
+      FreeContext();
+  }
+
+  // Parses the whole content which has been converted by ConvertXMLToUTF8().
+  bool ParseMemory(const std::string &utf8_xml) {
+    ctxt_ = xmlCreateMemoryParserCtxt(utf8_xml.c_str(),
+                                      static_cast<int>(utf8_xml.length()));
+    if (!ctxt_)
+      return false;
+    // Let the built-in libxml2 error reporter print the correct filename.
+    ctxt_->input->filename = xmlMemStrdup(filename_.c_str());
+    SetupContext();
+
+    xmlGenericErrorFunc old_error_func = xmlGenericError;
+    xmlSetGenericErrorFunc(NULL, ErrorFunc);
+    xmlParseDocument(ctxt_);
+    xmlSetGenericErrorFunc(NULL, old_error_func);
+    return Done();
+  }
+
+  virtual void Destroy() {
+    delete this;
+  }
+
+  virtual size_t Write(const void *data, size_t size) {
+    if (failed_ || !size)
+      return 0;
+    const char *chunk = static_cast<const char *>(data);
+    if (!ctxt_ && !CreatePushContext(chunk, size)) {
+      failed_ = true;
+      return 0;
+    }
+
+    xmlGenericErrorFunc old_error_func = xmlGenericError;
+    xmlSetGenericErrorFunc(NULL, ErrorFunc);
+    xmlParseChunk(ctxt_, chunk, static_cast<int>(size), 0);
+    xmlSetGenericErrorFunc(NULL, old_error_func);
+    if (!ctxt_->wellFormed) {
+      failed_ = true;
+      return 0;
+    }
+    return size;
+  }
+
+  virtual bool Finish(std::string *encoding) {
+    if (encoding)
+      encoding->clear();
+    if (!ctxt_) {
+      LOG("No content in XML file: %s", filename_.c_str());
+      return false;
+    }
+
+    if (!failed_) {
+      xmlGenericErrorFunc old_error_func = xmlGenericError;
+      xmlSetGenericErrorFunc(NULL, ErrorFunc);
+      xmlParseChunk(ctxt_, NULL, 0, 1);
+      xmlSetGenericErrorFunc(NULL, old_error_func);
+    }
+    if (encoding) {
+      if (use_encoding_hint_) {
+        *encoding = encoding_hint_;
+      } else if (ctxt_->encoding) {
+        *encoding = FromXmlCharPtr(ctxt_->encoding);
+      } else if (ctxt_->input && ctxt_->input->buf &&
+                 ctxt_->input->buf->encoder) {
+        *encoding = ctxt_->input->buf->encoder->name;
+      } else {
+        *encoding = "UTF-8";
+      }
+    }
+    return Done();
+  }
+
+ private:
+  enum TextType { NO_TEXT, TEXT, CDATA };
+
+  bool CreatePushContext(const char *chunk, size_t size) {
+    ctxt_ = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, filename_.c_str());
+    if (!ctxt_)
+      return false;
+    // Like ConvertToUTF8(), the hint overrides the encoding declaration, but
+    // not the BOM.
+    use_encoding_hint_ = !encoding_hint_.empty() && !HasBOM(chunk, size);
+    if (use_encoding_hint_ &&
+        xmlCtxtResetPush(ctxt_, NULL, 0, filename_.c_str(),
+                         encoding_hint_.c_str()) != 0) {
+      LOG("Unsupported encoding %s of XML file: %s",
+          encoding_hint_.c_str(), filename_.c_str());
+      return false;
+    }
+    SetupContext();
+    return true;
+  }
+
+  void SetupContext() {
+    SetupParserContext(ctxt_, extra_entities_, &context_data_);
+    context_data_.builder = this;
+    ctxt_->linenumbers = 1;
+    xmlSAXHandler *sax = ctxt_->sax;
+    sax->startElementNs = StartElementHandler;
+    sax->endElementNs = EndElementHandler;
+    sax->characters = CharactersHandler;
+    sax->ignorableWhitespace = CharactersHandler;
+    sax->cdataBlock = CDataBlockHandler;
+    sax->comment = CommentHandler;
+    sax->processingInstruction = ProcessingInstructionHandler;
+    sax->reference = ReferenceHandler;
+  }
+
+  void FreeContext() {
+    // myDoc only contains the DTD and the entities.
+    xmlFreeDoc(ctxt_->myDoc);
+    ctxt_->myDoc = NULL;
+    xmlFreeParserCtxt(ctxt_);
+    ctxt_ = NULL;
+  }
+
+  // Finishes building. On failure, removes the nodes already built.
+  bool Done() {
+    bool result = !failed_ && ctxt_->wellFormed;
+    FreeContext();
+    if (result) {
+      FlushText();
+      if (!domdoc_->GetDocumentElement()) {
+        LOG("No root element in XML file: %s", filename_.c_str());
+        result = false;
+      }
+    }
+    if (!result) {
+      text_.clear();
+      text_type_ = NO_TEXT;
+      while (domdoc_->GetFirstChild())
+        domdoc_->RemoveChild(domdoc_->GetFirstChild());
+    }
+    current_ = domdoc_;
+    return result;
+  }
+
+  int GetLine() {
+    return ctxt_ && ctxt_->input ? ctxt_->input->line : 0;
+  }
+
+  void AppendText(TextType type, const char *text, size_t length) {
+    if (skip_depth_)
+      return;
+    if (text_type_ != type) {
+      FlushText();
+      text_type_ = type;
+      text_row_ = GetLine();
+    }
+    text_.append(text, length);
+  }
+
+  // Adds the pending text into the DOM. Adjacent character data and entity
+  // references are merged into one text node.
+  void FlushText() {
+    if (text_type_ == NO_TEXT)
+      return;
+
+    DOMCharacterDataInterface *data = NULL;
+    if (text_type_ == CDATA) {
+      data = domdoc_->CreateCDATASectionUTF8(text_);
+    } else if (!text_.empty() &&
+               (domdoc_->PreservesWhiteSpace() || text_has_entity_ ||
+                !IsBlankText(text_.c_str()))) {
+      // Don't trim the text. The caller can trim based on their own
+      // requirements.
+      data = domdoc_->CreateTextNodeUTF8(text_);
+    }
+    if (data) {
+      data->SetRow(text_row_);
+      current_->AppendChild(data);
+    }
+    text_.clear();
+    text_type_ = NO_TEXT;
+    text_has_entity_ = false;
+  }
+
+  void OnStartElement(const xmlChar *localname, const xmlChar *prefix,
+                      int nb_namespaces, const xmlChar **namespaces,
+                      int nb_attributes, int nb_defaulted,
+                      const xmlChar **attributes) {
+    FlushText();
+    if (skip_depth_) {
+      skip_depth_++;
+      return;
+    }
+
+    DOMElementInterface *element;
+    domdoc_->CreateElement(FromXmlCharPtr(localname), &element);
+    if (!element || DOM_NO_ERR != current_->AppendChild(element)) {
+      // Unlikely to happen.
+      DLOG("Failed to create DOM element or to add it to parent");
+      delete element;
+      skip_depth_ = 1;
+      return;
+    }
+    current_ = element;
+
+    // We don't support full DOM2 namespaces, but we must keep all namespace
+    // related information in the result DOM.
+    if (prefix)
+      element->SetPrefix(FromXmlCharPtr(prefix));
+    for (int i = 0; i < nb_namespaces; i++) {
+      const xmlChar *ns_prefix = namespaces[i * 2];
+      const xmlChar *ns_uri = namespaces[i * 2 + 1];
+      DOMAttrInterface *attr;
+      if (ns_prefix && *ns_prefix) {
+        // xmlns:prefix="uri" case.
+        domdoc_->CreateAttribute(FromXmlCharPtr(ns_prefix), &attr);
+        if (attr)
+          attr->SetPrefix("xmlns");
+      } else {
+        // xmlns="uri" case.
+        domdoc_->CreateAttribute("xmlns", &attr);
+      }
+      if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
+        // Unlikely to happen.
+        DLOG("Failed to create xmlns attribute or to add it to element");
+        delete attr;
+        continue;
+      }
+      attr->SetValue(ns_uri ? FromXmlCharPtr(ns_uri) : "");
+    }
+
+    // libxml2 doesn't support node column position for now.
+    element->SetRow(GetLine());
+    // Like the libxml2 tree builder, ignore the attributes defaulted by DTD.
+    if ((ctxt_->loadsubset & XML_COMPLETE_ATTRS) == 0)
+      nb_attributes -= nb_defaulted;
+    for (int i = 0; i < nb_attributes; i++) {
+      // Each attribute is (localname, prefix, URI, value, end).
+      const xmlChar **xmlattr = attributes + i * 5;
+      DOMAttrInterface *attr;
+      domdoc_->CreateAttribute(FromXmlCharPtr(xmlattr[0]), &attr);
+      if (!attr || DOM_NO_ERR != element->SetAttributeNode(attr)) {
+        // Unlikely to happen.
+        DLOG("Failed to create DOM attribute or to add it to element");
+        delete attr;
+        continue;
+      }
+
+      attr->SetValue(GetAttributeValue(ctxt_, xmlattr[3], xmlattr[4]));
+      if (xmlattr[1])
+        attr->SetPrefix(FromXmlCharPtr(xmlattr[1]));
+    }
+  }
+
+  void OnEndElement() {
+    FlushText();
+    if (skip_depth_) {
+      skip_depth_--;
+      return;
+    }
+    current_ = current_->GetParentNode();
+    ASSERT(current_);
+  }
+
+  void OnReference(const xmlChar *name) {
+    if (skip_depth_)
+      return;
+    AppendText(TEXT, "", 0);
+    text_has_entity_ = true;
+    AppendEntityContent(ctxt_, name, &text_);
+  }
+
+  void OnComment(const xmlChar *value) {
+    FlushText();
+    if (skip_depth_)
+      return;
+    DOMCharacterDataInterface *comment =
+        domdoc_->CreateCommentUTF8(value ? FromXmlCharPtr(value) : "");
+    if (comment) {
+      comment->SetRow(GetLine());
+      current_->AppendChild(comment);
+    }
+  }
+
+  void OnProcessingInstruction(const xmlChar *target, const xmlChar *data) {
+    FlushText();
+    if (skip_depth_)
+      return;
+    DOMProcessingInstructionInterface *pi;
+    domdoc_->CreateProcessingInstruction(FromXmlCharPtr(target),
+                                         data ? FromXmlCharPtr(data) : "",
+                                         &pi);
+    if (pi) {
+      pi->SetRow(GetLine());
+      current_->AppendChild(pi);
+    }
+  }
+
+  // Returns the builder if the event should be added into the DOM, or NULL
+  // if the event should go to the default SAX2 handler, that is, when the
+  // event is in the DTD, or in the content of an entity, which libxml2 parses
+  // under a temporary node.
+  static DOMBuilder *GetBuilder(void *ctx) {
+    xmlParserCtxt *ctxt = static_cast<xmlParserCtxt *>(ctx);
+    if (ctxt->node || ctxt->inSubset || !ctxt->_private)
+      return NULL;
+    DOMBuilder *builder = static_cast<ContextData *>(ctxt->_private)->builder;
+    return builder && builder->ctxt_ == ctxt ? builder : NULL;
+  }
+
+  static void StartElementHandler(void *ctx, const xmlChar *localname,
+                                  const xmlChar *prefix, const xmlChar *uri,
+                                  int nb_namespaces, const xmlChar **namespaces,
+                                  int nb_attributes, int nb_defaulted,
+                                  const xmlChar **attributes) {
+    DOMBuilder *builder = GetBuilder(ctx);
+    if (builder) {
+      builder->OnStartElement(localname, prefix, nb_namespaces, namespaces,
+                              nb_attributes, nb_defaulted, attributes);
+    } else {
+      xmlSAX2StartElementNs(ctx, localname, prefix, uri, nb_namespaces,
+                            namespaces, nb_attributes, nb_defaulted,
+                            attributes);
+    }
+  }
+
+  static void EndElementHandler(void *ctx, const xmlChar *localname,
+                                const xmlChar *prefix, const xmlChar *uri) {
+    DOMBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->OnEndElement();
+    else
+      xmlSAX2EndElementNs(ctx, localname, prefix, uri);
+  }
+
+  static void CharactersHandler(void *ctx, const xmlChar *ch, int len) {
+    DOMBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->AppendText(TEXT, FromXmlCharPtr(ch), static_cast<size_t>(len));
+    else
+      xmlSAX2Characters(ctx, ch, len);
+  }
+
+  static void CDataBlockHandler(void *ctx, const xmlChar *value, int len) {
+    DOMBuilder *builder = GetBuilder(ctx);
+    if (builder) {
+      builder->AppendText(CDATA, FromXmlCharPtr(value),
+                          static_cast<size_t>(len));
+    } else {
+      xmlSAX2CDataBlock(ctx, value, len);
+    }
+  }
+
+  static void CommentHandler(void *ctx, const xmlChar *value) {
+    DOMBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->OnComment(value);
+    else
+      xmlSAX2Comment(ctx, value);
+  }
+
+  static void ProcessingInstructionHandler(void *ctx, const xmlChar *target,
+                                           const xmlChar *data) {
+    DOMBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->OnProcessingInstruction(target, data);
+    else
+      xmlSAX2ProcessingInstruction(ctx, target, data);
+  }
+
+  static void ReferenceHandler(void *ctx, const xmlChar *name) {
+    DOMBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->OnReference(name);
+    else
+      xmlSAX2Reference(ctx, name);
+  }
+
+  const StringMap *extra_entities_;
+  std::string filename_;
+  std::string encoding_hint_;
+  bool use_encoding_hint_;
+  DOMDocumentInterface *domdoc_;
+  xmlParserCtxt *ctxt_;
+  ContextData context_data_;
+  // The node to which new nodes are appended.
+  DOMNodeInterface *current_;
+  // Nonzero when in an element which failed to be added into the DOM.
+  int skip_depth_;
+  // The pending character data which is not added into the DOM yet.
+  TextType text_type_;
+  std::string text_;
+  bool text_has_entity_;
+  int text_row_;
+  bool failed_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(DOMBuilder);
+};
+
+// Fills an XPath map directly from the SAX2 events of libxml2, without
+// building a libxml2 tree. The keys are built in one reused buffer, and the
+// text contents of all open elements are collected in one shared buffer, in
+// which each element remembers where its content starts.
+class XPathMapBuilder {
+ public:
+  XPathMapBuilder(const StringMap *extra_entities, const char *filename,
+                  const char *root_element_name)
+      : extra_entities_(extra_entities),
+        filename_(filename ? filename : ""),
+        root_element_name_(root_element_name),
+        ctxt_(NULL),
+        table_(NULL),
+        depth_(0),
+        has_root_(false),
+        failed_(false) {
+  }
+
+  // Parses the content which has been converted by ConvertXMLToUTF8() into
+  // table. Keys already in the table are taken into account as if they were
+  // added by the parser. The table is not changed on failure.
+  bool Parse(const std::string &utf8_xml, StringMap *table) {
+    ctxt_ = xmlCreateMemoryParserCtxt(utf8_xml.c_str(),
+                                      static_cast<int>(utf8_xml.length()));
+    if (!ctxt_)
+      return false;
+    ctxt_->input->filename = xmlMemStrdup(filename_.c_str());
+    SetupParserContext(ctxt_, extra_entities_, &context_data_);
+    context_data_.xpath_map_builder = this;
+    xmlSAXHandler *sax = ctxt_->sax;
+    sax->startElementNs = StartElementHandler;
+    sax->endElementNs = EndElementHandler;
+    sax->characters = CharactersHandler;
+    sax->ignorableWhitespace = CharactersHandler;
+    sax->cdataBlock = CDataBlockHandler;
+    sax->comment = CommentHandler;
+    sax->processingInstruction = ProcessingInstructionHandler;
+    sax->reference = ReferenceHandler;
+
+    StringMap result;
+    if (!table->empty())
+      result = *table;
+    table_ = &result;
+
+    xmlGenericErrorFunc old_error_func = xmlGenericError;
+    xmlSetGenericErrorFunc(NULL, ErrorFunc);
+    xmlParseDocument(ctxt_);
+    xmlSetGenericErrorFunc(NULL, old_error_func);
+
+    bool well_formed = ctxt_->wellFormed != 0;
+    bool succeeded = !failed_ && well_formed && has_root_;
+    // myDoc only contains the DTD and the entities.
+    xmlFreeDoc(ctxt_->myDoc);
+    ctxt_->myDoc = NULL;
+    xmlFreeParserCtxt(ctxt_);
+    ctxt_ = NULL;
+    table_ = NULL;
+
+    if (well_formed && !failed_ && !has_root_) {
+      LOG("No valid root element %s in XML file: %s",
+          root_element_name_, filename_.c_str());
+    }
+    if (succeeded)
+      table->swap(result);
+    return succeeded;
+  }
+
+ private:
+  struct Element {
+    // Length of the key of the element in key_.
+    size_t key_length;
+    // Where the text content of the element starts in text_.
+    size_t text_start;
+    // The value in the table to be set when the element ends.
+    StringMap::iterator value;
+    // Number of child elements seen for each tag name. An element seldom
+    // has many different child tag names, so a vector is enough.
+    std::vector<std::pair<std::string, int> > child_counts;
+  };
+
+  int CountChild(Element *parent, const char *tag) {
+    std::vector<std::pair<std::string, int> > &counts = parent->child_counts;
+    for (size_t i = 0; i < counts.size(); i++) {
+      if (GadgetStrCmp(counts[i].first.c_str(), tag) == 0)
+        return ++counts[i].second;
+    }
+    counts.push_back(std::make_pair(std::string(tag), 1));
+    return 1;
+  }
+
+  // Stops the parser, for example, once the root element is known to be
+  // wrong, instead of parsing the rest of the document.
+  void Stop() {
+    failed_ = true;
+    xmlStopParser(ctxt_);
+  }
+
+  void OnStartElement(const xmlChar *localname, int nb_attributes,
+                      int nb_defaulted, const xmlChar **attributes) {
+    if (failed_)
+      return;
+    const char *tag = FromXmlCharPtr(localname);
+    // Reuse the Element structures of the closed elements.
+    if (depth_ == elements_.size())
+      elements_.resize(depth_ + 1);
+    Element *element = &elements_[depth_];
+    element->child_counts.clear();
+
+    if (depth_ == 0) {
+      if (has_root_ || GadgetStrCmp(tag, root_element_name_) != 0) {
+        LOG("No valid root element %s in XML file: %s",
+            root_element_name_, filename_.c_str());
+        Stop();
+        return;
+      }
+      has_root_ = true;
+      // The name of the root element is omitted in the keys.
+      key_.clear();
+    } else {
+      Element *parent = &elements_[depth_ - 1];
+      int sequence = CountChild(parent, tag);
+      key_.resize(parent->key_length);
+      if (!key_.empty())
+        key_ += '/';
+      key_ += tag;
+      if (table_->find(key_) != table_->end()) {
+        // Postpend the sequence if there are multiple elements with the same
+        // name.
+        char buf[20];
+        snprintf(buf, sizeof(buf), "[%d]", sequence);
+        key_ += buf;
+      }
+      element->value = table_->insert(
+          std::make_pair(key_, std::string())).first;
+    }
+    element->key_length = key_.size();
+    element->text_start = text_.size();
+    depth_++;
+
+    // Like the libxml2 tree builder, ignore the attributes defaulted by DTD.
+    if ((ctxt_->loadsubset & XML_COMPLETE_ATTRS) == 0)
+      nb_attributes -= nb_defaulted;
+    for (int i = 0; i < nb_attributes; i++) {
+      // Each attribute is (localname, prefix, URI, value, end).
+      const xmlChar **xmlattr = attributes + i * 5;
+      key_ += '@';
+      key_ += FromXmlCharPtr(xmlattr[0]);
+      (*table_)[key_] = GetAttributeValue(ctxt_, xmlattr[3], xmlattr[4]);
+      key_.resize(element->key_length);
+    }
+  }
+
+  void OnEndElement() {
+    if (failed_)
+      return;
+    ASSERT(depth_ > 0);
+    depth_--;
+    if (depth_ > 0) {
+      Element *element = &elements_[depth_];
+      element->value->second.assign(text_, element->text_start,
+                                    std::string::npos);
+      // The content of the root element is not used, so the text buffer only
+      // needs to hold the content of one child of the root element.
+      if (depth_ == 1)
+        text_.clear();
+    }
+  }
+
+  // Appends text into the content of all open elements except the root.
+  void AppendText(const char *text, size_t length) {
+    if (!failed_ && depth_ > 1)
+      text_.append(text, length);
+  }
+
+  void OnReference(const xmlChar *name) {
+    if (!failed_ && depth_ > 1)
+      AppendEntityContent(ctxt_, name, &text_);
+  }
+
+  // Returns the builder if the event is in the document content, or NULL if
+  // the event should go to the default SAX2 handler, that is, when the
+  // event is in the DTD, or in the content of an entity, which libxml2 parses
+  // under a temporary node.
+  static XPathMapBuilder *GetBuilder(void *ctx) {
+    xmlParserCtxt *ctxt = static_cast<xmlParserCtxt *>(ctx);
+    if (ctxt->node || ctxt->inSubset || !ctxt->_private)
+      return NULL;
+    XPathMapBuilder *builder =
+        static_cast<ContextData *>(ctxt->_private)->xpath_map_builder;
+    return builder && builder->ctxt_ == ctxt ? builder : NULL;
+  }
+
+  static void StartElementHandler(void *ctx, const xmlChar *localname,
+                                  const xmlChar *prefix, const xmlChar *uri,
+                                  int nb_namespaces, const xmlChar **namespaces,
+                                  int nb_attributes, int nb_defaulted,
+                                  const xmlChar **attributes) {
+    XPathMapBuilder *builder = GetBuilder(ctx);
+    if (builder) {
+      builder->OnStartElement(localname, nb_attributes, nb_defaulted,
+                              attributes);
+    } else {
+      xmlSAX2StartElementNs(ctx, localname, prefix, uri, nb_namespaces,
+                            namespaces, nb_attributes, nb_defaulted,
+                            attributes);
+    }
+  }
+
+  static void EndElementHandler(void *ctx, const xmlChar *localname,
+                                const xmlChar *prefix, const xmlChar *uri) {
+    XPathMapBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->OnEndElement();
+    else
+      xmlSAX2EndElementNs(ctx, localname, prefix, uri);
+  }
+
+  static void CharactersHandler(void *ctx, const xmlChar *ch, int len) {
+    XPathMapBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->AppendText(FromXmlCharPtr(ch), static_cast<size_t>(len));
+    else
+      xmlSAX2Characters(ctx, ch, len);
+  }
+
+  // CDATA sections are not distinguished from character data in the text
+  // content.
+  static void CDataBlockHandler(void *ctx, const xmlChar *value, int len) {
+    XPathMapBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->AppendText(FromXmlCharPtr(value), static_cast<size_t>(len));
+    else
+      xmlSAX2CDataBlock(ctx, value, len);
+  }
+
+  // Comments and processing instructions are not in the text content.
+  static void CommentHandler(void *ctx, const xmlChar *value) {
+    if (!GetBuilder(ctx))
+      xmlSAX2Comment(ctx, value);
+  }
+
+  static void ProcessingInstructionHandler(void *ctx, const xmlChar *target,
+                                           const xmlChar *data) {
+    if (!GetBuilder(ctx))
+      xmlSAX2ProcessingInstruction(ctx, target, data);
+  }
+
+  static void ReferenceHandler(void *ctx, const xmlChar *name) {
+    XPathMapBuilder *builder = GetBuilder(ctx);
+    if (builder)
+      builder->OnReference(name);
+    else
+      xmlSAX2Reference(ctx, name);
+  }
+
+  const StringMap *extra_entities_;
+  std::string filename_;
+  const char *root_element_name_;
+  xmlParserCtxt *ctxt_;
+  ContextData context_data_;
+  StringMap *table_;
+  // The open elements. Only the first depth_ ones are valid.
+  std::vector<Element> elements_;
+  size_t depth_;
+  std::string key_;
+  std::string text_;
+  bool has_root_;
+  bool failed_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(XPathMapBuilder);
+};
+
 class XMLParser : public XMLParserInterface {
  public:
   virtual bool CheckXMLName(const char *name) {
@@ -758,21 +1280,14 @@ class XMLParser : public XMLParserInterface {
         // text/html or others, so detect from the contents.
         HasXMLDecl(content)) {
       ASSERT(!domdoc || !domdoc->HasChildNodes());
-      xmlDoc *xmldoc = ParseXML(content, extra_entities, filename,
-                                encoding_hint, encoding_fallback,
-                                encoding, utf8_content);
-      if (!xmldoc) {
+      std::string converted_xml;
+      if (!ConvertXMLToUTF8(content, filename, encoding_hint,
+                            encoding_fallback, encoding, utf8_content,
+                            &converted_xml)) {
         result = false;
       } else {
-        if (!xmlDocGetRootElement(xmldoc)) {
-          LOG("No root element in XML file: %s", filename);
-          result = false;
-        } else {
-          ConvertChildrenIntoDOM(domdoc, domdoc,
-                                 reinterpret_cast<xmlNode *>(xmldoc));
-          domdoc->Normalize();
-        }
-        xmlFreeDoc(xmldoc);
+        DOMBuilder builder(extra_entities, filename, NULL, domdoc);
+        result = builder.ParseMemory(converted_xml);
       }
     } else {
       result = ConvertToUTF8(content, filename, content_type, encoding_hint,
@@ -784,6 +1299,14 @@ class XMLParser : public XMLParserInterface {
     return result;
   }
 
+  virtual XMLDOMBuilderInterface *CreateDOMBuilder(
+      const StringMap *extra_entities,
+      const char *filename,
+      const char *encoding_hint,
+      DOMDocumentInterface *domdoc) {
+    return new DOMBuilder(extra_entities, filename, encoding_hint, domdoc);
+  }
+
   virtual bool ParseXMLIntoXPathMap(const std::string &xml,
                                     const StringMap *extra_entities,
                                     const char *filename,
@@ -791,23 +1314,13 @@ class XMLParser : public XMLParserInterface {
                                     const char *encoding_hint,
                                     const char *encoding_fallback,
                                     StringMap *table) {
-    xmlDoc *xmldoc = ParseXML(xml, extra_entities, filename, encoding_hint,
-                              encoding_fallback, NULL, NULL);
-    if (!xmldoc)
-      return false;
-
-    xmlNode *root = xmlDocGetRootElement(xmldoc);
-    if (!root ||
-        GadgetStrCmp(FromXmlCharPtr(root->name), root_element_name) != 0) {
-      LOG("No valid root element %s in XML file: %s",
-          root_element_name, filename);
-      xmlFreeDoc(xmldoc);
+    std::string converted_xml;
+    if (!ConvertXMLToUTF8(xml, filename, encoding_hint, encoding_fallback,
+                          NULL, NULL, &converted_xml)) {
       return false;
     }
-
-    ConvertElementIntoXPathMap(root, "", table);
-    xmlFreeDoc(xmldoc);
-    return true;
+    XPathMapBuilder builder(extra_entities, filename, root_element_name);
+    return builder.Parse(converted_xml, table);
   }
 
   virtual std::string EncodeXMLString(const char *src) {
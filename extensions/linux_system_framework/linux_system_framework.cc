@@ -30,6 +30,7 @@
 #include "file_system.h"
 #include "runtime.h"
 #include "memory.h"
+#include "network_statistics.h"
 #include "perfmon.h"
 #include "process.h"
 
@@ -58,10 +59,10 @@ static Memory *g_memory_ = NULL;
 static Process *g_process_ = NULL;
 static FileSystem *g_filesystem_ = NULL;
 static Perfmon *g_perfmon_ = NULL;
+static NetworkStatistics *g_network_statistics_ = NULL;
 
 static ScriptableRuntime *g_script_runtime_ = NULL;
 static ScriptableMemory *g_script_memory_ = NULL;
-static ScriptableProcess *g_script_process_ = NULL;
 
 #ifdef HAVE_DBUS_LIBRARY
 static Machine *g_machine_ = NULL;
@@ -97,10 +98,10 @@ extern "C" {
     g_process_ = new Process;
     g_filesystem_ = new FileSystem;
     g_perfmon_ = new Perfmon;
+    g_network_statistics_ = new NetworkStatistics;
 
     g_script_runtime_ = new ScriptableRuntime(g_runtime_);
     g_script_memory_ = new ScriptableMemory(g_memory_);
-    g_script_process_ = new ScriptableProcess(g_process_);
 
 #ifdef HAVE_DBUS_LIBRARY
     g_machine_ = new Machine;
@@ -126,13 +127,13 @@ extern "C" {
 
     delete g_script_runtime_;
     delete g_script_memory_;
-    delete g_script_process_;
 
     delete g_runtime_;
     delete g_memory_;
     delete g_process_;
     delete g_filesystem_;
     delete g_perfmon_;
+    delete g_network_statistics_;
 
 #ifdef HAVE_DBUS_LIBRARY
     delete g_script_bios_;
@@ -211,8 +212,11 @@ extern "C" {
                                            Variant(g_script_runtime_));
     reg_system->RegisterVariantConstant("memory",
                                         Variant(g_script_memory_));
-    reg_system->RegisterVariantConstant("process",
-                                        Variant(g_script_process_));
+
+    // ScriptableProcess is per gadget, so that each gadget has its own
+    // onForegroundChanged handler.
+    ScriptableProcess *script_process = new ScriptableProcess(g_process_);
+    reg_system->RegisterVariantConstant("process", Variant(script_process));
 
     // ScriptablePerfmon is per gadget, so create a new instance here.
     ScriptablePerfmon *script_perfmon =
@@ -220,6 +224,12 @@ extern "C" {
 
     reg_system->RegisterVariantConstant("perfmon", Variant(script_perfmon));
 
+    // ScriptableNetworkStatistics is per gadget for the same reason.
+    ScriptableNetworkStatistics *script_network_statistics =
+        new ScriptableNetworkStatistics(g_network_statistics_);
+    reg_system->RegisterVariantConstant("networkStatistics",
+                                        Variant(script_network_statistics));
+
 #ifdef HAVE_DBUS_LIBRARY
     reg_system->RegisterVariantConstant("bios",
                                         Variant(g_script_bios_));
@@ -32,33 +32,6 @@ class Memory : public MemoryInterface {
   virtual int64_t GetFreePhysical();
   virtual int64_t GetTotalPhysical();
   virtual int64_t GetUsedPhysical();
-
- private:
-  /**
-   * Refreshes the memory information.
-   */
-  void Refresh();
-
-  /**
-   * Retrieves the corresponding information from the proc file MemInfo.
-   */
-  void ReadMemInfoFromProc();
-
- private:
-  enum {
-    TOTAL_PHYSICAL,
-    FREE_PHYSICAL,
-    TOTAL_SWAP,
-    FREE_SWAP,
-    BUFFERS,
-    CACHED,
-    SWAP_CACHED,
-    MEM_INFO_COUNT
-  };
-
-  int64_t mem_info_[MEM_INFO_COUNT];
-  time_t timestamp_;
-
 };
 
 } // namespace linux_system
@@ -0,0 +1,276 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "network_statistics.h"
+
+#include <ggadget/common.h>
+#include <ggadget/light_map.h>
+#include <ggadget/main_loop_interface.h>
+#include "proc_sampler.h"
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+// Gets the rate of a counter. A counter which goes backwards has been reset
+// or wrapped, so its rate is unknown.
+static double GetRate(uint64_t current, uint64_t last, double seconds) {
+  if (current < last || seconds <= 0)
+    return 0.0;
+  return static_cast<double>(current - last) / seconds;
+}
+
+class NetworkStatistics::Impl : public ProcSampler::SampleCallbackInterface,
+                                public WatchCallbackInterface {
+ public:
+  struct Interface {
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t sample_time;
+    Throughput throughput;
+  };
+
+  struct Listener {
+    bool high_frequency;
+    CallbackSlot *slot;
+  };
+
+  Impl()
+      : sample_time_(0),
+        listener_index_(0),
+        high_frequency_count_(0),
+        subscription_id_(-1),
+        watch_id_(-1) {
+  }
+
+  ~Impl() {
+    for (ListenerMap::iterator it = listeners_.begin();
+         it != listeners_.end(); ++it)
+      delete it->second.slot;
+    listeners_.clear();
+    high_frequency_count_ = 0;
+    UpdateSchedule();
+  }
+
+  // Updates the throughput with a snapshot.
+  // Returns false if the snapshot has already been used.
+  bool Update(const ProcSampler::Snapshot &snapshot) {
+    if (snapshot.net_dev_time == 0 || snapshot.net_dev_time == sample_time_)
+      return false;
+
+    for (size_t i = 0; i < snapshot.net_devs.size(); ++i) {
+      const ProcSampler::NetDevStat &dev = snapshot.net_devs[i];
+      InterfaceMap::iterator it = interfaces_.find(dev.name);
+      if (it == interfaces_.end()) {
+        Interface new_interface;
+        new_interface.rx_bytes = dev.rx_bytes;
+        new_interface.tx_bytes = dev.tx_bytes;
+        new_interface.rx_packets = dev.rx_packets;
+        new_interface.tx_packets = dev.tx_packets;
+        new_interface.throughput.rx_bytes = 0;
+        new_interface.throughput.tx_bytes = 0;
+        new_interface.throughput.rx_packets = 0;
+        new_interface.throughput.tx_packets = 0;
+        it = interfaces_.insert(std::make_pair(dev.name, new_interface)).first;
+      } else {
+        Interface *iface = &it->second;
+        double seconds = static_cast<double>(snapshot.net_dev_time -
+                                             iface->sample_time) / 1000;
+        iface->throughput.rx_bytes =
+            GetRate(dev.rx_bytes, iface->rx_bytes, seconds);
+        iface->throughput.tx_bytes =
+            GetRate(dev.tx_bytes, iface->tx_bytes, seconds);
+        iface->throughput.rx_packets =
+            GetRate(dev.rx_packets, iface->rx_packets, seconds);
+        iface->throughput.tx_packets =
+            GetRate(dev.tx_packets, iface->tx_packets, seconds);
+        iface->rx_bytes = dev.rx_bytes;
+        iface->tx_bytes = dev.tx_bytes;
+        iface->rx_packets = dev.rx_packets;
+        iface->tx_packets = dev.tx_packets;
+      }
+      it->second.sample_time = snapshot.net_dev_time;
+    }
+
+    // Removes the interfaces which have gone.
+    for (InterfaceMap::iterator it = interfaces_.begin();
+         it != interfaces_.end();) {
+      if (it->second.sample_time != snapshot.net_dev_time)
+        interfaces_.erase(it++);
+      else
+        ++it;
+    }
+
+    sample_time_ = snapshot.net_dev_time;
+    return true;
+  }
+
+  // Updates the throughput if no listener keeps it up to date.
+  void Refresh() {
+    if (listeners_.empty()) {
+      Update(ProcSampler::get()->Sample(ProcSampler::SOURCE_NET_DEV,
+                                        ProcSampler::kSampleInterval));
+    }
+  }
+
+  void Dispatch() {
+    // A listener may remove any one during the dispatching.
+    dispatch_ids_.clear();
+    for (ListenerMap::iterator it = listeners_.begin();
+         it != listeners_.end(); ++it)
+      dispatch_ids_.push_back(it->first);
+    for (size_t i = 0; i < dispatch_ids_.size(); ++i) {
+      ListenerMap::iterator it = listeners_.find(dispatch_ids_[i]);
+      if (it != listeners_.end())
+        (*it->second.slot)();
+    }
+  }
+
+  virtual void OnSample(const ProcSampler::Snapshot &snapshot) {
+    if (Update(snapshot))
+      Dispatch();
+  }
+
+  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    GGL_UNUSED(watch_id);
+    OnSample(ProcSampler::get()->Sample(ProcSampler::SOURCE_NET_DEV,
+                                        kHighFrequencyInterval / 2));
+    return true;
+  }
+
+  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    GGL_UNUSED(watch_id);
+    // In case the main loop is destroyed before the watch.
+    watch_id_ = -1;
+  }
+
+  // Samples with the high frequency watch if any listener wants it,
+  // otherwise with the shared subscription of ProcSampler, and stops
+  // sampling if there is no listener.
+  void UpdateSchedule() {
+    bool fast = high_frequency_count_ > 0;
+    bool slow = !fast && !listeners_.empty();
+    MainLoopInterface *main_loop = GetGlobalMainLoop();
+
+    if (fast && watch_id_ < 0 && main_loop) {
+      watch_id_ = main_loop->AddTimeoutWatch(kHighFrequencyInterval, this);
+    } else if (!fast && watch_id_ >= 0) {
+      // The global main loop may have been reset before the destruction.
+      if (main_loop)
+        main_loop->RemoveWatch(watch_id_);
+      watch_id_ = -1;
+    }
+
+    if (slow && subscription_id_ < 0) {
+      subscription_id_ = ProcSampler::get()->Subscribe(
+          ProcSampler::SOURCE_NET_DEV, this);
+    } else if (!slow && subscription_id_ >= 0) {
+      ProcSampler::get()->Unsubscribe(subscription_id_);
+      subscription_id_ = -1;
+    }
+  }
+
+  int AddListener(bool high_frequency, CallbackSlot *slot) {
+    if (!slot || !GetGlobalMainLoop()) {
+      delete slot;
+      return -1;
+    }
+
+    // In case the listener_index_ is wrapped.
+    if (listener_index_ < 0) listener_index_ = 0;
+
+    int id = listener_index_++;
+    Listener listener = { high_frequency, slot };
+    listeners_[id] = listener;
+    if (high_frequency)
+      ++high_frequency_count_;
+
+    // Starts with a sample, so that the first update has the throughput.
+    Update(ProcSampler::get()->Sample(ProcSampler::SOURCE_NET_DEV,
+                                      kHighFrequencyInterval / 2));
+    UpdateSchedule();
+    return id;
+  }
+
+  void RemoveListener(int id) {
+    ListenerMap::iterator it = listeners_.find(id);
+    if (it != listeners_.end()) {
+      if (it->second.high_frequency)
+        --high_frequency_count_;
+      delete it->second.slot;
+      listeners_.erase(it);
+      UpdateSchedule();
+    }
+  }
+
+  typedef LightMap<std::string, Interface> InterfaceMap;
+  InterfaceMap interfaces_;
+  uint64_t sample_time_;
+
+  typedef LightMap<int, Listener> ListenerMap;
+  ListenerMap listeners_;
+  std::vector<int> dispatch_ids_;
+  int listener_index_;
+  int high_frequency_count_;
+  int subscription_id_;
+  int watch_id_;
+};
+
+NetworkStatistics::NetworkStatistics()
+    : impl_(new Impl()) {
+}
+
+NetworkStatistics::~NetworkStatistics() {
+  delete impl_;
+}
+
+void NetworkStatistics::GetInterfaces(std::vector<std::string> *names) {
+  ASSERT(names);
+  impl_->Refresh();
+  names->clear();
+  for (Impl::InterfaceMap::const_iterator it = impl_->interfaces_.begin();
+       it != impl_->interfaces_.end(); ++it)
+    names->push_back(it->first);
+}
+
+bool NetworkStatistics::GetThroughput(const char *name,
+                                      Throughput *throughput) {
+  ASSERT(throughput);
+  if (!name)
+    return false;
+  impl_->Refresh();
+  Impl::InterfaceMap::const_iterator it = impl_->interfaces_.find(name);
+  if (it == impl_->interfaces_.end())
+    return false;
+  *throughput = it->second.throughput;
+  return true;
+}
+
+int NetworkStatistics::AddListener(bool high_frequency, CallbackSlot *slot) {
+  return impl_->AddListener(high_frequency, slot);
+}
+
+void NetworkStatistics::RemoveListener(int id) {
+  impl_->RemoveListener(id);
+}
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
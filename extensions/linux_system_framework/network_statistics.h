@@ -0,0 +1,53 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_NETWORK_STATISTICS_H__
+#define EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_NETWORK_STATISTICS_H__
+
+#include <ggadget/framework_interface.h>
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+/**
+ * Computes the throughput of the network interfaces from the deltas of the
+ * counters in /proc/net/dev, which is sampled with @c ProcSampler.
+ */
+class NetworkStatistics : public NetworkStatisticsInterface {
+ public:
+  /** The interval of sampling in the high frequency mode, in milliseconds. */
+  static const int kHighFrequencyInterval = 500;
+
+  NetworkStatistics();
+  virtual ~NetworkStatistics();
+
+  virtual void GetInterfaces(std::vector<std::string> *names);
+  virtual bool GetThroughput(const char *name, Throughput *throughput);
+  virtual int AddListener(bool high_frequency, CallbackSlot *slot);
+  virtual void RemoveListener(int id);
+
+ private:
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(NetworkStatistics);
+};
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
+
+#endif // EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_NETWORK_STATISTICS_H__
@@ -0,0 +1,424 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "proc_sampler.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <ggadget/light_map.h>
+#include <ggadget/logger.h>
+#include <ggadget/main_loop_interface.h>
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+static const char kProcStatFile[] = "/proc/stat";
+static const char kProcMemInfoFile[] = "/proc/meminfo";
+static const char kProcNetDevFile[] = "/proc/net/dev";
+
+// The initial size of the buffer of each file, which is doubled until the
+// whole file fits in.
+static const size_t kInitialBufferSize = 4096;
+
+// The keys in /proc/meminfo, in the order of ProcSampler::MemInfoField.
+static const char *kMemInfoKeys[] = {
+  "MemTotal", "MemFree", "SwapTotal",
+  "SwapFree", "Buffers", "Cached", "SwapCached"
+};
+
+// The header of the total cpu line in /proc/stat.
+static const char kCpuHeader[] = "cpu";
+
+// The number of header lines in /proc/net/dev.
+static const int kNetDevHeaderLines = 2;
+
+// Uses the clock of the global main loop if there is one, so that the age of
+// the samples agrees with the timers which trigger them.
+static uint64_t GetTimeInMilliseconds() {
+  MainLoopInterface *main_loop = GetGlobalMainLoop();
+  if (main_loop)
+    return main_loop->GetCurrentTime();
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+// Splits a NUL-terminated buffer into lines and tokens in place, without
+// allocating memory. Tokens are separated by spaces, tabs and colons, and
+// never span lines.
+class ProcTokenizer {
+ public:
+  explicit ProcTokenizer(const char *data) : pos_(data) { }
+
+  // Moves to the beginning of the next line.
+  // Returns false if there is no more line.
+  bool NextLine() {
+    while (*pos_ && *pos_ != '\n')
+      ++pos_;
+    if (*pos_)
+      ++pos_;
+    return *pos_ != 0;
+  }
+
+  // Gets the next token in the current line.
+  bool NextToken(const char **token, size_t *length) {
+    while (*pos_ == ' ' || *pos_ == '\t' || *pos_ == ':')
+      ++pos_;
+    if (!*pos_ || *pos_ == '\n')
+      return false;
+    *token = pos_;
+    while (*pos_ && *pos_ != ' ' && *pos_ != '\t' && *pos_ != ':' &&
+           *pos_ != '\n')
+      ++pos_;
+    *length = static_cast<size_t>(pos_ - *token);
+    return true;
+  }
+
+  // Gets the next token in the current line as a decimal integer.
+  bool NextInteger(int64_t *value) {
+    const char *token;
+    size_t length;
+    if (!NextToken(&token, &length))
+      return false;
+    int64_t result = 0;
+    for (size_t i = 0; i < length; ++i) {
+      if (token[i] < '0' || token[i] > '9')
+        return false;
+      result = result * 10 + (token[i] - '0');
+    }
+    *value = result;
+    return true;
+  }
+
+  // Skips the given number of tokens in the current line.
+  bool SkipTokens(int count) {
+    const char *token;
+    size_t length;
+    for (int i = 0; i < count; ++i) {
+      if (!NextToken(&token, &length))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  const char *pos_;
+};
+
+static bool TokenEquals(const char *token, size_t length, const char *str) {
+  return strncmp(token, str, length) == 0 && str[length] == 0;
+}
+
+class ProcSampler::Impl : public WatchCallbackInterface {
+ public:
+  // A /proc file which is kept open and read into a reusable buffer.
+  struct ProcFile {
+    explicit ProcFile(const char *path_in)
+        : path(path_in), fd(-1), buffer(kInitialBufferSize) { }
+    const char *path;
+    int fd;
+    std::vector<char> buffer;
+  };
+
+  struct Subscription {
+    int sources;
+    SampleCallbackInterface *callback;
+  };
+
+  Impl()
+      : stat_file_(kProcStatFile),
+        meminfo_file_(kProcMemInfoFile),
+        net_dev_file_(kProcNetDevFile),
+        subscription_index_(0),
+        watch_id_(-1),
+        read_count_(0) {
+    memset(&snapshot_.cpu, 0, sizeof(snapshot_.cpu));
+    memset(snapshot_.mem_info, 0, sizeof(snapshot_.mem_info));
+    snapshot_.stat_time = 0;
+    snapshot_.meminfo_time = 0;
+    snapshot_.net_dev_time = 0;
+  }
+
+  ~Impl() {
+    if (watch_id_ >= 0)
+      GetGlobalMainLoop()->RemoveWatch(watch_id_);
+    CloseFile(&stat_file_);
+    CloseFile(&meminfo_file_);
+    CloseFile(&net_dev_file_);
+  }
+
+  static void CloseFile(ProcFile *file) {
+    if (file->fd >= 0) {
+      close(file->fd);
+      file->fd = -1;
+    }
+  }
+
+  // Reads the whole file into its buffer and terminates it with NUL.
+  bool ReadFile(ProcFile *file) {
+    if (file->fd < 0) {
+      file->fd = open(file->path, O_RDONLY);
+      if (file->fd < 0) {
+        DLOG("Failed to open %s: %s", file->path, strerror(errno));
+        return false;
+      }
+      fcntl(file->fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    ++read_count_;
+    size_t size = 0;
+    while (true) {
+      if (size + 1 >= file->buffer.size())
+        file->buffer.resize(file->buffer.size() * 2);
+      ssize_t result = pread(file->fd, &file->buffer[size],
+                             file->buffer.size() - size - 1,
+                             static_cast<off_t>(size));
+      if (result < 0) {
+        if (errno == EINTR)
+          continue;
+        DLOG("Failed to read %s: %s", file->path, strerror(errno));
+        CloseFile(file);
+        return false;
+      }
+      if (result == 0)
+        break;
+      size += static_cast<size_t>(result);
+    }
+    file->buffer[size] = 0;
+    return true;
+  }
+
+  bool ReadStat() {
+    if (!ReadFile(&stat_file_))
+      return false;
+
+    ProcTokenizer tokenizer(&stat_file_.buffer[0]);
+    const char *token;
+    size_t length;
+    if (!tokenizer.NextToken(&token, &length) ||
+        !TokenEquals(token, length, kCpuHeader))
+      return false;
+
+    CpuStat *cpu = &snapshot_.cpu;
+    // Old kernels have no iowait, hardirq and softirq fields.
+    int64_t *fields[] = {
+      &cpu->user, &cpu->nice, &cpu->system, &cpu->idle,
+      &cpu->iowait, &cpu->hardirq, &cpu->softirq
+    };
+    for (size_t i = 0; i < arraysize(fields); ++i) {
+      if (!tokenizer.NextInteger(fields[i]))
+        *fields[i] = 0;
+    }
+    return true;
+  }
+
+  bool ReadMemInfo() {
+    if (!ReadFile(&meminfo_file_))
+      return false;
+
+    ProcTokenizer tokenizer(&meminfo_file_.buffer[0]);
+    do {
+      const char *token;
+      size_t length;
+      if (!tokenizer.NextToken(&token, &length))
+        continue;
+      for (int i = 0; i < MEM_INFO_COUNT; ++i) {
+        if (TokenEquals(token, length, kMemInfoKeys[i])) {
+          int64_t value;
+          if (tokenizer.NextInteger(&value))
+            snapshot_.mem_info[i] = value * 1024;
+          break;
+        }
+      }
+    } while (tokenizer.NextLine());
+    return true;
+  }
+
+  bool ReadNetDev() {
+    if (!ReadFile(&net_dev_file_))
+      return false;
+
+    ProcTokenizer tokenizer(&net_dev_file_.buffer[0]);
+    for (int i = 0; i < kNetDevHeaderLines; ++i) {
+      if (!tokenizer.NextLine())
+        break;
+    }
+
+    std::vector<NetDevStat> &devs = snapshot_.net_devs;
+    size_t count = 0;
+    do {
+      const char *token;
+      size_t length;
+      if (!tokenizer.NextToken(&token, &length))
+        continue;
+      // The fields are: bytes, packets, errs, drop, fifo, frame, compressed,
+      // multicast for receiving, then the same for transmitting.
+      int64_t rx_bytes, rx_packets, tx_bytes, tx_packets;
+      if (!tokenizer.NextInteger(&rx_bytes) ||
+          !tokenizer.NextInteger(&rx_packets) ||
+          !tokenizer.SkipTokens(6) ||
+          !tokenizer.NextInteger(&tx_bytes) ||
+          !tokenizer.NextInteger(&tx_packets))
+        continue;
+
+      if (count == devs.size())
+        devs.push_back(NetDevStat());
+      NetDevStat *dev = &devs[count++];
+      dev->name.assign(token, length);
+      dev->rx_bytes = static_cast<uint64_t>(rx_bytes);
+      dev->rx_packets = static_cast<uint64_t>(rx_packets);
+      dev->tx_bytes = static_cast<uint64_t>(tx_bytes);
+      dev->tx_packets = static_cast<uint64_t>(tx_packets);
+    } while (tokenizer.NextLine());
+    devs.resize(count);
+    return true;
+  }
+
+  static bool IsStale(uint64_t sample_time, uint64_t now, uint64_t max_age) {
+    return sample_time == 0 || now < sample_time ||
+           now - sample_time >= max_age;
+  }
+
+  const Snapshot &Sample(int sources, uint64_t max_age) {
+    uint64_t now = GetTimeInMilliseconds();
+    if ((sources & SOURCE_STAT) &&
+        IsStale(snapshot_.stat_time, now, max_age) && ReadStat())
+      snapshot_.stat_time = now;
+    if ((sources & SOURCE_MEMINFO) &&
+        IsStale(snapshot_.meminfo_time, now, max_age) && ReadMemInfo())
+      snapshot_.meminfo_time = now;
+    if ((sources & SOURCE_NET_DEV) &&
+        IsStale(snapshot_.net_dev_time, now, max_age) && ReadNetDev())
+      snapshot_.net_dev_time = now;
+    return snapshot_;
+  }
+
+  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    GGL_UNUSED(watch_id);
+    int sources = 0;
+    dispatch_ids_.clear();
+    for (SubscriptionMap::iterator it = subscriptions_.begin();
+         it != subscriptions_.end(); ++it) {
+      sources |= it->second.sources;
+      dispatch_ids_.push_back(it->first);
+    }
+
+    // Samples all the sources once, but don't read the files again if some
+    // one has just sampled them.
+    Sample(sources, kSampleInterval / 2);
+
+    // A subscriber may unsubscribe any one during the dispatching.
+    for (size_t i = 0; i < dispatch_ids_.size(); ++i) {
+      SubscriptionMap::iterator it = subscriptions_.find(dispatch_ids_[i]);
+      if (it != subscriptions_.end())
+        it->second.callback->OnSample(snapshot_);
+    }
+    return true;
+  }
+
+  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    GGL_UNUSED(watch_id);
+    // In case the main loop is destroyed before the watch.
+    watch_id_ = -1;
+  }
+
+  int Subscribe(int sources, SampleCallbackInterface *callback) {
+    MainLoopInterface *main_loop = GetGlobalMainLoop();
+    if (!callback || !main_loop)
+      return -1;
+
+    // In case the subscription_index_ is wrapped.
+    if (subscription_index_ < 0) subscription_index_ = 0;
+
+    int id = subscription_index_++;
+    Subscription subscription = { sources, callback };
+    subscriptions_[id] = subscription;
+
+    // Add timeout watch only when there is any subscription.
+    if (watch_id_ < 0)
+      watch_id_ = main_loop->AddTimeoutWatch(kSampleInterval, this);
+    return id;
+  }
+
+  void Unsubscribe(int id) {
+    SubscriptionMap::iterator it = subscriptions_.find(id);
+    if (it != subscriptions_.end())
+      subscriptions_.erase(it);
+
+    // Remove watch if there is no more subscription.
+    if (subscriptions_.empty() && watch_id_ >= 0) {
+      GetGlobalMainLoop()->RemoveWatch(watch_id_);
+      watch_id_ = -1;
+    }
+  }
+
+  ProcFile stat_file_;
+  ProcFile meminfo_file_;
+  ProcFile net_dev_file_;
+  Snapshot snapshot_;
+
+  typedef LightMap<int, Subscription> SubscriptionMap;
+  SubscriptionMap subscriptions_;
+  std::vector<int> dispatch_ids_;
+  int subscription_index_;
+  int watch_id_;
+  size_t read_count_;
+
+  static ProcSampler *sampler_;
+};
+
+ProcSampler *ProcSampler::Impl::sampler_ = NULL;
+
+ProcSampler::ProcSampler()
+    : impl_(new Impl()) {
+}
+
+ProcSampler::~ProcSampler() {
+  delete impl_;
+}
+
+const ProcSampler::Snapshot &ProcSampler::Sample(int sources,
+                                                 uint64_t max_age) {
+  return impl_->Sample(sources, max_age);
+}
+
+int ProcSampler::Subscribe(int sources, SampleCallbackInterface *callback) {
+  return impl_->Subscribe(sources, callback);
+}
+
+void ProcSampler::Unsubscribe(int id) {
+  impl_->Unsubscribe(id);
+}
+
+size_t ProcSampler::GetReadCount() const {
+  return impl_->read_count_;
+}
+
+ProcSampler *ProcSampler::get() {
+  if (!Impl::sampler_)
+    Impl::sampler_ = new ProcSampler();
+  return Impl::sampler_;
+}
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
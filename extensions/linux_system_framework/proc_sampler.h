@@ -0,0 +1,153 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROC_SAMPLER_H__
+#define EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROC_SAMPLER_H__
+
+#include <string>
+#include <vector>
+#include <ggadget/common.h>
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+/**
+ * Samples the system statistics in /proc for all the system framework
+ * objects, so that each file is read once per sample however many objects
+ * and gadgets use it.
+ *
+ * The files are kept open and read with pread() into reusable buffers, and
+ * are parsed without allocating memory. Subscribers are called on a single
+ * timer with the same snapshot; other callers get the latest snapshot if it
+ * is new enough.
+ */
+class ProcSampler {
+ public:
+  /** The sampled files. */
+  enum Source {
+    SOURCE_STAT = 1,      /**< /proc/stat */
+    SOURCE_MEMINFO = 2,   /**< /proc/meminfo */
+    SOURCE_NET_DEV = 4    /**< /proc/net/dev */
+  };
+
+  /** Total CPU times in /proc/stat, in units of USER_HZ. */
+  struct CpuStat {
+    int64_t user;
+    int64_t nice;
+    int64_t system;
+    int64_t idle;
+    int64_t iowait;
+    int64_t hardirq;
+    int64_t softirq;
+
+    int64_t GetTotalTime() const {
+      return user + nice + system + idle + iowait + hardirq + softirq;
+    }
+    int64_t GetWorkTime() const {
+      return user + nice + system + hardirq + softirq;
+    }
+  };
+
+  /** Fields of /proc/meminfo, in bytes. */
+  enum MemInfoField {
+    MEM_TOTAL,
+    MEM_FREE,
+    SWAP_TOTAL,
+    SWAP_FREE,
+    BUFFERS,
+    CACHED,
+    SWAP_CACHED,
+    MEM_INFO_COUNT
+  };
+
+  /** Statistics of a network interface in /proc/net/dev. */
+  struct NetDevStat {
+    std::string name;
+    uint64_t rx_bytes;
+    uint64_t rx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_packets;
+  };
+
+  struct Snapshot {
+    /**
+     * Times in milliseconds when each source was sampled, or 0 if it was
+     * never sampled successfully.
+     */
+    uint64_t stat_time;
+    uint64_t meminfo_time;
+    uint64_t net_dev_time;
+
+    CpuStat cpu;
+    int64_t mem_info[MEM_INFO_COUNT];
+    std::vector<NetDevStat> net_devs;
+  };
+
+  /** Receives the snapshots of a subscription. */
+  class SampleCallbackInterface {
+   public:
+    virtual ~SampleCallbackInterface() { }
+    virtual void OnSample(const Snapshot &snapshot) = 0;
+  };
+
+  /** The interval of sampling for subscribers, in milliseconds. */
+  static const int kSampleInterval = 2000;
+
+  /**
+   * Gets the latest snapshot, and samples the given sources again if they
+   * are older than @a max_age milliseconds.
+   * @param sources bitwise or of @c Source values.
+   * @param max_age 0 to always sample the sources again.
+   */
+  const Snapshot &Sample(int sources, uint64_t max_age);
+
+  /**
+   * Subscribes to snapshots of the given sources, which are sampled every
+   * @c kSampleInterval milliseconds with the global main loop while there
+   * is any subscriber.
+   * @param sources bitwise or of @c Source values.
+   * @param callback called with each snapshot. It's not owned by the
+   *     sampler, and must be unsubscribed before it's destroyed.
+   * @return the subscription id to pass to @c Unsubscribe(), or -1 if
+   *     there is no global main loop.
+   */
+  int Subscribe(int sources, SampleCallbackInterface *callback);
+
+  /** Cancels a subscription returned by @c Subscribe(). */
+  void Unsubscribe(int id);
+
+  /** Returns the number of /proc files read. For testing. */
+  size_t GetReadCount() const;
+
+  /** Gets the singleton of ProcSampler. */
+  static ProcSampler *get();
+
+ private:
+  class Impl;
+  Impl *impl_;
+
+  ProcSampler();
+  ~ProcSampler();
+
+  DISALLOW_EVIL_CONSTRUCTORS(ProcSampler);
+};
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
+
+#endif // EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROC_SAMPLER_H__
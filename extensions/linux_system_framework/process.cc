@@ -14,26 +14,22 @@
   limitations under the License.
 */
 
-#include <sys/types.h>
-#include <dirent.h>
-#include <cstdlib>
 
 #ifdef HAVE_X11
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #endif
 
+#include <ggadget/main_loop_interface.h>
+#include <ggadget/signals.h>
 #include "process.h"
+#include "process_table.h"
 #include "machine.h"
 
 namespace ggadget {
 namespace framework {
 namespace linux_system {
 
-static const char* kDirName = "/proc";
-
-static bool ReadCmdPath(int pid, std::string *cmdline);
-
 // ---------------------------PrcoessInfo Class-------------------------------//
 
 ProcessInfo::ProcessInfo(int pid, const std::string &path) :
@@ -59,7 +55,13 @@ void Processes::Destroy() {
 }
 
 Processes::Processes() {
-  InitProcesses();
+  // A ProcessTable would subscribe to the proc connector only to be thrown
+  // away, so just take a snapshot of /proc.
+  ReadProcesses(&procs_);
+}
+
+Processes::Processes(const ProcessTable &table) {
+  table.GetProcesses(&procs_);
 }
 
 int Processes::GetCount() const {
@@ -72,36 +74,8 @@ ProcessInfoInterface *Processes::GetItem(int index) {
   return new ProcessInfo(procs_[index].first, procs_[index].second);
 }
 
-void Processes::InitProcesses() {
-  DIR *dir = NULL;
-  struct dirent *entry = NULL;
-
-  dir = opendir(kDirName);
-  if (!dir) // if can't open the directory, just return
-    return;
-
-  while ((entry = readdir(dir)) != NULL) {
-    char *name = entry->d_name;
-    char *end;
-    int pid = static_cast<int>(strtol(name, &end, 10));
-
-    // if it is not a process folder, so skip it
-    if (!pid || *end)
-      continue;
-
-    std::string cmdline;
-    if (ReadCmdPath(pid, &cmdline) && cmdline != "") {
-      procs_.push_back(IntStringPair(pid, cmdline));
-    }
-  }
-}
-
 // -----------------------------Process Class---------------------------------//
 
-ProcessesInterface *Process::EnumerateProcesses() {
-  return new Processes;
-}
-
 #ifdef HAVE_X11
 
 static int IgnoreXError(Display *display, XErrorEvent *event) {
@@ -111,114 +85,258 @@ static int IgnoreXError(Display *display, XErrorEvent *event) {
   return 0;
 }
 
-static int GetWindowPID(Display *display, Window window, Atom atom) {
+// Gets the value of a window property containing a single 32-bit item.
+static bool GetWindowProperty32(Display *display, Window window, Atom atom,
+                                Atom type, unsigned long *value) {
   unsigned char *data = NULL;
-  Atom type;
+  Atom actual_type;
   int format;
   unsigned long count, after;
-  XGetWindowProperty(display, window, atom, 0, 1, False, XA_CARDINAL,
-                     &type, &format, &count, &after, &data);
-  int pid = -1;
+  XGetWindowProperty(display, window, atom, 0, 1, False, type,
+                     &actual_type, &format, &count, &after, &data);
+  bool result = false;
   if (data) {
-    if (format == 32 && count == 1 && after == 0)
-      pid = *reinterpret_cast<int32_t *>(data);
+    // Xlib returns 32-bit items as longs.
+    if (format == 32 && count == 1 && after == 0) {
+      *value = *reinterpret_cast<unsigned long *>(data);
+      result = true;
+    }
     XFree(data);
   }
-  return pid;
+  return result;
 }
 
-ProcessInfoInterface *Process::GetForeground() {
-  int pid = -1;
-  int (*old_error_handler)(Display *, XErrorEvent *) =
-      XSetErrorHandler(IgnoreXError);
-  Display *display = XOpenDisplay(NULL);
-  if (display) {
-    // See http://standards.freedesktop.org/wm-spec/wm-spec-1.3.html#id2507760.
-    Atom pid_atom = XInternAtom(display, "_NET_WM_PID", True);
-    if (pid_atom != None) {
-      Window focused;
+static int GetWindowPID(Display *display, Window window, Atom atom) {
+  unsigned long pid;
+  return GetWindowProperty32(display, window, atom, XA_CARDINAL, &pid) ?
+         static_cast<int>(pid) : -1;
+}
+
+// Keeps a connection to the X server, and tracks the foreground process with
+// the PropertyNotify events of _NET_ACTIVE_WINDOW on the root window, so that
+// getting the foreground process needs no round trip to the X server.
+// If there is no main loop, or the window manager doesn't maintain
+// _NET_ACTIVE_WINDOW, the foreground process is queried on each call, and
+// the changes are not signalled.
+class ForegroundWatch : public WatchCallbackInterface {
+ public:
+  ForegroundWatch()
+    : display_(NULL),
+      open_failed_(false),
+      pid_atom_(None),
+      active_window_atom_(None),
+      active_window_found_(false),
+      watch_id_(-1),
+      pid_(-1) {
+  }
+
+  ~ForegroundWatch() {
+    if (watch_id_ >= 0)
+      GetGlobalMainLoop()->RemoveWatch(watch_id_);
+    if (display_)
+      XCloseDisplay(display_);
+  }
+
+  // Returns the id of the foreground process, or -1 if it's unknown.
+  int GetForegroundPID() {
+    if (!display_ && (open_failed_ || !Open()))
+      return -1;
+    if (watch_id_ < 0 || !active_window_found_)
+      pid_ = QueryForegroundPID();
+    return pid_;
+  }
+
+  Connection *ConnectOnChanged(Slot0<void> *slot) {
+    // Opens the display now, otherwise no event would be received until
+    // the foreground process is queried.
+    if (!display_ && !open_failed_)
+      Open();
+    if (watch_id_ < 0) {
+      delete slot;
+      return NULL;
+    }
+    return on_changed_signal_.Connect(slot);
+  }
+
+  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    GGL_UNUSED(watch_id);
+    int old_pid = pid_;
+    // Events may be queued by Xlib when reading replies of the queries, in
+    // which case the connection won't become readable for them.
+    while (ReadEvents())
+      pid_ = QueryForegroundPID();
+    // The active window may change among the windows of one process.
+    if (pid_ != old_pid)
+      on_changed_signal_();
+    return true;
+  }
+
+  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+    GGL_UNUSED(main_loop);
+    GGL_UNUSED(watch_id);
+    // In case the main loop is destroyed before the watch.
+    watch_id_ = -1;
+  }
+
+ private:
+  bool Open() {
+    int (*old_error_handler)(Display *, XErrorEvent *) =
+        XSetErrorHandler(IgnoreXError);
+    display_ = XOpenDisplay(NULL);
+    if (!display_) {
+      DLOG("Failed to open X display to get the foreground process.");
+      open_failed_ = true;
+      XSetErrorHandler(old_error_handler);
+      return false;
+    }
+
+    // See http://standards.freedesktop.org/wm-spec/wm-spec-1.3.html.
+    pid_atom_ = XInternAtom(display_, "_NET_WM_PID", False);
+    active_window_atom_ = XInternAtom(display_, "_NET_ACTIVE_WINDOW", False);
+    MainLoopInterface *main_loop = GetGlobalMainLoop();
+    if (main_loop) {
+      XSelectInput(display_, DefaultRootWindow(display_), PropertyChangeMask);
+      watch_id_ = main_loop->AddIOReadWatch(ConnectionNumber(display_), this);
+    }
+    pid_ = QueryForegroundPID();
+    XSetErrorHandler(old_error_handler);
+    return true;
+  }
+
+  // Reads all pending events, and returns whether the active window changed.
+  bool ReadEvents() {
+    bool changed = false;
+    while (XPending(display_)) {
+      XEvent event;
+      XNextEvent(display_, &event);
+      if (event.type == PropertyNotify &&
+          event.xproperty.atom == active_window_atom_)
+        changed = true;
+    }
+    return changed;
+  }
+
+  int QueryForegroundPID() {
+    int (*old_error_handler)(Display *, XErrorEvent *) =
+        XSetErrorHandler(IgnoreXError);
+    Window focused = None;
+    unsigned long active_window;
+    active_window_found_ =
+        GetWindowProperty32(display_, DefaultRootWindow(display_),
+                            active_window_atom_, XA_WINDOW, &active_window);
+    if (active_window_found_) {
+      focused = static_cast<Window>(active_window);
+    } else {
       int revert_to;
-      XGetInputFocus(display, &focused, &revert_to);
-      if (focused != None) {
-        // Walk up the window tree to find a window with _WM_NET_PID property.
-        Window pid_window = focused;
-        Window parent, root;
-        Window *children = NULL;
-        unsigned int nchildren;
-        while (true) {
-          pid = GetWindowPID(display, pid_window, pid_atom);
-          if (pid != -1)
-            break;
-          if (!XQueryTree(display, pid_window, &root, &parent, &children,
-                          &nchildren))
-            break;
-          if (children)
-            XFree(children);
-          if (parent == None || parent == root)
-            break;
-          pid_window = parent;
-        }
-        // Can't find a correct focused window in parents. try children.
-        if (pid == -1 &&
-            XQueryTree(display, focused, &root, &parent, &children,
-                       &nchildren) &&
-            children) {
-          for (unsigned int i = 0; i < nchildren && pid == -1; ++i)
-            pid = GetWindowPID(display, children[i], pid_atom);
-          XFree(children);
-        }
-      }
+      XGetInputFocus(display_, &focused, &revert_to);
+    }
+    int pid = focused == None ? -1 : FindWindowPID(focused);
+    // Handles all errors before restoring the error handler.
+    XSync(display_, False);
+    XSetErrorHandler(old_error_handler);
+    return pid;
+  }
+
+  int FindWindowPID(Window focused) {
+    // Walk up the window tree to find a window with _NET_WM_PID property.
+    int pid = -1;
+    Window pid_window = focused;
+    Window parent, root;
+    Window *children = NULL;
+    unsigned int nchildren;
+    while (true) {
+      pid = GetWindowPID(display_, pid_window, pid_atom_);
+      if (pid != -1)
+        break;
+      if (!XQueryTree(display_, pid_window, &root, &parent, &children,
+                      &nchildren))
+        break;
+      if (children)
+        XFree(children);
+      if (parent == None || parent == root)
+        break;
+      pid_window = parent;
+    }
+    // Can't find a correct focused window in parents. try children.
+    if (pid == -1 &&
+        XQueryTree(display_, focused, &root, &parent, &children,
+                   &nchildren) &&
+        children) {
+      for (unsigned int i = 0; i < nchildren && pid == -1; ++i)
+        pid = GetWindowPID(display_, children[i], pid_atom_);
+      XFree(children);
     }
-    XCloseDisplay(display);
+    return pid;
   }
 
-  XSetErrorHandler(old_error_handler);
+  Display *display_;
+  bool open_failed_;
+  Atom pid_atom_;
+  Atom active_window_atom_;
+  bool active_window_found_;
+  int watch_id_;
+  int pid_;
+  Signal0<void> on_changed_signal_;
+};
+
+class Process::Impl {
+ public:
+  ProcessTable process_table_;
+  ForegroundWatch foreground_watch_;
+};
+
+ProcessInfoInterface *Process::GetForeground() {
+  int pid = impl_->foreground_watch_.GetForegroundPID();
   return pid == -1 ? NULL : GetInfo(pid);
 }
 
+Connection *Process::ConnectOnForegroundChanged(Slot0<void> *slot) {
+  return impl_->foreground_watch_.ConnectOnChanged(slot);
+}
+
 #else // ifdef HAVE_X11
 
+class Process::Impl {
+ public:
+  ProcessTable process_table_;
+};
+
 ProcessInfoInterface *Process::GetForeground() {
   return NULL;
 }
 
-#endif // HAVE_X11
-
-ProcessInfoInterface *Process::GetInfo(int pid) {
-  std::string cmdline;
-  if (ReadCmdPath(pid, &cmdline)) {
-    return new ProcessInfo(pid, cmdline);
-  }
+Connection *Process::ConnectOnForegroundChanged(Slot0<void> *slot) {
+  delete slot;
   return NULL;
 }
 
+#endif // HAVE_X11
 
-// ---------------------------Utility Functions-------------------------------//
+Process::Process()
+  : impl_(new Impl()) {
+}
 
-// Reads the command path with pid from proc system.
-// EMPTY string will be returned if any error.
-static bool ReadCmdPath(int pid, std::string *cmdline) {
-  if (pid <= 0 || !cmdline)
-    return false;
+Process::~Process() {
+  delete impl_;
+}
 
-  char filename[PATH_MAX + 2] = {0};
-  snprintf(filename, sizeof(filename) - 1, "%s/%d/exe", kDirName, pid);
+ProcessesInterface *Process::EnumerateProcesses() {
+  impl_->process_table_.Update();
+  return new Processes(impl_->process_table_);
+}
 
-  char command[PATH_MAX + 2] = {0};
-  if (readlink(filename, command, sizeof(command) - 1) < 0) {
-    *cmdline = "";
-    return false;
-  }
+uint64_t Process::GetChanges(uint64_t since, std::vector<int> *added,
+                             std::vector<int> *removed) {
+  return impl_->process_table_.GetChanges(since, added, removed);
+}
 
-  for (int i = 0; command[i]; i++) {
-    if (command[i] == ' ' || command[i] == '\n') {
-      command[i] = 0;
-      break;
-    }
+ProcessInfoInterface *Process::GetInfo(int pid) {
+  std::string cmdline;
+  if (ReadProcessPath(pid, &cmdline)) {
+    return new ProcessInfo(pid, cmdline);
   }
-  *cmdline = std::string(command);
-
-  return true;
+  return NULL;
 }
 
 } // namespace linux_system
@@ -41,17 +41,17 @@ class ProcessInfo : public ProcessInfoInterface {
   std::string path_;
 };
 
+class ProcessTable;
+
 class Processes : public ProcessesInterface {
  public:
   Processes();
+  explicit Processes(const ProcessTable &table);
   virtual void Destroy();
 
   virtual int GetCount() const;
   virtual ProcessInfoInterface *GetItem(int index);
 
- private:
-  void InitProcesses();
-
  private:
   typedef std::pair<int, std::string> IntStringPair;
    std::vector<IntStringPair> procs_;
@@ -59,9 +59,19 @@ class Processes : public ProcessesInterface {
 
 class Process : public ProcessInterface {
  public:
+  Process();
+  virtual ~Process();
+
   virtual ProcessesInterface *EnumerateProcesses();
   virtual ProcessInfoInterface *GetForeground();
+  virtual Connection *ConnectOnForegroundChanged(Slot0<void> *slot);
   virtual ProcessInfoInterface *GetInfo(int pid);
+  virtual uint64_t GetChanges(uint64_t since, std::vector<int> *added,
+                              std::vector<int> *removed);
+
+ private:
+  class Impl;
+  Impl *impl_;
 };
 
 } // namespace linux_system
@@ -0,0 +1,543 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "process_table.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <ggadget/light_map.h>
+#include <ggadget/logger.h>
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+static const char kProcDir[] = "/proc";
+
+// A process may exec another program right after it's forked, so the path of
+// a process younger than this (in seconds) is read again in later updates,
+// unless exec events are reported by the proc connector.
+static const int kSettleTime = 2;
+
+// The max number of removed processes remembered for GetChanges().
+static const size_t kMaxRemovedProcesses = 4096;
+
+// Size of the receive buffer of the proc connector socket.
+static const int kProcConnectorBufferSize = 1024 * 1024;
+
+bool ReadProcessPath(int pid, std::string *path) {
+  if (pid <= 0 || !path)
+    return false;
+
+  char filename[PATH_MAX + 2] = {0};
+  snprintf(filename, sizeof(filename) - 1, "%s/%d/exe", kProcDir, pid);
+
+  char command[PATH_MAX + 2] = {0};
+  if (readlink(filename, command, sizeof(command) - 1) < 0) {
+    *path = "";
+    return false;
+  }
+
+  for (int i = 0; command[i]; i++) {
+    if (command[i] == ' ' || command[i] == '\n') {
+      command[i] = 0;
+      break;
+    }
+  }
+  *path = std::string(command);
+  return true;
+}
+
+void ReadProcesses(std::vector<std::pair<int, std::string> > *processes) {
+  processes->clear();
+  DIR *dir = opendir(kProcDir);
+  if (!dir)
+    return;
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char *end;
+    int pid = static_cast<int>(strtol(entry->d_name, &end, 10));
+    // if it is not a process folder, so skip it
+    if (pid <= 0 || *end)
+      continue;
+
+    std::string path;
+    if (ReadProcessPath(pid, &path) && !path.empty())
+      processes->push_back(std::make_pair(pid, path));
+  }
+  closedir(dir);
+}
+
+// Reads the start time of a process, in clock ticks since boot.
+static bool ReadStartTime(int pid, uint64_t *start_time) {
+  char filename[64];
+  snprintf(filename, sizeof(filename), "%s/%d/stat", kProcDir, pid);
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return false;
+  char buffer[1024];
+  ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+  close(fd);
+  if (size <= 0)
+    return false;
+  buffer[size] = 0;
+
+  // The command name in the second field may contain spaces, so count the
+  // fields from the last ')'. The start time is the 22nd field.
+  const char *p = strrchr(buffer, ')');
+  for (int field = 2; p && field < 22; field++) {
+    p = strchr(p + 1, ' ');
+  }
+  if (!p)
+    return false;
+  *start_time = strtoull(p + 1, NULL, 10);
+  return true;
+}
+
+// Reads the time since boot, in clock ticks.
+static uint64_t ReadUptime() {
+  FILE *fp = fopen("/proc/uptime", "r");
+  if (!fp)
+    return 0;
+  double uptime = 0;
+  if (fscanf(fp, "%lf", &uptime) != 1)
+    uptime = 0;
+  fclose(fp);
+  return static_cast<uint64_t>(uptime * static_cast<double>(
+      sysconf(_SC_CLK_TCK)));
+}
+
+class ProcessTable::Impl {
+ public:
+  struct Record {
+    uint64_t start_time;
+    // The inode number of the /proc/<pid> directory, or 0 if unknown.
+    ino_t inode;
+    // Empty for kernel threads, which are kept in the table only to avoid
+    // reading them again.
+    std::string path;
+    // The generation in which the record is added.
+    uint64_t generation;
+    // Whether the path needn't be read again.
+    bool settled;
+    // The serial number of the last scan which saw the process.
+    unsigned int scan_serial;
+  };
+
+  typedef LightMap<int, Record> RecordMap;
+  typedef std::deque<std::pair<uint64_t, int> > RemovedList;
+
+  Impl(bool use_proc_connector)
+      : generation_(1),
+        changed_(false),
+        removed_since_(0),
+        scanned_(false),
+        scan_serial_(0),
+        uptime_(0),
+        proc_connector_(-1),
+        proc_connector_acked_(false) {
+    if (use_proc_connector)
+      OpenProcConnector();
+  }
+
+  ~Impl() {
+    CloseProcConnector();
+  }
+
+  void Update() {
+    bool rescan = !scanned_ || proc_connector_ < 0;
+    if (proc_connector_ >= 0 && !ReadProcEvents())
+      rescan = true;
+    if (rescan)
+      Scan();
+    if (changed_) {
+      generation_++;
+      changed_ = false;
+    }
+  }
+
+  uint64_t GetChanges(uint64_t since, std::vector<int> *added,
+                      std::vector<int> *removed) {
+    Update();
+    if (since != 0 && since < removed_since_)
+      return 0;
+    for (RecordMap::const_iterator it = records_.begin();
+         it != records_.end(); ++it) {
+      if (it->second.generation > since && !it->second.path.empty())
+        added->push_back(it->first);
+    }
+    if (since != 0) {
+      RemovedList::const_iterator it = removed_.end();
+      while (it != removed_.begin() && (it - 1)->first > since)
+        --it;
+      for (; it != removed_.end(); ++it)
+        removed->push_back(it->second);
+    }
+    return generation_;
+  }
+
+  // Scans /proc and reads only the processes not in the table yet and the
+  // ones not settled. The start time of a known process is read only if the
+  // inode number of its directory changes, which happens if the id is reused,
+  // or if the inode is evicted from the cache of the kernel.
+  void Scan() {
+    DIR *dir = opendir(kProcDir);
+    if (!dir)
+      return;
+
+    scanned_ = true;
+    scan_serial_++;
+    uptime_ = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      char *end;
+      int pid = static_cast<int>(strtol(entry->d_name, &end, 10));
+      // if it is not a process folder, so skip it
+      if (pid <= 0 || *end)
+        continue;
+
+      RecordMap::iterator it = records_.find(pid);
+      if (it == records_.end()) {
+        it = AddProcess(pid, entry->d_ino);
+      } else {
+        if (it->second.inode != entry->d_ino) {
+          uint64_t start_time;
+          if (!ReadStartTime(pid, &start_time)) {
+            // The process has just exited.
+            continue;
+          }
+          if (start_time != it->second.start_time) {
+            // The process id is reused by a new process.
+            RemoveProcess(it);
+            it = AddProcess(pid, entry->d_ino);
+          } else {
+            it->second.inode = entry->d_ino;
+          }
+        }
+        if (it != records_.end() && !it->second.settled) {
+          std::string path;
+          ReadProcessPath(pid, &path);
+          SetProcessPath(it, path);
+          it->second.settled = IsSettled(it->second.start_time);
+        }
+      }
+      if (it != records_.end())
+        it->second.scan_serial = scan_serial_;
+    }
+    closedir(dir);
+
+    RecordMap::iterator it = records_.begin();
+    while (it != records_.end()) {
+      if (it->second.scan_serial == scan_serial_)
+        ++it;
+      else
+        RemoveProcess(it++);
+    }
+  }
+
+  bool IsSettled(uint64_t start_time) {
+    if (proc_connector_ >= 0)
+      return true;
+    if (!uptime_)
+      uptime_ = ReadUptime();
+    return uptime_ > start_time &&
+           uptime_ - start_time >=
+               static_cast<uint64_t>(kSettleTime * sysconf(_SC_CLK_TCK));
+  }
+
+  // Adds a process not in the table. Returns records_.end() if the process
+  // has exited.
+  RecordMap::iterator AddProcess(int pid, ino_t inode) {
+    Record record;
+    if (!ReadStartTime(pid, &record.start_time))
+      return records_.end();
+    record.inode = inode;
+    ReadProcessPath(pid, &record.path);
+    record.generation = generation_ + 1;
+    record.settled = IsSettled(record.start_time);
+    record.scan_serial = scan_serial_;
+    if (!record.path.empty())
+      changed_ = true;
+    return records_.insert(std::make_pair(pid, record)).first;
+  }
+
+  void RemoveProcess(RecordMap::iterator it) {
+    AddRemovedProcess(it);
+    records_.erase(it);
+  }
+
+  void AddRemovedProcess(RecordMap::iterator it) {
+    if (!it->second.path.empty()) {
+      changed_ = true;
+      removed_.push_back(std::make_pair(generation_ + 1, it->first));
+      if (removed_.size() > kMaxRemovedProcesses) {
+        removed_since_ = removed_.front().first;
+        removed_.pop_front();
+      }
+    }
+  }
+
+  // Updates the path of a process after exec. The process is reported as
+  // removed with the old path and added with the new one.
+  void SetProcessPath(RecordMap::iterator it, const std::string &path) {
+    if (path == it->second.path)
+      return;
+    AddRemovedProcess(it);
+    it->second.path = path;
+    it->second.generation = generation_ + 1;
+    if (!path.empty())
+      changed_ = true;
+  }
+
+  // Sends a multicast operation to the proc connector.
+  static bool SendProcConnectorOp(int fd, enum proc_cn_mcast_op op) {
+    union {
+      struct nlmsghdr header;
+      char data[NLMSG_SPACE(sizeof(struct cn_msg) +
+                            sizeof(enum proc_cn_mcast_op))];
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = static_cast<uint32_t>(
+        NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op)));
+    request.header.nlmsg_type = NLMSG_DONE;
+    struct cn_msg *message =
+        reinterpret_cast<struct cn_msg *>(NLMSG_DATA(&request.header));
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(enum proc_cn_mcast_op);
+    memcpy(message->data, &op, sizeof(op));
+    return send(fd, &request, request.header.nlmsg_len, 0) >= 0;
+  }
+
+  // Unsubscribes from the proc connector before closing the socket. The
+  // kernel counts the listeners and keeps broadcasting the events as long as
+  // any listener hasn't sent PROC_CN_MCAST_IGNORE.
+  void CloseProcConnector() {
+    if (proc_connector_ >= 0) {
+      SendProcConnectorOp(proc_connector_, PROC_CN_MCAST_IGNORE);
+      close(proc_connector_);
+      proc_connector_ = -1;
+    }
+  }
+
+  // Subscribes to the process events of the proc connector. The process
+  // table is then updated with the events instead of scanning /proc.
+  void OpenProcConnector() {
+    int fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR);
+    if (fd < 0)
+      return;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &kProcConnectorBufferSize,
+               sizeof(kProcConnectorBufferSize));
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+             sizeof(addr)) != 0) {
+      DLOG("Proc connector is not available: %s", strerror(errno));
+      close(fd);
+      return;
+    }
+
+    // The kernel handles the request and broadcasts the acknowledgement
+    // before send() returns.
+    proc_connector_ = fd;
+    proc_connector_acked_ = false;
+    if (!SendProcConnectorOp(fd, PROC_CN_MCAST_LISTEN) ||
+        !ReadProcEvents() || !proc_connector_acked_) {
+      DLOG("Failed to listen to proc connector events.");
+      CloseProcConnector();
+    }
+  }
+
+  // Reads the pending process events. Returns false if some events are lost.
+  bool ReadProcEvents() {
+    union {
+      struct nlmsghdr header;
+      char data[8192];
+    } buffer;
+    bool lost = false;
+    while (true) {
+      ssize_t size = recv(proc_connector_, &buffer, sizeof(buffer), 0);
+      if (size < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          return !lost;
+        if (errno == EINTR)
+          continue;
+        if (errno == ENOBUFS) {
+          // Reads the remaining events, and let the caller scan /proc.
+          DLOG("Proc connector events are lost.");
+          lost = true;
+          continue;
+        }
+        DLOG("Failed to read proc connector: %s", strerror(errno));
+        CloseProcConnector();
+        return false;
+      }
+
+      const char *p = buffer.data;
+      size_t remaining = static_cast<size_t>(size);
+      while (remaining >= sizeof(struct nlmsghdr)) {
+        const struct nlmsghdr *header =
+            reinterpret_cast<const struct nlmsghdr *>(p);
+        if (header->nlmsg_len < sizeof(struct nlmsghdr) ||
+            header->nlmsg_len > remaining)
+          break;
+        if (header->nlmsg_type == NLMSG_DONE &&
+            header->nlmsg_len >= NLMSG_LENGTH(sizeof(struct cn_msg))) {
+          const struct cn_msg *message =
+              reinterpret_cast<const struct cn_msg *>(NLMSG_DATA(header));
+          if (message->id.idx == CN_IDX_PROC &&
+              message->id.val == CN_VAL_PROC &&
+              header->nlmsg_len >=
+                  NLMSG_LENGTH(sizeof(struct cn_msg) + message->len)) {
+            HandleProcEvent(
+                reinterpret_cast<const struct proc_event *>(message->data),
+                message->len);
+          }
+        }
+        size_t length = NLMSG_ALIGN(header->nlmsg_len);
+        if (length >= remaining)
+          break;
+        p += length;
+        remaining -= length;
+      }
+    }
+  }
+
+  void HandleProcEvent(const struct proc_event *event, size_t size) {
+    // The size of proc_event differs among kernel versions, so only check
+    // the size of the used fields.
+    static const size_t kHeaderSize = offsetof(struct proc_event, event_data);
+    if (size < kHeaderSize)
+      return;
+    switch (event->what) {
+      case proc_event::PROC_EVENT_NONE:
+        if (size >= kHeaderSize + sizeof(event->event_data.ack) &&
+            event->event_data.ack.err == 0)
+          proc_connector_acked_ = true;
+        break;
+      case proc_event::PROC_EVENT_FORK:
+        // Ignore new threads and events before the first scan.
+        if (scanned_ && size >= kHeaderSize + sizeof(event->event_data.fork) &&
+            event->event_data.fork.child_pid ==
+                event->event_data.fork.child_tgid) {
+          int pid = event->event_data.fork.child_tgid;
+          RecordMap::iterator it = records_.find(pid);
+          uint64_t start_time;
+          if (it != records_.end()) {
+            // The process may have been found by the scan.
+            if (ReadStartTime(pid, &start_time) &&
+                start_time == it->second.start_time)
+              break;
+            RemoveProcess(it);
+          }
+          AddProcess(pid, 0);
+        }
+        break;
+      case proc_event::PROC_EVENT_EXEC:
+        if (scanned_ && size >= kHeaderSize + sizeof(event->event_data.exec)) {
+          int pid = event->event_data.exec.process_tgid;
+          RecordMap::iterator it = records_.find(pid);
+          if (it == records_.end()) {
+            AddProcess(pid, 0);
+          } else {
+            std::string path;
+            ReadProcessPath(pid, &path);
+            SetProcessPath(it, path);
+          }
+        }
+        break;
+      case proc_event::PROC_EVENT_EXIT:
+        if (scanned_ && size >= kHeaderSize + sizeof(event->event_data.exit) &&
+            event->event_data.exit.process_pid ==
+                event->event_data.exit.process_tgid) {
+          RecordMap::iterator it =
+              records_.find(event->event_data.exit.process_tgid);
+          if (it != records_.end())
+            RemoveProcess(it);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  RecordMap records_;
+  // The ids of the removed processes, with the generations in which they are
+  // removed.
+  RemovedList removed_;
+  uint64_t generation_;
+  bool changed_;
+  // The removed processes of this generation and before are forgotten.
+  uint64_t removed_since_;
+  bool scanned_;
+  unsigned int scan_serial_;
+  uint64_t uptime_;
+  int proc_connector_;
+  bool proc_connector_acked_;
+};
+
+ProcessTable::ProcessTable(bool use_proc_connector)
+    : impl_(new Impl(use_proc_connector)) {
+}
+
+ProcessTable::~ProcessTable() {
+  delete impl_;
+}
+
+void ProcessTable::Update() {
+  impl_->Update();
+}
+
+void ProcessTable::GetProcesses(std::vector<IntStringPair> *processes) const {
+  processes->clear();
+  for (Impl::RecordMap::const_iterator it = impl_->records_.begin();
+       it != impl_->records_.end(); ++it) {
+    if (!it->second.path.empty())
+      processes->push_back(IntStringPair(it->first, it->second.path));
+  }
+}
+
+uint64_t ProcessTable::GetChanges(uint64_t since, std::vector<int> *added,
+                                  std::vector<int> *removed) {
+  return impl_->GetChanges(since, added, removed);
+}
+
+bool ProcessTable::IsUsingProcConnector() const {
+  return impl_->proc_connector_ >= 0;
+}
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
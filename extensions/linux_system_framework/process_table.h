@@ -0,0 +1,106 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROCESS_TABLE_H__
+#define EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROCESS_TABLE_H__
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <ggadget/common.h>
+
+namespace ggadget {
+namespace framework {
+namespace linux_system {
+
+/**
+ * Reads the executable path of a process from /proc.
+ * @return @c false if the path can't be read, for example, of kernel threads.
+ */
+bool ReadProcessPath(int pid, std::string *path);
+
+/**
+ * Reads the ids and executable paths of the running processes from /proc
+ * once, without keeping a table. Kernel threads are skipped.
+ */
+void ReadProcesses(std::vector<std::pair<int, std::string> > *processes);
+
+/**
+ * A table of the running processes which is updated incrementally.
+ *
+ * Each process is recorded with its start time and executable path. When the
+ * table is updated, only the processes not in the table are read from /proc.
+ * The others are identified by the inode numbers of their /proc directories,
+ * which are returned by readdir() and change when the ids are reused.
+ * If the proc connector of netlink is available (normally it requires root
+ * privilege), the table is updated with its fork, exec and exit events, and
+ * /proc is scanned only if some events are lost.
+ *
+ * A process whose executable path is changed by exec is reported as both
+ * removed and added.
+ *
+ * Every update that changes the table increases the generation of the table,
+ * so that a client can get the processes added and removed since the
+ * generation it saw last time.
+ */
+class ProcessTable {
+ public:
+  /**
+   * @param use_proc_connector whether to use the proc connector if it's
+   *     available. If @c false, /proc is scanned in every update.
+   */
+  explicit ProcessTable(bool use_proc_connector = true);
+  ~ProcessTable();
+
+  typedef std::pair<int, std::string> IntStringPair;
+
+  /** Updates the table to the currently running processes. */
+  void Update();
+
+  /**
+   * Gets the ids and executable paths of the processes in the table, in the
+   * order of ids.
+   */
+  void GetProcesses(std::vector<IntStringPair> *processes) const;
+
+  /**
+   * Updates the table and gets the changes since a previous generation.
+   * @param since a generation returned by a previous call, or 0 to get all
+   *     processes as added ones.
+   * @param[out] added ids of processes added since @a since.
+   * @param[out] removed ids of processes removed since @a since. An id may be
+   *     in both lists if it is reused by a new process.
+   * @return the current generation, or 0 if the changes since @a since are
+   *     no longer remembered, in which case the client should get all the
+   *     processes instead.
+   */
+  uint64_t GetChanges(uint64_t since, std::vector<int> *added,
+                      std::vector<int> *removed);
+
+  /** Returns whether the table is updated with proc connector events. */
+  bool IsUsingProcConnector() const;
+
+ private:
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(ProcessTable);
+};
+
+} // namespace linux_system
+} // namespace framework
+} // namespace ggadget
+
+#endif // EXTENSIONS_LINUX_SYSTEM_FRAMEWORK_PROCESS_TABLE_H__
@@ -0,0 +1,118 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <stdio.h>
+#include <ggadget/common.h>
+#include <ggadget/logger.h>
+#include <ggadget/main_loop_interface.h>
+#include <ggadget/slot.h>
+#include "ggadget/tests/mocked_timer_main_loop.h"
+#include <unittest/gtest.h>
+#include "../network_statistics.h"
+#include "../proc_sampler.h"
+
+using namespace ggadget;
+using namespace ggadget::framework;
+using namespace ggadget::framework::linux_system;
+
+// The time base is not 0, which the samplers take as never sampled.
+static MockedTimerMainLoop g_main_loop(1000000);
+
+static int g_updates = 0;
+
+static void OnUpdate() {
+  ++g_updates;
+}
+
+// Advances the mocked time by count steps, so that each timer with the
+// interval of a step fires once per step.
+static void AdvanceTime(int step, int count) {
+  for (int i = 0; i < count; ++i)
+    g_main_loop.AdvanceTime(step);
+}
+
+static void CheckThroughput(NetworkStatistics *statistics) {
+  std::vector<std::string> names;
+  statistics->GetInterfaces(&names);
+  for (size_t i = 0; i < names.size(); ++i) {
+    NetworkStatisticsInterface::Throughput throughput;
+    ASSERT_TRUE(statistics->GetThroughput(names[i].c_str(), &throughput));
+    EXPECT_GE(throughput.rx_bytes, 0);
+    EXPECT_GE(throughput.tx_bytes, 0);
+    EXPECT_GE(throughput.rx_packets, 0);
+    EXPECT_GE(throughput.tx_packets, 0);
+    LOG("%s: rx %.1f bytes/s, tx %.1f bytes/s", names[i].c_str(),
+        throughput.rx_bytes, throughput.tx_bytes);
+  }
+}
+
+TEST(NetworkStatistics, GetThroughput) {
+  NetworkStatistics statistics;
+  CheckThroughput(&statistics);
+
+  NetworkStatisticsInterface::Throughput throughput;
+  EXPECT_FALSE(statistics.GetThroughput(NULL, &throughput));
+  EXPECT_FALSE(statistics.GetThroughput("no-such-interface", &throughput));
+}
+
+TEST(NetworkStatistics, AddListener) {
+  NetworkStatistics statistics;
+  EXPECT_EQ(-1, statistics.AddListener(false, NULL));
+
+  g_updates = 0;
+  int id = statistics.AddListener(false, NewSlot(OnUpdate));
+  EXPECT_GE(id, 0);
+  // Not called before the first sample interval elapses.
+  AdvanceTime(ProcSampler::kSampleInterval / 2, 1);
+  EXPECT_EQ(0, g_updates);
+  AdvanceTime(ProcSampler::kSampleInterval / 2, 1);
+  EXPECT_EQ(1, g_updates);
+  AdvanceTime(ProcSampler::kSampleInterval, 2);
+  EXPECT_EQ(3, g_updates);
+  CheckThroughput(&statistics);
+
+  statistics.RemoveListener(id);
+  AdvanceTime(ProcSampler::kSampleInterval, 2);
+  EXPECT_EQ(3, g_updates);
+}
+
+TEST(NetworkStatistics, HighFrequency) {
+  NetworkStatistics statistics;
+  g_updates = 0;
+  int slow_id = statistics.AddListener(false, NewSlot(OnUpdate));
+  int fast_id = statistics.AddListener(true, NewSlot(OnUpdate));
+  EXPECT_NE(slow_id, fast_id);
+
+  // Both listeners are called at the high frequency. At the normal
+  // frequency, they would not be called yet.
+  AdvanceTime(NetworkStatistics::kHighFrequencyInterval, 4);
+  EXPECT_EQ(8, g_updates);
+
+  // Back to the normal frequency.
+  statistics.RemoveListener(fast_id);
+  g_updates = 0;
+  AdvanceTime(NetworkStatistics::kHighFrequencyInterval, 3);
+  EXPECT_EQ(0, g_updates);
+  AdvanceTime(NetworkStatistics::kHighFrequencyInterval, 1);
+  EXPECT_EQ(1, g_updates);
+  statistics.RemoveListener(slow_id);
+}
+
+int main(int argc, char *argv[]) {
+  testing::ParseGTestFlags(&argc, argv);
+  SetGlobalMainLoop(&g_main_loop);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,181 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ggadget/common.h>
+#include <ggadget/logger.h>
+#include <ggadget/main_loop_interface.h>
+#include <ggadget/slot.h>
+#include <ggadget/string_utils.h>
+#include "ggadget/tests/native_main_loop.h"
+#include <unittest/gtest.h>
+#include "../proc_sampler.h"
+
+using namespace ggadget;
+using namespace ggadget::framework;
+using namespace ggadget::framework::linux_system;
+
+static NativeMainLoop g_main_loop;
+
+static const int kAllSources = ProcSampler::SOURCE_STAT |
+                               ProcSampler::SOURCE_MEMINFO |
+                               ProcSampler::SOURCE_NET_DEV;
+
+TEST(ProcSampler, Sample) {
+  const ProcSampler::Snapshot &snapshot =
+      ProcSampler::get()->Sample(kAllSources, 0);
+  EXPECT_GT(snapshot.stat_time, 0U);
+  EXPECT_GT(snapshot.meminfo_time, 0U);
+  EXPECT_GT(snapshot.net_dev_time, 0U);
+
+  EXPECT_GT(snapshot.cpu.GetTotalTime(), 0);
+  EXPECT_GE(snapshot.cpu.GetTotalTime(), snapshot.cpu.GetWorkTime());
+
+  EXPECT_GT(snapshot.mem_info[ProcSampler::MEM_TOTAL], 0);
+  EXPECT_GE(snapshot.mem_info[ProcSampler::MEM_TOTAL],
+            snapshot.mem_info[ProcSampler::MEM_FREE]);
+  EXPECT_GE(snapshot.mem_info[ProcSampler::SWAP_TOTAL],
+            snapshot.mem_info[ProcSampler::SWAP_FREE]);
+
+  for (size_t i = 0; i < snapshot.net_devs.size(); ++i) {
+    const ProcSampler::NetDevStat &dev = snapshot.net_devs[i];
+    EXPECT_FALSE(dev.name.empty());
+    EXPECT_TRUE(dev.name.find(':') == std::string::npos);
+    LOG("%s: rx %ju bytes, tx %ju bytes", dev.name.c_str(),
+        dev.rx_bytes, dev.tx_bytes);
+  }
+}
+
+TEST(ProcSampler, MaxAge) {
+  ProcSampler *sampler = ProcSampler::get();
+  size_t count = sampler->GetReadCount();
+  sampler->Sample(ProcSampler::SOURCE_STAT, 0);
+  EXPECT_EQ(count + 1, sampler->GetReadCount());
+
+  // The recent snapshot is shared.
+  sampler->Sample(ProcSampler::SOURCE_STAT, 60000);
+  EXPECT_EQ(count + 1, sampler->GetReadCount());
+
+  sampler->Sample(kAllSources, 0);
+  EXPECT_EQ(count + 4, sampler->GetReadCount());
+  sampler->Sample(kAllSources, 60000);
+  EXPECT_EQ(count + 4, sampler->GetReadCount());
+}
+
+static const ProcSampler::Snapshot *g_last_snapshot = NULL;
+
+class SampleCounter : public ProcSampler::SampleCallbackInterface {
+ public:
+  SampleCounter() : calls_(0), unsubscribe_id_(-1) { }
+  virtual void OnSample(const ProcSampler::Snapshot &snapshot) {
+    ++calls_;
+    // All subscribers get the same snapshot.
+    EXPECT_TRUE(g_last_snapshot == NULL || g_last_snapshot == &snapshot);
+    g_last_snapshot = &snapshot;
+    EXPECT_GT(snapshot.cpu.GetTotalTime(), 0);
+    EXPECT_GT(snapshot.mem_info[ProcSampler::MEM_TOTAL], 0);
+    if (unsubscribe_id_ >= 0) {
+      ProcSampler::get()->Unsubscribe(unsubscribe_id_);
+      unsubscribe_id_ = -1;
+    }
+  }
+  int calls_;
+  int unsubscribe_id_;
+};
+
+static bool QuitMainLoop(int watch_id) {
+  GGL_UNUSED(watch_id);
+  g_main_loop.Quit();
+  return false;
+}
+
+TEST(ProcSampler, Subscribe) {
+  ProcSampler *sampler = ProcSampler::get();
+  SampleCounter stat_counter, meminfo_counter;
+  int stat_id = sampler->Subscribe(ProcSampler::SOURCE_STAT, &stat_counter);
+  int meminfo_id = sampler->Subscribe(ProcSampler::SOURCE_MEMINFO,
+                                      &meminfo_counter);
+  EXPECT_GE(stat_id, 0);
+  EXPECT_GE(meminfo_id, 0);
+  EXPECT_NE(stat_id, meminfo_id);
+
+  size_t count = sampler->GetReadCount();
+  g_main_loop.AddTimeoutWatch(
+      ProcSampler::kSampleInterval * 3 / 2,
+      new WatchCallbackSlot(NewSlot(QuitMainLoop)));
+  g_main_loop.Run();
+  EXPECT_EQ(1, stat_counter.calls_);
+  EXPECT_EQ(1, meminfo_counter.calls_);
+  // Both subscribers share one read of each file.
+  EXPECT_EQ(count + 2, sampler->GetReadCount());
+
+  // A subscriber may unsubscribe another during the dispatching.
+  stat_counter.unsubscribe_id_ = meminfo_id;
+  meminfo_counter.unsubscribe_id_ = stat_id;
+  g_main_loop.AddTimeoutWatch(
+      ProcSampler::kSampleInterval,
+      new WatchCallbackSlot(NewSlot(QuitMainLoop)));
+  g_main_loop.Run();
+  EXPECT_EQ(3, stat_counter.calls_ + meminfo_counter.calls_);
+
+  sampler->Unsubscribe(stat_id);
+  sampler->Unsubscribe(meminfo_id);
+}
+
+// The old way to read /proc/meminfo, for comparison.
+static int64_t ReadMemTotalWithStdio() {
+  FILE *fp = fopen("/proc/meminfo", "r");
+  if (!fp)
+    return 0;
+  char line[1001];
+  int64_t total = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    std::string key, value;
+    if (!SplitString(line, ":", &key, &value))
+      continue;
+    if (TrimString(key) == "MemTotal")
+      total = strtoll(TrimString(value).c_str(), NULL, 10) * 1024;
+  }
+  fclose(fp);
+  return total;
+}
+
+TEST(ProcSampler, Benchmark) {
+  const int kRounds = 2000;
+  ProcSampler *sampler = ProcSampler::get();
+  clock_t start = clock();
+  for (int i = 0; i < kRounds; i++)
+    ASSERT_GT(ReadMemTotalWithStdio(), 0);
+  double stdio_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    ASSERT_GT(sampler->Sample(ProcSampler::SOURCE_MEMINFO, 0)
+              .mem_info[ProcSampler::MEM_TOTAL], 0);
+  }
+  double sampler_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  printf("Read /proc/meminfo: stdio %.3fus, sampler %.3fus\n",
+         stdio_time * 1000000 / kRounds, sampler_time * 1000000 / kRounds);
+}
+
+int main(int argc, char *argv[]) {
+  testing::ParseGTestFlags(&argc, argv);
+  SetGlobalMainLoop(&g_main_loop);
+  return RUN_ALL_TESTS();
+}
@@ -15,12 +15,18 @@
 */
 
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <algorithm>
 #include <ggadget/common.h>
 #include <ggadget/logger.h>
+#include <ggadget/slot.h>
 #include <unittest/gtest.h>
 #include "../process.h"
+#include "../process_table.h"
 
 using namespace ggadget;
 using namespace ggadget::framework;
@@ -41,6 +47,31 @@ TEST(Process, GetForeground) {
   ASSERT_TRUE(fore_process != NULL);
 }
 
+TEST(Process, GetForegroundRepeatedly) {
+  Process process;
+  ProcessInfoInterface *fore_process1 = process.GetForeground();
+  ProcessInfoInterface *fore_process2 = process.GetForeground();
+  // The foreground process is tracked on a connection kept by the process
+  // object, and doesn't change between the calls.
+  ASSERT_EQ(fore_process1 == NULL, fore_process2 == NULL);
+  if (fore_process1) {
+    EXPECT_EQ(fore_process1->GetProcessId(), fore_process2->GetProcessId());
+    fore_process1->Destroy();
+    fore_process2->Destroy();
+  }
+}
+
+static void OnForegroundChanged() {
+}
+
+TEST(Process, ConnectOnForegroundChanged) {
+  Process process;
+  // Without a main loop, the changes of the foreground process can't be
+  // tracked.
+  ASSERT_TRUE(process.ConnectOnForegroundChanged(
+      NewSlot(OnForegroundChanged)) == NULL);
+}
+
 TEST(Process, GetInfo) {
   pid_t pid = getpid();
   Process process;
@@ -109,6 +140,144 @@ TEST(ProcessInfo, GetProcessIdAndGetExecutablePath2) {
   proc->Destroy();
 }
 
+static bool Contains(const std::vector<int> &ids, int id) {
+  return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+TEST(ProcessTable, GetChanges) {
+  ProcessTable table;
+  LOG("Using proc connector: %d", table.IsUsingProcConnector());
+  std::vector<int> added, removed;
+  uint64_t generation = table.GetChanges(0, &added, &removed);
+  EXPECT_NE(0U, generation);
+  EXPECT_TRUE(Contains(added, getpid()));
+  EXPECT_TRUE(removed.empty());
+
+  pid_t child = fork();
+  if (child == 0) {
+    pause();
+    _exit(0);
+  }
+  ASSERT_GT(child, 0);
+  added.clear();
+  uint64_t generation1 = table.GetChanges(generation, &added, &removed);
+  EXPECT_GT(generation1, generation);
+  EXPECT_TRUE(Contains(added, child));
+  EXPECT_FALSE(Contains(added, getpid()));
+  EXPECT_TRUE(removed.empty());
+
+  std::vector<ProcessTable::IntStringPair> processes;
+  table.GetProcesses(&processes);
+  bool found = false;
+  for (size_t i = 0; i < processes.size(); i++) {
+    if (processes[i].first == child) {
+      std::string path;
+      ASSERT_TRUE(ReadProcessPath(getpid(), &path));
+      EXPECT_EQ(path, processes[i].second);
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+
+  kill(child, SIGKILL);
+  waitpid(child, NULL, 0);
+  added.clear();
+  uint64_t generation2 = table.GetChanges(generation1, &added, &removed);
+  EXPECT_GT(generation2, generation1);
+  EXPECT_FALSE(Contains(added, child));
+  EXPECT_TRUE(Contains(removed, child));
+
+  // Changes since an earlier generation include the later ones.
+  added.clear();
+  removed.clear();
+  EXPECT_EQ(generation2, table.GetChanges(generation, &added, &removed));
+  EXPECT_TRUE(Contains(removed, child));
+}
+
+static void TestExec(bool use_proc_connector) {
+  ProcessTable table(use_proc_connector);
+  std::vector<int> added, removed;
+  uint64_t generation = table.GetChanges(0, &added, &removed);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  pid_t child = fork();
+  if (child == 0) {
+    char c;
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    execl("/bin/sleep", "sleep", "10", NULL);
+    _exit(1);
+  }
+  ASSERT_GT(child, 0);
+  close(fds[0]);
+  added.clear();
+  generation = table.GetChanges(generation, &added, &removed);
+  EXPECT_TRUE(Contains(added, child));
+
+  // The process is reported as removed and added again after exec.
+  close(fds[1]);
+  std::string path;
+  for (int i = 0; i < 100; i++) {
+    usleep(10000);
+    if (ReadProcessPath(child, &path) && path.find("sleep") != path.npos)
+      break;
+  }
+  added.clear();
+  removed.clear();
+  uint64_t generation1 = table.GetChanges(generation, &added, &removed);
+  EXPECT_GT(generation1, generation);
+  EXPECT_TRUE(Contains(added, child));
+  EXPECT_TRUE(Contains(removed, child));
+  std::vector<ProcessTable::IntStringPair> processes;
+  table.GetProcesses(&processes);
+  for (size_t i = 0; i < processes.size(); i++) {
+    if (processes[i].first == child)
+      EXPECT_EQ(path, processes[i].second);
+  }
+
+  kill(child, SIGKILL);
+  waitpid(child, NULL, 0);
+}
+
+TEST(ProcessTable, Exec) {
+  TestExec(true);
+  TestExec(false);
+}
+
+TEST(ProcessTable, Benchmark) {
+  const int kRounds = 20;
+  clock_t start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    Processes processes;
+    ASSERT_GT(processes.GetCount(), 0);
+  }
+  double full_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  Process process;
+  process.EnumerateProcesses()->Destroy();
+  start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    ProcessesInterface *processes = process.EnumerateProcesses();
+    ASSERT_GT(processes->GetCount(), 0);
+    processes->Destroy();
+  }
+  double incremental_time =
+      static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  // Without the proc connector, /proc is scanned in every update.
+  ProcessTable table(false);
+  table.Update();
+  start = clock();
+  for (int i = 0; i < kRounds; i++)
+    table.Update();
+  double scan_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  printf("EnumerateProcesses: full scan %.3fms, incremental %.3fms, "
+         "incremental scan %.3fms\n",
+         full_time * 1000 / kRounds, incremental_time * 1000 / kRounds,
+         scan_time * 1000 / kRounds);
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
 
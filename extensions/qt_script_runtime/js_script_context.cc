@@ -19,7 +19,7 @@
 #include <ggadget/logger.h>
 #include <ggadget/slot.h>
 #include <ggadget/unicode_utils.h>
-#include <ggadget/js/jscript_massager.h>
+#include <ggadget/js/jscript_massager_cache.h>
 #include "js_script_context.h"
 #include "js_function_slot.h"
 #include "js_native_wrapper.h"
@@ -580,8 +580,8 @@ void JSScriptContext::Execute(const char *script,
   ScopedLogContext log_context(this);
   DLOG("Execute: (%s, %d)", filename, lineno);
 
-  std::string massaged_script = ggadget::js::MassageJScript(script, false,
-                                                            filename, lineno);
+  std::string massaged_script =
+      ggadget::js::MassageJScriptCached(script, filename, lineno);
   QScriptValue val = impl_->engine_.evaluate(
       QString::fromUtf8(massaged_script.c_str()), filename, lineno);
   if (impl_->engine_.hasUncaughtException()) {
@@ -593,6 +593,14 @@ void JSScriptContext::Execute(const char *script,
   }
 }
 
+// QScriptEngine can't share compiled scripts among engines, so only the
+// massaged script is shared, by MassageJScriptCached().
+void JSScriptContext::ExecuteShared(const char *script,
+                                    const char *filename,
+                                    int lineno) {
+  Execute(script, filename, lineno);
+}
+
 Slot *JSScriptContext::Compile(const char *script,
                                const char *filename,
                                int lineno) {
@@ -600,8 +608,8 @@ Slot *JSScriptContext::Compile(const char *script,
   DLOG("Compile: (%s, %d)", filename, lineno);
   DLOG("\t%s", script);
 
-  std::string massaged_script = ggadget::js::MassageJScript(script, false,
-                                                            filename, lineno);
+  std::string massaged_script =
+      ggadget::js::MassageJScriptCached(script, filename, lineno);
   return new JSFunctionSlot(NULL, &impl_->engine_, massaged_script.c_str(),
                             filename, lineno);
 }
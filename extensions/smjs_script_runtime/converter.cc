@@ -27,7 +27,7 @@
 #include <ggadget/scriptable_interface.h>
 #include <ggadget/string_utils.h>
 #include <ggadget/unicode_utils.h>
-#include <ggadget/js/jscript_massager.h>
+#include <ggadget/js/jscript_massager_cache.h>
 #include "js_function_slot.h"
 #include "js_native_wrapper.h"
 #include "js_script_context.h"
@@ -760,7 +760,7 @@ JSFunction *CompileFunction(JSContext *cx, const char *script,
   if (!script)
     return NULL;
 
-  std::string massaged_script = MassageJScript(script, false, filename, lineno);
+  std::string massaged_script = MassageJScriptCached(script, filename, lineno);
   UTF16String utf16_string;
   if (ConvertStringUTF8ToUTF16(massaged_script, &utf16_string) ==
       massaged_script.size()) {
@@ -776,12 +776,27 @@ JSFunction *CompileFunction(JSContext *cx, const char *script,
   }
 }
 
+JSScript *CompileScript(JSContext *cx, JSObject *object, const char *script,
+                        const char *filename, int lineno) {
+  if (!script)
+    return NULL;
+
+  std::string massaged_script = MassageJScriptCached(script, filename, lineno);
+  UTF16String utf16_string;
+  if (ConvertStringUTF8ToUTF16(massaged_script, &utf16_string) !=
+      massaged_script.size())
+    return NULL;
+  return JS_CompileUCScript(cx, object, utf16_string.c_str(),
+                            static_cast<uintN>(utf16_string.size()),
+                            filename, lineno);
+}
+
 JSBool EvaluateScript(JSContext *cx, JSObject *object, const char *script,
                       const char *filename, int lineno, jsval *rval) {
   if (!script)
     return JS_FALSE;
 
-  std::string massaged_script = MassageJScript(script, false, filename, lineno);
+  std::string massaged_script = MassageJScriptCached(script, filename, lineno);
   UTF16String utf16_string;
   if (ConvertStringUTF8ToUTF16(massaged_script, &utf16_string) ==
       massaged_script.size()) {
@@ -88,6 +88,14 @@ JSBool ConvertNativeToJS(JSContext* cx,
 JSFunction *CompileFunction(JSContext *cx, const char *script,
                             const char *filename, int lineno);
 
+/**
+ * Compiles a piece of script into <code>JSScript *</code> which can be
+ * executed later with JS_ExecuteScript(). Returns @c NULL if the script
+ * fails to compile or contains invalid UTF-8 sequences.
+ */
+JSScript *CompileScript(JSContext *cx, JSObject *object, const char *script,
+                        const char *filename, int lineno);
+
 /**
  * Compile and evaluate a piece of script.
  */
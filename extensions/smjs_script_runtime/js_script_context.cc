@@ -392,6 +392,21 @@ void JSScriptContext::Execute(const char *script,
                  filename, lineno, &rval);
 }
 
+void JSScriptContext::ExecuteShared(const char *script,
+                                    const char *filename,
+                                    int lineno) {
+  JSScript *shared_script = runtime_->GetSharedScript(script, filename, lineno);
+  jsval rval;
+  if (shared_script) {
+    JS_ExecuteScript(context_, JS_GetGlobalObject(context_), shared_script,
+                     &rval);
+  } else {
+    // EvaluateScript() also accepts scripts with invalid UTF-8 sequences.
+    EvaluateScript(context_, JS_GetGlobalObject(context_), script,
+                   filename, lineno, &rval);
+  }
+}
+
 Slot *JSScriptContext::Compile(const char *script,
                                const char *filename,
                                int lineno) {
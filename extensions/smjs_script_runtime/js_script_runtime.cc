@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <ggadget/logger.h>
 #include <ggadget/signals.h>
+#include "converter.h"
 #include "js_script_context.h"
 
 namespace ggadget {
@@ -47,8 +48,22 @@ static void *TriggerOperationCallbacksThread(void *data) {
 }
 #endif
 
+static void FinalizeSharedGlobal(JSContext *cx, JSObject *obj) {
+  GGL_UNUSED(cx);
+  GGL_UNUSED(obj);
+}
+
+// The class of the global object of the shared context.
+static JSClass g_shared_global_class = {
+  "SharedGlobal", 0,
+  JS_PropertyStub, JS_PropertyStub, JS_PropertyStub, JS_PropertyStub,
+  JS_EnumerateStub, JS_ResolveStub, JS_ConvertStub, FinalizeSharedGlobal,
+  JSCLASS_NO_OPTIONAL_MEMBERS
+};
+
 JSScriptRuntime::JSScriptRuntime()
-    : runtime_(JS_NewRuntime(kDefaultContextSize)) {
+    : runtime_(JS_NewRuntime(kDefaultContextSize)),
+      shared_context_(NULL) {
   ASSERT(runtime_);
   // Use the similar policy as Mozilla Gecko that unconstrains the runtime's
   // threshold on nominal heap size, to avoid triggering GC too often.
@@ -86,6 +101,10 @@ JSScriptRuntime::~JSScriptRuntime() {
     usleep(10000); // 10ms is enough for the thread to exit the hazard zone.
   }
 #endif
+  while (!shared_scripts_.empty())
+    RemoveSharedScript(shared_scripts_.begin());
+  if (shared_context_)
+    JS_DestroyContext(shared_context_);
   JS_DestroyRuntime(runtime_);
 }
 
@@ -102,5 +121,79 @@ void JSScriptRuntime::DestroyContext(JSScriptContext *context) {
   delete context;
 }
 
+JSContext *JSScriptRuntime::GetSharedContext() {
+  if (!shared_context_) {
+    JSContext *cx = JS_NewContext(runtime_, kDefaultStackTrunkSize);
+    if (!cx)
+      return NULL;
+    // The standard classes are needed to compile literals like regular
+    // expressions.
+    JSObject *global = JS_NewObject(cx, &g_shared_global_class, NULL, NULL);
+    if (!global) {
+      JS_DestroyContext(cx);
+      return NULL;
+    }
+    // The global object is rooted by the context from now on.
+    JS_SetGlobalObject(cx, global);
+    if (!JS_InitStandardClasses(cx, global)) {
+      JS_DestroyContext(cx);
+      return NULL;
+    }
+    shared_context_ = cx;
+  }
+  return shared_context_;
+}
+
+JSScript *JSScriptRuntime::GetSharedScript(const char *script,
+                                           const char *filename, int lineno) {
+  if (!script)
+    return NULL;
+
+  std::string key(filename ? filename : "");
+  SharedScriptMap::iterator it = shared_scripts_.find(key);
+  if (it != shared_scripts_.end()) {
+    if (it->second->source == script)
+      return it->second->script;
+    RemoveSharedScript(it);
+  }
+
+  JSContext *cx = GetSharedContext();
+  if (!cx)
+    return NULL;
+
+  // Our contexts don't set JSOPTION_COMPILE_N_GO, so the compiled script is
+  // not bound to the global object of cx and can run in other contexts.
+  // Compilation errors are not reported here, because the caller will then
+  // evaluate the script in its own context, which reports them.
+  JSScript *compiled = CompileScript(cx, JS_GetGlobalObject(cx), script,
+                                     filename, lineno);
+  if (!compiled) {
+    JS_ClearPendingException(cx);
+    return NULL;
+  }
+
+  // The script object owns the script and destroys it when finalized.
+  JSObject *script_object = JS_NewScriptObject(cx, compiled);
+  if (!script_object) {
+    JS_DestroyScript(cx, compiled);
+    return NULL;
+  }
+
+  SharedScript *shared = new SharedScript;
+  shared->source = script;
+  shared->script = compiled;
+  shared->script_object = script_object;
+  JS_AddNamedRootRT(runtime_, &shared->script_object, "SharedScript");
+  shared_scripts_[key] = shared;
+  DLOG("Compiled shared script %s", key.c_str());
+  return compiled;
+}
+
+void JSScriptRuntime::RemoveSharedScript(SharedScriptMap::iterator it) {
+  JS_RemoveRootRT(runtime_, &it->second->script_object);
+  delete it->second;
+  shared_scripts_.erase(it);
+}
+
 } // namespace smjs
 } // namespace ggadget
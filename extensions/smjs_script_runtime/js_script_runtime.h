@@ -17,6 +17,8 @@
 #ifndef EXTENSIONS_SMJS_SCRIPT_RUNTIME_JS_SCRIPT_RUNTIME_H__
 #define EXTENSIONS_SMJS_SCRIPT_RUNTIME_JS_SCRIPT_RUNTIME_H__
 
+#include <string>
+#include <ggadget/light_map.h>
 #include <ggadget/script_runtime_interface.h>
 #include "libmozjs_glue.h"
 
@@ -38,9 +40,37 @@ class JSScriptRuntime : public ScriptRuntimeInterface {
 
   void DestroyContext(JSScriptContext *context);
 
+  /**
+   * Gets the compiled script shared by all contexts of this runtime for
+   * @a filename. The script is compiled on the first call, or when @a script
+   * is different from the source of the compiled script. The compiled script
+   * is owned by the runtime, and is compiled against a global object of the
+   * runtime's own, so that it doesn't keep any gadget's global alive.
+   * @return @c NULL if the script can't be compiled.
+   */
+  JSScript *GetSharedScript(const char *script, const char *filename,
+                            int lineno);
+
  private:
   DISALLOW_EVIL_CONSTRUCTORS(JSScriptRuntime);
+
+  struct SharedScript {
+    std::string source;
+    JSScript *script;
+    // Rooted to keep the script and the objects it contains from being
+    // collected between executions.
+    JSObject *script_object;
+  };
+  typedef LightMap<std::string, SharedScript *> SharedScriptMap;
+
+  JSContext *GetSharedContext();
+  void RemoveSharedScript(SharedScriptMap::iterator it);
+
   JSRuntime *runtime_;
+  // The context in which the shared scripts are compiled. It's created on
+  // demand and isn't associated with any JSScriptContext.
+  JSContext *shared_context_;
+  SharedScriptMap shared_scripts_;
 };
 
 // The maximum execution time of a piece of script (10 seconds).
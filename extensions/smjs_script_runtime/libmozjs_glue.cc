@@ -92,6 +92,7 @@ namespace libmozjs {
 #undef JS_NewContext
 #undef JS_NewDouble
 #undef JS_NewObject
+#undef JS_NewScriptObject
 #undef JS_Init
 #undef JS_NewString
 #undef JS_NewStringCopyN
@@ -94,6 +94,7 @@ MOZJS_API(JSObject *, JS_NewArrayObject, (JSContext *cx, jsint length, jsval *ve
 MOZJS_API(JSContext *, JS_NewContext, (JSRuntime *rt, size_t stackChunkSize));
 MOZJS_API(jsdouble *, JS_NewDouble, (JSContext *cx, jsdouble d));
 MOZJS_API(JSObject *, JS_NewObject, (JSContext *cx, JSClass *clasp, JSObject *proto, JSObject *parent));
+MOZJS_API(JSObject *, JS_NewScriptObject, (JSContext *cx, JSScript *script));
 MOZJS_API(JSRuntime *, JS_Init, (uint32 maxbytes));
 MOZJS_API(JSString *, JS_NewString, (JSContext *cx, char *bytes, size_t length));
 MOZJS_API(JSString *, JS_NewStringCopyN, (JSContext *cx, const char *s, size_t n));
@@ -205,6 +206,7 @@ MOZJS_API(void, JS_SetOperationCallback, (JSContext *cx, JSOperationCallback cal
   MOZJS_FUNC(JS_NewContext) \
   MOZJS_FUNC(JS_NewDouble) \
   MOZJS_FUNC(JS_NewObject) \
+  MOZJS_FUNC(JS_NewScriptObject) \
   MOZJS_FUNC(JS_Init) \
   MOZJS_FUNC(JS_NewString) \
   MOZJS_FUNC(JS_NewStringCopyN) \
@@ -308,6 +310,7 @@ MOZJS_FUNCTIONS
 #define JS_NewContext ggadget::libmozjs::JS_NewContext.func
 #define JS_NewDouble ggadget::libmozjs::JS_NewDouble.func
 #define JS_NewObject ggadget::libmozjs::JS_NewObject.func
+#define JS_NewScriptObject ggadget::libmozjs::JS_NewScriptObject.func
 #define JS_Init ggadget::libmozjs::JS_Init.func
 #define JS_NewString ggadget::libmozjs::JS_NewString.func
 #define JS_NewStringCopyN ggadget::libmozjs::JS_NewStringCopyN.func
@@ -152,6 +152,47 @@ TEST(CrossContext, Test) {
   delete runtime;
 }
 
+TEST(CrossContext, SharedScript) {
+  JSScriptRuntime *runtime = new JSScriptRuntime();
+  ScriptContextInterface *context1 = runtime->CreateContext();
+  ScriptContextInterface *context2 = runtime->CreateContext();
+  Scriptable1 *native_global1 = new Scriptable1();
+  Scriptable1 *native_global2 = new Scriptable1();
+  context1->SetGlobalObject(native_global1);
+  context2->SetGlobalObject(native_global2);
+
+  // The script is compiled once in the shared global of the runtime, but the
+  // literals and functions get the prototypes of the executing context.
+  const char *kScript =
+      "var re = /a+/g; var obj = {}; var arr = [1]; function f() {}";
+  context1->ExecuteShared(kScript, "shared.js", 1);
+  context1->Evaluate(NULL,
+      "RegExp.prototype.tag = 1; Object.prototype.tag = 1;"
+      "Array.prototype.tag = 1; Function.prototype.tag = 1;");
+  context2->ExecuteShared(kScript, "shared.js", 1);
+  const char *kCheck =
+      "re instanceof RegExp && obj instanceof Object && arr instanceof Array &&"
+      "f instanceof Function && re.__proto__ === RegExp.prototype &&"
+      "obj.__proto__ === Object.prototype && arr.__proto__ === Array.prototype";
+  EXPECT_EQ(Variant(true), context1->Evaluate(NULL, kCheck));
+  EXPECT_EQ(Variant(true), context2->Evaluate(NULL, kCheck));
+  EXPECT_EQ(Variant(true), context1->Evaluate(NULL,
+      "re.tag == 1 && obj.tag == 1 && arr.tag == 1 && f.tag == 1"));
+  EXPECT_EQ(Variant(true), context2->Evaluate(NULL,
+      "re.tag === undefined && obj.tag === undefined &&"
+      "arr.tag === undefined && f.tag === undefined"));
+
+  // Each context has its own regexp object with its own lastIndex.
+  context1->Evaluate(NULL, "re.exec('aa')");
+  EXPECT_EQ(Variant(0), context2->Evaluate(NULL, "re.lastIndex"));
+
+  context1->Destroy();
+  context2->Destroy();
+  delete native_global1;
+  delete native_global2;
+  delete runtime;
+}
+
 int main(int argc, char *argv[]) {
 #ifdef XPCOM_GLUE
   if (!ggadget::libmozjs::LibmozjsGlueStartup()) {
@@ -24,7 +24,7 @@
 #include <ggadget/string_utils.h>
 #include <ggadget/unicode_utils.h>
 #include <ggadget/variant.h>
-#include <ggadget/js/jscript_massager.h>
+#include <ggadget/js/jscript_massager_cache.h>
 #include "js_script_context.h"
 #include "json.h"
 
@@ -754,7 +754,7 @@ JSObjectRef CompileFunction(JSScriptContext *ctx, const char *script,
   if (!script)
     return NULL;
 
-  std::string massaged_script = MassageJScript(script, false, filename, lineno);
+  std::string massaged_script = MassageJScriptCached(script, filename, lineno);
   JSStringRef js_script =
       JSStringCreateWithUTF8CString(massaged_script.c_str());
   JSStringRef src_url =
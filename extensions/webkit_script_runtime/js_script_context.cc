@@ -29,7 +29,7 @@
 #include <ggadget/scoped_ptr.h>
 #include <ggadget/light_map.h>
 #include <ggadget/main_loop_interface.h>
-#include <ggadget/js/jscript_massager.h>
+#include <ggadget/js/jscript_massager_cache.h>
 #include "js_script_runtime.h"
 #include "converter.h"
 #include "json.h"
@@ -905,7 +905,7 @@ class JSScriptContext::Impl : public SmallObject<> {
 #endif
     ASSERT(script && *script);
     std::string massaged_script =
-        ggadget::js::MassageJScript(script, false, filename, lineno);
+        ggadget::js::MassageJScriptCached(script, filename, lineno);
     JSStringRef js_script =
         JSStringCreateWithUTF8CString(massaged_script.c_str());
     JSStringRef source_url = NULL;
@@ -1567,7 +1567,7 @@ class JSScriptContext::Impl : public SmallObject<> {
 
     if (expr && *expr) {
       std::string massaged_script =
-          ggadget::js::MassageJScript(expr, false, NULL, 0);
+          ggadget::js::MassageJScriptCached(expr, NULL, 0);
       JSStringRef js_script =
           JSStringCreateWithUTF8CString(massaged_script.c_str());
       JSValueRef exception = NULL;
@@ -2329,6 +2329,15 @@ void JSScriptContext::Execute(const char *script,
   impl_->Execute(script, filename, lineno);
 }
 
+// JavaScriptCore has no public API to run a compiled script in other
+// contexts, so only the massaged script is shared, by
+// MassageJScriptCached().
+void JSScriptContext::ExecuteShared(const char *script,
+                                    const char *filename,
+                                    int lineno) {
+  Execute(script, filename, lineno);
+}
+
 Slot *JSScriptContext::Compile(const char *script,
                                const char *filename,
                                int lineno) {
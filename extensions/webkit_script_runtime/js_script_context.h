@@ -49,6 +49,10 @@ class JSScriptContext : public ScriptContextInterface {
   virtual void Execute(const char *script,
                        const char *filename,
                        int lineno);
+  /** @see ScriptContextInterface::ExecuteShared() */
+  virtual void ExecuteShared(const char *script,
+                             const char *filename,
+                             int lineno);
 
   /** @see ScriptContextInterface::Compile() */
   virtual Slot *Compile(const char *script,
@@ -596,7 +596,7 @@ class BasicElement::Impl : public SmallObject<> {
           target = cache_;
           target->PushState();
         } else {
-          target = view_->GetGraphics()->NewCanvas(width, height);
+          target = view_->GetGraphics()->NewScratchCanvas(width, height);
           force_draw = true;
         }
       }
@@ -645,7 +645,8 @@ class BasicElement::Impl : public SmallObject<> {
         else
           canvas->DrawCanvas(offset_x, offset_y, target);
 
-        // Don't destroy canvas cache.
+        // Don't destroy canvas cache. Destroying a scratch canvas may return
+        // it to the graphics for the next draw.
         if (cache_ != target)
           target->Destroy();
         else
@@ -803,21 +804,32 @@ class BasicElement::Impl : public SmallObject<> {
       view_->PostElementSizeEvent(owner_, onsize_event_);
   }
 
+  // The siblings' hit-test index depends on the geometry of this element.
+  void InvalidateHitTestIndex() {
+    Elements *siblings = parent_ ? parent_->GetChildren() :
+                         view_->GetChildren();
+    if (siblings)
+      siblings->InvalidateHitTestIndex();
+  }
+
   void PositionChanged() {
     position_changed_ = true;
     draw_queued_ = false;
+    InvalidateHitTestIndex();
     QueueDraw();
   }
 
   void WidthChanged() {
     size_changed_ = true;
     draw_queued_ = false;
+    InvalidateHitTestIndex();
     QueueDraw();
   }
 
   void HeightChanged() {
     size_changed_ = true;
     draw_queued_ = false;
+    InvalidateHitTestIndex();
     QueueDraw();
   }
 
@@ -2141,6 +2153,12 @@ void BasicElement::SelfCoordToChildCoord(const BasicElement *child,
     *child_y = child->GetPixelHeight() - *child_y;
 }
 
+void BasicElement::GetScrollOffset(double *x, double *y) const {
+  ASSERT(x && y);
+  *x = 0;
+  *y = 0;
+}
+
 void BasicElement::ChildCoordToSelfCoord(const BasicElement *child,
                                          double x, double y,
                                          double *self_x,
@@ -601,6 +601,17 @@ class BasicElement: public ScriptableHelperNativeOwnedDefault {
                                      double x, double y,
                                      double *self_x, double *self_y) const;
 
+  /**
+   * Gets the distance by which the children of this element are scrolled.
+   *
+   * The default implementation returns 0. BasicElement implementation should
+   * override this method if it supports scrolling.
+   *
+   * @param[out] x the horizontal scroll offset, in pixels.
+   * @param[out] y the vertical scroll offset, in pixels.
+   */
+  virtual void GetScrollOffset(double *x, double *y) const;
+
   /**
    * Converts coordinates in this element's space to coordinates in its
    * parent element or the view if it has no parent.
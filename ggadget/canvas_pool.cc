@@ -0,0 +1,117 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <list>
+#include "canvas_pool.h"
+#include "canvas_interface.h"
+
+namespace ggadget {
+
+class CanvasPool::Impl {
+ public:
+  struct Entry {
+    CanvasInterface *canvas;
+    size_t bytes;
+  };
+  // The most recently returned canvas first.
+  typedef std::list<Entry> Entries;
+
+  Impl(size_t max_bytes)
+      : max_bytes_(max_bytes), retained_bytes_(0),
+        reuse_count_(0), miss_count_(0) {
+  }
+
+  ~Impl() {
+    Trim(0);
+  }
+
+  CanvasInterface *Get(double w, double h) {
+    for (Entries::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+      CanvasInterface *canvas = it->canvas;
+      if (canvas->GetWidth() == w && canvas->GetHeight() == h) {
+        retained_bytes_ -= it->bytes;
+        entries_.erase(it);
+        canvas->ClearCanvas();
+        ++reuse_count_;
+        return canvas;
+      }
+    }
+    ++miss_count_;
+    return NULL;
+  }
+
+  bool Put(CanvasInterface *canvas, size_t bytes) {
+    if (bytes > max_bytes_)
+      return false;
+    Trim(max_bytes_ - bytes);
+    Entry entry = { canvas, bytes };
+    entries_.push_front(entry);
+    retained_bytes_ += bytes;
+    return true;
+  }
+
+  // Destroys the least recently returned canvases until the idle canvases
+  // use no more than max_bytes.
+  void Trim(size_t max_bytes) {
+    while (retained_bytes_ > max_bytes && !entries_.empty()) {
+      CanvasInterface *canvas = entries_.back().canvas;
+      retained_bytes_ -= entries_.back().bytes;
+      entries_.pop_back();
+      canvas->Destroy();
+    }
+  }
+
+  size_t max_bytes_;
+  size_t retained_bytes_;
+  size_t reuse_count_;
+  size_t miss_count_;
+  Entries entries_;
+};
+
+CanvasPool::CanvasPool(size_t max_bytes)
+    : impl_(new Impl(max_bytes)) {
+}
+
+CanvasPool::~CanvasPool() {
+  delete impl_;
+  impl_ = NULL;
+}
+
+CanvasInterface *CanvasPool::Get(double w, double h) {
+  return impl_->Get(w, h);
+}
+
+bool CanvasPool::Put(CanvasInterface *canvas, size_t bytes) {
+  return impl_->Put(canvas, bytes);
+}
+
+void CanvasPool::Clear() {
+  impl_->Trim(0);
+}
+
+size_t CanvasPool::GetRetainedBytes() const {
+  return impl_->retained_bytes_;
+}
+
+size_t CanvasPool::GetReuseCount() const {
+  return impl_->reuse_count_;
+}
+
+size_t CanvasPool::GetMissCount() const {
+  return impl_->miss_count_;
+}
+
+} // namespace ggadget
@@ -0,0 +1,82 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef GGADGET_CANVAS_POOL_H__
+#define GGADGET_CANVAS_POOL_H__
+
+#include <ggadget/common.h>
+
+namespace ggadget {
+
+class CanvasInterface;
+
+/**
+ * @ingroup Utilities
+ * A pool of idle scratch canvases, used by GraphicsInterface implementations
+ * to recycle the canvases for short-lived offscreen drawing instead of
+ * allocating and freeing a surface every time.
+ *
+ * Idle canvases are bucketed by their exact size. If the idle canvases use
+ * more memory than the limit, the least recently returned ones are destroyed.
+ */
+class CanvasPool {
+ public:
+  /** @param max_bytes Maximum bytes retained by the idle canvases. */
+  explicit CanvasPool(size_t max_bytes);
+
+  /** Destroys all idle canvases. */
+  ~CanvasPool();
+
+  /**
+   * Takes an idle canvas with the specified size out of the pool.
+   * The canvas is cleared before being returned.
+   * @return NULL if there is no such canvas. The caller should then create a
+   *     new one and return it with Put() when done.
+   */
+  CanvasInterface *Get(double w, double h);
+
+  /**
+   * Returns a canvas to the pool.
+   * @param canvas The canvas to be kept. When evicted, it will be destroyed
+   *     by calling its Destroy(), which must then really free the canvas
+   *     instead of returning it to the pool again.
+   * @param bytes The memory used by the canvas.
+   * @return false if the canvas is too large to be kept, and the caller
+   *     should delete it.
+   */
+  bool Put(CanvasInterface *canvas, size_t bytes);
+
+  /** Destroys all idle canvases. */
+  void Clear();
+
+  /** Gets the bytes retained by the idle canvases. */
+  size_t GetRetainedBytes() const;
+
+  /** Gets the number of canvases served by Get(). */
+  size_t GetReuseCount() const;
+
+  /** Gets the number of times Get() found no idle canvas. */
+  size_t GetMissCount() const;
+
+ private:
+  class Impl;
+  Impl *impl_;
+  DISALLOW_EVIL_CONSTRUCTORS(CanvasPool);
+};
+
+} // namespace ggadget
+
+#endif // GGADGET_CANVAS_POOL_H__
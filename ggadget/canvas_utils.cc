@@ -87,7 +87,8 @@ static void TileDrawCanvasArea(const CanvasInterface *src,
     dest->DrawCanvas(dest_x - src_x, dest_y - src_y, src);
     dest->PopState();
   } else {
-    CanvasInterface* temp_canvas = graphics->NewCanvas(src_width, src_height);
+    CanvasInterface* temp_canvas =
+        graphics->NewScratchCanvas(src_width, src_height);
     temp_canvas->DrawCanvas(-src_x, -src_y, src);
     dest->DrawFilledRectWithCanvas(dest_x, dest_y, dest_width, dest_height,
                                    temp_canvas);
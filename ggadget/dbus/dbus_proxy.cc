@@ -41,6 +41,10 @@ limitations under the License.
 namespace ggadget {
 namespace dbus {
 
+// Time in milliseconds to keep a bus connection after its last proxy is
+// deleted.
+static const int kIdleBusTimeout = 5000;
+
 class DBusProxy::Impl : public SmallObject<> {
   // Structure to hold information of an argument.
   struct ArgPrototype {
@@ -68,8 +72,27 @@ class DBusProxy::Impl : public SmallObject<> {
   };
   typedef LightMap<std::string, PropertyPrototype> PropertyPrototypeMap;
 
+  // Structure to hold information of an interface.
+  struct InterfacePrototype {
+    MethodSignalPrototypeMap methods;
+    MethodSignalPrototypeMap signals;
+    PropertyPrototypeMap properties;
+  };
+  typedef LightMap<std::string, InterfacePrototype> InterfacePrototypeMap;
+
+  // Structure to hold the parsed introspect data of a remote object.
+  // interface_names keeps the order of interfaces in the introspect data.
+  struct ObjectPrototype {
+    InterfacePrototypeMap interfaces;
+    StringVector interface_names;
+    StringVector children;
+  };
+
   typedef LightMap<int, DBusPendingCall *> PendingCallMap;
 
+  class Batch;
+  typedef LightMap<int, Batch *> BatchMap;
+
   // Class to hold owner<->names mapping information.
   class OwnerNamesCache {
    public:
@@ -192,9 +215,11 @@ class DBusProxy::Impl : public SmallObject<> {
         bus_(NULL),
         main_loop_closure_(NULL),
         bus_proxy_(NULL),
+        idle_watch_(0),
         destroying_(false) {
     }
     ~Manager() {
+      RemoveIdleWatch();
       ASSERT(proxies_.size() == 0);
       if (proxies_.size()) {
         LOGW("%zu DBusProxy objects are still available when destroying"
@@ -237,6 +262,7 @@ class DBusProxy::Impl : public SmallObject<> {
       }
 
       if (EnsureInitialized()) {
+        RemoveIdleWatch();
         std::string tri_name = GetTriName(name, path, interface);
         ProxyMap::iterator it = proxies_.find(tri_name);
         if (it != proxies_.end()) {
@@ -288,9 +314,19 @@ class DBusProxy::Impl : public SmallObject<> {
           delete impl;
           proxies_.erase(it);
           if (proxies_.size() == 0) {
-            DLOG("No proxy left, destroy %s bus.", GetTypeName());
             // No more proxy, destroy the connection to save resource.
-            Destroy();
+            // Keep it for a while if possible, so that the cached introspect
+            // data can be reused by proxies created again soon.
+            MainLoopInterface *main_loop = GetGlobalMainLoop();
+            if (main_loop && !idle_watch_) {
+              idle_watch_ = main_loop->AddTimeoutWatch(
+                  kIdleBusTimeout,
+                  new WatchCallbackSlot(NewSlot(this, &Manager::OnIdle)));
+            }
+            if (!idle_watch_) {
+              DLOG("No proxy left, destroy %s bus.", GetTypeName());
+              Destroy();
+            }
           }
           return true;
         } else {
@@ -368,6 +404,8 @@ class DBusProxy::Impl : public SmallObject<> {
         // Existing proxies can be reused when dbus connection is
         // established again.
         owner_names_.Clear();
+        // Owner changes can't be tracked without the connection.
+        prototypes_.clear();
         delete main_loop_closure_;
         // Bus must be closed before unref.
         dbus_connection_close(bus_);
@@ -380,7 +418,50 @@ class DBusProxy::Impl : public SmallObject<> {
       }
     }
 
+    // Returns the cached introspect data of an object, or NULL if it's not
+    // available.
+    const ObjectPrototype *GetPrototype(const std::string &name,
+                                        const std::string &path) const {
+      PrototypeMap::const_iterator it =
+          prototypes_.find(GetBiName(name, path));
+      return it != prototypes_.end() ? &it->second : NULL;
+    }
+    void CachePrototype(const std::string &name, const std::string &path,
+                        const ObjectPrototype &proto) {
+      if (bus_ && !destroying_)
+        prototypes_[GetBiName(name, path)] = proto;
+    }
+
    private:
+    // Removes cached introspect data of all objects owned by a name.
+    void RemovePrototypes(const std::string &name) {
+      std::string prefix = name + "|";
+      PrototypeMap::iterator it = prototypes_.lower_bound(prefix);
+      while (it != prototypes_.end() &&
+             it->first.compare(0, prefix.size(), prefix) == 0) {
+        prototypes_.erase(it++);
+      }
+    }
+
+    bool OnIdle(int watch_id) {
+      GGL_UNUSED(watch_id);
+      idle_watch_ = 0;
+      if (proxies_.size() == 0) {
+        DLOG("No proxy left, destroy %s bus.", GetTypeName());
+        Destroy();
+      }
+      return false;
+    }
+
+    void RemoveIdleWatch() {
+      if (idle_watch_) {
+        MainLoopInterface *main_loop = GetGlobalMainLoop();
+        if (main_loop)
+          main_loop->RemoveWatch(idle_watch_);
+        idle_watch_ = 0;
+      }
+    }
+
     Impl *GetBusProxy() {
       if (EnsureInitialized()) {
         if (!bus_proxy_) {
@@ -451,6 +532,9 @@ class DBusProxy::Impl : public SmallObject<> {
     void NameOwnerChanged(const char *name, const char *old_owner,
                           const char *new_owner) {
       GGL_UNUSED(old_owner);
+      // The objects of the name may be totally different now, so the cached
+      // introspect data must be removed before notifying the proxies.
+      RemovePrototypes(name);
       // Don't monitor owner names.
       if (name[0] == ':') return;
 #ifdef DBUS_VERBOSE_LOG
@@ -506,6 +590,15 @@ class DBusProxy::Impl : public SmallObject<> {
       return tri_name;
     }
 
+    static std::string GetBiName(const std::string &name,
+                                 const std::string &path) {
+      std::string bi_name;
+      bi_name.append(name);
+      bi_name.append("|");
+      bi_name.append(path);
+      return bi_name;
+    }
+
     static DBusHandlerResult BusFilter(DBusConnection *bus,
                                        DBusMessage *message,
                                        void *user_data) {
@@ -565,12 +658,18 @@ class DBusProxy::Impl : public SmallObject<> {
     ProxyMap proxies_;
     OwnerNamesCache owner_names_;
 
+    // Introspect data of remote objects, keyed by name and path.
+    typedef LightMap<std::string, ObjectPrototype> PrototypeMap;
+    PrototypeMap prototypes_;
+
     DBusBusType type_;
     DBusConnection *bus_;
     DBusMainLoopClosure *main_loop_closure_;
 
     // Special proxy to retrieve a name's owner.
     Impl *bus_proxy_;
+    // Watch to destroy the connection after the last proxy is gone.
+    int idle_watch_;
     bool destroying_;
   };
 
@@ -583,7 +682,8 @@ class DBusProxy::Impl : public SmallObject<> {
       interface_(interface),
       on_name_owner_changed_connection_(NULL),
       refcount_(1),
-      call_id_counter_(1) {
+      call_id_counter_(1),
+      reset_watch_(0) {
   }
   ~Impl() {
     CancelAllPendingCalls();
@@ -626,12 +726,43 @@ class DBusProxy::Impl : public SmallObject<> {
   }
 
   void CancelAllPendingCalls() {
+    // Batches will be freed along with their pending calls.
+    batches_.clear();
     PendingCallMap::iterator it = pending_calls_.begin();
     for (; it != pending_calls_.end(); ++it) {
       dbus_pending_call_cancel(it->second);
       dbus_pending_call_unref(it->second);
     }
     pending_calls_.clear();
+    RemoveResetWatch();
+  }
+
+  // Emits on_reset_ in the main loop, as if the introspect data were
+  // received asynchronously.
+  void ScheduleReset() {
+    MainLoopInterface *main_loop = GetGlobalMainLoop();
+    if (!main_loop) {
+      on_reset_();
+    } else if (!reset_watch_) {
+      reset_watch_ = main_loop->AddTimeoutWatch(
+          0, new WatchCallbackSlot(NewSlot(this, &Impl::OnResetWatch)));
+    }
+  }
+
+  bool OnResetWatch(int watch_id) {
+    GGL_UNUSED(watch_id);
+    reset_watch_ = 0;
+    on_reset_();
+    return false;
+  }
+
+  void RemoveResetWatch() {
+    if (reset_watch_) {
+      MainLoopInterface *main_loop = GetGlobalMainLoop();
+      if (main_loop)
+        main_loop->RemoveWatch(reset_watch_);
+      reset_watch_ = 0;
+    }
   }
 
   int CallMethod(const std::string &method, bool sync, int timeout,
@@ -690,7 +821,82 @@ class DBusProxy::Impl : public SmallObject<> {
     return 0;
   }
 
+  int CallMethods(int count, const MethodCall *calls, int timeout,
+                  BatchResultCallback *callback) {
+    ASSERT(count == 0 || calls);
+    DBusConnection *bus = GetBus();
+    if (!bus || count <= 0 || !calls) {
+      DLOG("Failed to call methods of %s|%s|%s",
+           name_.c_str(), path_.c_str(), interface_.c_str());
+      if (callback)
+        (*callback)(false, 0, NULL);
+      delete callback;
+      return 0;
+    }
+
+    Batch *batch = new Batch(this, NewCallId(), count, callback);
+    batches_[batch->id] = batch;
+    bool async = manager_->IsAsyncSupported();
+    for (int i = 0; i < count; ++i) {
+      Arguments in_args;
+      for (int j = 0; j < calls[i].argc; ++j)
+        in_args.push_back(Argument(calls[i].argv[j]));
+      const char *method = calls[i].method.c_str();
+      MethodSignalPrototypeMap::iterator it = methods_.find(calls[i].method);
+      if (it != methods_.end() &&
+          !ValidateArguments(it->second.in_args, &in_args, "method", method)) {
+        batch->SetResult(i, false, Arguments());
+        continue;
+      }
+
+      if (!async) {
+        Arguments out_args;
+        bool ret = CallMethodSync(bus, interface_.c_str(), method, in_args,
+                                  &out_args, timeout);
+        if (ret && it != methods_.end()) {
+          ret = ValidateArguments(it->second.out_args, &out_args,
+                                  "method", method);
+        }
+        batch->SetResult(i, ret, out_args);
+        continue;
+      }
+
+      // Sends all messages before waiting for any reply.
+      DBusPendingCall *pending = NULL;
+      if (SendMessage(bus, interface_.c_str(), method, in_args,
+                      &pending, timeout) && pending) {
+        BatchCallClosure *closure = new BatchCallClosure;
+        closure->batch = batch;
+        closure->call_id = NewCallId();
+        closure->index = i;
+        closure->method = calls[i].method;
+        batch->Ref();
+        batch->call_ids.push_back(closure->call_id);
+        dbus_pending_call_set_notify(pending, BatchCallNotify,
+                                     closure, BatchCallClosureFree);
+        pending_calls_[closure->call_id] = pending;
+      } else {
+        if (pending)
+          dbus_pending_call_unref(pending);
+        batch->SetResult(i, false, Arguments());
+      }
+    }
+
+    int ret = (batch->remaining > 0 || batch->success) ? batch->id : 0;
+    batch->Unref();
+    return ret;
+  }
+
   bool CancelMethodCall(int index) {
+    BatchMap::iterator batch_it = batches_.find(index);
+    if (batch_it != batches_.end()) {
+      std::vector<int> call_ids;
+      call_ids.swap(batch_it->second->call_ids);
+      batches_.erase(batch_it);
+      for (size_t i = 0; i < call_ids.size(); ++i)
+        CancelMethodCall(call_ids[i]);
+      return true;
+    }
     PendingCallMap::iterator it = pending_calls_.find(index);
     if (it != pending_calls_.end()) {
       dbus_pending_call_cancel(it->second);
@@ -702,7 +908,8 @@ class DBusProxy::Impl : public SmallObject<> {
   }
 
   bool IsMethodCallPending(int index) {
-    return pending_calls_.find(index) != pending_calls_.end();
+    return pending_calls_.find(index) != pending_calls_.end() ||
+           batches_.find(index) != batches_.end();
   }
 
   bool GetMethodInfo(const std::string &method,
@@ -1301,6 +1508,113 @@ class DBusProxy::Impl : public SmallObject<> {
     return 0;
   }
 
+  // A batch of method calls, see CallMethods(). It's referenced by
+  // CallMethods() and the closures of its pending calls.
+  class Batch {
+   public:
+    Batch(Impl *a_impl, int a_id, int count, BatchResultCallback *a_callback)
+      : impl(a_impl), id(a_id), remaining(count), success(true),
+        results(count), callback(a_callback), refcount_(1) {
+    }
+    ~Batch() {
+      // The batch may be freed before it's finished, if its pending calls are
+      // cancelled. The impl may be gone if the batch has finished, because
+      // the callback may delete the proxy.
+      if (remaining > 0) {
+        BatchMap::iterator it = impl->batches_.find(id);
+        if (it != impl->batches_.end() && it->second == this)
+          impl->batches_.erase(it);
+      }
+      delete callback;
+    }
+    void Ref() {
+      ++refcount_;
+    }
+    void Unref() {
+      ASSERT(refcount_ > 0);
+      if (--refcount_ == 0)
+        delete this;
+    }
+    // Stores the result of a call, and calls the callback if all calls
+    // have returned.
+    void SetResult(int index, bool ret, const Arguments &out_args) {
+      ASSERT(remaining > 0);
+      if (!ret) {
+        success = false;
+      } else if (out_args.size() == 1) {
+        results[index] = out_args[0].value;
+      } else if (out_args.size() > 1) {
+        std::vector<ResultVariant> values;
+        for (size_t i = 0; i < out_args.size(); ++i)
+          values.push_back(out_args[i].value);
+        results[index] = ResultVariant(
+            Variant(ScriptableArray::Create(values.begin(), values.end())));
+      }
+      if (--remaining == 0) {
+        // The batch can't be cancelled anymore.
+        impl->batches_.erase(id);
+        call_ids.clear();
+        if (callback) {
+          std::vector<Variant> vars;
+          for (size_t i = 0; i < results.size(); ++i)
+            vars.push_back(results[i].v());
+          (*callback)(success, static_cast<int>(vars.size()), &vars[0]);
+        }
+      }
+    }
+
+    Impl *impl;
+    int id;
+    int remaining;
+    bool success;
+    std::vector<ResultVariant> results;
+    std::vector<int> call_ids;
+    BatchResultCallback *callback;
+
+   private:
+    int refcount_;
+  };
+
+  struct BatchCallClosure {
+    Batch *batch;
+    int call_id;
+    int index;
+    std::string method;
+  };
+
+  static void BatchCallClosureFree(void *data) {
+    BatchCallClosure *closure = reinterpret_cast<BatchCallClosure *>(data);
+    ASSERT(closure);
+    if (closure) {
+      closure->batch->Unref();
+      delete closure;
+    }
+  }
+
+  static void BatchCallNotify(DBusPendingCall *pending, void *data) {
+    BatchCallClosure *closure = reinterpret_cast<BatchCallClosure *>(data);
+    ASSERT(closure);
+    if (closure) {
+#ifdef DBUS_VERBOSE_LOG
+      DLOG("Batch call returned: %d, %d", closure->batch->id, closure->call_id);
+#endif
+      Impl *impl = closure->batch->impl;
+      Arguments out_args;
+      bool ret = impl->RetrieveReplyMessage(pending, &out_args);
+      if (ret) {
+        MethodSignalPrototypeMap::iterator it =
+            impl->methods_.find(closure->method);
+        if (it != impl->methods_.end()) {
+          ret = impl->ValidateArguments(it->second.out_args, &out_args,
+                                        "method", closure->method.c_str());
+        }
+      }
+      impl->pending_calls_.erase(closure->call_id);
+      closure->batch->SetResult(closure->index, ret, out_args);
+    }
+    dbus_pending_call_unref(pending);
+  }
+
   bool PingPeer(DBusConnection *bus) {
     // DBus service itself doesn't support PEER interface.
     if (name_ == DBUS_SERVICE_DBUS)
@@ -1332,6 +1646,18 @@ class DBusProxy::Impl : public SmallObject<> {
     if (!bus)
       return false;
 
+    const ObjectPrototype *cached = manager_->GetPrototype(name_, path_);
+    if (cached) {
+#ifdef DBUS_VERBOSE_LOG
+      DLOG("Use cached introspect data: %s|%s", name_.c_str(), path_.c_str());
+#endif
+      ApplyObjectPrototype(*cached);
+      // Callers of async mode expect on_reset_ after Introspect() returns.
+      if (!sync)
+        ScheduleReset();
+      return true;
+    }
+
     Arguments in_args;
     if (sync) {
       Arguments out_args;
@@ -1347,10 +1673,13 @@ class DBusProxy::Impl : public SmallObject<> {
              name_.c_str(), path_.c_str());
         return false;
       }
-      if (!ParseIntrospectResult(xml)) {
+      ObjectPrototype proto;
+      if (!ParseIntrospectResult(xml, &proto)) {
         ClearIntrospectData();
         return false;
       }
+      manager_->CachePrototype(name_, path_, proto);
+      ApplyObjectPrototype(proto);
       return true;
     } else {
       int call_id =
@@ -1375,15 +1704,38 @@ class DBusProxy::Impl : public SmallObject<> {
 #endif
     ClearIntrospectData();
     std::string xml;
-    if (index == 0 && result.ConvertToString(&xml)) {
-      if (!ParseIntrospectResult(xml))
-        ClearIntrospectData();
+    ObjectPrototype proto;
+    if (index == 0 && result.ConvertToString(&xml) &&
+        ParseIntrospectResult(xml, &proto)) {
+      if (manager_)
+        manager_->CachePrototype(name_, path_, proto);
+      ApplyObjectPrototype(proto);
     }
     on_reset_();
     return false;
   }
 
-  bool ParseIntrospectResult(const std::string& xml) {
+  // Copies the introspect data of this proxy's interface.
+  void ApplyObjectPrototype(const ObjectPrototype &proto) {
+    InterfacePrototypeMap::const_iterator it =
+        proto.interfaces.find(interface_);
+    if (it != proto.interfaces.end()) {
+      methods_ = it->second.methods;
+      signals_ = it->second.signals;
+      properties_ = it->second.properties;
+    } else {
+      methods_.clear();
+      signals_.clear();
+      properties_.clear();
+    }
+    interfaces_ = proto.interface_names;
+    children_ = proto.children;
+#ifdef DBUS_VERBOSE_LOG
+    DLOG("Introspect result:\n%s", PrintProxyInfo().c_str());
+#endif
+  }
+
+  bool ParseIntrospectResult(const std::string& xml, ObjectPrototype *proto) {
     XMLParserInterface *xml_parser = GetXMLParser();
     ASSERT(xml_parser);
 
@@ -1429,9 +1781,9 @@ class DBusProxy::Impl : public SmallObject<> {
       }
       DOMElementInterface *elm = down_cast<DOMElementInterface *>(node);
       if (tag_name == "interface") {
-        result = ParseInterfaceNode(elm);
+        result = ParseInterfaceNode(elm, proto);
       } else if (tag_name == "node") {
-        result = ParseChildNode(elm);
+        result = ParseChildNode(elm, proto);
       }
     }
 
@@ -1439,28 +1791,25 @@ class DBusProxy::Impl : public SmallObject<> {
     domdoc->Unref();
     if (!result)
       DLOG("Failed to introspect %s|%s", name_.c_str(), path_.c_str());
-#ifdef DBUS_VERBOSE_LOG
-    else
-      DLOG("Introspect result:\n%s", PrintProxyInfo().c_str());
-#endif
     return result;
   }
 
-  bool ParseInterfaceNode(DOMElementInterface *interface_node) {
+  bool ParseInterfaceNode(DOMElementInterface *interface_node,
+                          ObjectPrototype *proto) {
     std::string name_attr = interface_node->GetAttribute("name");
-    if (std::find(interfaces_.begin(), interfaces_.end(), name_attr) ==
-        interfaces_.end()) {
+    if (std::find(proto->interface_names.begin(),
+                  proto->interface_names.end(), name_attr) ==
+        proto->interface_names.end()) {
 #ifdef DBUS_VERBOSE_LOG
       DLOG("Found interface for %s|%s: %s",
            name_.c_str(), path_.c_str(), name_attr.c_str());
 #endif
-      interfaces_.push_back(name_attr);
+      proto->interface_names.push_back(name_attr);
     }
 
-    // If it's not self interface, just return.
-    if (name_attr != interface_)
-      return true;
-
+    // All interfaces are parsed, because the result is cached and may be
+    // used by proxies of other interfaces.
+    InterfacePrototype *interface_proto = &proto->interfaces[name_attr];
     bool result = true;
     DOMNodeInterface *node = interface_node->GetFirstChild();
     for (; node && result; node = node->GetNextSibling()) {
@@ -1471,28 +1820,29 @@ class DBusProxy::Impl : public SmallObject<> {
       }
       DOMElementInterface *elm = down_cast<DOMElementInterface *>(node);
       if (tag_name == "method") {
-        result = ParseMethodSignalNode(elm, true);
+        result = ParseMethodSignalNode(elm, true, interface_proto);
       } else if (tag_name == "signal") {
-        result = ParseMethodSignalNode(elm, false);
+        result = ParseMethodSignalNode(elm, false, interface_proto);
       } else if (tag_name == "property") {
-        result = ParsePropertyNode(elm);
+        result = ParsePropertyNode(elm, interface_proto);
       }
     }
     return result;
   }
 
-  bool ParseChildNode(DOMElementInterface *node) {
+  bool ParseChildNode(DOMElementInterface *node, ObjectPrototype *proto) {
     std::string name_attr = node->GetAttribute("name");
     // Child node can't have absolute path.
     if (name_attr.length() && name_attr[0] =='/')
       return false;
     if (name_attr.empty())
-      name_attr = StringPrintf("child_%zu", children_.size());
-    children_.push_back(name_attr);
+      name_attr = StringPrintf("child_%zu", proto->children.size());
+    proto->children.push_back(name_attr);
     return true;
   }
 
-  bool ParseMethodSignalNode(DOMElementInterface *node, bool is_method) {
+  bool ParseMethodSignalNode(DOMElementInterface *node, bool is_method,
+                             InterfacePrototype *interface_proto) {
     std::string name_attr = node->GetAttribute("name");
     if (name_attr.empty()) {
       DLOG("Ignore anonymous %s node.", is_method ? "method" : "signal");
@@ -1522,14 +1872,15 @@ class DBusProxy::Impl : public SmallObject<> {
     }
 
     if (is_method)
-      methods_[name_attr] = proto;
+      interface_proto->methods[name_attr] = proto;
     else
-      signals_[name_attr] = proto;
+      interface_proto->signals[name_attr] = proto;
 
     return true;
   }
 
-  bool ParsePropertyNode(DOMElementInterface *node) {
+  bool ParsePropertyNode(DOMElementInterface *node,
+                         InterfacePrototype *interface_proto) {
     std::string name_attr = node->GetAttribute("name");
     std::string type_attr = node->GetAttribute("type");
     std::string access_attr = node->GetAttribute("access");
@@ -1546,7 +1897,7 @@ class DBusProxy::Impl : public SmallObject<> {
 
       if (proto.access != PROP_UNKNOWN) {
         proto.signature = type_attr;
-        properties_[name_attr] = proto;
+        interface_proto->properties[name_attr] = proto;
       }
     }
     return true;
@@ -1632,6 +1983,9 @@ class DBusProxy::Impl : public SmallObject<> {
   int refcount_;
   int call_id_counter_;
   PendingCallMap pending_calls_;
+  BatchMap batches_;
+  // Watch to emit on_reset_ for the cached introspect data in async mode.
+  int reset_watch_;
 
   MethodSignalPrototypeMap methods_;
   MethodSignalPrototypeMap signals_;
@@ -1687,6 +2041,10 @@ int DBusProxy::CallMethod(const std::string &method, bool sync, int timeout,
   }
   return impl_->CallMethod(method, sync, timeout, callback, &in_args);
 }
+int DBusProxy::CallMethods(int count, const MethodCall *calls, int timeout,
+                           BatchResultCallback *callback) {
+  return impl_->CallMethods(count, calls, timeout, callback);
+}
 bool DBusProxy::CancelMethodCall(int index) {
   return impl_->CancelMethodCall(index);
 }
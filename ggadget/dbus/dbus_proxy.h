@@ -71,6 +71,18 @@ enum MessageType {
  * It supports accessing properties, methods and signals of remote DBus
  * objects.
  * Exporting local C++ object to DBus is not supported.
+ *
+ * The introspect data of a remote object is cached by name and path, and is
+ * shared by the proxies of all interfaces of the object. The cache is kept
+ * until the owner of the name changes, or until the bus connection is closed.
+ * So the known children of a proxy don't include the objects added later
+ * under the same owner.
+ *
+ * If the global main loop is set, the connection to a bus is kept open for
+ * 5 seconds after the last proxy of the bus is deleted, so that the cache
+ * can be reused by proxies created again soon. A timeout watch is pending in
+ * the main loop during this time. Without the global main loop the
+ * connection is closed at once.
  */
 class DBusProxy : public SmallObject<> {
  public:
@@ -160,10 +172,51 @@ class DBusProxy : public SmallObject<> {
                  ResultCallback *callback,
                  int argc, const Variant *argv);
 
+  /** A method call in a batch, see @c CallMethods(). */
+  struct MethodCall {
+    /** Name of the method. */
+    std::string method;
+    /** Number of arguments. */
+    int argc;
+    /** Array holding the arguments. */
+    const Variant *argv;
+  };
+
+  /**
+   * Callback slot to receive the results of a batch of method calls. The
+   * first parameter is @c true if all calls succeeded, the second one is the
+   * number of calls, and the third one is an array containing the result of
+   * each call. A result is void if the call failed or returned nothing, the
+   * return value if the call returned one value, or a @c ScriptableArray of
+   * all return values.
+   */
+  typedef Slot3<void, bool, int, const Variant *> BatchResultCallback;
+
+  /**
+   * Calls several methods of the remote DBus object in a batch.
+   *
+   * All method calls are sent before waiting for any reply, and the callback
+   * is called only once after all replies are received. The calls are
+   * asynchronous if there is a main loop, otherwise they will be made one by
+   * one synchronously.
+   *
+   * @param count number of method calls.
+   * @param calls array of method calls.
+   * @param timeout timeout in milisecond of each call, -1 means the default
+   *        timeout for sync calls, and no timeout for async calls.
+   * @param callback callback to receive the results of all calls. The
+   *        method will own the callback and delete it after execute.
+   * @return a number greater than zero will be returned when succeeds,
+   *    otherwise returns zero. The returned number can be used to cancel
+   *    the whole batch.
+   */
+  int CallMethods(int count, const MethodCall *calls, int timeout,
+                  BatchResultCallback *callback);
+
   /**
    * Cancels an async method call.
    *
-   * @param index the index returned by CallMethod().
+   * @param index the index returned by CallMethod() or CallMethods().
    * @return @c true when succeeds, otherwsize returns @c false.
    */
   bool CancelMethodCall(int index);
@@ -287,7 +340,8 @@ class DBusProxy : public SmallObject<> {
                            const std::string &interface);
 
   /**
-   * Enumerates all known children of this proxy.
+   * Enumerates all known children of this proxy. The children come from the
+   * cached introspect data, see the description of this class.
    * @param callback it will be called for each child with child's name.
    *        The callback should return @c false if it doesn't want to continue.
    *        It will be deleted by this method after finishing enumeration.
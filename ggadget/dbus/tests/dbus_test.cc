@@ -18,6 +18,8 @@ limitations under the License.
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string>
+#include <vector>
 #include <dbus/dbus.h>
 
 #include "ggadget/dbus/dbus_proxy.h"
@@ -35,6 +37,22 @@ namespace {
 const char* kName        = "com.google.Gadget";
 const char* kPath        = "/com/google/Gadget/Test";
 const char* kInterface   = "com.google.Gadget.Test";
+const char* kInterface2  = "com.google.Gadget.Test2";
+// The object which can be introspected.
+const char* kIntrospectablePath = "/com/google/Gadget/Introspectable";
+const char* kIntrospectXML =
+  "<node>\n"
+  "  <interface name=\"com.google.Gadget.Test\">\n"
+  "    <method name=\"Hello\">\n"
+  "      <arg type=\"i\" direction=\"out\"/>\n"
+  "    </method>\n"
+  "  </interface>\n"
+  "  <interface name=\"com.google.Gadget.Test2\">\n"
+  "    <method name=\"Goodbye\"/>\n"
+  "  </interface>\n"
+  "</node>\n";
+// Same as the linger time of idle bus connections in dbus_proxy.cc.
+const int kIdleBusTimeout = 5000;
 const char* kDisconnect  = "Disconnected";
 const char* kSystemRule  = "type='signal',interface='"DBUS_INTERFACE_LOCAL "'";
 const char* kSessionRule = "type='signal',interface='com.google.Gadget.Test'";
@@ -43,6 +61,9 @@ static int g_feed = rand();
 
 static NativeMainLoop *g_mainloop;
 
+// Number of Introspect calls received by the server.
+static int g_introspect_count = 0;
+
 DBusHandlerResult FilterFunction(DBusConnection *connection,
                                  DBusMessage *message,
                                  void *user_data) {
@@ -187,6 +208,35 @@ DBusHandlerResult path_message_func(DBusConnection *connection,
     dbus_message_unref(reply);
     dbus_message_unref(signal);
     return DBUS_HANDLER_RESULT_HANDLED;
+  } else if (dbus_message_is_method_call(message,
+                                         kInterface,
+                                         "IntrospectCount")) {
+    DBusMessage *reply = dbus_message_new_method_return(message);
+    dbus_int32_t count = g_introspect_count;
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_INT32, &count,
+                             DBUS_TYPE_INVALID);
+    dbus_connection_send(connection, reply, NULL);
+    dbus_message_unref(reply);
+    return DBUS_HANDLER_RESULT_HANDLED;
+  } else if (dbus_message_is_method_call(message,
+                                         kInterface,
+                                         "Reacquire")) {
+    DLOG("server: release and request the name again.");
+    // The bus emits NameOwnerChanged signals before the reply is sent.
+    DBusError error;
+    dbus_error_init(&error);
+    dbus_bus_release_name(connection, kName, &error);
+    dbus_error_free(&error);
+    dbus_int32_t result = dbus_bus_request_name(connection, kName, 0, &error);
+    dbus_error_free(&error);
+    DBusMessage *reply = dbus_message_new_method_return(message);
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_INT32, &result,
+                             DBUS_TYPE_INVALID);
+    dbus_connection_send(connection, reply, NULL);
+    dbus_message_unref(reply);
+    return DBUS_HANDLER_RESULT_HANDLED;
   } else if (dbus_message_is_method_call(message,
                                          kInterface,
                                          "Hello")) {
@@ -212,6 +262,31 @@ DBusObjectPathVTable echo_vtable = {
   NULL,
 };
 
+DBusHandlerResult introspectable_message_func(DBusConnection *connection,
+                                              DBusMessage *message,
+                                              void *user_data) {
+  if (dbus_message_is_method_call(message,
+                                  DBUS_INTERFACE_INTROSPECTABLE,
+                                  "Introspect")) {
+    DLOG("server: received Introspect call.");
+    ++g_introspect_count;
+    DBusMessage *reply = dbus_message_new_method_return(message);
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_STRING, &kIntrospectXML,
+                             DBUS_TYPE_INVALID);
+    dbus_connection_send(connection, reply, NULL);
+    dbus_message_unref(reply);
+    return DBUS_HANDLER_RESULT_HANDLED;
+  }
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+DBusObjectPathVTable introspectable_vtable = {
+  path_unregistered_func,
+  introspectable_message_func,
+  NULL,
+};
+
 void StartDBusServer(int feed) {
   DBusError error;
   dbus_error_init(&error);
@@ -247,6 +322,9 @@ void StartDBusServer(int feed) {
   if (!dbus_connection_register_object_path(bus, kPath, &echo_vtable,
                                             (void*)&f))
     DLOG("server: register failed.");
+  if (!dbus_connection_register_object_path(bus, kIntrospectablePath,
+                                            &introspectable_vtable, NULL))
+    DLOG("server: register failed.");
 
   while (dbus_connection_read_write_dispatch(bus, -1))
     ;
@@ -403,6 +481,132 @@ TEST(DBusProxy, SystemAsyncCall) {
   delete proxy;
 }
 
+class BatchValues {
+ public:
+  BatchValues() : success_(false) {}
+  bool success() const { return success_; }
+  const std::vector<std::string> &values() const { return values_; }
+  void Callback(bool success, int count, const Variant *results) {
+    DLOG("batch: success: %d, count: %d", success, count);
+    success_ = success;
+    for (int i = 0; i < count; ++i)
+      values_.push_back(results[i].Print());
+    g_mainloop->Quit();
+  }
+ private:
+  bool success_;
+  std::vector<std::string> values_;
+};
+
+TEST(DBusProxy, BatchCall) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  BatchValues obj;
+  Variant args[] = { Variant("Hello world"), Variant("Goodbye") };
+  DBusProxy::MethodCall calls[3];
+  calls[0].method = "Echo";
+  calls[0].argc = 1;
+  calls[0].argv = &args[0];
+  calls[1].method = "Hello";
+  calls[1].argc = 0;
+  calls[1].argv = NULL;
+  calls[2].method = "Echo";
+  calls[2].argc = 1;
+  calls[2].argv = &args[1];
+  int id = proxy->CallMethods(3, calls, -1,
+                              NewSlot(&obj, &BatchValues::Callback));
+  EXPECT_NE(0, id);
+  EXPECT_TRUE(proxy->IsMethodCallPending(id));
+  g_mainloop->Run();
+  EXPECT_FALSE(proxy->IsMethodCallPending(id));
+  EXPECT_TRUE(obj.success());
+  ASSERT_EQ(3U, obj.values().size());
+  EXPECT_EQ(Variant("Hello world").Print(), obj.values()[0]);
+  EXPECT_EQ(Variant(static_cast<int64_t>(g_feed)).Print(), obj.values()[1]);
+  EXPECT_EQ(Variant("Goodbye").Print(), obj.values()[2]);
+  delete proxy;
+}
+
+// Gets the number of Introspect calls received by the server.
+static int GetIntrospectCount() {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  EXPECT_TRUE(proxy != NULL);
+  if (!proxy)
+    return -1;
+  IntValue obj;
+  EXPECT_TRUE(proxy->CallMethod("IntrospectCount", true, -1,
+                                NewSlot(&obj, &IntValue::Callback),
+                                MESSAGE_TYPE_INVALID));
+  delete proxy;
+  return obj.value();
+}
+
+static bool QuitMainLoop(int watch_id) {
+  g_mainloop->Quit();
+  return false;
+}
+
+TEST(DBusProxy, IntrospectCache) {
+  // Holds the bus connection during the test.
+  DBusProxy *holder = DBusProxy::NewSessionProxy(kName, kPath, kInterface);
+  ASSERT_TRUE(holder != NULL);
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kIntrospectablePath,
+                                                kInterface);
+  ASSERT_TRUE(proxy != NULL);
+  int count = GetIntrospectCount();
+  EXPECT_TRUE(proxy->GetMethodInfo("Hello", NULL, NULL, NULL, NULL));
+
+  // Another interface of the same object is served from the cache.
+  DBusProxy *proxy2 = DBusProxy::NewSessionProxy(kName, kIntrospectablePath,
+                                                 kInterface2);
+  ASSERT_TRUE(proxy2 != NULL);
+  EXPECT_EQ(count, GetIntrospectCount());
+  EXPECT_TRUE(proxy2->GetMethodInfo("Goodbye", NULL, NULL, NULL, NULL));
+  EXPECT_FALSE(proxy2->GetMethodInfo("Hello", NULL, NULL, NULL, NULL));
+  delete proxy;
+  delete proxy2;
+
+  // The cache is dropped after the owner of the name changes. The call is
+  // sync because NameOwnerChanged cancels the pending calls of the holder.
+  IntValue obj;
+  EXPECT_TRUE(holder->CallMethod("Reacquire", true, -1,
+                                 NewSlot(&obj, &IntValue::Callback),
+                                 MESSAGE_TYPE_INVALID));
+  EXPECT_EQ(DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER, obj.value());
+  // Dispatches NameOwnerChanged.
+  g_mainloop->AddTimeoutWatch(500,
+                              new WatchCallbackSlot(NewSlot(QuitMainLoop)));
+  g_mainloop->Run();
+  proxy = DBusProxy::NewSessionProxy(kName, kIntrospectablePath, kInterface);
+  ASSERT_TRUE(proxy != NULL);
+  EXPECT_EQ(count + 1, GetIntrospectCount());
+  delete proxy;
+  delete holder;
+}
+
+TEST(DBusProxy, IdleBusTimeout) {
+  DBusProxy *proxy = DBusProxy::NewSessionProxy(kName, kIntrospectablePath,
+                                                kInterface);
+  ASSERT_TRUE(proxy != NULL);
+  int count = GetIntrospectCount();
+  delete proxy;
+
+  // The connection lingers after the last proxy is deleted, so the cache is
+  // still used by a new proxy.
+  proxy = DBusProxy::NewSessionProxy(kName, kIntrospectablePath, kInterface);
+  ASSERT_TRUE(proxy != NULL);
+  EXPECT_EQ(count, GetIntrospectCount());
+  delete proxy;
+
+  // The connection and the cache are gone after the linger time.
+  g_mainloop->AddTimeoutWatch(kIdleBusTimeout + 1000,
+                              new WatchCallbackSlot(NewSlot(QuitMainLoop)));
+  g_mainloop->Run();
+  proxy = DBusProxy::NewSessionProxy(kName, kIntrospectablePath, kInterface);
+  ASSERT_TRUE(proxy != NULL);
+  EXPECT_EQ(count + 1, GetIntrospectCount());
+  delete proxy;
+}
+
 class SignalCallback {
  public:
   SignalCallback() : value_(0) {}
@@ -14,6 +14,7 @@
   limitations under the License.
 */
 
+#include <cmath>
 #include <vector>
 #include <algorithm>
 
@@ -36,12 +37,133 @@
 
 namespace ggadget {
 
+// Containers with fewer children are hit-tested by checking all children.
+static const size_t kMinChildrenForHitTestIndex = 16;
+// Maximum number of columns or rows of the hit-test grid.
+static const size_t kMaxHitTestGridSize = 64;
+
 class Elements::Impl : public SmallObject<> {
  public:
+  typedef std::vector<BasicElement *> Children;
+
+  // A uniform grid over the axis-aligned extents of the children, used to
+  // find the children which may contain a point without checking all of
+  // them. Rotated children are not indexed, and are always checked.
+  class HitTestGrid {
+   public:
+    HitTestGrid()
+        : left_(0), top_(0), right_(0), bottom_(0),
+          cell_width_(0), cell_height_(0),
+          columns_(0), rows_(0) {
+    }
+
+    void Build(const Children &children) {
+      cells_.clear();
+      unindexed_.clear();
+      columns_ = rows_ = 0;
+
+      bool empty = true;
+      for (Children::const_iterator it = children.begin();
+           it != children.end(); ++it) {
+        BasicElement *child = *it;
+        if (child->GetRotation() != .0)
+          continue;
+        double x = child->GetPixelX() - child->GetPixelPinX();
+        double y = child->GetPixelY() - child->GetPixelPinY();
+        if (empty) {
+          left_ = x;
+          top_ = y;
+          right_ = x + child->GetPixelWidth();
+          bottom_ = y + child->GetPixelHeight();
+          empty = false;
+        } else {
+          left_ = std::min(left_, x);
+          top_ = std::min(top_, y);
+          right_ = std::max(right_, x + child->GetPixelWidth());
+          bottom_ = std::max(bottom_, y + child->GetPixelHeight());
+        }
+      }
+
+      if (!empty && right_ > left_ && bottom_ > top_) {
+        // About one child per cell if the children are evenly distributed.
+        size_t size = static_cast<size_t>(
+            ceil(sqrt(static_cast<double>(children.size()))));
+        columns_ = rows_ = std::max(static_cast<size_t>(1),
+                                    std::min(size, kMaxHitTestGridSize));
+        cell_width_ = (right_ - left_) / static_cast<double>(columns_);
+        cell_height_ = (bottom_ - top_) / static_cast<double>(rows_);
+        cells_.resize(columns_ * rows_);
+      }
+
+      for (size_t i = 0; i < children.size(); ++i) {
+        BasicElement *child = children[i];
+        if (child->GetRotation() != .0 || !columns_) {
+          unindexed_.push_back(i);
+          continue;
+        }
+        double x = child->GetPixelX() - child->GetPixelPinX();
+        double y = child->GetPixelY() - child->GetPixelPinY();
+        // Children with empty extent can't contain any point.
+        if (child->GetPixelWidth() <= 0 || child->GetPixelHeight() <= 0)
+          continue;
+        size_t column1 = GetColumn(x);
+        size_t column2 = GetColumn(x + child->GetPixelWidth());
+        size_t row1 = GetRow(y);
+        size_t row2 = GetRow(y + child->GetPixelHeight());
+        for (size_t row = row1; row <= row2; ++row) {
+          for (size_t column = column1; column <= column2; ++column)
+            cells_[row * columns_ + column].push_back(i);
+        }
+      }
+    }
+
+    // Gets the indexes of the children which may contain the point, in
+    // descending order.
+    void Query(double x, double y, std::vector<size_t> *result) const {
+      result->clear();
+      const std::vector<size_t> *cell = NULL;
+      if (columns_ && x >= left_ && y >= top_ && x <= right_ && y <= bottom_) {
+        cell = &cells_[GetRow(y) * columns_ + GetColumn(x)];
+      }
+      if (!cell || cell->empty()) {
+        result->assign(unindexed_.rbegin(), unindexed_.rend());
+      } else if (unindexed_.empty()) {
+        result->assign(cell->rbegin(), cell->rend());
+      } else {
+        result->resize(cell->size() + unindexed_.size());
+        std::merge(cell->rbegin(), cell->rend(),
+                   unindexed_.rbegin(), unindexed_.rend(),
+                   result->begin(), std::greater<size_t>());
+      }
+    }
+
+   private:
+    size_t GetColumn(double x) const {
+      double column = floor((x - left_) / cell_width_);
+      return column <= 0 ? 0 :
+             std::min(static_cast<size_t>(column), columns_ - 1);
+    }
+
+    size_t GetRow(double y) const {
+      double row = floor((y - top_) / cell_height_);
+      return row <= 0 ? 0 : std::min(static_cast<size_t>(row), rows_ - 1);
+    }
+
+    // The bounding box of the indexed children.
+    double left_, top_, right_, bottom_;
+    double cell_width_, cell_height_;
+    size_t columns_, rows_;
+    // Indexes of the children overlapping each cell, in ascending order.
+    std::vector<std::vector<size_t> > cells_;
+    // Indexes of the rotated children, in ascending order.
+    std::vector<size_t> unindexed_;
+  };
+
   Impl(ElementFactory *factory, BasicElement *owner, View *view)
       : width_(.0), height_(.0),
         factory_(factory), owner_(owner), view_(view),
-        scrollable_(false), element_removed_(false) {
+        scrollable_(false), element_removed_(false),
+        hit_test_index_enabled_(true), hit_test_index_dirty_(true) {
     ASSERT(view);
   }
 
@@ -105,6 +227,7 @@ class Elements::Impl : public SmallObject<> {
         element->SetIndex(children_.size());
         children_.push_back(element);
       }
+      hit_test_index_dirty_ = true;
       ASSERT_ELEMENTS_INTEGRITY;
       if (on_element_added_.HasActiveConnections())
         on_element_added_(element);
@@ -123,6 +246,7 @@ class Elements::Impl : public SmallObject<> {
     children_.erase(children_.begin() + index);
     UpdateIndexes(index);
     element_removed_ = true;
+    hit_test_index_dirty_ = true;
     ASSERT_ELEMENTS_INTEGRITY;
     if (on_element_removed_.HasActiveConnections())
         on_element_removed_(element);
@@ -201,6 +325,7 @@ class Elements::Impl : public SmallObject<> {
       Children v;
       children_.swap(v);
       element_removed_ = true;
+      hit_test_index_dirty_ = true;
     }
     // The caller should call QueueDraw() at proper time.
   }
@@ -272,18 +397,43 @@ class Elements::Impl : public SmallObject<> {
     *fired_element = NULL;
     ViewInterface::HitTest in_hittest = *hittest;
     MouseEvent new_event(event);
+
+    // Only check the children which may contain the point if the index is
+    // available. The candidates are in descending order of indexes.
+    std::vector<size_t> candidates;
+    bool use_index = IsHitTestIndexUsable();
+    if (use_index) {
+      if (hit_test_index_dirty_) {
+        hit_test_grid_.Build(children_);
+        hit_test_index_dirty_ = false;
+      }
+      // The children are indexed by their layout positions, so map the point
+      // into that space in case the owner scrolls its children.
+      double x = event.GetX(), y = event.GetY();
+      if (owner_) {
+        double scroll_x, scroll_y;
+        owner_->GetScrollOffset(&scroll_x, &scroll_y);
+        x += scroll_x;
+        y += scroll_y;
+      }
+      hit_test_grid_.Query(x, y, &candidates);
+    }
+
     // Iterate in reverse since higher elements are listed last.
-    for (Children::reverse_iterator ite = children_.rbegin();
-         ite != children_.rend(); ++ite) {
-      BasicElement *child = *ite;
+    size_t count = use_index ? candidates.size() : children_.size();
+    for (size_t i = 0; i < count; ++i) {
+      size_t index = use_index ? candidates[i] : count - 1 - i;
+      // Event handlers might have removed some children.
+      if (index >= children_.size())
+        continue;
+      BasicElement *child = children_[index];
       // Don't use child->IsReallyVisible() because here we don't need to check
       // visibility of ancestors.
       if (!child->IsVisible() || child->GetOpacity() == 0.0)
         continue;
       MapChildMouseEvent(event, child, &new_event);
       if (child->IsPointIn(new_event.GetX(), new_event.GetY())) {
-        BasicElement *child = *ite;
-        ElementHolder child_holder(*ite);
+        ElementHolder child_holder(child);
         BasicElement *descendant_in_element = NULL;
         ViewInterface::HitTest descendant_hittest = *hittest;
         EventResult result = child->OnMouseEvent(new_event, false,
@@ -380,8 +530,11 @@ class Elements::Impl : public SmallObject<> {
     bool need_update_extents = element_removed_;
     for (; it != end; ++it) {
       (*it)->RecursiveLayout();
-      if ((*it)->IsPositionChanged() || (*it)->IsSizeChanged())
+      if ((*it)->IsPositionChanged() || (*it)->IsSizeChanged()) {
         need_update_extents = true;
+        // The hit-test index will be rebuilt when it's used next time.
+        hit_test_index_dirty_ = true;
+      }
       // Clear the size and position changed state here, because children's
       // Draw() method might not be called.
       (*it)->ClearPositionChanged();
@@ -482,18 +635,25 @@ class Elements::Impl : public SmallObject<> {
       (*it)->MarkRedraw();
   }
 
+  bool IsHitTestIndexUsable() {
+    return hit_test_index_enabled_ &&
+           children_.size() >= kMinChildrenForHitTestIndex;
+  }
+
   double width_;
   double height_;
   ElementFactory *factory_;
   BasicElement *owner_;
   View *view_;
-  typedef std::vector<BasicElement *> Children;
   Children children_;
   Signal1<void, BasicElement*> on_element_added_;
   Signal1<void, BasicElement*> on_element_removed_;
+  HitTestGrid hit_test_grid_;
 
-  bool scrollable_      : 1;
-  bool element_removed_ : 1;
+  bool scrollable_             : 1;
+  bool element_removed_        : 1;
+  bool hit_test_index_enabled_ : 1;
+  bool hit_test_index_dirty_   : 1;
 };
 
 Elements::Elements(ElementFactory *factory,
@@ -696,6 +856,15 @@ void Elements::MarkRedraw() {
   impl_->MarkRedraw();
 }
 
+void Elements::EnableHitTestIndex(bool enable) {
+  impl_->hit_test_index_enabled_ = enable;
+  impl_->hit_test_index_dirty_ = true;
+}
+
+void Elements::InvalidateHitTestIndex() {
+  impl_->hit_test_index_dirty_ = true;
+}
+
 void Elements::AggregateClipRegion(const Rectangle &boundary,
                                    ClipRegion *region) {
   impl_->AggregateClipRegion(boundary, region);
@@ -306,6 +306,20 @@ class Elements : public ScriptableHelperNativeOwnedDefault {
    */
   void MarkRedraw();
 
+  /**
+   * Enables or disables the spatial index used to find the children under
+   * the mouse pointer. It's enabled by default, and only used when there are
+   * many children. The index is rebuilt lazily after the geometry of any
+   * child changed.
+   */
+  void EnableHitTestIndex(bool enable);
+
+  /**
+   * Marks the spatial index outdated. Children call it when their position
+   * or size is changed.
+   */
+  void InvalidateHitTestIndex();
+
   /**
    * Aggregates clip region of all children. It'll be called just
    * after calling Layout() and before calling Draw().
@@ -18,6 +18,7 @@
 #define GGADGET_FRAMEWORK_INTERFACE_H__
 
 #include <string>
+#include <vector>
 #include <ggadget/common.h>
 #include <ggadget/slot.h>
 
@@ -25,6 +26,7 @@ namespace ggadget {
 
 template <typename R, typename P1> class Slot1;
 class Slot;
+class Connection;
 
 namespace framework {
 
@@ -230,6 +232,51 @@ class PerfmonInterface {
   virtual void RemoveCounter(int id) = 0;
 };
 
+/** Interface for retrieving the throughput of the network interfaces. */
+class NetworkStatisticsInterface {
+ protected:
+  virtual ~NetworkStatisticsInterface() {}
+
+ public:
+  /** Throughput of a network interface, in units per second. */
+  struct Throughput {
+    double rx_bytes;
+    double tx_bytes;
+    double rx_packets;
+    double tx_packets;
+  };
+
+  /** Callback when the throughput of the interfaces is updated. */
+  typedef Slot0<void> CallbackSlot;
+
+  /** Gets the names of the network interfaces. */
+  virtual void GetInterfaces(std::vector<std::string> *names) = 0;
+
+  /**
+   * Gets the throughput of a network interface, computed from the last two
+   * samples of its counters.
+   * @return @c false if the interface doesn't exist.
+   */
+  virtual bool GetThroughput(const char *name, Throughput *throughput) = 0;
+
+  /**
+   * Adds a listener which is called each time the interfaces are sampled.
+   *
+   * @param high_frequency whether to sample the interfaces several times per
+   * second instead of every few seconds while the listener is added.
+   * @param slot The slot is owned by the NetworkStatisticsInterface instance,
+   * and shall be deleted when removing the listener.
+   *
+   * @return an unique id of the listener, which can be used to remove the
+   * listener. if returns -1 means failed to add listener, and the slot will be
+   * deleted immediately.
+   */
+  virtual int AddListener(bool high_frequency, CallbackSlot *slot) = 0;
+
+  /** Removes a listener, previously added by AddListener() function. */
+  virtual void RemoveListener(int id) = 0;
+};
+
 /** Interface for retrieving the information of the power and battery status. */
 class PowerInterface {
  protected:
@@ -306,12 +353,31 @@ class ProcessInterface {
    *     The user must call @c Destroy() after using this object.
    */
   virtual ProcessInfoInterface *GetForeground() = 0;
+  /**
+   * Connects a slot which is called when the foreground process changes.
+   * @return the connection, or @c NULL if the changes can't be tracked, in
+   *     which case the slot is deleted immediately.
+   */
+  virtual Connection *ConnectOnForegroundChanged(Slot0<void> *slot) = 0;
   /**
    * Gets the information of the specified process according to the process ID.
    * @return the information of the specified process.
    *     The user must call @c Destroy() after using this object.
    */
   virtual ProcessInfoInterface *GetInfo(int pid) = 0;
+  /**
+   * Gets the processes started and exited since a previous call, so that
+   * the caller needn't compare whole process lists.
+   * @param since the generation returned by a previous call, or 0 to get
+   *     all the processes as started ones.
+   * @param[out] added ids of the processes started since @a since.
+   * @param[out] removed ids of the processes exited since @a since.
+   * @return the generation to pass to the next call, or 0 if the changes
+   *     are not available, in which case the caller should call
+   *     @c EnumerateProcesses() instead.
+   */
+  virtual uint64_t GetChanges(uint64_t since, std::vector<int> *added,
+                              std::vector<int> *removed) = 0;
 };
 
 /** Interface for retrieving the information of the wireless access point. */
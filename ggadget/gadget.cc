@@ -107,11 +107,13 @@ class Gadget::Impl : public ScriptableHelperNativeOwnedDefault {
             "ContentItem", NewSlot(ContentItem::CreateInstance, view_));
 
         // Execute common.js to initialize global constants and compatibility
-        // adapters.
-        std::string common_js_contents;
-        if (GetGlobalFileManager()->ReadFile(kCommonJS, &common_js_contents)) {
-          std::string path = GetGlobalFileManager()->GetFullPath(kCommonJS);
-          context_->Execute(common_js_contents.c_str(), path.c_str(), 1);
+        // adapters. common.js is the same for all gadgets, so it's only read
+        // once, and the script runtime may compile it only once.
+        std::string common_js_contents, common_js_path;
+        if (ScriptRuntimeManager::get()->ReadSharedScriptFile(
+                kCommonJS, &common_js_contents, &common_js_path)) {
+          context_->ExecuteShared(common_js_contents.c_str(),
+                                  common_js_path.c_str(), 1);
         } else {
           LOG("Failed to load %s.", kCommonJS);
         }
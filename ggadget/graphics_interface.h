@@ -52,6 +52,16 @@ class GraphicsInterface {
    */
   virtual CanvasInterface *NewCanvas(double w, double h) const = 0;
 
+  /**
+   * Creates a blank canvas for short-lived offscreen drawing, for example,
+   * the indirect draw of an element with mask. The implementation may
+   * recycle the canvas when it's destroyed, so the caller should destroy it
+   * as soon as possible, and must not keep it across draws.
+   * @param w Width of the new canvas.
+   * @param h Height of the new canvas.
+   */
+  virtual CanvasInterface *NewScratchCanvas(double w, double h) const = 0;
+
   /**
    * Creates a new image.
    * @param tag A string tag to the image. It can be anything, for example,
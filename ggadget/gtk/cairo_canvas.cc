@@ -21,6 +21,7 @@
 #include <pango/pango.h>
 #include <pango/pangocairo.h>
 #include <ggadget/clip_region.h>
+#include <ggadget/light_map.h>
 #include <ggadget/logger.h>
 #include <ggadget/math_utils.h>
 #include <ggadget/signals.h>
@@ -69,6 +70,139 @@ static void SetPangoLayoutAttrFromTextFlags(PangoLayout *layout,
   pango_attr_list_unref(attr_list);
 }
 
+// The max number of text layouts kept in the layout cache.
+static const size_t kMaxCachedTextLayouts = 256;
+
+// Alignment values in the keys of text extents, which don't depend on the
+// alignments and trimming.
+static const int kExtentsOnly = -1;
+
+// The result of laying out a text in a box, relative to the top left corner
+// of the box.
+struct TextLayout {
+  // The lines above the trimmed last line, or NULL if the text isn't
+  // trimmed or has only one line.
+  PangoLayout *head_layout;
+  double head_y;
+  // The text, or its trimmed last line.
+  PangoLayout *layout;
+  double x;
+  double y;
+};
+
+// Caches the text layouts, so that the same text isn't shaped again and again
+// when it's redrawn, for example, by a label updated every second. The cache
+// is shared by all canvases, because the layouts don't depend on the canvas
+// they are drawn on. The least recently used layout is dropped when the cache
+// is full.
+class TextLayoutCache {
+ public:
+  struct Key {
+    std::string text;
+    guint font_hash;
+    int text_flags;
+    double width;
+    double height;
+    int align;
+    int valign;
+    int trimming;
+
+    bool operator<(const Key &another) const {
+      if (font_hash != another.font_hash)
+        return font_hash < another.font_hash;
+      if (text_flags != another.text_flags)
+        return text_flags < another.text_flags;
+      if (width != another.width)
+        return width < another.width;
+      if (height != another.height)
+        return height < another.height;
+      if (align != another.align)
+        return align < another.align;
+      if (valign != another.valign)
+        return valign < another.valign;
+      if (trimming != another.trimming)
+        return trimming < another.trimming;
+      return text < another.text;
+    }
+  };
+
+  struct Entry {
+    PangoFontDescription *font;
+    TextLayout text_layout;
+    // The size of the text, only for the keys of text extents.
+    int text_width;
+    int text_height;
+    uint64_t last_use;
+  };
+
+  TextLayoutCache() : use_serial_(0), hits_(0), misses_(0) { }
+
+  ~TextLayoutCache() {
+    for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ++it)
+      FreeEntry(&it->second);
+  }
+
+  static void FreeEntry(Entry *entry) {
+    pango_font_description_free(entry->font);
+    if (entry->text_layout.head_layout)
+      g_object_unref(entry->text_layout.head_layout);
+    if (entry->text_layout.layout)
+      g_object_unref(entry->text_layout.layout);
+  }
+
+  // Returns the cached entry of the key, or NULL if it's not cached.
+  const Entry *Find(const Key &key, const PangoFontDescription *font) {
+    EntryMap::iterator it = entries_.find(key);
+    // Different fonts may have the same hash.
+    if (it == entries_.end() ||
+        !pango_font_description_equal(it->second.font, font)) {
+      misses_++;
+      return NULL;
+    }
+    hits_++;
+    it->second.last_use = ++use_serial_;
+    return &it->second;
+  }
+
+  // Adds an entry for the key. The returned entry should be filled by the
+  // caller, and will own the layouts in it.
+  Entry *Add(const Key &key, const PangoFontDescription *font) {
+    EntryMap::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+      FreeEntry(&it->second);
+      entries_.erase(it);
+    } else if (entries_.size() >= kMaxCachedTextLayouts) {
+      EntryMap::iterator oldest = entries_.begin();
+      for (it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->second.last_use < oldest->second.last_use)
+          oldest = it;
+      }
+      FreeEntry(&oldest->second);
+      entries_.erase(oldest);
+    }
+
+    Entry *entry = &entries_[key];
+    entry->font = pango_font_description_copy(font);
+    entry->text_layout.head_layout = NULL;
+    entry->text_layout.head_y = 0;
+    entry->text_layout.layout = NULL;
+    entry->text_layout.x = 0;
+    entry->text_layout.y = 0;
+    entry->text_width = 0;
+    entry->text_height = 0;
+    entry->last_use = ++use_serial_;
+    return entry;
+  }
+
+  typedef LightMap<Key, Entry> EntryMap;
+  EntryMap entries_;
+  uint64_t use_serial_;
+  size_t hits_;
+  size_t misses_;
+};
+
+static TextLayoutCache g_text_layout_cache;
+
 class CairoCanvas::Impl : public SmallObject<> {
  public:
   Impl(const CairoGraphics *graphics, double w, double h, cairo_format_t fmt)
@@ -238,37 +372,21 @@ class CairoCanvas::Impl : public SmallObject<> {
     return NULL;
   }
 
-  PangoLayout *CreatePangoLayout() {
+  static PangoLayout *CreatePangoLayout() {
     // Pango layout must be created with a cairo context that isn't scaled at
     // all. Otherwise, some text layout behavior will be wrong.
     CairoCanvas canvas(1.0, 1, 1, CAIRO_FORMAT_ARGB32);
     return pango_cairo_create_layout(canvas.GetContext());
   }
 
-  bool DrawTextInternal(double x, double y, double width,
-                        double height, const char *text,
-                        const FontInterface *f,
-                        Alignment align, VAlignment valign,
-                        Trimming trimming, int text_flags) {
-    if (text == NULL || f == NULL) return false;
-
-    // If the text is blank, we need to do nothing.
-    if (*text == 0) return true;
-
-    cairo_save(cr_);
-    // Restrict the output area.
-    cairo_rectangle(cr_, x, y, x + width, y + height);
-    cairo_clip(cr_);
-
-    const CairoFont *font = down_cast<const CairoFont*>(f);
+  static PangoLayout *CreateTextLayout(const char *text, int length,
+                                       const PangoFontDescription *font,
+                                       double width, Alignment align,
+                                       int text_flags) {
     PangoLayout *layout = CreatePangoLayout();
-    pango_layout_set_text(layout, text, -1);
-    pango_layout_set_font_description(layout, font->GetFontDescription());
+    pango_layout_set_text(layout, text, length);
+    pango_layout_set_font_description(layout, font);
     SetPangoLayoutAttrFromTextFlags(layout, text_flags, width);
-    // Pos is used to get glyph extents in pango.
-    PangoRectangle pos;
-    // real_x and real_y represent the real position of the layout.
-    double real_x = x, real_y = y;
 
     // Set alignment. This is only effective when wordwrap is set
     // because when wordwrap is unset, the width has to be
@@ -281,6 +399,21 @@ class CairoCanvas::Impl : public SmallObject<> {
       pango_layout_set_alignment(layout, PANGO_ALIGN_RIGHT);
     else if (align == ALIGN_JUSTIFY)
       pango_layout_set_justify(layout, TRUE);
+    return layout;
+  }
+
+  // Lays out a text in a box of the given size, trimming it if necessary.
+  static void LayoutText(const char *text, const PangoFontDescription *font,
+                         double width, double height,
+                         Alignment align, VAlignment valign,
+                         Trimming trimming, int text_flags,
+                         TextLayout *result) {
+    PangoLayout *layout = CreateTextLayout(text, -1, font, width, align,
+                                           text_flags);
+    // Pos is used to get glyph extents in pango.
+    PangoRectangle pos;
+    // real_x and real_y represent the real position of the layout.
+    double real_x = 0, real_y = 0;
 
     // Get the pixel extents(logical extents) of the layout.
     pango_layout_get_pixel_extents(layout, NULL, &pos);
@@ -300,155 +433,209 @@ class CairoCanvas::Impl : public SmallObject<> {
 
       // Set vertical alignment.
       if (valign == VALIGN_MIDDLE)
-        real_y = y + (height - pos.height) / 2;
+        real_y = (height - pos.height) / 2;
       else if (valign == VALIGN_BOTTOM)
-        real_y = y + height - pos.height;
+        real_y = height - pos.height;
 
       // When wordwrap is unset, we also have to do the horizontal alignment.
       if ((text_flags & TEXT_FLAGS_WORDWRAP) == 0) {
         if (align == ALIGN_CENTER)
-          real_x = x + (width - pos.width) / 2;
+          real_x = (width - pos.width) / 2;
         else if (align == ALIGN_RIGHT)
-          real_x = x + width - pos.width;
+          real_x = width - pos.width;
       }
 
-      // Show pango layout when there is no trimming.
-      cairo_move_to(cr_, real_x, real_y);
-      pango_cairo_show_layout(cr_, layout);
+      result->layout = layout;
+      result->x = real_x;
+      result->y = real_y;
+      return;
+    }
 
+    // We will use newtext as the content of the layout,
+    // because we have to display the trimmed text.
+    std::string newtext;
+
+    // Set vertical alignment.
+    if (valign == VALIGN_MIDDLE)
+      real_y = (height - line_height * displayed_lines) / 2;
+    else if (valign == VALIGN_BOTTOM)
+      real_y = height - line_height * displayed_lines;
+
+    if (displayed_lines > 1) {
+      // When there are multilines, we will show the above lines first,
+      // because trimming will only occurs in the last line.
+      PangoLayoutLine *line = pango_layout_get_line(layout,
+                                                    displayed_lines - 2);
+      int last_line_index = line->start_index + line->length;
+      pango_layout_set_text(layout, text, last_line_index);
+      result->head_layout = layout;
+      result->head_y = real_y;
+
+      // The newtext contains the text that will be shown in the last line.
+      newtext = text + last_line_index;
+      real_y += line_height * (displayed_lines - 1);
+      layout = CreateTextLayout(newtext.c_str(), -1, font, width, align,
+                                text_flags);
     } else {
-      // We will use newtext as the content of the layout,
-      // because we have to display the trimmed text.
-      std::string newtext;
+      // When there is only a single line, the newtext equals text.
+      newtext = text;
+    }
 
-      // Set vertical alignment.
-      if (valign == VALIGN_MIDDLE)
-        real_y = y + (height - line_height * displayed_lines) / 2;
-      else if (valign == VALIGN_BOTTOM)
-        real_y = y + height - line_height * displayed_lines;
-
-      if (displayed_lines > 1) {
-        // When there are multilines, we will show the above lines first,
-        // because trimming will only occurs in the last line.
-        PangoLayoutLine *line = pango_layout_get_line(layout,
-                                                      displayed_lines - 2);
-        int last_line_index = line->start_index + line->length;
-        pango_layout_set_text(layout, text, last_line_index);
-        cairo_move_to(cr_, real_x, real_y);
-        pango_cairo_show_layout(cr_, layout);
-
-        // The newtext contains the text that will be shown in the last line.
-        newtext = text + last_line_index;
-        real_y += line_height * (displayed_lines - 1);
+    // This record the width of the ellipsis text.
+    int ellipsis_width = 0;
 
-      } else {
-        // When there is only a single line, the newtext equals text.
-        newtext = text;
-      }
-      // Set the newtext as the content of the layout.
-      pango_layout_set_text(layout, newtext.c_str(), -1);
-
-      // This record the width of the ellipsis text.
-      int ellipsis_width = 0;
-
-      if (trimming == TRIMMING_CHARACTER_ELLIPSIS) {
-        // Pango has provided character-ellipsis trimming.
-        // FIXME: when displaying arabic, the final layout width
-        // may exceed the width we set before
-        pango_layout_set_width(layout, static_cast<int>(width) * PANGO_SCALE);
-        pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
-
-      } else if (trimming == TRIMMING_PATH_ELLIPSIS) {
-        // Pango has provided path-ellipsis trimming.
-        // FIXME: when displaying arabic, the final layout width
-        // may exceed the width we set before
-        pango_layout_set_width(layout, static_cast<int>(width) * PANGO_SCALE);
-        pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_MIDDLE);
+    if (trimming == TRIMMING_CHARACTER_ELLIPSIS) {
+      // Pango has provided character-ellipsis trimming.
+      // FIXME: when displaying arabic, the final layout width
+      // may exceed the width we set before
+      pango_layout_set_width(layout, static_cast<int>(width) * PANGO_SCALE);
+      pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_END);
 
-      } else {
-        // We have to do other type of trimming ourselves, including
-        // "character", "word" and "word-ellipsis".
+    } else if (trimming == TRIMMING_PATH_ELLIPSIS) {
+      // Pango has provided path-ellipsis trimming.
+      // FIXME: when displaying arabic, the final layout width
+      // may exceed the width we set before
+      pango_layout_set_width(layout, static_cast<int>(width) * PANGO_SCALE);
+      pango_layout_set_ellipsize(layout, PANGO_ELLIPSIZE_MIDDLE);
 
-        // We want every thing in a single line, so set no word wrap.
-        pango_layout_set_width(layout, -1);
+    } else {
+      // We have to do other type of trimming ourselves, including
+      // "character", "word" and "word-ellipsis".
+
+      // We want every thing in a single line, so set no word wrap.
+      pango_layout_set_width(layout, -1);
+      pango_layout_get_pixel_extents(layout, NULL, &pos);
+      if (trimming == TRIMMING_WORD_ELLIPSIS) {
+        // Only in this condition should we calculate the ellipsis width.
+        pango_layout_set_text(layout, kEllipsisText, -1);
         pango_layout_get_pixel_extents(layout, NULL, &pos);
-        if (trimming == TRIMMING_WORD_ELLIPSIS) {
-          // Only in this condition should we calculate the ellipsis width.
-          pango_layout_set_text(layout, kEllipsisText, -1);
-          pango_layout_get_pixel_extents(layout, NULL, &pos);
-          ellipsis_width = pos.width;
-          pango_layout_set_text(layout, newtext.c_str(), -1);
-        }
+        ellipsis_width = pos.width;
+        pango_layout_set_text(layout, newtext.c_str(), -1);
+      }
 
-        // Figure out how many characters can be displayed.
-        std::vector<int> cluster_index;
-        PangoLayoutIter *it = pango_layout_get_iter(layout);
-        // A cluster is the smallest linguistic unit that can be shaped.
-        do {
-          cluster_index.push_back(pango_layout_iter_get_index(it));
-        } while (pango_layout_iter_next_cluster(it));
-        cluster_index.push_back(static_cast<int>(newtext.size()));
-        std::sort(cluster_index.begin(), cluster_index.end());
-
-        std::vector<int>::iterator cluster_it = cluster_index.begin();
-        for (; cluster_it != cluster_index.end(); ++cluster_it) {
-          pango_layout_set_text(layout, newtext.c_str(), *cluster_it);
-          pango_layout_get_pixel_extents(layout, NULL, &pos);
-          if (pos.width > width - ellipsis_width)
-            break;
-        }
+      // Figure out how many characters can be displayed.
+      std::vector<int> cluster_index;
+      PangoLayoutIter *it = pango_layout_get_iter(layout);
+      // A cluster is the smallest linguistic unit that can be shaped.
+      do {
+        cluster_index.push_back(pango_layout_iter_get_index(it));
+      } while (pango_layout_iter_next_cluster(it));
+      pango_layout_iter_free(it);
+      cluster_index.push_back(static_cast<int>(newtext.size()));
+      std::sort(cluster_index.begin(), cluster_index.end());
+
+      std::vector<int>::iterator cluster_it = cluster_index.begin();
+      for (; cluster_it != cluster_index.end(); ++cluster_it) {
+        pango_layout_set_text(layout, newtext.c_str(), *cluster_it);
+        pango_layout_get_pixel_extents(layout, NULL, &pos);
+        if (pos.width > width - ellipsis_width)
+          break;
+      }
+
+      // Use conceal_index to represent the first byte that won't be displayed.
+      int conceal_index = 0;
+      if (cluster_it != cluster_index.begin())
+        conceal_index = *(--cluster_it);
 
-        // Use conceal_index to represent the first byte that won't be displayed.
-        int conceal_index = 0;
-        if (cluster_it != cluster_index.begin())
-          conceal_index = *(--cluster_it);
-
-        // Get the text that will finally be displayed.
-        if (trimming == TRIMMING_CHARACTER) {
-          // In "character", just show the characters before the index.
-          pango_layout_set_text(layout, newtext.c_str(), conceal_index);
-        } else {
-          // In "word" or "word-ellipsis" trimming, we have to find out where
-          // last word stops. If we can't find out a reasonable position, then
-          // just do trimming as in "character".
-          PangoLogAttr *log_attrs;
-          int n_attrs;
-          pango_layout_get_log_attrs(layout, &log_attrs, &n_attrs);
-          int off = static_cast<int>(g_utf8_pointer_to_offset(newtext.c_str(),
-                                             newtext.c_str() + conceal_index));
-          while (off > 0 && !log_attrs[off].is_word_end &&
-                 !log_attrs[off].is_word_start)
-            --off;
-          if (off > 0) {
-            conceal_index =
-               static_cast<int>(g_utf8_offset_to_pointer(newtext.c_str(), off) -
-                                newtext.c_str());
-          }
-          newtext.erase(conceal_index);
-
-          // In word-ellipsis, we have to append the ellipsis manualy.
-          if (trimming == TRIMMING_WORD_ELLIPSIS)
-            newtext.append(kEllipsisText);
-
-          pango_layout_set_text(layout, newtext.c_str(), -1);
+      // Get the text that will finally be displayed.
+      if (trimming == TRIMMING_CHARACTER) {
+        // In "character", just show the characters before the index.
+        pango_layout_set_text(layout, newtext.c_str(), conceal_index);
+      } else {
+        // In "word" or "word-ellipsis" trimming, we have to find out where
+        // last word stops. If we can't find out a reasonable position, then
+        // just do trimming as in "character".
+        PangoLogAttr *log_attrs;
+        int n_attrs;
+        pango_layout_get_log_attrs(layout, &log_attrs, &n_attrs);
+        int off = static_cast<int>(g_utf8_pointer_to_offset(newtext.c_str(),
+                                           newtext.c_str() + conceal_index));
+        while (off > 0 && !log_attrs[off].is_word_end &&
+               !log_attrs[off].is_word_start)
+          --off;
+        if (off > 0) {
+          conceal_index =
+             static_cast<int>(g_utf8_offset_to_pointer(newtext.c_str(), off) -
+                              newtext.c_str());
         }
+        g_free(log_attrs);
+        newtext.erase(conceal_index);
 
-        // We also have to do the horizontal alignment.
-        pango_layout_get_pixel_extents(layout, NULL, &pos);
-        if (align == ALIGN_CENTER)
-          real_x = x + (width - pos.width) / 2;
-        else if (align == ALIGN_RIGHT)
-          real_x = x + width - pos.width;
+        // In word-ellipsis, we have to append the ellipsis manualy.
+        if (trimming == TRIMMING_WORD_ELLIPSIS)
+          newtext.append(kEllipsisText);
+
+        pango_layout_set_text(layout, newtext.c_str(), -1);
       }
 
-      // Show the trimmed text.
-      cairo_move_to(cr_, real_x, real_y);
-      pango_cairo_show_layout(cr_, layout);
+      // We also have to do the horizontal alignment.
+      pango_layout_get_pixel_extents(layout, NULL, &pos);
+      if (align == ALIGN_CENTER)
+        real_x = (width - pos.width) / 2;
+      else if (align == ALIGN_RIGHT)
+        real_x = width - pos.width;
     }
 
-    g_object_unref(layout);
-    cairo_restore(cr_);
+    result->layout = layout;
+    result->x = real_x;
+    result->y = real_y;
+  }
+
+  // Gets the layout of a text from the layout cache, or lays it out and
+  // adds it to the cache.
+  static const TextLayout *GetTextLayout(const char *text,
+                                         const PangoFontDescription *font,
+                                         double width, double height,
+                                         Alignment align, VAlignment valign,
+                                         Trimming trimming, int text_flags) {
+    TextLayoutCache::Key key;
+    key.text = text;
+    key.font_hash = pango_font_description_hash(font);
+    key.text_flags = text_flags;
+    key.width = width;
+    key.height = height;
+    key.align = align;
+    key.valign = valign;
+    key.trimming = trimming;
+
+    const TextLayoutCache::Entry *entry = g_text_layout_cache.Find(key, font);
+    if (!entry) {
+      TextLayoutCache::Entry *new_entry = g_text_layout_cache.Add(key, font);
+      LayoutText(text, font, width, height, align, valign, trimming,
+                 text_flags, &new_entry->text_layout);
+      entry = new_entry;
+    }
+    return &entry->text_layout;
+  }
+
+  bool DrawTextInternal(double x, double y, double width,
+                        double height, const char *text,
+                        const FontInterface *f,
+                        Alignment align, VAlignment valign,
+                        Trimming trimming, int text_flags) {
+    if (text == NULL || f == NULL) return false;
+
+    // If the text is blank, we need to do nothing.
+    if (*text == 0) return true;
+
+    const CairoFont *font = down_cast<const CairoFont*>(f);
+    const TextLayout *text_layout =
+        GetTextLayout(text, font->GetFontDescription(), width, height,
+                      align, valign, trimming, text_flags);
+
+    cairo_save(cr_);
+    // Restrict the output area.
+    cairo_rectangle(cr_, x, y, x + width, y + height);
+    cairo_clip(cr_);
 
+    if (text_layout->head_layout) {
+      cairo_move_to(cr_, x, y + text_layout->head_y);
+      pango_cairo_show_layout(cr_, text_layout->head_layout);
+    }
+    cairo_move_to(cr_, x + text_layout->x, y + text_layout->y);
+    pango_cairo_show_layout(cr_, text_layout->layout);
+
+    cairo_restore(cr_);
     return true;
   }
 
@@ -796,25 +983,52 @@ bool CairoCanvas::GetTextExtents(const char *text, const FontInterface *f,
   }
 
   const CairoFont *font = down_cast<const CairoFont*>(f);
-  PangoLayout *layout = impl_->CreatePangoLayout();
-  pango_layout_set_text(layout, text, -1);
-  pango_layout_set_font_description(layout, font->GetFontDescription());
+  const PangoFontDescription *font_desc = font->GetFontDescription();
 
   if (in_width <= 0) {
     text_flags &= ~TEXT_FLAGS_WORDWRAP;
   }
-  SetPangoLayoutAttrFromTextFlags(layout, text_flags, in_width);
 
-  // Get the pixel extents(logical extents) of the layout.
-  int w, h;
-  pango_layout_get_pixel_size(layout, &w, &h);
-  *width = w;
-  *height = h;
+  // The width only matters when the text is wrapped.
+  TextLayoutCache::Key key;
+  key.text = text;
+  key.font_hash = pango_font_description_hash(font_desc);
+  key.text_flags = text_flags;
+  key.width = (text_flags & TEXT_FLAGS_WORDWRAP) ? in_width : 0;
+  key.height = 0;
+  key.align = kExtentsOnly;
+  key.valign = kExtentsOnly;
+  key.trimming = kExtentsOnly;
+
+  const TextLayoutCache::Entry *entry =
+      g_text_layout_cache.Find(key, font_desc);
+  if (!entry) {
+    PangoLayout *layout = Impl::CreatePangoLayout();
+    pango_layout_set_text(layout, text, -1);
+    pango_layout_set_font_description(layout, font_desc);
+    SetPangoLayoutAttrFromTextFlags(layout, text_flags, in_width);
+
+    // Get the pixel extents(logical extents) of the layout.
+    TextLayoutCache::Entry *new_entry = g_text_layout_cache.Add(key, font_desc);
+    pango_layout_get_pixel_size(layout, &new_entry->text_width,
+                                &new_entry->text_height);
+    g_object_unref(layout);
+    entry = new_entry;
+  }
 
-  g_object_unref(layout);
+  *width = entry->text_width;
+  *height = entry->text_height;
   return true;
 }
 
+size_t CairoCanvas::GetTextLayoutCacheHitCount() {
+  return g_text_layout_cache.hits_;
+}
+
+size_t CairoCanvas::GetTextLayoutCacheMissCount() {
+  return g_text_layout_cache.misses_;
+}
+
 bool CairoCanvas::GetPointValue(double x, double y,
                                 Color *color, double *opacity) const {
 #if CAIRO_VERSION >= CAIRO_VERSION_ENCODE(1,2,0)
@@ -149,6 +149,15 @@ class CairoCanvas : public CanvasInterface {
   /** Get the zoom factor. */
   double GetZoom() const;
 
+  /**
+   * Returns the number of text layouts found in the layout cache shared by
+   * all canvases. For profiling and testing.
+   */
+  static size_t GetTextLayoutCacheHitCount();
+
+  /** Returns the number of text layouts not found in the layout cache. */
+  static size_t GetTextLayoutCacheMissCount();
+
  private:
   class Impl;
   Impl *impl_;
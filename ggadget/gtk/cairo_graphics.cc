@@ -14,9 +14,12 @@
   limitations under the License.
 */
 
+#include <cmath>
 #include <map>
 #include <gdk/gdkcairo.h>
+#include <ggadget/canvas_pool.h>
 #include <ggadget/gadget_consts.h>
+#include <ggadget/light_map.h>
 #include <ggadget/logger.h>
 #include <ggadget/signals.h>
 #include <ggadget/small_object.h>
@@ -29,21 +32,220 @@
 #include "rsvg_image.h"
 #endif
 
+#if defined(HAVE_XSHM) && defined(GDK_WINDOWING_X11)
+#define GGL_HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#endif
+
 namespace ggadget {
 namespace gtk {
 
+// Maximum bytes retained by the idle scratch canvases of a CairoGraphics.
+static const size_t kMaxScratchCanvasBytes = 4 * 1024 * 1024;
+
+#ifdef GGL_HAVE_XSHM
+// An XImage of a window in MIT-SHM shared memory, which is drawn with cairo.
+class ShmSurface {
+ public:
+  ShmSurface(GdkWindow *window)
+      : window_(window),
+        display_(GDK_WINDOW_XDISPLAY(window)),
+        image_(NULL),
+        gc_(NULL),
+        surface_(NULL),
+        put_pending_(false) {
+    g_object_ref(G_OBJECT(window_));
+    info_.shmid = -1;
+    info_.shmaddr = NULL;
+  }
+
+  ~ShmSurface() {
+    if (surface_)
+      cairo_surface_destroy(surface_);
+    if (info_.shmaddr) {
+      XShmDetach(display_, &info_);
+      shmdt(info_.shmaddr);
+    }
+    if (image_)
+      XDestroyImage(image_);
+    if (gc_)
+      XFreeGC(display_, gc_);
+    g_object_unref(G_OBJECT(window_));
+  }
+
+  bool Init(int width, int height) {
+    if (!XShmQueryExtension(display_))
+      return false;
+
+    // The pixels must be in the layout of cairo.
+    GdkVisual *visual = gdk_drawable_get_visual(window_);
+    int depth = gdk_drawable_get_depth(window_);
+    if (!visual || (depth != 24 && depth != 32) ||
+        visual->red_mask != 0xff0000 || visual->green_mask != 0xff00 ||
+        visual->blue_mask != 0xff)
+      return false;
+
+    image_ = XShmCreateImage(display_, GDK_VISUAL_XVISUAL(visual),
+                             static_cast<unsigned int>(depth), ZPixmap, NULL,
+                             &info_, static_cast<unsigned int>(width),
+                             static_cast<unsigned int>(height));
+    int byte_order = G_BYTE_ORDER == G_LITTLE_ENDIAN ? LSBFirst : MSBFirst;
+    if (!image_ || image_->bits_per_pixel != 32 ||
+        image_->byte_order != byte_order)
+      return false;
+
+    info_.shmid = shmget(IPC_PRIVATE,
+                         static_cast<size_t>(image_->bytes_per_line) *
+                         static_cast<size_t>(image_->height),
+                         IPC_CREAT | 0600);
+    if (info_.shmid < 0)
+      return false;
+    char *addr = static_cast<char *>(shmat(info_.shmid, NULL, 0));
+    if (addr == reinterpret_cast<char *>(-1)) {
+      shmctl(info_.shmid, IPC_RMID, NULL);
+      return false;
+    }
+    info_.readOnly = False;
+
+    // XShmAttach() fails asynchronously, e.g. if the X server is remote.
+    gdk_error_trap_push();
+    XShmAttach(display_, &info_);
+    XSync(display_, False);
+    bool attached = (gdk_error_trap_pop() == 0);
+    // The segment is removed after both sides have detached it.
+    shmctl(info_.shmid, IPC_RMID, NULL);
+    if (!attached) {
+      shmdt(addr);
+      return false;
+    }
+    info_.shmaddr = image_->data = addr;
+
+    gc_ = XCreateGC(display_, GDK_WINDOW_XID(window_), 0, NULL);
+    surface_ = cairo_image_surface_create_for_data(
+        reinterpret_cast<unsigned char *>(addr),
+        depth == 32 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
+        width, height, image_->bytes_per_line);
+    return cairo_surface_status(surface_) == CAIRO_STATUS_SUCCESS;
+  }
+
+  bool Matches(GdkWindow *window, int width, int height) const {
+    return window == window_ && width == image_->width &&
+           height == image_->height;
+  }
+
+  cairo_surface_t *Get() {
+    // The X server reads the shared memory asynchronously.
+    if (put_pending_) {
+      XSync(display_, False);
+      put_pending_ = false;
+    }
+    return surface_;
+  }
+
+  void Put(GdkRegion *region) {
+    cairo_surface_flush(surface_);
+    GdkRectangle bounds = { 0, 0, image_->width, image_->height };
+    GdkRectangle *rects;
+    gint n_rects;
+    gdk_region_get_rectangles(region, &rects, &n_rects);
+    for (gint i = 0; i < n_rects; ++i) {
+      GdkRectangle rect;
+      if (gdk_rectangle_intersect(&rects[i], &bounds, &rect)) {
+        XShmPutImage(display_, GDK_WINDOW_XID(window_), gc_, image_,
+                     rect.x, rect.y, rect.x, rect.y,
+                     static_cast<unsigned int>(rect.width),
+                     static_cast<unsigned int>(rect.height), False);
+      }
+    }
+    g_free(rects);
+    XFlush(display_);
+    put_pending_ = true;
+  }
+
+ private:
+  GdkWindow *window_;
+  Display *display_;
+  XShmSegmentInfo info_;
+  XImage *image_;
+  GC gc_;
+  cairo_surface_t *surface_;
+  bool put_pending_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ShmSurface);
+};
+#endif
+
 class CairoGraphics::Impl : public SmallObject<> {
  public:
-  Impl(double zoom) : zoom_(zoom) {
+  // A canvas which returns itself to the pool when destroyed.
+  class ScratchCanvas : public CairoCanvas {
+   public:
+    // Impl here would name CairoCanvas::Impl.
+    ScratchCanvas(const CairoGraphics *graphics, CairoGraphics::Impl *owner,
+                  double w, double h)
+        : CairoCanvas(graphics, w, h, CAIRO_FORMAT_ARGB32),
+          owner_(owner), in_pool_(false) {
+    }
+
+    virtual void Destroy() {
+      // The pool destroys the canvases evicted from it. A canvas still in
+      // use when the graphics is deleted has been detached from it.
+      if (in_pool_ || !owner_) {
+        delete this;
+        return;
+      }
+      owner_->scratch_canvases_in_use_.erase(this);
+      double zoom = GetZoom();
+      size_t bytes = static_cast<size_t>(ceil(GetWidth() * zoom)) *
+                     static_cast<size_t>(ceil(GetHeight() * zoom)) * 4;
+      if (owner_->scratch_canvases_.Put(this, bytes))
+        in_pool_ = true;
+      else
+        delete this;
+    }
+
+    CairoGraphics::Impl *owner_;
+    bool in_pool_;
+  };
+
+  Impl(double zoom)
+      : zoom_(zoom),
+#ifdef GGL_HAVE_XSHM
+        shm_surface_(NULL),
+        shm_supported_(true),
+#endif
+        scratch_canvases_(kMaxScratchCanvasBytes) {
     if (zoom_ <= 0) zoom_ = 1;
   }
 
   ~Impl() {
+    // The idle canvases are connected to on_zoom_signal_.
+    scratch_canvases_.Clear();
+    // The canvases in use may be destroyed after this object.
+    for (LightSet<ScratchCanvas *>::iterator it =
+             scratch_canvases_in_use_.begin();
+         it != scratch_canvases_in_use_.end(); ++it)
+      (*it)->owner_ = NULL;
     on_zoom_signal_(-1);
+#ifdef GGL_HAVE_XSHM
+    delete shm_surface_;
+#endif
   }
 
   double zoom_;
+#ifdef GGL_HAVE_XSHM
+  ShmSurface *shm_surface_;
+  // Set to false once MIT-SHM fails, to not try it for every draw.
+  bool shm_supported_;
+#endif
   Signal1<void, double> on_zoom_signal_;
+  CanvasPool scratch_canvases_;
+  LightSet<ScratchCanvas *> scratch_canvases_in_use_;
 };
 
 CairoGraphics::CairoGraphics(double zoom)
@@ -64,6 +266,8 @@ double CairoGraphics::GetZoom() const {
 void CairoGraphics::SetZoom(double zoom) {
   if (impl_->zoom_ != zoom) {
     impl_->zoom_ = (zoom > 0 ? zoom : 1);
+    // Don't bother to zoom the idle scratch canvases.
+    impl_->scratch_canvases_.Clear();
     impl_->on_zoom_signal_(impl_->zoom_);
   }
 }
@@ -83,6 +287,70 @@ CanvasInterface *CairoGraphics::NewCanvas(double w, double h) const {
   return canvas;
 }
 
+CanvasInterface *CairoGraphics::NewScratchCanvas(double w, double h) const {
+  if (w <= 0 || h <= 0) return NULL;
+  Impl::ScratchCanvas *canvas = down_cast<Impl::ScratchCanvas *>(
+      impl_->scratch_canvases_.Get(w, h));
+  if (canvas) {
+    canvas->in_pool_ = false;
+  } else {
+    canvas = new Impl::ScratchCanvas(this, impl_, w, h);
+    if (!canvas->IsValid()) {
+      delete canvas;
+      return NULL;
+    }
+  }
+  impl_->scratch_canvases_in_use_.insert(canvas);
+  return canvas;
+}
+
+const CanvasPool *CairoGraphics::GetScratchCanvasPool() const {
+  return &impl_->scratch_canvases_;
+}
+
+cairo_surface_t *CairoGraphics::GetShmSurface(GdkWindow *window,
+                                             int width, int height) {
+#ifdef GGL_HAVE_XSHM
+  if (!window || width <= 0 || height <= 0 || !impl_->shm_supported_)
+    return NULL;
+  if (!impl_->shm_surface_ ||
+      !impl_->shm_surface_->Matches(window, width, height)) {
+    delete impl_->shm_surface_;
+    impl_->shm_surface_ = new ShmSurface(window);
+    if (!impl_->shm_surface_->Init(width, height)) {
+      DLOG("MIT-SHM is not available for window %p.", window);
+      delete impl_->shm_surface_;
+      impl_->shm_surface_ = NULL;
+      impl_->shm_supported_ = false;
+      return NULL;
+    }
+  }
+  return impl_->shm_surface_->Get();
+#else
+  GGL_UNUSED(window);
+  GGL_UNUSED(width);
+  GGL_UNUSED(height);
+  return NULL;
+#endif
+}
+
+void CairoGraphics::PutShmSurface(GdkRegion *region) {
+#ifdef GGL_HAVE_XSHM
+  if (impl_->shm_surface_)
+    impl_->shm_surface_->Put(region);
+#else
+  GGL_UNUSED(region);
+#endif
+}
+
+void CairoGraphics::ReleaseShmSurface() {
+#ifdef GGL_HAVE_XSHM
+  delete impl_->shm_surface_;
+  impl_->shm_surface_ = NULL;
+  impl_->shm_supported_ = true;
+#endif
+}
+
 #ifdef HAVE_RSVG_LIBRARY
 static bool IsSvg(const std::string &data) {
   //TODO: better detection method?
@@ -17,11 +17,15 @@
 #ifndef GGADGET_GTK_CAIRO_GRAPHICS_H__
 #define GGADGET_GTK_CAIRO_GRAPHICS_H__
 
+#include <gdk/gdk.h>
 #include <ggadget/common.h>
 #include <ggadget/graphics_interface.h>
 #include <ggadget/slot.h>
 
 namespace ggadget {
+
+class CanvasPool;
+
 namespace gtk {
 
 /**
@@ -49,9 +53,35 @@ class CairoGraphics : public GraphicsInterface {
 
   Connection *ConnectOnZoom(Slot1<void, double> *slot) const;
 
+  /** Gets the pool of idle scratch canvases, mainly for statistics. */
+  const CanvasPool *GetScratchCanvasPool() const;
+
+  /**
+   * Gets a cairo image surface in MIT-SHM shared memory of the X server, to
+   * present views on @a window without sending the pixels through the X
+   * connection. Views draw straight into the surface, and the damaged parts
+   * are put onto the window with @c PutShmSurface().
+   *
+   * The surface is owned by the graphics object, and is reused while the
+   * window and the size are unchanged. It waits until the X server has
+   * finished the last put, so that the surface can be drawn again.
+   *
+   * @return NULL if MIT-SHM is not supported by the display or the visual
+   *     of @a window.
+   */
+  cairo_surface_t *GetShmSurface(GdkWindow *window, int width, int height);
+
+  /** Puts @a region of the MIT-SHM surface onto its window. */
+  void PutShmSurface(GdkRegion *region);
+
+  /** Frees the MIT-SHM surface. */
+  void ReleaseShmSurface();
+
  public:
   virtual CanvasInterface *NewCanvas(double w, double h) const;
 
+  virtual CanvasInterface *NewScratchCanvas(double w, double h) const;
+
   virtual ImageInterface *NewImage(const std::string &tag,
                                    const std::string &data,
                                    bool is_mask) const;
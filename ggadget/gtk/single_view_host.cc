@@ -228,6 +228,8 @@ class SingleViewHost::Impl {
     // instead of the GtkFixed widget, to get better performance and make the
     // input event mask effective.
     binder_ = new ViewWidgetBinder(view_, owner_, widget_, transparent);
+    if (flags_ & SHARED_MEMORY)
+      binder_->EnableSharedMemory(true);
 
     gtk_widget_realize(fixed_);
     gtk_widget_realize(window_);
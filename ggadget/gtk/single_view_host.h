@@ -60,6 +60,10 @@ class SingleViewHost : public ViewHostInterface {
    * - DIALOG_TYPE_HINT
    *   Uses GDK_WINDOW_TYPE_HINT_DIALOG by default. To workaround problems on
    *   some special window managers, like matchbox.
+   * - SHARED_MEMORY
+   *   Presents the view through MIT-SHM shared memory images, if the X
+   *   server supports it. It's faster on local X servers without
+   *   compositing.
    */
   enum Flags {
     DEFAULT           = 0,
@@ -68,7 +72,8 @@ class SingleViewHost : public ViewHostInterface {
     RECORD_STATES     = 0x04,
     WM_MANAGEABLE     = 0x08,
     OPAQUE_BACKGROUND = 0x10,
-    DIALOG_TYPE_HINT  = 0x20
+    DIALOG_TYPE_HINT  = 0x20,
+    SHARED_MEMORY     = 0x40
   };
 
   /**
@@ -21,6 +21,7 @@
 #include "ggadget/common.h"
 #include "ggadget/color.h"
 #include "ggadget/canvas_interface.h"
+#include "ggadget/font_interface.h"
 #include "ggadget/gtk/cairo_canvas.h"
 #include "ggadget/gtk/cairo_graphics.h"
 #include "unittest/gtest.h"
@@ -185,6 +186,46 @@ TEST_F(CairoCanvasTest, GetPointValue) {
 }
 #endif
 
+TEST_F(CairoCanvasTest, TextLayoutCache) {
+  FontInterface *font = gfx_.NewFont("Sans", 12, FontInterface::STYLE_NORMAL,
+                                     FontInterface::WEIGHT_NORMAL);
+  ASSERT_TRUE(font);
+  const char *text = "The quick brown fox jumps over the lazy dog";
+
+  size_t hits = CairoCanvas::GetTextLayoutCacheHitCount();
+  size_t misses = CairoCanvas::GetTextLayoutCacheMissCount();
+  EXPECT_TRUE(canvas_->DrawText(0, 0, 100, 50, text, font, Color::kBlack,
+                                CanvasInterface::ALIGN_CENTER,
+                                CanvasInterface::VALIGN_MIDDLE,
+                                CanvasInterface::TRIMMING_WORD_ELLIPSIS, 0));
+  EXPECT_EQ(misses + 1, CairoCanvas::GetTextLayoutCacheMissCount());
+  // The same text in another position reuses the layout.
+  EXPECT_TRUE(canvas_->DrawText(50, 50, 100, 50, text, font, Color::kBlack,
+                                CanvasInterface::ALIGN_CENTER,
+                                CanvasInterface::VALIGN_MIDDLE,
+                                CanvasInterface::TRIMMING_WORD_ELLIPSIS, 0));
+  EXPECT_EQ(hits + 1, CairoCanvas::GetTextLayoutCacheHitCount());
+  EXPECT_EQ(misses + 1, CairoCanvas::GetTextLayoutCacheMissCount());
+
+  // Text extents are cached separately.
+  double width1, height1, width2, height2;
+  EXPECT_TRUE(canvas_->GetTextExtents(text, font, 0, 0, &width1, &height1));
+  EXPECT_EQ(misses + 2, CairoCanvas::GetTextLayoutCacheMissCount());
+  EXPECT_TRUE(canvas_->GetTextExtents(text, font, 0, 0, &width2, &height2));
+  EXPECT_EQ(hits + 2, CairoCanvas::GetTextLayoutCacheHitCount());
+  EXPECT_EQ(width1, width2);
+  EXPECT_EQ(height1, height2);
+  EXPECT_GT(width1, 0);
+  EXPECT_GT(height1, 0);
+
+  // Another text is laid out again.
+  EXPECT_TRUE(canvas_->GetTextExtents("12:00", font, 0, 0, &width2, &height2));
+  EXPECT_EQ(misses + 3, CairoCanvas::GetTextLayoutCacheMissCount());
+  EXPECT_LT(width2, width1);
+
+  font->Destroy();
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
 
@@ -25,6 +25,7 @@
 #include <strings.h>
 #include <string>
 
+#include "ggadget/canvas_pool.h"
 #include "ggadget/common.h"
 #include "ggadget/system_utils.h"
 #include "ggadget/gtk/cairo_canvas.h"
@@ -94,6 +95,42 @@ TEST_F(CairoGfxTest, NewCanvas) {
   c = NULL;
 }
 
+TEST_F(CairoGfxTest, NewScratchCanvas) {
+  const CanvasPool *pool = gfx_.GetScratchCanvasPool();
+  CanvasInterface *c = gfx_.NewScratchCanvas(100, 100);
+  ASSERT_TRUE(c != NULL);
+  EXPECT_EQ(1U, pool->GetMissCount());
+  EXPECT_TRUE(c->DrawFilledRect(0, 0, 100, 100, Color(1, 0, 0)));
+  c->Destroy();
+  // 200x200 pixels at zoom 2.
+  EXPECT_EQ(160000U, pool->GetRetainedBytes());
+
+  // The canvas with the same size is reused and cleared.
+  CanvasInterface *c1 = gfx_.NewScratchCanvas(100, 100);
+  EXPECT_EQ(c, c1);
+  EXPECT_EQ(1U, pool->GetReuseCount());
+  EXPECT_EQ(0U, pool->GetRetainedBytes());
+  double opacity = 1;
+  EXPECT_TRUE(c1->GetPointValue(50, 50, NULL, &opacity));
+  EXPECT_DOUBLE_EQ(0, opacity);
+
+  CanvasInterface *c2 = gfx_.NewScratchCanvas(50, 100);
+  EXPECT_NE(c1, c2);
+  EXPECT_EQ(2U, pool->GetMissCount());
+  c1->Destroy();
+  c2->Destroy();
+  EXPECT_EQ(240000U, pool->GetRetainedBytes());
+
+  // Canvases larger than the limit are not retained.
+  c = gfx_.NewScratchCanvas(2000, 2000);
+  ASSERT_TRUE(c != NULL);
+  c->Destroy();
+  EXPECT_EQ(240000U, pool->GetRetainedBytes());
+
+  gfx_.SetZoom(1);
+  EXPECT_EQ(0U, pool->GetRetainedBytes());
+}
+
 TEST_F(CairoGfxTest, LoadImage) {
   char *buffer = NULL;
 
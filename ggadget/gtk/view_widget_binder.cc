@@ -55,7 +55,8 @@ static const double kDragThreshold = 3;
 static const uint64_t kFPSCountDuration = 5000;
 #endif
 
-// Update input shape mask once per second.
+// Update input shape mask at most once per second, if the window content
+// has to be read back from the X server.
 static const uint64_t kUpdateMaskInterval = 1000;
 
 // Minimal interval between self draws.
@@ -71,9 +72,11 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
       widget_(widget),
 #if GTK_CHECK_VERSION(2,10,0)
       input_shape_mask_(NULL),
+      mask_region_(NULL),
       last_mask_time_(0),
       should_update_input_shape_mask_(false),
       enable_input_shape_mask_(false),
+      mask_changed_(false),
 #endif
       handlers_(new gulong[kEventHandlersNum]),
       current_drag_event_(NULL),
@@ -89,6 +92,7 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
 #ifdef _DEBUG
       draw_count_(0),
       last_fps_time_(0),
+      blit_pixel_count_(0),
 #endif
       zoom_(1.0),
       mouse_down_x_(-1),
@@ -97,7 +101,8 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
       self_draw_(false),
       self_draw_timer_(0),
       last_self_draw_time_(0),
-      sys_clip_region_(NULL) {
+      sys_clip_region_(NULL),
+      shm_enabled_(false) {
     ASSERT(view);
     ASSERT(host);
     ASSERT(GTK_IS_WIDGET(widget));
@@ -149,6 +154,9 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
   }
 
   ~Impl() {
+    // The shared memory segment is attached to the X server, don't leave it
+    // behind for the graphics, which may outlive this binder.
+    ReleaseShmSurface();
     view_ = NULL;
 
     if (self_draw_timer_) {
@@ -183,9 +191,7 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
 
     g_object_unref(G_OBJECT(widget_));
 #if GTK_CHECK_VERSION(2,10,0)
-    if (input_shape_mask_) {
-      g_object_unref(G_OBJECT(input_shape_mask_));
-    }
+    DestroyInputShapeMask();
 #endif
   }
 
@@ -199,6 +205,19 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
     if (no_background_) {
       composited_ = DisableWidgetBackground(widget_);
     }
+    // The window may have been recreated with another visual.
+    if (shm_enabled_)
+      ReleaseShmSurface();
+  }
+
+  CairoGraphics *GetGraphics() {
+    return down_cast<CairoGraphics *>(view_->GetGraphics());
+  }
+
+  void ReleaseShmSurface() {
+    CairoGraphics *gfx = view_ ? GetGraphics() : NULL;
+    if (gfx)
+      gfx->ReleaseShmSurface();
   }
 
   GdkRegion *CreateExposeRegionFromViewClipRegion() {
@@ -273,7 +292,6 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
     gdk_drawable_get_size(widget_->window, &width, &height);
 
     bool update_input_shape_mask = enable_input_shape_mask_ &&
-        (GetCurrentTime() - last_mask_time_ > kUpdateMaskInterval) &&
         no_background_ && composited_;
 
     // We need set input shape mask if there is no background.
@@ -296,6 +314,8 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
         rect.width = width;
         rect.height = height;
         input_shape_mask_ = gdk_pixmap_new(NULL, width, height, 1);
+        alpha_map_.assign(static_cast<size_t>(width * height), 0);
+        mask_changed_ = true;
 
         // Redraw whole view.
         AddGdkRectToSystemClipRegion(&rect);
@@ -304,6 +324,106 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
 
     return update_input_shape_mask;
   }
+
+  void DestroyInputShapeMask() {
+    if (input_shape_mask_) {
+      g_object_unref(G_OBJECT(input_shape_mask_));
+      input_shape_mask_ = NULL;
+    }
+    if (mask_region_) {
+      gdk_region_destroy(mask_region_);
+      mask_region_ = NULL;
+    }
+    alpha_map_.clear();
+  }
+
+  // Compares the alpha channel of @a image, whose origin is at (x, y) of the
+  // window, with the alpha map in @a region, and saves the changes. Returns
+  // true if any alpha value has changed.
+  bool UpdateAlphaMap(cairo_surface_t *image, int x, int y,
+                      GdkRegion *region) {
+    gint mask_width, mask_height;
+    gdk_drawable_get_size(GDK_DRAWABLE(input_shape_mask_),
+                          &mask_width, &mask_height);
+    if (alpha_map_.size() != static_cast<size_t>(mask_width * mask_height))
+      return true;
+
+    cairo_surface_flush(image);
+    const unsigned char *data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    GdkRectangle bounds = { 0, 0, mask_width, mask_height };
+    GdkRectangle image_bounds = { x, y,
+                                  cairo_image_surface_get_width(image),
+                                  cairo_image_surface_get_height(image) };
+    gdk_rectangle_intersect(&bounds, &image_bounds, &bounds);
+
+    bool changed = false;
+    GdkRectangle *rects;
+    gint n_rects;
+    gdk_region_get_rectangles(region, &rects, &n_rects);
+    for (gint i = 0; i < n_rects; ++i) {
+      GdkRectangle rect;
+      if (!gdk_rectangle_intersect(&rects[i], &bounds, &rect))
+        continue;
+      for (int row = rect.y; row < rect.y + rect.height; ++row) {
+        const uint32_t *pixel = reinterpret_cast<const uint32_t *>(
+            data + (row - y) * stride) + (rect.x - x);
+        unsigned char *alpha = &alpha_map_[row * mask_width + rect.x];
+        for (int col = 0; col < rect.width; ++col) {
+          unsigned char value = static_cast<unsigned char>(pixel[col] >> 24);
+          if (alpha[col] != value) {
+            alpha[col] = value;
+            changed = true;
+          }
+        }
+      }
+    }
+    g_free(rects);
+    return changed;
+  }
+
+  // Updates the input shape mask in the region drawn since the last update,
+  // if the alpha channel of the window has changed there.
+  void UpdateInputShapeMask(cairo_surface_t *shm_surface) {
+    if (!mask_region_ || gdk_region_empty(mask_region_))
+      return;
+
+    // The shared memory has the whole window content, otherwise the drawn
+    // region is read back from the X server.
+    cairo_surface_t *image = shm_surface;
+    GdkRectangle box = { 0, 0, 0, 0 };
+    if (!image) {
+      gdk_region_get_clipbox(mask_region_, &box);
+      image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                         box.width, box.height);
+      cairo_t *cr = cairo_create(image);
+      cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+      gdk_cairo_set_source_pixmap(cr, widget_->window, -box.x, -box.y);
+      cairo_paint(cr);
+      cairo_destroy(cr);
+    }
+
+    if (UpdateAlphaMap(image, box.x, box.y, mask_region_) || mask_changed_) {
+      cairo_t *mask_cr = gdk_cairo_create(input_shape_mask_);
+      gdk_cairo_region(mask_cr, mask_region_);
+      cairo_clip(mask_cr);
+      cairo_set_operator(mask_cr, CAIRO_OPERATOR_CLEAR);
+      cairo_paint(mask_cr);
+      cairo_set_operator(mask_cr, CAIRO_OPERATOR_SOURCE);
+      cairo_set_source_surface(mask_cr, image, box.x, box.y);
+      cairo_paint(mask_cr);
+      cairo_destroy(mask_cr);
+      gdk_window_input_shape_combine_mask(widget_->window,
+                                          input_shape_mask_, 0, 0);
+      mask_changed_ = false;
+    }
+
+    if (!shm_surface)
+      cairo_surface_destroy(image);
+    gdk_region_destroy(mask_region_);
+    mask_region_ = NULL;
+    last_mask_time_ = GetCurrentTime();
+  }
 #endif
 
   GdkRegion *GetInvalidateRegion() {
@@ -541,9 +661,29 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
       gdk_region_destroy(invalidate_region);
     }
 
-    gdk_window_begin_paint_region(widget->window, event->region);
+    // Draw straight into the shared memory if possible, otherwise into an
+    // off-screen pixmap of the X server.
+    cairo_surface_t *shm_surface = NULL;
+    if (impl->shm_enabled_) {
+      gint width, height;
+      gdk_drawable_get_size(widget->window, &width, &height);
+      shm_surface = impl->GetGraphics()->GetShmSurface(widget->window,
+                                                       width, height);
+    }
+
+    cairo_t *cr;
+    if (shm_surface) {
+      cr = cairo_create(shm_surface);
+    } else {
+      gdk_window_begin_paint_region(widget->window, event->region);
+      cr = gdk_cairo_create(widget->window);
+    }
 
-    cairo_t *cr = gdk_cairo_create(widget->window);
+    // Only the exposed region needs compositing. The View only copies the
+    // damaged part of its canvas cache, so clipping here keeps the paint
+    // buffer from being filled outside the damage as well.
+    gdk_cairo_region(cr, event->region);
+    cairo_clip(cr);
 
     // If background is disabled, and if composited is enabled,  the window
     // needs clearing every times.
@@ -552,6 +692,11 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
       cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
       cairo_paint(cr);
       cairo_set_operator(cr, op);
+    } else if (shm_surface) {
+      // Like gdk_window_begin_paint_region(), start with the background.
+      gdk_cairo_set_source_color(
+          cr, &widget->style->bg[GTK_WIDGET_STATE(widget)]);
+      cairo_paint(cr);
     }
 
     // Let View draw on the gdk window directly.
@@ -567,37 +712,40 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
     canvas->Destroy();
     cairo_destroy(cr);
 
+    // Copy off-screen buffer to screen.
+    if (shm_surface)
+      impl->GetGraphics()->PutShmSurface(event->region);
+    else
+      gdk_window_end_paint(widget->window);
+
 #if GTK_CHECK_VERSION(2,10,0)
     // We need set input shape mask if there is no background.
     if (impl->should_update_input_shape_mask_ && impl->input_shape_mask_) {
-      cairo_t *mask_cr = gdk_cairo_create(impl->input_shape_mask_);
-      gdk_cairo_region(mask_cr, event->region);
-      cairo_clip(mask_cr);
-      cairo_set_operator(mask_cr, CAIRO_OPERATOR_CLEAR);
-      cairo_paint(mask_cr);
-      cairo_set_operator(mask_cr, CAIRO_OPERATOR_SOURCE);
-      gdk_cairo_set_source_pixmap(mask_cr, widget->window, 0, 0);
-      cairo_paint(mask_cr);
-      cairo_destroy(mask_cr);
-      gdk_window_input_shape_combine_mask(widget->window,
-                                          impl->input_shape_mask_, 0, 0);
-      impl->last_mask_time_ = GetCurrentTime();
+      if (!impl->mask_region_)
+        impl->mask_region_ = gdk_region_new();
+      gdk_region_union(impl->mask_region_, event->region);
+      // Reading back the window is expensive, so don't do it for every draw.
+      if (shm_surface ||
+          GetCurrentTime() - impl->last_mask_time_ > kUpdateMaskInterval)
+        impl->UpdateInputShapeMask(shm_surface);
     }
 #endif
 
-    // Copy off-screen buffer to screen.
-    gdk_window_end_paint(widget->window);
-
 #ifdef _DEBUG
     ++impl->draw_count_;
+    impl->blit_pixel_count_ += impl->view_->GetBlitPixelCount();
     uint64_t current_time = GetCurrentTime();
     uint64_t duration = current_time - impl->last_fps_time_;
     if (duration >= kFPSCountDuration) {
       impl->last_fps_time_ = current_time;
-      DLOG("FPS of View %s: %f", impl->view_->GetCaption().c_str(),
+      DLOG("FPS of View %s: %f, pixels per frame: %f",
+           impl->view_->GetCaption().c_str(),
            static_cast<double>(impl->draw_count_ * 1000) /
-           static_cast<double>(duration));
+           static_cast<double>(duration),
+           static_cast<double>(impl->blit_pixel_count_) /
+           static_cast<double>(impl->draw_count_));
       impl->draw_count_ = 0;
+      impl->blit_pixel_count_ = 0;
     }
 #endif
 
@@ -949,6 +1097,13 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
     impl->SetupBackgroundMode();
   }
 
+  // The surface is bound to the widget's X window, which goes away here.
+  static void UnrealizeHandler(GtkWidget *widget, gpointer user_data) {
+    GGL_UNUSED(widget);
+    Impl *impl = reinterpret_cast<Impl *>(user_data);
+    impl->ReleaseShmSurface();
+  }
+
   static void CompositedChangedHandler(GtkWidget *widget, gpointer user_data) {
     GGL_UNUSED(widget);
     Impl *impl = reinterpret_cast<Impl *>(user_data);
@@ -990,9 +1145,15 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
   GtkWidget *widget_;
 #if GTK_CHECK_VERSION(2,10,0)
   GdkBitmap *input_shape_mask_;
+  // The region drawn since the last update of the input shape mask.
+  GdkRegion *mask_region_;
+  // The alpha channel of the window when the mask was updated.
+  std::vector<unsigned char> alpha_map_;
   uint64_t last_mask_time_;
   bool should_update_input_shape_mask_;
   bool enable_input_shape_mask_;
+  // Whether the mask must be updated even if the alpha is unchanged.
+  bool mask_changed_;
 #endif
   gulong *handlers_;
   DragEvent *current_drag_event_;
@@ -1008,6 +1169,7 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
 #ifdef _DEBUG
   int draw_count_;
   uint64_t last_fps_time_;
+  uint64_t blit_pixel_count_;
 #endif
   double zoom_;
   double mouse_down_x_;
@@ -1018,6 +1180,7 @@ class ViewWidgetBinder::Impl : public SmallObject<> {
   guint self_draw_timer_;
   uint64_t last_self_draw_time_;
   GdkRegion *sys_clip_region_;
+  bool shm_enabled_;
 
   struct EventHandlerInfo {
     const char *event;
@@ -1049,6 +1212,7 @@ ViewWidgetBinder::Impl::kEventHandlers[] = {
   { "motion-notify-event", G_CALLBACK(MotionNotifyHandler) },
   { "screen-changed", G_CALLBACK(ScreenChangedHandler) },
   { "scroll-event", G_CALLBACK(ScrollHandler) },
+  { "unrealize", G_CALLBACK(UnrealizeHandler) },
 #ifdef GRAB_POINTER_EXPLICITLY
   { "grab-broken-event", G_CALLBACK(GrabBrokenHandler) },
 #endif
@@ -1072,16 +1236,22 @@ void ViewWidgetBinder::EnableInputShapeMask(bool enable) {
       if (impl_->widget_->window) {
         gdk_window_input_shape_combine_mask(impl_->widget_->window, NULL, 0, 0);
       }
-      if (impl_->input_shape_mask_) {
-        g_object_unref(G_OBJECT(impl_->input_shape_mask_));
-        impl_->input_shape_mask_ = NULL;
-      }
+      impl_->DestroyInputShapeMask();
     }
     gtk_widget_queue_draw(impl_->widget_);
   }
 #endif
 }
 
+void ViewWidgetBinder::EnableSharedMemory(bool enable) {
+  if (impl_->shm_enabled_ != enable) {
+    impl_->shm_enabled_ = enable;
+    if (!enable)
+      impl_->ReleaseShmSurface();
+    gtk_widget_queue_draw(impl_->widget_);
+  }
+}
+
 ViewWidgetBinder::~ViewWidgetBinder() {
   delete impl_;
   impl_ = NULL;
@@ -54,6 +54,14 @@ class ViewWidgetBinder {
    */
   void EnableInputShapeMask(bool enable);
 
+  /**
+   * Enables or disables presenting the view through MIT-SHM shared memory
+   * images, if the X server supports it. The view is then drawn straight
+   * into memory shared with the X server, and only the damaged rectangles
+   * are sent to the window. It's disabled by default.
+   */
+  void EnableSharedMemory(bool enable);
+
   /** Called by ViewHost to queue a redraw request. */
   void QueueDraw();
 
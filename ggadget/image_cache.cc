@@ -15,6 +15,7 @@
 */
 
 #include <string>
+#include <list>
 #include <map>
 #include <algorithm>
 #include "common.h"
@@ -23,7 +24,6 @@
 #include "graphics_interface.h"
 #include "image_cache.h"
 #include "logger.h"
-#include "main_loop_interface.h"
 #include "small_object.h"
 #include "system_utils.h"
 
@@ -37,16 +37,24 @@
 
 namespace {
 
-const int kPurgeTrashInterval = 60000;  // 60 seconds
+// Default bytes of decoded pixels kept for the images no longer in use.
+const size_t kDefaultMemoryBudget = 8 * 1024 * 1024;
 
 }  // namespace
 
 namespace ggadget {
 
-class ImageCache::Impl : public WatchCallbackInterface {
+class ImageCache::Impl {
   class SharedImage;
   typedef LightMap<std::string, SharedImage *> ImageMap;
-  typedef LightMap<std::string, ImageInterface *> TrashImageMap;
+  // Keys of the trashed images, the most recently trashed first.
+  typedef std::list<std::pair<std::string, bool> > TrashList;
+  struct TrashedImage {
+    ImageInterface *image;
+    size_t bytes;
+    TrashList::iterator position;
+  };
+  typedef LightMap<std::string, TrashedImage> TrashImageMap;
 
   class SharedImage : public ImageInterface {
    public:
@@ -137,7 +145,13 @@ class ImageCache::Impl : public WatchCallbackInterface {
   };
 
  public:
-  Impl() : ref_(0), watch_id_(-1) {
+  Impl()
+      : memory_budget_(kDefaultMemoryBudget),
+        trashed_bytes_(0),
+        num_hits_(0),
+        num_misses_(0),
+        num_evictions_(0),
+        ref_(0) {
 #ifdef DEBUG_IMAGE_CACHE
     DLOG("Create ImageCache: %p", this);
     num_new_local_images_ = 0;
@@ -147,16 +161,9 @@ class ImageCache::Impl : public WatchCallbackInterface {
     num_trashed_images_ = 0;
     num_untrashed_images_ = 0;
 #endif
-    MainLoopInterface *main_loop = GetGlobalMainLoop();
-    if (main_loop)
-      watch_id_ = main_loop->AddTimeoutWatch(kPurgeTrashInterval, this);
   }
 
   ~Impl() {
-    MainLoopInterface *main_loop = GetGlobalMainLoop();
-    if (main_loop)
-      main_loop->RemoveWatch(watch_id_);
-
 #ifdef DEBUG_IMAGE_CACHE
     DLOG("Delete ImageCache: %p", this);
     DLOG("Image statistics(new/shared): "
@@ -166,6 +173,9 @@ class ImageCache::Impl : public WatchCallbackInterface {
          num_new_global_images_, num_shared_global_images_,
          images_.size() + mask_images_.size(),
          num_trashed_images_, num_untrashed_images_);
+    DLOG("Decoded image cache statistics(hit/miss/evict): "
+         "%"PRIuS"/%"PRIuS"/%"PRIuS,
+         num_hits_, num_misses_, num_evictions_);
 #endif
     for (ImageMap::const_iterator it = images_.begin();
          it != images_.end(); ++it) {
@@ -183,19 +193,6 @@ class ImageCache::Impl : public WatchCallbackInterface {
     PurgeTrashCan();
   }
 
-  // Overridden from WatchCallbackInterface:
-  virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
-    GGL_UNUSED(main_loop);
-    GGL_UNUSED(watch_id);
-    PurgeTrashCan();
-    return true;
-  }
-
-  virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
-    GGL_UNUSED(main_loop);
-    GGL_UNUSED(watch_id);
-  }
-
   ImageInterface *LoadImage(GraphicsInterface *gfx, FileManagerInterface *fm,
                             const std::string &filename, bool is_mask) {
     if (!gfx || filename.empty())
@@ -216,6 +213,7 @@ class ImageCache::Impl : public WatchCallbackInterface {
         num_shared_local_images_++;
         DLOG("Local image %s found in cache.", local_key.c_str());
 #endif
+        num_hits_++;
         it->second->Ref();
         return it->second;
       }
@@ -229,6 +227,7 @@ class ImageCache::Impl : public WatchCallbackInterface {
         num_shared_global_images_++;
         DLOG("Global image %s found in cache.", global_key.c_str());
 #endif
+        num_hits_++;
         it->second->Ref();
         return it->second;
       }
@@ -237,18 +236,24 @@ class ImageCache::Impl : public WatchCallbackInterface {
     // The image was not loaded yet.
     ImageInterface *img = NULL;
 
-    // Find the image in trash can first.
+    // Find the image in trash can first, to avoid decoding it again.
     if (fm) {
       img = Untrash(local_key, is_mask);
-      if (img)
+      if (img) {
+        num_hits_++;
         return NewSharedImage(local_key, filename, img, is_mask);
+      }
     }
     if (global_fm) {
       img = Untrash(global_key, is_mask);
-      if (img)
+      if (img) {
+        num_hits_++;
         return NewSharedImage(global_key, filename, img, is_mask);
+      }
     }
 
+    num_misses_++;
+
     std::string data;
     std::string key;
     if (fm && fm->ReadFile(filename.c_str(), &data)) {
@@ -294,6 +299,9 @@ class ImageCache::Impl : public WatchCallbackInterface {
     return shared_img;
   }
 
+  // Keeps an image no longer in use in the trash can, so that it can be
+  // reused without decoding again. The least recently trashed images are
+  // destroyed when the trashed images use more memory than the budget.
   void Trash(const std::string &key, ImageInterface *image, bool is_mask) {
     ImageMap *images = is_mask ? &mask_images_ : &images_;
     images->erase(key);
@@ -307,7 +315,13 @@ class ImageCache::Impl : public WatchCallbackInterface {
 #endif
     TrashImageMap *trash = is_mask ? &trashed_mask_images_ : &trashed_images_;
     ASSERT(!trash->count(key));
-    (*trash)[key] = image;
+    TrashedImage &trashed = (*trash)[key];
+    trashed.image = image;
+    trashed.bytes = GetImageBytes(image);
+    trashed.position = trash_list_.insert(trash_list_.begin(),
+                                          std::make_pair(key, is_mask));
+    trashed_bytes_ += trashed.bytes;
+    TrimTrashCan(memory_budget_);
   }
 
   ImageInterface* Untrash(const std::string &key, bool is_mask) {
@@ -318,13 +332,30 @@ class ImageCache::Impl : public WatchCallbackInterface {
       DLOG("Untrash image: %s", key.c_str());
       num_untrashed_images_++;
 #endif
-      ImageInterface *image = i->second;
+      ImageInterface *image = i->second.image;
+      trashed_bytes_ -= i->second.bytes;
+      trash_list_.erase(i->second.position);
       trash->erase(i);
       return image;
     }
     return NULL;
   }
 
+  // Destroys the least recently trashed images until the trashed images
+  // use no more than max_bytes.
+  void TrimTrashCan(size_t max_bytes) {
+    while (trashed_bytes_ > max_bytes && !trash_list_.empty()) {
+      const std::pair<std::string, bool> &last = trash_list_.back();
+#ifdef DEBUG_IMAGE_CACHE
+      DLOG("Evict image: %s", last.first.c_str());
+#endif
+      ImageInterface *image = Untrash(last.first, last.second);
+      if (image)
+        image->Destroy();
+      num_evictions_++;
+    }
+  }
+
   void PurgeTrashCan() {
 #ifdef DEBUG_IMAGE_CACHE
     DLOG("Purge trashed images: %"PRIuS,
@@ -332,17 +363,28 @@ class ImageCache::Impl : public WatchCallbackInterface {
 #endif
     for (TrashImageMap::const_iterator it = trashed_images_.begin();
          it != trashed_images_.end(); ++it) {
-      if (it->second)
-        it->second->Destroy();
+      it->second.image->Destroy();
     }
     trashed_images_.clear();
 
     for (TrashImageMap::const_iterator it = trashed_mask_images_.begin();
          it != trashed_mask_images_.end(); ++it) {
-      if (it->second)
-        it->second->Destroy();
+      it->second.image->Destroy();
     }
     trashed_mask_images_.clear();
+    trash_list_.clear();
+    trashed_bytes_ = 0;
+  }
+
+  // Estimates the memory used by the decoded pixels of an image.
+  static size_t GetImageBytes(const ImageInterface *image) {
+    return static_cast<size_t>(image->GetWidth()) *
+           static_cast<size_t>(image->GetHeight()) * 4;
+  }
+
+  void SetMemoryBudget(size_t bytes) {
+    memory_budget_ = bytes;
+    TrimTrashCan(memory_budget_);
   }
 
   void Ref() {
@@ -393,9 +435,17 @@ class ImageCache::Impl : public WatchCallbackInterface {
 
   TrashImageMap trashed_images_;
   TrashImageMap trashed_mask_images_;
+  TrashList trash_list_;
 
+ public:
+  size_t memory_budget_;
+  size_t trashed_bytes_;
+  size_t num_hits_;
+  size_t num_misses_;
+  size_t num_evictions_;
+
+ private:
   int ref_;
-  int watch_id_;
 
 #ifdef DEBUG_IMAGE_CACHE
   int num_new_local_images_;
@@ -430,4 +480,28 @@ ImageInterface *ImageCache::LoadImage(GraphicsInterface *gfx,
   return impl_->LoadImage(gfx, fm, filename, is_mask);
 }
 
+void ImageCache::SetMemoryBudget(size_t bytes) {
+  impl_->SetMemoryBudget(bytes);
+}
+
+size_t ImageCache::GetMemoryBudget() const {
+  return impl_->memory_budget_;
+}
+
+size_t ImageCache::GetCachedBytes() const {
+  return impl_->trashed_bytes_;
+}
+
+size_t ImageCache::GetHitCount() const {
+  return impl_->num_hits_;
+}
+
+size_t ImageCache::GetMissCount() const {
+  return impl_->num_misses_;
+}
+
+size_t ImageCache::GetEvictionCount() const {
+  return impl_->num_evictions_;
+}
+
 } // namespace ggadget
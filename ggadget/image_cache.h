@@ -35,6 +35,11 @@ namespace ggadget {
  * used as normal image without any difference.
  *
  * Each View shall have its own ImageCache object.
+ *
+ * The decoded images no longer used by anyone are kept in a memory limited
+ * cache, and are evicted in least recently used order, so that showing them
+ * again needn't decode them again. All ImageCache objects share the same
+ * underlying cache.
  */
 class ImageCache {
  public:
@@ -54,6 +59,25 @@ class ImageCache {
   ImageInterface *LoadImage(GraphicsInterface *gfx, FileManagerInterface *fm,
                             const std::string &filename, bool is_mask);
 
+  /**
+   * Sets the maximum bytes of decoded pixels kept for the images no longer
+   * in use. Default is 8MB. Setting it to 0 disables the cache.
+   */
+  void SetMemoryBudget(size_t bytes);
+  size_t GetMemoryBudget() const;
+
+  /** Gets the bytes of decoded pixels currently kept in the cache. */
+  size_t GetCachedBytes() const;
+
+  /**
+   * Gets the statistics of the cache. A hit is an image loaded without
+   * decoding, a miss is an image decoded, and an eviction is an unused
+   * image destroyed to fit the memory budget.
+   */
+  size_t GetHitCount() const;
+  size_t GetMissCount() const;
+  size_t GetEvictionCount() const;
+
  private:
   class Impl;
   Impl *impl_;
@@ -0,0 +1,187 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <ggadget/digest_utils.h>
+#include <ggadget/file_manager_factory.h>
+#include <ggadget/file_manager_interface.h>
+#include <ggadget/light_map.h>
+#include <ggadget/logger.h>
+#include "jscript_massager.h"
+#include "jscript_massager_cache.h"
+
+namespace ggadget {
+namespace js {
+
+// The first line of each file of the disk cache.
+static const char kDiskCacheHeaderFormat[] = "GGL-MASSAGED-JS %d\n";
+
+class MassagedScriptCache::Impl {
+ public:
+  Impl()
+      : file_manager_(NULL),
+        file_manager_set_(false),
+        memory_size_(0),
+        memory_hits_(0),
+        disk_hits_(0),
+        misses_(0) {
+    snprintf(disk_header_, sizeof(disk_header_), kDiskCacheHeaderFormat,
+             kMassagerVersion);
+  }
+
+  FileManagerInterface *GetFileManager() {
+    return file_manager_set_ ? file_manager_ : GetGlobalFileManager();
+  }
+
+  static std::string GetDiskCachePath(const std::string &digest) {
+    static const char kHexDigits[] = "0123456789abcdef";
+    std::string path(kMassagedScriptCacheDir);
+    for (size_t i = 0; i < digest.size(); ++i) {
+      unsigned char c = static_cast<unsigned char>(digest[i]);
+      path += kHexDigits[c >> 4];
+      path += kHexDigits[c & 0xf];
+    }
+    return path + ".js";
+  }
+
+  bool ReadDiskCache(const std::string &digest, std::string *result) {
+    FileManagerInterface *fm = GetFileManager();
+    std::string data;
+    if (!fm || !fm->ReadFile(GetDiskCachePath(digest).c_str(), &data))
+      return false;
+    size_t header_size = strlen(disk_header_);
+    if (data.compare(0, header_size, disk_header_) != 0) {
+      DLOG("Ignore massaged script of another version: %s",
+           GetDiskCachePath(digest).c_str());
+      return false;
+    }
+    result->assign(data, header_size, std::string::npos);
+    return true;
+  }
+
+  void WriteDiskCache(const std::string &digest, const std::string &result) {
+    FileManagerInterface *fm = GetFileManager();
+    if (fm && !fm->WriteFile(GetDiskCachePath(digest).c_str(),
+                             disk_header_ + result, true)) {
+      DLOG("Failed to write massaged script: %s",
+           GetDiskCachePath(digest).c_str());
+    }
+  }
+
+  void AddToMemory(const std::string &digest, const std::string &result) {
+    if (memory_size_ + result.size() > kMaxMemoryCacheSize)
+      ClearMemory();
+    memory_cache_[digest] = result;
+    memory_size_ += result.size();
+  }
+
+  void ClearMemory() {
+    memory_cache_.clear();
+    memory_size_ = 0;
+  }
+
+  std::string Massage(const char *input, const char *filename, int lineno) {
+    if (!input || !*input)
+      return std::string();
+
+    std::string digest;
+    if (!GenerateSHA1(input, &digest)) {
+      ++misses_;
+      return MassageJScript(input, false, filename, lineno);
+    }
+
+    MemoryCache::const_iterator it = memory_cache_.find(digest);
+    if (it != memory_cache_.end()) {
+      ++memory_hits_;
+      return it->second;
+    }
+
+    std::string result;
+    bool use_disk = strlen(input) >= kMinDiskCacheScriptSize;
+    if (use_disk && ReadDiskCache(digest, &result)) {
+      ++disk_hits_;
+    } else {
+      ++misses_;
+      result = MassageJScript(input, false, filename, lineno);
+      if (use_disk)
+        WriteDiskCache(digest, result);
+    }
+    AddToMemory(digest, result);
+    return result;
+  }
+
+  typedef LightMap<std::string, std::string> MemoryCache;
+  MemoryCache memory_cache_;
+  FileManagerInterface *file_manager_;
+  bool file_manager_set_;
+  size_t memory_size_;
+  size_t memory_hits_;
+  size_t disk_hits_;
+  size_t misses_;
+  char disk_header_[32];
+
+  static MassagedScriptCache *cache_;
+};
+
+MassagedScriptCache *MassagedScriptCache::Impl::cache_ = NULL;
+
+const int MassagedScriptCache::kMassagerVersion;
+const size_t MassagedScriptCache::kMinDiskCacheScriptSize;
+const size_t MassagedScriptCache::kMaxMemoryCacheSize;
+
+MassagedScriptCache::MassagedScriptCache()
+    : impl_(new Impl()) {
+}
+
+MassagedScriptCache::~MassagedScriptCache() {
+  delete impl_;
+}
+
+std::string MassagedScriptCache::Massage(const char *input,
+                                         const char *filename, int lineno) {
+  return impl_->Massage(input, filename, lineno);
+}
+
+void MassagedScriptCache::SetFileManager(FileManagerInterface *file_manager) {
+  impl_->file_manager_ = file_manager;
+  impl_->file_manager_set_ = true;
+}
+
+void MassagedScriptCache::ClearMemoryCache() {
+  impl_->ClearMemory();
+}
+
+size_t MassagedScriptCache::GetMemoryHitCount() const {
+  return impl_->memory_hits_;
+}
+
+size_t MassagedScriptCache::GetDiskHitCount() const {
+  return impl_->disk_hits_;
+}
+
+size_t MassagedScriptCache::GetMissCount() const {
+  return impl_->misses_;
+}
+
+MassagedScriptCache *MassagedScriptCache::get() {
+  if (!Impl::cache_)
+    Impl::cache_ = new MassagedScriptCache();
+  return Impl::cache_;
+}
+
+} // namespace js
+} // namespace ggadget
@@ -0,0 +1,109 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef GGADGET_JS_JSCRIPT_MASSAGER_CACHE_H__
+#define GGADGET_JS_JSCRIPT_MASSAGER_CACHE_H__
+
+#include <string>
+#include <ggadget/common.h>
+
+namespace ggadget {
+
+class FileManagerInterface;
+
+namespace js {
+
+/**
+ * @ingroup JSLibrary
+ * @{
+ */
+
+/**
+ * Caches the results of MassageJScript(), keyed by the SHA1 digest of the
+ * input script, so that the same script is massaged only once.
+ *
+ * Results are kept in memory. Results of scripts not shorter than
+ * kMinDiskCacheScriptSize are also stored under kMassagedScriptCacheDir with
+ * the global file manager, so that they survive restarts of the host. Entries
+ * stored by a different kMassagerVersion are ignored and overwritten.
+ */
+class MassagedScriptCache {
+ public:
+  /**
+   * Version of the massager output. Must be increased whenever
+   * jscript_massager.l changes its output.
+   */
+  static const int kMassagerVersion = 1;
+
+  /** Scripts shorter than this are only cached in memory. */
+  static const size_t kMinDiskCacheScriptSize = 1024;
+
+  /** The memory cache is cleared when it grows beyond this size. */
+  static const size_t kMaxMemoryCacheSize = 4 * 1024 * 1024;
+
+  /**
+   * Returns the same result as MassageJScript(input, false, filename,
+   * lineno), from the cache if possible.
+   */
+  std::string Massage(const char *input, const char *filename, int lineno);
+
+  /**
+   * Sets the file manager to store the disk cache. If not set, the global
+   * file manager is used. @c NULL disables the disk cache.
+   */
+  void SetFileManager(FileManagerInterface *file_manager);
+
+  /** Clears the memory cache. The disk cache is not affected. */
+  void ClearMemoryCache();
+
+  /** Returns the number of results found in the memory cache. */
+  size_t GetMemoryHitCount() const;
+  /** Returns the number of results found in the disk cache. */
+  size_t GetDiskHitCount() const;
+  /** Returns the number of scripts actually massaged. */
+  size_t GetMissCount() const;
+
+  /** Gets the singleton of MassagedScriptCache. */
+  static MassagedScriptCache *get();
+
+ private:
+  class Impl;
+  Impl *impl_;
+
+  MassagedScriptCache();
+  ~MassagedScriptCache();
+
+  DISALLOW_EVIL_CONSTRUCTORS(MassagedScriptCache);
+};
+
+/** The directory to store massaged scripts. */
+const char kMassagedScriptCacheDir[] = "profile://massaged_scripts/";
+
+/**
+ * Shortcut of MassagedScriptCache::get()->Massage(), to be used by script
+ * runtimes in place of MassageJScript().
+ */
+inline std::string MassageJScriptCached(const char *input,
+                                        const char *filename, int lineno) {
+  return MassagedScriptCache::get()->Massage(input, filename, lineno);
+}
+
+/** @} */
+
+} // namespace js
+} // namespace ggadget
+
+#endif // GGADGET_JS_JSCRIPT_MASSAGER_CACHE_H__
@@ -14,8 +14,12 @@
   limitations under the License.
 */
 
+#include <map>
+#include <string>
 #include <unittest/gtest.h>
 #include "../jscript_massager.h"
+#include "../jscript_massager_cache.h"
+#include "ggadget/tests/mocked_file_manager.h"
 
 using namespace ggadget::js;
 
@@ -282,6 +286,50 @@ TEST(JScriptMassager, InnerFunctions) {
   ASSERT_STREQ(function_output, result.c_str());
 }
 
+TEST(JScriptMassager, Cache) {
+  MassagedScriptCache *cache = MassagedScriptCache::get();
+  MockedFileManager fm;
+  cache->SetFileManager(&fm);
+  const char *short_input = "options(a) = b;";
+  std::string expected = MassageJScript(short_input, false, "filename", 1);
+
+  ASSERT_EQ(expected, cache->Massage(short_input, "filename", 1));
+  ASSERT_EQ(1U, cache->GetMissCount());
+  ASSERT_EQ(expected, cache->Massage(short_input, "another", 10));
+  ASSERT_EQ(1U, cache->GetMemoryHitCount());
+  ASSERT_EQ(1U, cache->GetMissCount());
+  // Short scripts are not stored on disk.
+  ASSERT_TRUE(fm.data_.empty());
+
+  // A long script is stored on disk, and survives clearing the memory cache.
+  std::string long_input;
+  while (long_input.size() < MassagedScriptCache::kMinDiskCacheScriptSize)
+    long_input += input;
+  std::string long_expected =
+      MassageJScript(long_input.c_str(), false, "filename", 1);
+  ASSERT_EQ(long_expected, cache->Massage(long_input.c_str(), "filename", 1));
+  ASSERT_EQ(2U, cache->GetMissCount());
+  ASSERT_EQ(1U, fm.data_.size());
+  std::string path = fm.data_.begin()->first;
+  ASSERT_EQ(0U, path.find(kMassagedScriptCacheDir));
+
+  cache->ClearMemoryCache();
+  ASSERT_EQ(long_expected, cache->Massage(long_input.c_str(), "filename", 1));
+  ASSERT_EQ(1U, cache->GetDiskHitCount());
+  ASSERT_EQ(2U, cache->GetMissCount());
+
+  // Entries of another massager version are ignored and overwritten.
+  cache->ClearMemoryCache();
+  fm.data_[path] = "GGL-MASSAGED-JS 0\nstale";
+  ASSERT_EQ(long_expected, cache->Massage(long_input.c_str(), "filename", 1));
+  ASSERT_EQ(1U, cache->GetDiskHitCount());
+  ASSERT_EQ(3U, cache->GetMissCount());
+  ASSERT_NE(std::string::npos, fm.data_[path].find(long_expected));
+
+  ASSERT_EQ(std::string(), cache->Massage("", "filename", 1));
+  cache->SetFileManager(NULL);
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
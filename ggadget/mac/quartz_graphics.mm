@@ -56,6 +56,10 @@ CanvasInterface* QuartzGraphics::NewCanvas(double w, double h) const {
   return canvas.release();
 }
 
+CanvasInterface* QuartzGraphics::NewScratchCanvas(double w, double h) const {
+  return NewCanvas(w, h);
+}
+
 ImageInterface* QuartzGraphics::NewImage(const std::string& tag,
                                          const std::string& data,
                                          bool is_mask) const {
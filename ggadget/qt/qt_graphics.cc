@@ -14,8 +14,11 @@
   limitations under the License.
 */
 
+#include <cmath>
+#include <ggadget/canvas_pool.h>
 #include <ggadget/color.h>
 #include <ggadget/common.h>
+#include <ggadget/light_map.h>
 #include <ggadget/logger.h>
 #include "qt_graphics.h"
 #include "qt_canvas.h"
@@ -25,14 +28,60 @@
 namespace ggadget {
 namespace qt {
 
+// Maximum bytes retained by the idle scratch canvases of a QtGraphics.
+static const size_t kMaxScratchCanvasBytes = 4 * 1024 * 1024;
+
 class QtGraphics::Impl {
  public:
-  Impl(double zoom) : zoom_(zoom) {
+  // A canvas which returns itself to the pool when destroyed.
+  class ScratchCanvas : public QtCanvas {
+   public:
+    // Impl here would name QtCanvas::Impl.
+    ScratchCanvas(const QtGraphics *graphics, QtGraphics::Impl *owner,
+                  double w, double h)
+        : QtCanvas(graphics, w, h, true),
+          owner_(owner), in_pool_(false) {
+    }
+
+    virtual void Destroy() {
+      // The pool destroys the canvases evicted from it. A canvas still in
+      // use when the graphics is deleted has been detached from it.
+      if (in_pool_ || !owner_) {
+        delete this;
+        return;
+      }
+      owner_->scratch_canvases_in_use_.erase(this);
+      double zoom = owner_->zoom_;
+      size_t bytes = static_cast<size_t>(ceil(GetWidth() * zoom)) *
+                     static_cast<size_t>(ceil(GetHeight() * zoom)) * 4;
+      if (owner_->scratch_canvases_.Put(this, bytes))
+        in_pool_ = true;
+      else
+        delete this;
+    }
+
+    QtGraphics::Impl *owner_;
+    bool in_pool_;
+  };
+
+  Impl(double zoom)
+      : zoom_(zoom),
+        scratch_canvases_(kMaxScratchCanvasBytes) {
     if (zoom_ <= 0) zoom_ = 1;
   }
 
+  ~Impl() {
+    // The canvases in use may be destroyed after this object.
+    for (LightSet<ScratchCanvas *>::iterator it =
+             scratch_canvases_in_use_.begin();
+         it != scratch_canvases_in_use_.end(); ++it)
+      (*it)->owner_ = NULL;
+  }
+
   double zoom_;
   Signal1<void, double> on_zoom_signal_;
+  CanvasPool scratch_canvases_;
+  LightSet<ScratchCanvas *> scratch_canvases_in_use_;
 };
 
 QtGraphics::QtGraphics(double zoom) : impl_(new Impl(zoom)) {
@@ -50,6 +99,8 @@ double QtGraphics::GetZoom() const {
 void QtGraphics::SetZoom(double zoom) {
   if (impl_->zoom_ != zoom) {
     impl_->zoom_ = (zoom > 0 ? zoom : 1);
+    // Don't bother to zoom the idle scratch canvases.
+    impl_->scratch_canvases_.Clear();
     impl_->on_zoom_signal_(impl_->zoom_);
   }
 }
@@ -70,6 +121,27 @@ CanvasInterface *QtGraphics::NewCanvas(double w, double h) const {
   return canvas;
 }
 
+CanvasInterface *QtGraphics::NewScratchCanvas(double w, double h) const {
+  if (!w || !h) return NULL;
+  Impl::ScratchCanvas *canvas = down_cast<Impl::ScratchCanvas *>(
+      impl_->scratch_canvases_.Get(w, h));
+  if (canvas) {
+    canvas->in_pool_ = false;
+  } else {
+    canvas = new Impl::ScratchCanvas(this, impl_, w, h);
+    if (!canvas->IsValid()) {
+      delete canvas;
+      return NULL;
+    }
+  }
+  impl_->scratch_canvases_in_use_.insert(canvas);
+  return canvas;
+}
+
+const CanvasPool *QtGraphics::GetScratchCanvasPool() const {
+  return &impl_->scratch_canvases_;
+}
+
 ImageInterface *QtGraphics::NewImage(const std::string &tag,
                                      const std::string &data,
                                      bool is_mask) const {
@@ -24,6 +24,9 @@
 #include <ggadget/slot.h>
 
 namespace ggadget {
+
+class CanvasPool;
+
 namespace qt {
 
 /**
@@ -54,9 +57,14 @@ class QtGraphics : public GraphicsInterface {
 
   Connection *ConnectOnZoom(Slot1<void, double> *slot) const;
 
+  /** Gets the pool of idle scratch canvases, mainly for statistics. */
+  const CanvasPool *GetScratchCanvasPool() const;
+
  public:
   virtual CanvasInterface *NewCanvas(double w, double h) const;
 
+  virtual CanvasInterface *NewScratchCanvas(double w, double h) const;
+
   virtual ImageInterface *NewImage(const std::string &tag,
                                    const std::string &data,
                                    bool is_mask) const;
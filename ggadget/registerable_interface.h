@@ -52,6 +52,7 @@ class RegisterableInterface {
    * @param setter a setter slot accepting an enum value. @c NULL if the
    *     property is readonly.
    * @param names a table containing string values of every enum values.
+   *     The table and the strings must point to static allocated memory.
    * @param count number of entries in the @a names table.
    */
   virtual void RegisterStringEnumProperty(const char *name,
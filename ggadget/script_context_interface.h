@@ -57,6 +57,20 @@ class ScriptContextInterface {
                        const char *filename,
                        int lineno) = 0;
 
+  /**
+   * Executes a script fragment which is executed in many contexts with the
+   * same source, for example, common.js. Has the same effect as Execute(),
+   * but the script runtime may compile the script only once and run the
+   * compiled script in all of its contexts.
+   * @param script the script source code.
+   * @param filename the name of the file containing the @a script. Compiled
+   *     scripts are shared by file name.
+   * @param lineno the line number of the @a script in the file.
+   */
+  virtual void ExecuteShared(const char *script,
+                             const char *filename,
+                             int lineno) = 0;
+
   /**
    * Compiles a script fragment in the context.
    * @param script the script source code. Normally it should encoded in UTF-8,
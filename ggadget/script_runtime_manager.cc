@@ -17,6 +17,9 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include "file_manager_factory.h"
+#include "file_manager_interface.h"
+#include "light_map.h"
 #include "logger.h"
 #include "script_runtime_manager.h"
 #include "small_object.h"
@@ -49,7 +52,30 @@ class ScriptRuntimeManager::Impl : public SmallObject<> {
     return NULL;
   }
 
+  bool ReadSharedScriptFile(const char *filename, std::string *contents,
+                            std::string *full_path) {
+    ASSERT(filename && *filename && contents && full_path);
+    std::string name(filename);
+    SharedScriptFileMap::iterator it = shared_script_files_.find(name);
+    if (it == shared_script_files_.end()) {
+      FileManagerInterface *file_manager = GetGlobalFileManager();
+      std::string file_contents;
+      if (!file_manager || !file_manager->ReadFile(filename, &file_contents))
+        return false;
+      it = shared_script_files_.insert(std::make_pair(name,
+          std::make_pair(file_contents,
+                         file_manager->GetFullPath(filename)))).first;
+    }
+    *contents = it->second.first;
+    *full_path = it->second.second;
+    return true;
+  }
+
   std::vector<std::pair<std::string, ScriptRuntimeInterface *> > runtimes_;
+  // Contents and full paths of the shared script files.
+  typedef LightMap<std::string, std::pair<std::string, std::string> >
+      SharedScriptFileMap;
+  SharedScriptFileMap shared_script_files_;
   static ScriptRuntimeManager *manager_;
 };
 
@@ -82,6 +108,12 @@ ScriptRuntimeManager::GetScriptRuntime(const char *tag_name) {
   return impl_->GetScriptRuntime(tag_name);
 }
 
+bool ScriptRuntimeManager::ReadSharedScriptFile(const char *filename,
+                                                std::string *contents,
+                                                std::string *full_path) {
+  return impl_->ReadSharedScriptFile(filename, contents, full_path);
+}
+
 ScriptRuntimeManager *ScriptRuntimeManager::get() {
   if (!Impl::manager_)
     Impl::manager_ = new ScriptRuntimeManager();
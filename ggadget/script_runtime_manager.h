@@ -17,6 +17,7 @@
 #ifndef GGADGET_SCRIPT_RUNTIME_MANAGER_H__
 #define GGADGET_SCRIPT_RUNTIME_MANAGER_H__
 
+#include <string>
 #include <ggadget/common.h>
 #include <ggadget/script_runtime_interface.h>
 #include <ggadget/script_context_interface.h>
@@ -62,6 +63,18 @@ class ScriptRuntimeManager {
    */
   ScriptRuntimeInterface *GetScriptRuntime(const char *tag_name);
 
+  /**
+   * Reads a script file which is executed in many script contexts, such as
+   * common.js, with the global file manager. The file is read only on the
+   * first call, and then kept by the manager.
+   * @param filename the name of the file in the global file manager.
+   * @param[out] contents the contents of the file.
+   * @param[out] full_path the full path of the file.
+   * @return @c false if the file can't be read.
+   */
+  bool ReadSharedScriptFile(const char *filename, std::string *contents,
+                            std::string *full_path);
+
  public:
   /**
    * Get the singleton of ScriptRuntimeManager.
@@ -29,6 +29,7 @@
 #include "unicode_utils.h"
 #include "view.h"
 #include "event.h"
+#include "format_macros.h"
 #include "scriptable_event.h"
 #include "gadget_consts.h"
 #include "permissions.h"
@@ -48,6 +49,11 @@ static const Variant kDefaultArgsForSecondSlot[] = {
   Variant(), Variant(static_cast<Slot *>(NULL))
 };
 
+// Default argument list for methods whose second argument is an optional bool.
+static const Variant kDefaultArgsForSecondBool[] = {
+  Variant(), Variant(false)
+};
+
 // Implementation of ScriptableAudio
 class ScriptableAudioclip : public ScriptableHelperDefault {
  public:
@@ -353,6 +359,96 @@ ScriptableNetwork::~ScriptableNetwork() {
   impl_ = NULL;
 }
 
+// Implementation of ScriptableNetworkStatistics
+class ScriptableNetworkStatistics::Impl : public SmallObject<> {
+ public:
+  Impl(NetworkStatisticsInterface *statistics)
+    : statistics_(statistics), listener_id_(-1), connection_(NULL) {
+    ASSERT(statistics_);
+  }
+
+  ~Impl() {
+    RemoveListener();
+  }
+
+  ScriptableArray *GetInterfaces() {
+    std::vector<std::string> names;
+    statistics_->GetInterfaces(&names);
+    ScriptableArray *array = new ScriptableArray();
+    for (size_t i = 0; i < names.size(); i++)
+      array->Append(Variant(names[i]));
+    return array;
+  }
+
+  // Returns an object like
+  // {"rxBytes":1024,"txBytes":512,"rxPackets":8,"txPackets":4}, in units per
+  // second, or null if the interface doesn't exist.
+  JSONString GetThroughput(const char *name) {
+    NetworkStatisticsInterface::Throughput throughput;
+    if (!name || !statistics_->GetThroughput(name, &throughput))
+      return JSONString("null");
+    return JSONString(StringPrintf(
+        "{\"rxBytes\":%.1f,\"txBytes\":%.1f,"
+        "\"rxPackets\":%.1f,\"txPackets\":%.1f}",
+        throughput.rx_bytes, throughput.tx_bytes,
+        throughput.rx_packets, throughput.tx_packets));
+  }
+
+  // Each gadget has only one listener, so the new one replaces the old one.
+  void AddListener(Slot *slot, bool high_frequency) {
+    RemoveListener();
+    if (!slot)
+      return;
+    connection_ = update_signal_.ConnectGeneral(slot);
+    listener_id_ = statistics_->AddListener(high_frequency,
+                                            NewSlot(this, &Impl::Call));
+    if (listener_id_ < 0)
+      RemoveListener();
+  }
+
+  void RemoveListener() {
+    if (listener_id_ >= 0) {
+      statistics_->RemoveListener(listener_id_);
+      listener_id_ = -1;
+    }
+    if (connection_) {
+      update_signal_.Disconnect(connection_);
+      connection_ = NULL;
+    }
+  }
+
+  void Call() {
+    update_signal_();
+  }
+
+  NetworkStatisticsInterface *statistics_;
+  int listener_id_;
+  Connection *connection_;
+  Signal0<void> update_signal_;
+};
+
+ScriptableNetworkStatistics::ScriptableNetworkStatistics(
+    NetworkStatisticsInterface *statistics)
+  : impl_(new Impl(statistics)) {
+}
+
+void ScriptableNetworkStatistics::DoRegister() {
+  RegisterProperty("interfaces",
+                   NewSlot(impl_, &Impl::GetInterfaces), NULL);
+  RegisterMethod("throughput",
+                 NewSlot(impl_, &Impl::GetThroughput));
+  RegisterMethod("addListener",
+                 NewSlotWithDefaultArgs(NewSlot(impl_, &Impl::AddListener),
+                                        kDefaultArgsForSecondBool));
+  RegisterMethod("removeListener",
+                 NewSlot(impl_, &Impl::RemoveListener));
+}
+
+ScriptableNetworkStatistics::~ScriptableNetworkStatistics() {
+  delete impl_;
+  impl_ = NULL;
+}
+
 // Implementation of ScriptablePerfmon
 class ScriptablePerfmon::Impl : public SmallObject<> {
  public:
@@ -450,8 +546,19 @@ ScriptablePerfmon::~ScriptablePerfmon() {
 class ScriptableProcess::Impl : public SmallObject<> {
  public:
   Impl(ProcessInterface *process)
-    : process_(process) {
+    : process_(process), connection_(NULL) {
     ASSERT(process_);
+    connection_ = process_->ConnectOnForegroundChanged(
+        NewSlot(this, &Impl::OnForegroundChanged));
+  }
+
+  ~Impl() {
+    if (connection_)
+      connection_->Disconnect();
+  }
+
+  void OnForegroundChanged() {
+    on_foreground_changed_signal_();
   }
 
   std::string EncodeProcessInfo(ProcessInfoInterface *proc_info) {
@@ -489,17 +596,51 @@ class ScriptableProcess::Impl : public SmallObject<> {
     return JSONString(EncodeProcessInfo(process_->GetInfo(pid)));
   }
 
+  static void AppendIdArray(const std::vector<int> &ids, std::string *json) {
+    *json += '[';
+    for (size_t i = 0; i < ids.size(); i++) {
+      if (i > 0)
+        *json += ',';
+      *json += StringPrintf("%d", ids[i]);
+    }
+    *json += ']';
+  }
+
+  // Returns an object like {"generation":2,"added":[1,2],"removed":[3]}.
+  // generation is 0 if the changes are not available.
+  JSONString GetChanges(int64_t since) {
+    std::vector<int> added, removed;
+    uint64_t generation = process_->GetChanges(
+        since > 0 ? static_cast<uint64_t>(since) : 0, &added, &removed);
+    std::string json = StringPrintf("{\"generation\":%" PRIu64 ",\"added\":",
+                                    generation);
+    AppendIdArray(added, &json);
+    json += ",\"removed\":";
+    AppendIdArray(removed, &json);
+    json += '}';
+    return JSONString(json);
+  }
+
   ProcessInterface *process_;
+  Connection *connection_;
+  Signal0<void> on_foreground_changed_signal_;
 };
 
 ScriptableProcess::ScriptableProcess(ProcessInterface *process)
   : impl_(new Impl(process)) {
+}
+
+void ScriptableProcess::DoRegister() {
   RegisterProperty("enumerateProcesses",
                    NewSlot(impl_, &Impl::EnumerateProcesses), NULL);
   RegisterProperty("foreground",
                    NewSlot(impl_, &Impl::GetForegroundProcess), NULL);
   RegisterMethod("getInfo",
                  NewSlot(impl_, &Impl::GetProcessInfo));
+  RegisterMethod("getChanges",
+                 NewSlot(impl_, &Impl::GetChanges));
+  RegisterSignal("onForegroundChanged",
+                 &impl_->on_foreground_changed_signal_);
 }
 
 ScriptableProcess::~ScriptableProcess() {
@@ -30,6 +30,7 @@ class RuntimeInterface;
 class MachineInterface;
 class MemoryInterface;
 class NetworkInterface;
+class NetworkStatisticsInterface;
 class PerfmonInterface;
 class PowerInterface;
 class ProcessInterface;
@@ -140,14 +141,49 @@ class ScriptableNetwork : public ScriptableHelperNativeOwnedDefault {
   Impl *impl_;
 };
 
-/** Scriptable counterpart of ProcessInterface*/
-class ScriptableProcess : public ScriptableHelperNativeOwnedDefault {
+/**
+ * Scriptable counterpart of NetworkStatisticsInterface.
+ *
+ * Like ScriptablePerfmon, it's bound to a Gadget instance, because the
+ * listener added by a gadget must be removed when the gadget is destroyed.
+ * All ScriptableNetworkStatistics objects can share one
+ * NetworkStatisticsInterface instance, which will not be deleted upon
+ * destroying.
+ */
+class ScriptableNetworkStatistics : public ScriptableHelperDefault {
+ public:
+  DEFINE_CLASS_ID(0x3C5A0F2E91D74B68, ScriptableInterface);
+
+  explicit ScriptableNetworkStatistics(NetworkStatisticsInterface *statistics);
+  virtual ~ScriptableNetworkStatistics();
+
+ protected:
+  virtual void DoRegister();
+
+ private:
+  DISALLOW_EVIL_CONSTRUCTORS(ScriptableNetworkStatistics);
+
+  class Impl;
+  Impl *impl_;
+};
+
+/**
+ * Scriptable counterpart of ProcessInterface.
+ *
+ * It's per gadget, because each gadget sets its own onForegroundChanged
+ * handler. All ScriptableProcess objects can share one ProcessInterface
+ * instance, which will not be deleted upon destroying.
+ */
+class ScriptableProcess : public ScriptableHelperDefault {
  public:
   DEFINE_CLASS_ID(0x838F203231104C25, ScriptableInterface);
 
   explicit ScriptableProcess(ProcessInterface *process);
   virtual ~ScriptableProcess();
 
+ protected:
+  virtual void DoRegister();
+
  private:
   DISALLOW_EVIL_CONSTRUCTORS(ScriptableProcess);
 
@@ -14,6 +14,7 @@
   limitations under the License.
 */
 
+#include <cctype>
 #include <cstring>
 #include <map>
 #include <vector>
@@ -139,14 +140,43 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
   typedef LightMap<const char *, PropertyInfo,
                    GadgetCharPtrComparator> PropertyInfoMap;
 
-  class ClassInfoMap : public LightMap<uint64_t, PropertyInfoMap> {
+  // A read-only hash table of the class-based properties, built once after
+  // the class is registered. The hash seed is chosen so that the properties
+  // fall into distinct buckets if possible, then a lookup costs one hash and
+  // at most one string comparison.
+  class FrozenPropertyTable {
+   public:
+    FrozenPropertyTable() : seed_(0), mask_(0) { }
+    void Build(PropertyInfoMap *properties);
+    const PropertyInfo *Find(const char *name) const;
+
+   private:
+    static size_t Hash(const char *name, size_t seed);
+    bool Fill(PropertyInfoMap *properties, size_t size, size_t seed,
+              bool allow_collision);
+
+    struct Bucket {
+      const char *name;
+      const PropertyInfo *info;
+    };
+    std::vector<Bucket> buckets_;
+    size_t seed_;
+    size_t mask_;
+  };
+
+  struct ClassInfo {
+    PropertyInfoMap properties;
+    FrozenPropertyTable table;
+  };
+
+  class ClassInfoMap : public LightMap<uint64_t, ClassInfo> {
    public:
     ~ClassInfoMap() {
       ClassInfoMap::iterator it = this->begin();
       ClassInfoMap::iterator end = this->end();
       for (; it != end; ++it) {
-        PropertyInfoMap::iterator prop_it = it->second.begin();
-        PropertyInfoMap::iterator prop_end = it->second.end();
+        PropertyInfoMap::iterator prop_it = it->second.properties.begin();
+        PropertyInfoMap::iterator prop_end = it->second.properties.end();
         for (; prop_it != prop_end; ++prop_it)
           ScriptableHelperImpl::DestroyPropertyInfo(&prop_it->second);
       }
@@ -157,10 +187,10 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
   PropertyInfoMap property_info_;
   // Stores class-based property information for all classes.
   static ClassInfoMap *all_class_info_;
-  // If a class has no class-based property_info, let class_property_info_
-  // point to this map to save duplicated blank maps.
-  static PropertyInfoMap *blank_property_info_;
-  PropertyInfoMap *class_property_info_;
+  // If a class has no class-based property_info, let class_info_ point to
+  // this to save duplicated blank maps.
+  static ClassInfo *blank_class_info_;
+  ClassInfo *class_info_;
 
 #ifdef _DEBUG
   struct ClassStatInfo {
@@ -213,9 +243,79 @@ class ScriptableHelperImpl : public ScriptableHelperImplInterface {
 // exiting.
 ScriptableHelperImpl::ClassInfoMap *ScriptableHelperImpl::all_class_info_ =
   new ScriptableHelperImpl::ClassInfoMap;
-ScriptableHelperImpl::PropertyInfoMap
-  *ScriptableHelperImpl::blank_property_info_ =
-    new ScriptableHelperImpl::PropertyInfoMap;
+ScriptableHelperImpl::ClassInfo *ScriptableHelperImpl::blank_class_info_ =
+  new ScriptableHelperImpl::ClassInfo;
+
+size_t ScriptableHelperImpl::FrozenPropertyTable::Hash(const char *name,
+                                                       size_t seed) {
+  // FNV-1a, case-insensitive if GadgetStrCmp() is.
+  size_t hash = 2166136261U ^ seed;
+  for (; *name; ++name) {
+#ifdef GADGET_CASE_SENSITIVE
+    unsigned char c = static_cast<unsigned char>(*name);
+#else
+    unsigned char c = static_cast<unsigned char>(tolower(*name));
+#endif
+    hash = (hash ^ c) * 16777619U;
+  }
+  return hash;
+}
+
+bool ScriptableHelperImpl::FrozenPropertyTable::Fill(
+    PropertyInfoMap *properties, size_t size, size_t seed,
+    bool allow_collision) {
+  Bucket empty = { NULL, NULL };
+  buckets_.assign(size, empty);
+  seed_ = seed;
+  mask_ = size - 1;
+  for (PropertyInfoMap::const_iterator it = properties->begin();
+       it != properties->end(); ++it) {
+    size_t i = Hash(it->first, seed) & mask_;
+    if (buckets_[i].name) {
+      if (!allow_collision)
+        return false;
+      // Linear probing.
+      while (buckets_[i].name)
+        i = (i + 1) & mask_;
+    }
+    buckets_[i].name = it->first;
+    buckets_[i].info = &it->second;
+  }
+  return true;
+}
+
+void ScriptableHelperImpl::FrozenPropertyTable::Build(
+    PropertyInfoMap *properties) {
+  static const size_t kMaxSeeds = 32;
+  static const size_t kMaxSizeFactor = 8;
+  if (properties->empty())
+    return;
+
+  // Keeps the load factor at most 50%, so that a table with collisions
+  // still performs well.
+  size_t min_size = 4;
+  while (min_size < properties->size() * 2)
+    min_size *= 2;
+  for (size_t size = min_size; size <= min_size * kMaxSizeFactor; size *= 2) {
+    for (size_t seed = 0; seed < kMaxSeeds; ++seed) {
+      if (Fill(properties, size, seed, false))
+        return;
+    }
+  }
+  Fill(properties, min_size, 0, true);
+}
+
+const ScriptableHelperImpl::PropertyInfo *
+ScriptableHelperImpl::FrozenPropertyTable::Find(const char *name) const {
+  if (buckets_.empty())
+    return NULL;
+  for (size_t i = Hash(name, seed_) & mask_; buckets_[i].name;
+       i = (i + 1) & mask_) {
+    if (GadgetStrCmp(buckets_[i].name, name) == 0)
+      return buckets_[i].info;
+  }
+  return NULL;
+}
 
 #ifdef _DEBUG
 ScriptableHelperImpl::ClassStat ScriptableHelperImpl::class_stat_;
@@ -231,7 +331,7 @@ ScriptableHelperImpl::ScriptableHelperImpl(
     : owner_(owner),
       ref_count_(0),
       registering_class_(false),
-      class_property_info_(NULL),
+      class_info_(NULL),
       inherits_from_(NULL),
       array_getter_(NULL),
       array_setter_(NULL),
@@ -258,7 +358,7 @@ ScriptableHelperImpl::~ScriptableHelperImpl() {
 }
 
 void ScriptableHelperImpl::EnsureRegistered() {
-  if (!class_property_info_) {
+  if (!class_info_) {
     uint64_t class_id = owner_->GetScriptable()->GetClassId();
     ClassInfoMap::iterator it = all_class_info_->find(class_id);
     if (it == all_class_info_->end()) {
@@ -268,12 +368,14 @@ void ScriptableHelperImpl::EnsureRegistered() {
       it = all_class_info_->find(class_id);
       if (it == all_class_info_->end()) {
         // This class's DoClassRegister() did nothing.
-        class_property_info_ = blank_property_info_;
+        class_info_ = blank_class_info_;
       } else {
-        class_property_info_ = &it->second;
+        // Class-based properties can't be changed any more.
+        class_info_ = &it->second;
+        class_info_->table.Build(&class_info_->properties);
       }
     } else {
-      class_property_info_ = &it->second;
+      class_info_ = &it->second;
     }
     owner_->DoRegister();
 #ifdef _DEBUG
@@ -307,7 +409,7 @@ void ScriptableHelperImpl::AddPropertyInfo(const char *name, PropertyType type,
                                            Slot *getter, Slot *setter) {
   uint64_t class_id = owner_->GetScriptable()->GetClassId();
   PropertyInfo *info =
-      registering_class_ ? &(*all_class_info_)[class_id][name] :
+      registering_class_ ? &(*all_class_info_)[class_id].properties[name] :
       &property_info_[name];
   if (info->type != PROPERTY_NOT_EXIST) {
     // A previously registered property is overriden.
@@ -380,8 +482,9 @@ class StringEnumGetter : public Slot0<const char *> {
     GGL_UNUSED(argc);
     GGL_UNUSED(argv);
     int index = VariantValue<int>()(slot_->Call(obj, 0, NULL).v());
-    return ResultVariant(index >= 0 && index < count_ ?
-                         Variant(names_[index]) : Variant(""));
+    // The names are static, so return them as atoms to avoid copying.
+    return ResultVariant(Variant(StringAtom(
+        index >= 0 && index < count_ ? names_[index] : "")));
   }
   virtual bool operator==(const Slot &another) const {
     GGL_UNUSED(another);
@@ -584,14 +687,14 @@ Connection *ScriptableHelperImpl::ConnectOnReferenceChange(
 const ScriptableHelperImpl::PropertyInfo *
 ScriptableHelperImpl::GetPropertyInfoInternal(const char *name) {
   EnsureRegistered();
-  ASSERT(class_property_info_);
-  PropertyInfoMap::const_iterator it = property_info_.find(name);
-  bool found = it != property_info_.end();
-  if (!found) {
-    it = class_property_info_->find(name);
-    found = it != class_property_info_->end();
-  }
-  return found ? &it->second : NULL;
+  ASSERT(class_info_);
+  // Most objects have only class-based properties.
+  if (!property_info_.empty()) {
+    PropertyInfoMap::const_iterator it = property_info_.find(name);
+    if (it != property_info_.end())
+      return &it->second;
+  }
+  return class_info_->table.Find(name);
 }
 
 ScriptableInterface::PropertyType ScriptableHelperImpl::GetPropertyInfo(
@@ -740,8 +843,7 @@ class ScriptableHelperImpl::InheritedPropertiesCallback {
   bool Callback(const char *name, PropertyType type, const Variant &value) {
     if (owner_->property_info_.find(name) ==
             owner_->property_info_.end() &&
-        owner_->class_property_info_->find(name) ==
-            owner_->class_property_info_->end()) {
+        !owner_->class_info_->table.Find(name)) {
       // Only emunerate inherited properties which are not overriden by this
       // scriptable object.
       return (*callback_)(name, type, value);
@@ -769,8 +871,9 @@ bool ScriptableHelperImpl::EnumerateProperties(
       return false;
     }
   }
-  for (PropertyInfoMap::const_iterator it = class_property_info_->begin();
-       it != class_property_info_->end(); ++it) {
+  for (PropertyInfoMap::const_iterator it =
+           class_info_->properties.begin();
+       it != class_info_->properties.end(); ++it) {
     if (property_info_.find(it->first) == property_info_.end()) {
       ResultVariant value = GetProperty(it->first);
       if (!(*callback)(it->first, it->second.type, value.v())) {
@@ -803,7 +906,7 @@ bool ScriptableHelperImpl::RemoveProperty(const char *name) {
   ASSERT(!registering_class_);
 
   EnsureRegistered();
-  ASSERT(class_property_info_);
+  ASSERT(class_info_);
 
   PropertyInfoMap::iterator it = property_info_.find(name);
   if (it == property_info_.end())
@@ -308,6 +308,12 @@ void ScrollingElement::ChildCoordToSelfCoord(const BasicElement *child,
   }
 }
 
+void ScrollingElement::GetScrollOffset(double *x, double *y) const {
+  ASSERT(x && y);
+  *x = impl_->scroll_pos_x_;
+  *y = impl_->scroll_pos_y_;
+}
+
 void ScrollingElement::DrawScrollbar(CanvasInterface *canvas) {
   if (impl_->scrollbar_ && impl_->scrollbar_->IsVisible()) {
     canvas->TranslateCoordinates(impl_->scrollbar_->GetPixelX(),
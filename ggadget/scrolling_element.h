@@ -130,6 +130,12 @@ class ScrollingElement : public BasicElement {
                                      double x, double y,
                                      double *self_x, double *self_y) const;
 
+  /**
+   * Overrides because this element supports scrolling.
+   * @see BasicElement::GetScrollOffset()
+   */
+  virtual void GetScrollOffset(double *x, double *y) const;
+
 
   /**
    * Register a slot to listen to on-scrolled event.
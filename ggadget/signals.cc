@@ -16,7 +16,6 @@
 
 #include "signals.h"
 
-#include <algorithm>
 #include <vector>
 #include "logger.h"
 #include "small_object.h"
@@ -30,7 +29,8 @@ namespace ggadget {
 
 Connection::Connection(Signal *signal, Slot *slot)
     : signal_(signal),
-      slot_(slot) {
+      slot_(slot),
+      native_(false) {
 }
 
 Connection::~Connection() {
@@ -45,6 +45,8 @@ void Connection::Disconnect() {
 bool Connection::Reconnect(Slot *slot) {
   delete slot_;
   slot_ = NULL;
+  // The type of the new slot is only known at runtime.
+  native_ = false;
   if (slot) {
     if (!signal_->CheckCompatibility(slot)) {
       // According to our convention, no matter Reconnect succeeds or failes,
@@ -60,7 +62,10 @@ bool Connection::Reconnect(Slot *slot) {
 class Signal::Impl : public SmallObject<> {
  public:
   Impl()
-      : default_connection_(NULL),
+      : first_connection_(NULL),
+        connection_count_(0),
+        has_null_connections_(false),
+        default_connection_(NULL),
         death_flag_ptr_(NULL) {
 #ifdef DEBUG_SIGNALS
     max_connection_length_ = 0;
@@ -72,8 +77,67 @@ class Signal::Impl : public SmallObject<> {
       signal->impl_ = new Impl;
   }
 
+  Connection *GetConnection(size_t index) const {
+    ASSERT(index < connection_count_);
+    return index == 0 ? first_connection_ : more_connections_[index - 1];
+  }
+
+  void SetConnection(size_t index, Connection *connection) {
+    ASSERT(index < connection_count_);
+    if (index == 0)
+      first_connection_ = connection;
+    else
+      more_connections_[index - 1] = connection;
+  }
+
+  void AddConnection(Connection *connection) {
+    if (connection_count_ == 0)
+      first_connection_ = connection;
+    else
+      more_connections_.push_back(connection);
+    ++connection_count_;
+  }
+
+  void RemoveConnection(size_t index) {
+    ASSERT(index < connection_count_);
+    if (index == 0) {
+      if (more_connections_.empty()) {
+        first_connection_ = NULL;
+      } else {
+        first_connection_ = more_connections_.front();
+        more_connections_.erase(more_connections_.begin());
+      }
+    } else {
+      more_connections_.erase(more_connections_.begin() + (index - 1));
+    }
+    --connection_count_;
+  }
+
+  // Removes the NULL connections left by Disconnect() during Emit().
+  void RemoveNullConnections() {
+    if (!has_null_connections_)
+      return;
+    has_null_connections_ = false;
+    size_t count = 0;
+    for (size_t i = 0; i < connection_count_; ++i) {
+      Connection *connection = GetConnection(i);
+      if (connection)
+        SetConnection(count++, connection);
+    }
+    connection_count_ = count;
+    more_connections_.resize(count > 1 ? count - 1 : 0);
+    if (count == 0)
+      first_connection_ = NULL;
+  }
+
+  // The first connection is stored separately, because most signals have at
+  // most one connection, and then no additional memory is needed.
+  // Entries can be NULL if the connection was disconnected during Emit().
   typedef std::vector<Connection *> Connections;
-  Connections connections_;
+  Connection *first_connection_;
+  Connections more_connections_;
+  size_t connection_count_;
+  bool has_null_connections_;
   Connection *default_connection_;
 
   // During an Emit() call, this Signal object may be deleted in some slot.
@@ -109,10 +173,8 @@ Signal::~Signal() {
   if (!impl_)
     return;
 
-  for (Impl::Connections::iterator it = impl_->connections_.begin();
-       it != impl_->connections_.end(); ++it) {
-    delete *it;
-  }
+  for (size_t i = 0; i < impl_->connection_count_; ++i)
+    delete impl_->GetConnection(i);
 
   // Set *death_flag_ to true to let Emit() know this Signal is to be deleted.
   if (impl_->death_flag_ptr_)
@@ -173,89 +235,104 @@ bool Signal::CheckCompatibility(const Slot *slot) const {
 bool Signal::HasActiveConnections() const {
   if (!impl_)
     return false;
-  if (impl_->connections_.empty())
-    return false;
-  for (Impl::Connections::const_iterator it = impl_->connections_.begin();
-       it != impl_->connections_.end(); ++it) {
-    if (*it && (*it)->slot_)
+  for (size_t i = 0; i < impl_->connection_count_; ++i) {
+    Connection *connection = impl_->GetConnection(i);
+    if (connection && connection->slot_)
       return true;
   }
   return false;
 }
 
-ResultVariant Signal::Emit(int argc, const Variant argv[]) const {
-  ResultVariant result = ResultVariant(Variant(GetReturnType()));
-  if (!impl_)
-    return result;
+Signal::EmitScope::EmitScope(const Signal *signal)
+    : signal_(signal),
+      index_(0),
+      count_(signal->impl_ ? signal->impl_->connection_count_ : 0),
+      death_flag_(false),
+      death_flag_ptr_(&death_flag_) {
+  // Nothing to track for a signal without connections.
+  if (count_ == 0)
+    return;
 
-  bool death_flag = false;
-  bool *death_flag_ptr = &death_flag;
-  if (!impl_->death_flag_ptr_) {
+  Impl *impl = signal->impl_;
+  if (!impl->death_flag_ptr_) {
     // Let the destructor inform us when this object is to be deleted.
-    impl_->death_flag_ptr_ = death_flag_ptr;
+    impl->death_flag_ptr_ = death_flag_ptr_;
   } else {
     // There must be some upper stack frame containing Emit() call of the same
     // object. We just use the outer most death_flag_.
-    death_flag_ptr = impl_->death_flag_ptr_;
+    death_flag_ptr_ = impl->death_flag_ptr_;
 #ifdef DEBUG_SIGNALS
     DLOG("Signal::Emit() Re-entrance");
 #endif
   }
+}
 
-  // Can't use iterator here, because new connection might be added during the
-  // loop, which may invalidate the iterator.
-  size_t n_connections = impl_->connections_.size();
-  for (size_t i = 0; i < n_connections && !*death_flag_ptr; ++i) {
-    Connection *connection = impl_->connections_[i];
-    if (connection && connection->slot_) {
-      result = connection->slot_->Call(NULL, argc, argv);
-    }
+Signal::EmitScope::~EmitScope() {
+  if (count_ && !*death_flag_ptr_ && death_flag_ptr_ == &death_flag_) {
+    // The outer most Emit() should erase the NULL connections created by
+    // Disconnect() called during this Emit() call.
+    signal_->impl_->death_flag_ptr_ = NULL;
+    signal_->impl_->RemoveNullConnections();
   }
+}
 
-  if (!*death_flag_ptr && death_flag_ptr == &death_flag) {
-    impl_->death_flag_ptr_ = NULL;
-    // The outer most Emit() should erase all NULL slots in the connection
-    // list to save memory. The NULL slots is created by Disconnect() called
-    // during this Emit() call.
-    Impl::Connections::iterator it = impl_->connections_.begin();
-    while (it != impl_->connections_.end()) {
-      if (!*it)
-        it = impl_->connections_.erase(it);
-      else
-        ++it;
-    }
+Connection *Signal::EmitScope::Next() {
+  // Connections added during the emit are not called, and the connection
+  // list is not shrinked until the outer most emit finishes.
+  while (index_ < count_ && !*death_flag_ptr_) {
+    Connection *connection = signal_->impl_->GetConnection(index_++);
+    if (connection && connection->slot_)
+      return connection;
   }
+  return NULL;
+}
+
+ResultVariant Signal::Emit(int argc, const Variant argv[]) const {
+  ResultVariant result = ResultVariant(Variant(GetReturnType()));
+  EmitScope scope(this);
+  while (Connection *connection = scope.Next())
+    result = connection->slot_->Call(NULL, argc, argv);
   return result;
 }
 
 Connection *Signal::Connect(Slot *slot) {
   Impl::EnsureImpl(this);
   Connection *connection = new Connection(this, slot);
-  impl_->connections_.push_back(connection);
+  impl_->AddConnection(connection);
 #ifdef DEBUG_SIGNALS
-  if (impl_->connections_.size() > impl_->max_connection_length_)
-    impl_->max_connection_length_ = impl_->connections_.size();
+  if (impl_->connection_count_ > impl_->max_connection_length_)
+    impl_->max_connection_length_ = impl_->connection_count_;
 #endif
   return connection;
 }
 
+Connection *Signal::ConnectNative(Slot *slot) {
+  Connection *connection = Connect(slot);
+  connection->native_ = slot && slot->HasNativeCall();
+  return connection;
+}
+
 bool Signal::Disconnect(Connection *connection) {
   ASSERT(impl_);
-  Impl::Connections::iterator it = std::find(impl_->connections_.begin(),
-                                             impl_->connections_.end(),
-                                             connection);
-  if (it == impl_->connections_.end())
+  size_t index = 0;
+  while (index < impl_->connection_count_ &&
+         impl_->GetConnection(index) != connection)
+    ++index;
+  if (index == impl_->connection_count_)
     return false;
 
   if (impl_->death_flag_ptr_) {
-    // Emit() is executing, so the vector can't be changed here.
-    *it = NULL;
+    // Emit() is executing, so the list can't be changed here.
+    impl_->SetConnection(index, NULL);
+    impl_->has_null_connections_ = true;
 #ifdef DEBUG_SIGNALS
     DLOG("Signal::Disconnect() called indirectly by Signal::Emit()");
 #endif
   } else {
-    impl_->connections_.erase(it);
+    impl_->RemoveConnection(index);
   }
+  if (connection == impl_->default_connection_)
+    impl_->default_connection_ = NULL;
   delete connection;
   return true;
 }
@@ -277,7 +354,7 @@ Connection *Signal::SetDefaultSlot(Slot *slot) {
 size_t Signal::GetConnectionCount() const {
   if (!impl_)
     return 0;
-  return impl_->connections_.size();
+  return impl_->connection_count_;
 }
 
 } // namespace ggadget
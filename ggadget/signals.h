@@ -71,6 +71,9 @@ class Connection : public SmallObject<> {
 
   Signal *signal_;
   Slot *slot_;
+  // Whether slot_ is known to be of the native slot type of the signal, so
+  // that the typed emit path can call it without converting to Variants.
+  bool native_;
 };
 
 /**
@@ -162,6 +165,42 @@ class Signal : public SmallObject<> {
    */
   Connection *Connect(Slot *slot);
 
+  /**
+   * Same as @c Connect(), for templated subclasses whose @a slot is known to
+   * be of the @c Slot template class matching the signal. If the slot has
+   * native call, the typed emit path of the subclass can call it directly.
+   */
+  Connection *ConnectNative(Slot *slot);
+
+  /**
+   * Iterates the active connections during an emit. It keeps the connection
+   * list stable and tracks deletion of the signal during the emit.
+   */
+  class EmitScope {
+   public:
+    EmitScope(const Signal *signal);
+    ~EmitScope();
+
+    /**
+     * Returns the next active connection, or @c NULL if there is no more
+     * connection or the signal has been deleted.
+     */
+    Connection *Next();
+
+   private:
+    DISALLOW_EVIL_CONSTRUCTORS(EmitScope);
+    const Signal *signal_;
+    size_t index_;
+    size_t count_;
+    bool death_flag_;
+    bool *death_flag_ptr_;
+  };
+
+  /** Gets whether a connection can be called with @c Slot::NativeCall(). */
+  static bool IsNative(const Connection *connection) {
+    return connection->native_;
+  }
+
  private:
   DISALLOW_EVIL_CONSTRUCTORS(Signal);
   class Impl;
@@ -244,7 +283,11 @@ class Signal0<void> : public Signal {
  public:
   Signal0() { }
   Connection *Connect(Slot0<void> *slot) { return Signal::Connect(slot); }
-  void operator()() const { Emit(0, NULL); }
+  void operator()() const {
+    EmitScope scope(this);
+    while (Connection *connection = scope.Next())
+      connection->slot()->Call(NULL, 0, NULL);
+  }
  private:
   DISALLOW_EVIL_CONSTRUCTORS(Signal0);
 };
@@ -308,20 +351,40 @@ inline ClassSignal *NewClassSignal(Signal0<R> DT::*signal,
 /**
  * Other <code>Signal</code>s are defined by this macro.
  */
-#define DEFINE_SIGNAL(n, _arg_types, _arg_type_names, _args, _init_args)      \
+#define DEFINE_SIGNAL(n, _arg_types, _arg_type_names, _args, _init_args,      \
+                      _arg_names)                                             \
 template <typename R, _arg_types>                                             \
 class Signal##n : public Signal {                                             \
  public:                                                                      \
   Signal##n() { }                                                             \
   Connection *Connect(Slot##n<R, _arg_type_names> *slot) {                    \
-    return Signal::Connect(slot);                                             \
+    return Signal::ConnectNative(slot);                                       \
   }                                                                           \
   R operator()(_args) const {                                                 \
     ASSERT_M(GetReturnType() != Variant::TYPE_SCRIPTABLE,                     \
              ("Use Emit() when the signal returns ScriptableInterface *"));   \
+    R result = VariantValue<R>()(Variant(VariantType<R>::type));              \
+    EmitScope scope(this);                                                    \
+    Connection *connection = scope.Next();                                    \
+    if (!connection)                                                          \
+      return result;                                                          \
     Variant vargs[n];                                                         \
-    _init_args;                                                               \
-    return VariantValue<R>()(Emit(n, vargs).v());                             \
+    bool vargs_ready = false;                                                 \
+    do {                                                                      \
+      if (IsNative(connection)) {                                             \
+        typedef NativeSlot##n<R, _arg_type_names> NativeSlotType;             \
+        result = down_cast<const NativeSlotType *>(                           \
+            connection->slot())->NativeCall(_arg_names);                      \
+      } else {                                                                \
+        if (!vargs_ready) {                                                   \
+          _init_args;                                                         \
+          vargs_ready = true;                                                 \
+        }                                                                     \
+        result = VariantValue<R>()(                                           \
+            connection->slot()->Call(NULL, n, vargs).v());                    \
+      }                                                                       \
+    } while ((connection = scope.Next()) != NULL);                            \
+    return result;                                                            \
   }                                                                           \
   virtual Variant::Type GetReturnType() const { return VariantType<R>::type; }\
   virtual int GetArgCount() const { return n; }                               \
@@ -337,12 +400,28 @@ class Signal##n<void, _arg_type_names> : public Signal {                      \
  public:                                                                      \
   Signal##n() { }                                                             \
   Connection *Connect(Slot##n<void, _arg_type_names> *slot) {                 \
-    return Signal::Connect(slot);                                             \
+    return Signal::ConnectNative(slot);                                       \
   }                                                                           \
   void operator()(_args) const {                                              \
+    EmitScope scope(this);                                                    \
+    Connection *connection = scope.Next();                                    \
+    if (!connection)                                                          \
+      return;                                                                 \
     Variant vargs[n];                                                         \
-    _init_args;                                                               \
-    Emit(n, vargs);                                                           \
+    bool vargs_ready = false;                                                 \
+    do {                                                                      \
+      if (IsNative(connection)) {                                             \
+        typedef NativeSlot##n<void, _arg_type_names> NativeSlotType;          \
+        down_cast<const NativeSlotType *>(                                    \
+            connection->slot())->NativeCall(_arg_names);                      \
+      } else {                                                                \
+        if (!vargs_ready) {                                                   \
+          _init_args;                                                         \
+          vargs_ready = true;                                                 \
+        }                                                                     \
+        connection->slot()->Call(NULL, n, vargs);                             \
+      }                                                                       \
+    } while ((connection = scope.Next()) != NULL);                            \
   }                                                                           \
   virtual int GetArgCount() const { return n; }                               \
   virtual const Variant::Type *GetArgTypes() const {                          \
@@ -414,55 +493,73 @@ inline ClassSignal *NewClassSignal(                                           \
 #define ARG_TYPE_NAMES1 P1
 #define ARGS1           P1 p1
 #define INIT_ARGS1      INIT_ARG(1)
-DEFINE_SIGNAL(1, ARG_TYPES1, ARG_TYPE_NAMES1, ARGS1, INIT_ARGS1)
+#define ARG_NAMES1      p1
+DEFINE_SIGNAL(1, ARG_TYPES1, ARG_TYPE_NAMES1, ARGS1, INIT_ARGS1,
+              ARG_NAMES1)
 
 #define ARG_TYPES2      ARG_TYPES1, typename P2
 #define ARG_TYPE_NAMES2 ARG_TYPE_NAMES1, P2
 #define ARGS2           ARGS1, P2 p2
 #define INIT_ARGS2      INIT_ARGS1; INIT_ARG(2)
-DEFINE_SIGNAL(2, ARG_TYPES2, ARG_TYPE_NAMES2, ARGS2, INIT_ARGS2)
+#define ARG_NAMES2      ARG_NAMES1, p2
+DEFINE_SIGNAL(2, ARG_TYPES2, ARG_TYPE_NAMES2, ARGS2, INIT_ARGS2,
+              ARG_NAMES2)
 
 #define ARG_TYPES3      ARG_TYPES2, typename P3
 #define ARG_TYPE_NAMES3 ARG_TYPE_NAMES2, P3
 #define ARGS3           ARGS2, P3 p3
 #define INIT_ARGS3      INIT_ARGS2; INIT_ARG(3)
-DEFINE_SIGNAL(3, ARG_TYPES3, ARG_TYPE_NAMES3, ARGS3, INIT_ARGS3)
+#define ARG_NAMES3      ARG_NAMES2, p3
+DEFINE_SIGNAL(3, ARG_TYPES3, ARG_TYPE_NAMES3, ARGS3, INIT_ARGS3,
+              ARG_NAMES3)
 
 #define ARG_TYPES4      ARG_TYPES3, typename P4
 #define ARG_TYPE_NAMES4 ARG_TYPE_NAMES3, P4
 #define ARGS4           ARGS3, P4 p4
 #define INIT_ARGS4      INIT_ARGS3; INIT_ARG(4)
-DEFINE_SIGNAL(4, ARG_TYPES4, ARG_TYPE_NAMES4, ARGS4, INIT_ARGS4)
+#define ARG_NAMES4      ARG_NAMES3, p4
+DEFINE_SIGNAL(4, ARG_TYPES4, ARG_TYPE_NAMES4, ARGS4, INIT_ARGS4,
+              ARG_NAMES4)
 
 #define ARG_TYPES5      ARG_TYPES4, typename P5
 #define ARG_TYPE_NAMES5 ARG_TYPE_NAMES4, P5
 #define ARGS5           ARGS4, P5 p5
 #define INIT_ARGS5      INIT_ARGS4; INIT_ARG(5)
-DEFINE_SIGNAL(5, ARG_TYPES5, ARG_TYPE_NAMES5, ARGS5, INIT_ARGS5)
+#define ARG_NAMES5      ARG_NAMES4, p5
+DEFINE_SIGNAL(5, ARG_TYPES5, ARG_TYPE_NAMES5, ARGS5, INIT_ARGS5,
+              ARG_NAMES5)
 
 #define ARG_TYPES6      ARG_TYPES5, typename P6
 #define ARG_TYPE_NAMES6 ARG_TYPE_NAMES5, P6
 #define ARGS6           ARGS5, P6 p6
 #define INIT_ARGS6      INIT_ARGS5; INIT_ARG(6)
-DEFINE_SIGNAL(6, ARG_TYPES6, ARG_TYPE_NAMES6, ARGS6, INIT_ARGS6)
+#define ARG_NAMES6      ARG_NAMES5, p6
+DEFINE_SIGNAL(6, ARG_TYPES6, ARG_TYPE_NAMES6, ARGS6, INIT_ARGS6,
+              ARG_NAMES6)
 
 #define ARG_TYPES7      ARG_TYPES6, typename P7
 #define ARG_TYPE_NAMES7 ARG_TYPE_NAMES6, P7
 #define ARGS7           ARGS6, P7 p7
 #define INIT_ARGS7      INIT_ARGS6; INIT_ARG(7)
-DEFINE_SIGNAL(7, ARG_TYPES7, ARG_TYPE_NAMES7, ARGS7, INIT_ARGS7)
+#define ARG_NAMES7      ARG_NAMES6, p7
+DEFINE_SIGNAL(7, ARG_TYPES7, ARG_TYPE_NAMES7, ARGS7, INIT_ARGS7,
+              ARG_NAMES7)
 
 #define ARG_TYPES8      ARG_TYPES7, typename P8
 #define ARG_TYPE_NAMES8 ARG_TYPE_NAMES7, P8
 #define ARGS8           ARGS7, P8 p8
 #define INIT_ARGS8      INIT_ARGS7; INIT_ARG(8)
-DEFINE_SIGNAL(8, ARG_TYPES8, ARG_TYPE_NAMES8, ARGS8, INIT_ARGS8)
+#define ARG_NAMES8      ARG_NAMES7, p8
+DEFINE_SIGNAL(8, ARG_TYPES8, ARG_TYPE_NAMES8, ARGS8, INIT_ARGS8,
+              ARG_NAMES8)
 
 #define ARG_TYPES9      ARG_TYPES8, typename P9
 #define ARG_TYPE_NAMES9 ARG_TYPE_NAMES8, P9
 #define ARGS9           ARGS8, P9 p9
 #define INIT_ARGS9      INIT_ARGS8; INIT_ARG(9)
-DEFINE_SIGNAL(9, ARG_TYPES9, ARG_TYPE_NAMES9, ARGS9, INIT_ARGS9)
+#define ARG_NAMES9      ARG_NAMES8, p9
+DEFINE_SIGNAL(9, ARG_TYPES9, ARG_TYPE_NAMES9, ARGS9, INIT_ARGS9,
+              ARG_NAMES9)
 
 // Undefine macros to avoid name polution.
 #undef DEFINE_SIGNAL
@@ -472,38 +569,47 @@ DEFINE_SIGNAL(9, ARG_TYPES9, ARG_TYPE_NAMES9, ARGS9, INIT_ARGS9)
 #undef ARG_TYPE_NAMES1
 #undef INIT_ARGS1
 #undef ARGS1
+#undef ARG_NAMES1
 #undef ARG_TYPES2
 #undef ARG_TYPE_NAMES2
 #undef INIT_ARGS2
 #undef ARGS2
+#undef ARG_NAMES2
 #undef ARG_TYPES3
 #undef ARG_TYPE_NAMES3
 #undef INIT_ARGS3
 #undef ARGS3
+#undef ARG_NAMES3
 #undef ARG_TYPES4
 #undef ARG_TYPE_NAMES4
 #undef INIT_ARGS4
 #undef ARGS4
+#undef ARG_NAMES4
 #undef ARG_TYPES5
 #undef ARG_TYPE_NAMES5
 #undef INIT_ARGS5
 #undef ARGS5
+#undef ARG_NAMES5
 #undef ARG_TYPES6
 #undef ARG_TYPE_NAMES6
 #undef INIT_ARGS6
 #undef ARGS6
+#undef ARG_NAMES6
 #undef ARG_TYPES7
 #undef ARG_TYPE_NAMES7
 #undef INIT_ARGS7
 #undef ARGS7
+#undef ARG_NAMES7
 #undef ARG_TYPES8
 #undef ARG_TYPE_NAMES8
 #undef INIT_ARGS8
 #undef ARGS8
+#undef ARG_NAMES8
 #undef ARG_TYPES9
 #undef ARG_TYPE_NAMES9
 #undef INIT_ARGS9
 #undef ARGS9
+#undef ARG_NAMES9
 
 /** @} */
 
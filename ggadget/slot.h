@@ -100,6 +100,13 @@ class Slot : public SmallObject<> {
    */
   virtual const Variant *GetDefaultArgs() const { return NULL; }
 
+  /**
+   * @return @c true if this @c Slot is a @c NativeSlot1 .. @c NativeSlot9,
+   *     which can be called by the typed emit path of <code>Signal</code>s
+   *     without converting arguments to <code>Variant</code>s.
+   */
+  virtual bool HasNativeCall() const { return false; }
+
   /**
    * Equality tester, only for unit testing.
    * The slots to be tested must be of the same type, otherwise the program
@@ -699,7 +706,7 @@ inline Slot0<R> *NewFunctorSlot(F functor, PA pa) {
  * <code>Slot</code>s with 1 or more parameters are defined by this macro.
  */
 #define DEFINE_SLOT(n, _arg_types, _arg_type_names, _args, _init_args,        \
-                    _init_arg_types, _call_args)                              \
+                    _init_arg_types, _call_args, _arg_names)                  \
 template <_arg_types>                                                         \
 inline const Variant::Type *ArgTypesHelper() {                                \
   static Variant::Type arg_types[] = { _init_arg_types };                     \
@@ -737,6 +744,17 @@ class Slot##n<void, _arg_type_names> : public Slot {                          \
   }                                                                           \
 };                                                                            \
                                                                               \
+/**                                                                           \
+ * A @c Slot that can be called with native arguments, without                \
+ * converting them to and from <code>Variant</code>s.                         \
+ */                                                                           \
+template <typename R, _arg_types>                                             \
+class NativeSlot##n : public Slot##n<R, _arg_type_names> {                    \
+ public:                                                                      \
+  virtual bool HasNativeCall() const { return true; }                         \
+  virtual R NativeCall(_args) const = 0;                                      \
+};                                                                            \
+                                                                              \
 template <typename R, _arg_types>                                             \
 class PrototypeSlot##n : public Slot##n<R, _arg_type_names> {                 \
  public:                                                                      \
@@ -753,7 +771,7 @@ class PrototypeSlot##n : public Slot##n<R, _arg_type_names> {                 \
 };                                                                            \
                                                                               \
 template <typename R, _arg_types, typename F>                                 \
-class FunctorSlot##n : public Slot##n<R, _arg_type_names> {                   \
+class FunctorSlot##n : public NativeSlot##n<R, _arg_type_names> {             \
  public:                                                                      \
   typedef FunctorSlot##n<R, _arg_type_names, F> SelfType;                     \
   FunctorSlot##n(F functor) : functor_(functor) { }                           \
@@ -764,6 +782,7 @@ class FunctorSlot##n : public Slot##n<R, _arg_type_names> {                   \
     ASSERT(argc == n);                                                        \
     return ResultVariant(Variant(functor_(_call_args)));                      \
   }                                                                           \
+  virtual R NativeCall(_args) const { return functor_(_arg_names); }          \
   virtual bool operator==(const Slot &another) const {                        \
     const SelfType *a = down_cast<const SelfType *>(&another);                \
     return a && functor_ == a->functor_;                                      \
@@ -775,7 +794,7 @@ class FunctorSlot##n : public Slot##n<R, _arg_type_names> {                   \
                                                                               \
 template <_arg_types, typename F>                                             \
 class FunctorSlot##n<void, _arg_type_names, F> :                              \
-    public Slot##n<void, _arg_type_names> {                                   \
+    public NativeSlot##n<void, _arg_type_names> {                             \
  public:                                                                      \
   typedef FunctorSlot##n<void, _arg_type_names, F> SelfType;                  \
   FunctorSlot##n(F functor) : functor_(functor) { }                           \
@@ -787,6 +806,7 @@ class FunctorSlot##n<void, _arg_type_names, F> :                              \
     functor_(_call_args);                                                     \
     return ResultVariant(Variant());                                          \
   }                                                                           \
+  virtual void NativeCall(_args) const { functor_(_arg_names); }              \
   virtual bool operator==(const Slot &another) const {                        \
     const SelfType *a = down_cast<const SelfType *>(&another);                \
     return a && functor_ == a->functor_;                                      \
@@ -797,7 +817,7 @@ class FunctorSlot##n<void, _arg_type_names, F> :                              \
 };                                                                            \
                                                                               \
 template <typename R, _arg_types, typename T, typename M>                     \
-class MethodSlot##n : public Slot##n<R, _arg_type_names> {                    \
+class MethodSlot##n : public NativeSlot##n<R, _arg_type_names> {              \
  public:                                                                      \
   typedef MethodSlot##n<R, _arg_type_names, T, M> SelfType;                   \
   MethodSlot##n(T *obj, M method) : obj_(obj), method_(method) { }            \
@@ -808,6 +828,9 @@ class MethodSlot##n : public Slot##n<R, _arg_type_names> {                    \
     ASSERT(argc == n);                                                        \
     return ResultVariant(Variant((obj_->*method_)(_call_args)));              \
   }                                                                           \
+  virtual R NativeCall(_args) const {                                         \
+    return (obj_->*method_)(_arg_names);                                      \
+  }                                                                           \
   virtual bool operator==(const Slot &another) const {                        \
     const SelfType *a = down_cast<const SelfType *>(&another);                \
     return a && obj_ == a->obj_ && method_ == a->method_;                     \
@@ -820,7 +843,7 @@ class MethodSlot##n : public Slot##n<R, _arg_type_names> {                    \
                                                                               \
 template <_arg_types, typename T, typename M>                                 \
 class MethodSlot##n<void, _arg_type_names, T, M> :                            \
-    public Slot##n<void, _arg_type_names> {                                   \
+    public NativeSlot##n<void, _arg_type_names> {                             \
  public:                                                                      \
   typedef MethodSlot##n<void, _arg_type_names, T, M> SelfType;                \
   MethodSlot##n(T *obj, M method) : obj_(obj), method_(method) { }            \
@@ -832,6 +855,7 @@ class MethodSlot##n<void, _arg_type_names, T, M> :                            \
     (obj_->*method_)(_call_args);                                             \
     return ResultVariant(Variant());                                          \
   }                                                                           \
+  virtual void NativeCall(_args) const { (obj_->*method_)(_arg_names); }      \
   virtual bool operator==(const Slot &another) const {                        \
     const SelfType *a = down_cast<const SelfType *>(&another);                \
     return a && obj_ == a->obj_ && method_ == a->method_;                     \
@@ -1255,8 +1279,9 @@ NewFunctorSlot(F f, PA pa) {                                                  \
 #define INIT_ARGS1      INIT_ARG(1)
 #define INIT_ARG_TYPES1 INIT_ARG_TYPE(1)
 #define CALL_ARGS1      GET_ARG(1)
+#define ARG_NAMES1      p1
 DEFINE_SLOT(1, ARG_TYPES1, ARG_TYPE_NAMES1, ARGS1, INIT_ARGS1,
-            INIT_ARG_TYPES1, CALL_ARGS1)
+            INIT_ARG_TYPES1, CALL_ARGS1, ARG_NAMES1)
 
 #define ARG_TYPES2      ARG_TYPES1, typename P2
 #define ARG_TYPE_NAMES2 ARG_TYPE_NAMES1, P2
@@ -1264,8 +1289,9 @@ DEFINE_SLOT(1, ARG_TYPES1, ARG_TYPE_NAMES1, ARGS1, INIT_ARGS1,
 #define INIT_ARGS2      INIT_ARGS1; INIT_ARG(2)
 #define INIT_ARG_TYPES2 INIT_ARG_TYPES1, INIT_ARG_TYPE(2)
 #define CALL_ARGS2      CALL_ARGS1, GET_ARG(2)
+#define ARG_NAMES2      ARG_NAMES1, p2
 DEFINE_SLOT(2, ARG_TYPES2, ARG_TYPE_NAMES2, ARGS2, INIT_ARGS2,
-            INIT_ARG_TYPES2, CALL_ARGS2)
+            INIT_ARG_TYPES2, CALL_ARGS2, ARG_NAMES2)
 
 #define ARG_TYPES3      ARG_TYPES2, typename P3
 #define ARG_TYPE_NAMES3 ARG_TYPE_NAMES2, P3
@@ -1273,8 +1299,9 @@ DEFINE_SLOT(2, ARG_TYPES2, ARG_TYPE_NAMES2, ARGS2, INIT_ARGS2,
 #define INIT_ARGS3      INIT_ARGS2; INIT_ARG(3)
 #define INIT_ARG_TYPES3 INIT_ARG_TYPES2, INIT_ARG_TYPE(3)
 #define CALL_ARGS3      CALL_ARGS2, GET_ARG(3)
+#define ARG_NAMES3      ARG_NAMES2, p3
 DEFINE_SLOT(3, ARG_TYPES3, ARG_TYPE_NAMES3, ARGS3, INIT_ARGS3,
-            INIT_ARG_TYPES3, CALL_ARGS3)
+            INIT_ARG_TYPES3, CALL_ARGS3, ARG_NAMES3)
 
 #define ARG_TYPES4      ARG_TYPES3, typename P4
 #define ARG_TYPE_NAMES4 ARG_TYPE_NAMES3, P4
@@ -1282,8 +1309,9 @@ DEFINE_SLOT(3, ARG_TYPES3, ARG_TYPE_NAMES3, ARGS3, INIT_ARGS3,
 #define INIT_ARGS4      INIT_ARGS3; INIT_ARG(4)
 #define INIT_ARG_TYPES4 INIT_ARG_TYPES3, INIT_ARG_TYPE(4)
 #define CALL_ARGS4      CALL_ARGS3, GET_ARG(4)
+#define ARG_NAMES4      ARG_NAMES3, p4
 DEFINE_SLOT(4, ARG_TYPES4, ARG_TYPE_NAMES4, ARGS4, INIT_ARGS4,
-            INIT_ARG_TYPES4, CALL_ARGS4)
+            INIT_ARG_TYPES4, CALL_ARGS4, ARG_NAMES4)
 
 #define ARG_TYPES5      ARG_TYPES4, typename P5
 #define ARG_TYPE_NAMES5 ARG_TYPE_NAMES4, P5
@@ -1291,8 +1319,9 @@ DEFINE_SLOT(4, ARG_TYPES4, ARG_TYPE_NAMES4, ARGS4, INIT_ARGS4,
 #define INIT_ARGS5      INIT_ARGS4; INIT_ARG(5)
 #define INIT_ARG_TYPES5 INIT_ARG_TYPES4, INIT_ARG_TYPE(5)
 #define CALL_ARGS5      CALL_ARGS4, GET_ARG(5)
+#define ARG_NAMES5      ARG_NAMES4, p5
 DEFINE_SLOT(5, ARG_TYPES5, ARG_TYPE_NAMES5, ARGS5, INIT_ARGS5,
-            INIT_ARG_TYPES5, CALL_ARGS5)
+            INIT_ARG_TYPES5, CALL_ARGS5, ARG_NAMES5)
 
 #define ARG_TYPES6      ARG_TYPES5, typename P6
 #define ARG_TYPE_NAMES6 ARG_TYPE_NAMES5, P6
@@ -1300,8 +1329,9 @@ DEFINE_SLOT(5, ARG_TYPES5, ARG_TYPE_NAMES5, ARGS5, INIT_ARGS5,
 #define INIT_ARGS6      INIT_ARGS5; INIT_ARG(6)
 #define INIT_ARG_TYPES6 INIT_ARG_TYPES5, INIT_ARG_TYPE(6)
 #define CALL_ARGS6      CALL_ARGS5, GET_ARG(6)
+#define ARG_NAMES6      ARG_NAMES5, p6
 DEFINE_SLOT(6, ARG_TYPES6, ARG_TYPE_NAMES6, ARGS6, INIT_ARGS6,
-            INIT_ARG_TYPES6, CALL_ARGS6)
+            INIT_ARG_TYPES6, CALL_ARGS6, ARG_NAMES6)
 
 #define ARG_TYPES7      ARG_TYPES6, typename P7
 #define ARG_TYPE_NAMES7 ARG_TYPE_NAMES6, P7
@@ -1309,8 +1339,9 @@ DEFINE_SLOT(6, ARG_TYPES6, ARG_TYPE_NAMES6, ARGS6, INIT_ARGS6,
 #define INIT_ARGS7      INIT_ARGS6; INIT_ARG(7)
 #define INIT_ARG_TYPES7 INIT_ARG_TYPES6, INIT_ARG_TYPE(7)
 #define CALL_ARGS7      CALL_ARGS6, GET_ARG(7)
+#define ARG_NAMES7      ARG_NAMES6, p7
 DEFINE_SLOT(7, ARG_TYPES7, ARG_TYPE_NAMES7, ARGS7, INIT_ARGS7,
-            INIT_ARG_TYPES7, CALL_ARGS7)
+            INIT_ARG_TYPES7, CALL_ARGS7, ARG_NAMES7)
 
 #define ARG_TYPES8      ARG_TYPES7, typename P8
 #define ARG_TYPE_NAMES8 ARG_TYPE_NAMES7, P8
@@ -1318,8 +1349,9 @@ DEFINE_SLOT(7, ARG_TYPES7, ARG_TYPE_NAMES7, ARGS7, INIT_ARGS7,
 #define INIT_ARGS8      INIT_ARGS7; INIT_ARG(8)
 #define INIT_ARG_TYPES8 INIT_ARG_TYPES7, INIT_ARG_TYPE(8)
 #define CALL_ARGS8      CALL_ARGS7, GET_ARG(8)
+#define ARG_NAMES8      ARG_NAMES7, p8
 DEFINE_SLOT(8, ARG_TYPES8, ARG_TYPE_NAMES8, ARGS8, INIT_ARGS8,
-            INIT_ARG_TYPES8, CALL_ARGS8)
+            INIT_ARG_TYPES8, CALL_ARGS8, ARG_NAMES8)
 
 #define ARG_TYPES9      ARG_TYPES8, typename P9
 #define ARG_TYPE_NAMES9 ARG_TYPE_NAMES8, P9
@@ -1327,8 +1359,9 @@ DEFINE_SLOT(8, ARG_TYPES8, ARG_TYPE_NAMES8, ARGS8, INIT_ARGS8,
 #define INIT_ARGS9      INIT_ARGS8; INIT_ARG(9)
 #define INIT_ARG_TYPES9 INIT_ARG_TYPES8, INIT_ARG_TYPE(9)
 #define CALL_ARGS9      CALL_ARGS8, GET_ARG(9)
+#define ARG_NAMES9      ARG_NAMES8, p9
 DEFINE_SLOT(9, ARG_TYPES9, ARG_TYPE_NAMES9, ARGS9, INIT_ARGS9,
-            INIT_ARG_TYPES9, CALL_ARGS9)
+            INIT_ARG_TYPES9, CALL_ARGS9, ARG_NAMES9)
 
 // Undefine macros to avoid name polution.
 #undef DEFINE_SLOT
@@ -1341,54 +1374,63 @@ DEFINE_SLOT(9, ARG_TYPES9, ARG_TYPE_NAMES9, ARGS9, INIT_ARGS9,
 #undef INIT_ARGS1
 #undef INIT_ARG_TYPES1
 #undef CALL_ARGS1
+#undef ARG_NAMES1
 #undef ARG_TYPES2
 #undef ARG_TYPE_NAMES2
 #undef ARGS2
 #undef INIT_ARGS2
 #undef INIT_ARG_TYPES2
 #undef CALL_ARGS2
+#undef ARG_NAMES2
 #undef ARG_TYPES3
 #undef ARG_TYPE_NAMES3
 #undef ARGS3
 #undef INIT_ARGS3
 #undef INIT_ARG_TYPES3
 #undef CALL_ARGS3
+#undef ARG_NAMES3
 #undef ARG_TYPES4
 #undef ARG_TYPE_NAMES4
 #undef ARGS4
 #undef INIT_ARGS4
 #undef INIT_ARG_TYPES4
 #undef CALL_ARGS4
+#undef ARG_NAMES4
 #undef ARG_TYPES5
 #undef ARG_TYPE_NAMES5
 #undef ARGS5
 #undef INIT_ARGS5
 #undef INIT_ARG_TYPES5
 #undef CALL_ARGS5
+#undef ARG_NAMES5
 #undef ARG_TYPES6
 #undef ARG_TYPE_NAMES6
 #undef ARGS6
 #undef INIT_ARGS6
 #undef INIT_ARG_TYPES6
 #undef CALL_ARGS6
+#undef ARG_NAMES6
 #undef ARG_TYPES7
 #undef ARG_TYPE_NAMES7
 #undef ARGS7
 #undef INIT_ARGS7
 #undef INIT_ARG_TYPES7
 #undef CALL_ARGS7
+#undef ARG_NAMES7
 #undef ARG_TYPES8
 #undef ARG_TYPE_NAMES8
 #undef ARGS8
 #undef INIT_ARGS8
 #undef INIT_ARG_TYPES8
 #undef CALL_ARGS8
+#undef ARG_NAMES8
 #undef ARG_TYPES9
 #undef ARG_TYPE_NAMES9
 #undef ARGS9
 #undef INIT_ARGS9
 #undef INIT_ARG_TYPES9
 #undef CALL_ARGS9
+#undef ARG_NAMES9
 
 template <typename T>
 class FixedGetter {
@@ -18,17 +18,17 @@
 #include "small_object.h"
 
 #include <cstdlib>
-#include <climits>
 #include <cassert>
-#include <vector>
-#include <bitset>
+#include <set>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "format_macros.h"
 #include "logger.h"
 
 #ifdef _DEBUG
 // For special debug purpose only. Will affect performance dramatically.
-// #define DO_EXTRA_LOKI_TESTS
 // #define LOKI_CHECK_FOR_CORRUPTION
 // #define TRACE_ALLOCS
 #endif
@@ -41,1008 +41,946 @@
 namespace ggadget
 {
 
-    /** @struct Chunk
-        @ingroup SmallObjectGroupInternal
-     Contains info about each allocated Chunk - which is a collection of
-     contiguous blocks.  Each block is the same size, as specified by the
-     FixedAllocator.  The number of blocks in a Chunk depends upon page size.
-     This is a POD-style struct with value-semantics.  All functions and data
-     are private so that they can not be changed by anything other than the
-     FixedAllocator which owns the Chunk.
-
-     @par Minimal Interface
-     For the sake of runtime efficiency, no constructor, destructor, or
-     copy-assignment operator is defined. The inline functions made by the
-     compiler should be sufficient, and perhaps faster than hand-crafted
-     functions.  The lack of these functions allows vector to create and copy
-     Chunks as needed without overhead.  The Init and Release functions do
-     what the default constructor and destructor would do.  A Chunk is not in
-     a usable state after it is constructed and before calling Init.  Nor is
-     a Chunk usable after Release is called, but before the destructor.
-
-     @par Efficiency
-     Down near the lowest level of the allocator, runtime efficiencies trump
-     almost all other considerations.  Each function does the minimum required
-     of it.  All functions should execute in constant time to prevent higher-
-     level code from unwittingly using a version of Shlemiel the Painter's
-     Algorithm.
-
-     @par Stealth Indexes
-     The first char of each empty block contains the index of the next empty
-     block.  These stealth indexes form a singly-linked list within the blocks.
-     A Chunk is corrupt if this singly-linked list has a loop or is shorter
-     than blocksAvailable_.  Much of the allocator's time and space efficiency
-     comes from how these stealth indexes are implemented.
-     */
-    class Chunk
-    {
-    private:
-        friend class FixedAllocator;
+namespace
+{
 
-        /** Initializes a just-constructed Chunk.
-         @param blockSize Number of bytes per block.
-         @param blocks Number of blocks per Chunk.
-         @return True for success, false for failure.
-         */
-        bool Init( std::size_t blockSize, unsigned char blocks );
+/// Marks a valid slab header, to catch bad pointers in debug builds.
+const unsigned int kSlabMagic = 0x51AB0B1E;
 
-        /** Allocate a block within the Chunk.  Complexity is always O(1), and
-         this will never throw.  Does not actually "allocate" by calling
-         malloc, new, or any other function, but merely adjusts some internal
-         indexes to indicate an already allocated block is no longer available.
-         @return Pointer to block within Chunk.
-         */
-        void * Allocate( std::size_t blockSize );
-
-        /** Deallocate a block within the Chunk. Complexity is always O(1), and
-         this will never throw.  For efficiency, this assumes the address is
-         within the block and aligned along the correct byte boundary.  An
-         assertion checks the alignment, and a call to HasBlock is done from
-         within VicinityFind.  Does not actually "deallocate" by calling free,
-         delete, or other function, but merely adjusts some internal indexes to
-         indicate a block is now available.
-         */
-        void Deallocate( void * p, std::size_t blockSize );
+/// Maximum # of blocks moved between a thread cache and the shared pool.
+const std::size_t kMaxCacheBatch = 32;
 
-        /** Resets the Chunk back to pristine values. The available count is
-         set back to zero, and the first available index is set to the zeroth
-         block.  The stealth indexes inside each block are set to point to the
-         next block. This assumes the Chunk's data was already using Init.
-         */
-        void Reset( std::size_t blockSize, unsigned char blocks );
-
-        /// Releases the allocated block of memory.
-        void Release();
-
-        /** Determines if the Chunk has been corrupted.
-         @param numBlocks Total # of blocks in the Chunk.
-         @param blockSize # of bytes in each block.
-         @param checkIndexes True if caller wants to check indexes of available
-          blocks for corruption.  If false, then caller wants to skip some
-          tests tests just to run faster.  (Debug version does more checks, but
-          release version runs faster.)
-         @return True if Chunk is corrupt.
-         */
-        bool IsCorrupt( unsigned char numBlocks, std::size_t blockSize,
-            bool checkIndexes ) const;
-
-        /** Determines if block is available.
-         @param p Address of block managed by Chunk.
-         @param numBlocks Total # of blocks in the Chunk.
-         @param blockSize # of bytes in each block.
-         @return True if block is available, else false if allocated.
-         */
-        bool IsBlockAvailable( void * p, unsigned char numBlocks,
-            std::size_t blockSize ) const;
+// Mutex ----------------------------------------------------------------------
+/// A plain mutex which does nothing if there are no threads.
+class Mutex
+{
+public:
+#ifdef HAVE_PTHREAD
+    Mutex() { pthread_mutex_init( &mutex_, NULL ); }
+    ~Mutex() { pthread_mutex_destroy( &mutex_ ); }
+    void Lock() { pthread_mutex_lock( &mutex_ ); }
+    void Unlock() { pthread_mutex_unlock( &mutex_ ); }
+private:
+    pthread_mutex_t mutex_;
+#else
+    void Lock() { }
+    void Unlock() { }
+#endif
+};
 
-        /// Returns true if block at address P is inside this Chunk.
-        inline bool HasBlock( void * p, std::size_t chunkLength ) const
-        {
-            unsigned char * pc = static_cast< unsigned char * >( p );
-            return ( pData_ <= pc ) && ( pc < pData_ + chunkLength );
-        }
+class ScopedLock
+{
+public:
+    explicit ScopedLock( Mutex * mutex ) : mutex_( mutex ) { mutex_->Lock(); }
+    ~ScopedLock() { mutex_->Unlock(); }
+private:
+    Mutex * mutex_;
+};
+
+/// Rounds n up to a multiple of align, which must be a power of 2.
+inline std::size_t RoundUp( std::size_t n, std::size_t align )
+{
+    return ( n + align - 1 ) & ~( align - 1 );
+}
 
-        inline bool HasAvailable( unsigned char numBlocks ) const
-        { return ( blocksAvailable_ == numBlocks ); }
+} // anonymous namespace
 
-        inline bool IsFilled( void ) const
-        { return ( 0 == blocksAvailable_ ); }
+    /** @struct FreeBlock
+        @ingroup SmallObjectGroupInternal
+     The first word of each free block links to the next free block.
+     */
+    struct FreeBlock
+    {
+        FreeBlock * next;
+    };
 
-        /// Pointer to array of allocated blocks.
-        unsigned char * pData_;
-        /// Index of first empty block.
-        unsigned char firstAvailableBlock_;
-        /// Count of empty blocks.
-        unsigned char blocksAvailable_;
+    class SizeClass;
+
+    /** @struct Slab
+        @ingroup SmallObjectGroupInternal
+     Header at the beginning of each slab.  A slab is a page-aligned area of
+     pageSize bytes, and the header of the slab owning a block is found by
+     masking off the low bits of the block address.  The blocks which have
+     never been allocated are not linked into the free list, so a new slab
+     costs nothing more than the page itself.
+     */
+    struct Slab
+    {
+        /// The size class which owns this slab.
+        SizeClass * owner;
+        /// Links in the list of partially used slabs of the owner.
+        Slab * prev;
+        Slab * next;
+        /// Singly-linked list of the deallocated blocks.
+        FreeBlock * freeList;
+        /// Start of the blocks which have never been allocated.
+        unsigned char * unused;
+        /// # of blocks currently allocated from this slab.
+        std::size_t used;
+        unsigned int magic;
     };
 
-    /** @class FixedAllocator
+    /// Set of all slabs, used to find the owner of a block of unknown size.
+    typedef std::set< const void * > SlabSet;
+
+    /** @class SizeClass
         @ingroup SmallObjectGroupInternal
-     Offers services for allocating fixed-sized objects.  It has a container
-     of "containers" of fixed-size blocks.  The outer container has all the
-     Chunks.  The inner container is a Chunk which owns some blocks.
+     Offers services for allocating fixed-sized blocks from slabs.  All
+     functions except the constructor must be called with the pool lock held.
 
      @par Class Level Invariants
-     - There is always either zero or one Chunk which is empty.
-     - If this has no empty Chunk, then emptyChunk_ is NULL.
-     - If this has an empty Chunk, then emptyChunk_ points to it.
-     - If the Chunk container is empty, then deallocChunk_ and allocChunk_
-       are NULL.
-     - If the Chunk container is not-empty, then deallocChunk_ and allocChunk_
-       are either NULL or point to Chunks within the container.
-     - allocChunk_ will often point to the last Chunk in the container since
-       it was likely allocated most recently, and therefore likely to have an
-       available block.
+     - A slab is in partial_ list if and only if it has both allocated and
+       free blocks.
+     - There is always either zero or one empty slab, which is emptySlab_.
+     - A full slab is not linked anywhere; it will be relinked into partial_
+       list when one of its blocks is deallocated.
      */
-    class FixedAllocator
+    class SizeClass
     {
-    private:
+    public:
+        SizeClass();
+        ~SizeClass();
 
-        /** Deallocates the block at address p, and then handles the internal
-         bookkeeping needed to maintain class invariants.  This assumes that
-         deallocChunk_ points to the correct chunk.
-         */
-        void DoDeallocate( void * p );
+        /// Initializes a SizeClass which manages blocks of blockSize bytes.
+        void Initialize( std::size_t blockSize, std::size_t slabSize,
+                         SlabSet * slabs );
 
-        /** Creates an empty Chunk and adds it to the end of the ChunkList.
-         All calls to the lower-level memory allocation functions occur inside
-         this function, and so the only try-catch block is inside here.
-         @return true for success, false for failure.
-         */
-        bool MakeNewChunk( void );
-
-        /** Finds the Chunk which owns the block at address p.  It starts at
-         deallocChunk_ and searches in both forwards and backwards directions
-         from there until it finds the Chunk which owns p.  This algorithm
-         should find the Chunk quickly if it is deallocChunk_ or is close to it
-         in the Chunks container.  This goes both forwards and backwards since
-         that works well for both same-order and opposite-order deallocations.
-         (Same-order = objects are deallocated in the same order in which they
-         were allocated.  Opposite order = objects are deallocated in a last to
-         first order.  Complexity is O(C) where C is count of all Chunks.  This
-         never throws.
-         @return Pointer to Chunk that owns p, or NULL if no owner found.
+        /** Allocates at most count blocks, and links them into a list.
+         @return # of blocks allocated. Less than count only if out of memory.
          */
-        Chunk * VicinityFind( void * p ) const;
+        std::size_t AllocateBatch( FreeBlock ** head, std::size_t count );
 
-        /// Not implemented.
-        FixedAllocator(const FixedAllocator&);
-        /// Not implemented.
-        FixedAllocator& operator=(const FixedAllocator&);
+        /// Deallocates a block owned by this SizeClass.
+        void Deallocate( void * p );
 
-        /// Type of container used to hold Chunks.
-        typedef std::vector< Chunk > Chunks;
-        /// Iterator through container of Chunks.
-        typedef Chunks::iterator ChunkIter;
-        /// Iterator through const container of Chunks.
-        typedef Chunks::const_iterator ChunkCIter;
+        /// Releases the empty slab if there is one.
+        bool TrimEmptySlab( void );
 
-        /// Fewest # of objects managed by a Chunk.
-        static unsigned char MinObjectsPerChunk_;
+        /// Checks the slab headers and free lists for corruption.
+        bool IsCorrupt( void ) const;
 
-        /// Most # of objects managed by a Chunk - never exceeds UCHAR_MAX.
-        static unsigned char MaxObjectsPerChunk_;
+        /// Returns the slab which contains p.
+        inline Slab * SlabOf( const void * p ) const
+        {
+            return reinterpret_cast< Slab * >(
+                reinterpret_cast< uintptr_t >( p ) & ~( slabSize_ - 1 ) );
+        }
 
-        /// Number of bytes in a single block within a Chunk.
-        std::size_t blockSize_;
-        /// Number of blocks managed by each Chunk.
-        unsigned char numBlocks_;
-
-        /// Container of Chunks.
-        Chunks chunks_;
-        /// Pointer to Chunk used for last or next allocation.
-        Chunk * allocChunk_;
-        /// Pointer to Chunk used for last or next deallocation.
-        Chunk * deallocChunk_;
-        /// Pointer to the only empty Chunk if there is one, else NULL.
-        Chunk * emptyChunk_;
+        inline std::size_t BlockSize() const { return blockSize_; }
+        inline std::size_t BlocksPerSlab() const { return blocksPerSlab_; }
+        inline std::size_t SlabSize() const { return slabSize_; }
+        inline std::size_t SlabCount() const { return slabCount_; }
+        /// # of blocks allocated from slabs, including those in thread caches.
+        inline std::size_t BlocksInUse() const { return blocksInUse_; }
 
-#ifdef _DEBUG
-        size_t allocCount_;
-        size_t deallocCount_;
-        void ReportStat();
-#endif
+    private:
+        Slab * NewSlab( void );
+        void ReleaseSlab( Slab * slab );
+        void Link( Slab * slab );
+        void Unlink( Slab * slab );
 
-    public:
-        /// Create a FixedAllocator which manages blocks of 'blockSize' size.
-        FixedAllocator();
+        /// Not implemented.
+        SizeClass( const SizeClass & );
+        /// Not implemented.
+        SizeClass & operator = ( const SizeClass & );
 
-        /// Destroy the FixedAllocator and release all its Chunks.
-        ~FixedAllocator();
+        std::size_t blockSize_;
+        std::size_t slabSize_;
+        /// Offset of the first block from the slab header.
+        std::size_t headerSize_;
+        std::size_t blocksPerSlab_;
+        std::size_t slabCount_;
+        std::size_t blocksInUse_;
+        /// Head of the list of partially used slabs.
+        Slab * partial_;
+        /// The only empty slab if there is one, else NULL.
+        Slab * emptySlab_;
+        SlabSet * slabs_;
+    };
 
-        /// Initializes a FixedAllocator by calculating # of blocks per Chunk.
-        void Initialize( std::size_t blockSize, std::size_t pageSize );
+    /** @struct ThreadCache
+        @ingroup SmallObjectGroupInternal
+     Per-thread lists of free blocks, one for each size class.  Only the owner
+     thread touches the lists.  The counts are also read by
+     SmallObjAllocator::GetStats() from other threads.
+     */
+    struct ThreadCache
+    {
+        struct List
+        {
+            FreeBlock * head;
+            std::size_t count;
+        };
+
+        SmallObjPool * owner;
+        /// Links in the list of all thread caches of the pool.
+        ThreadCache * prev;
+        ThreadCache * next;
+        /// Array of lists, indexed by size class.
+        List * lists;
+    };
 
-        /** Returns pointer to allocated memory block of fixed size - or NULL
-         if it failed to allocate.
-         */
-        void * Allocate( void );
+    class SmallObjPool;
 
-        /** Deallocate a memory block previously allocated with Allocate.  If
-         the block is not owned by this FixedAllocator, it returns false so
-         that SmallObjAllocator can call the default deallocator.  If the
-         block was found, this returns true.
-         */
-        bool Deallocate( void * p, Chunk * hint );
+#ifdef HAVE_PTHREAD
+namespace
+{
+/// The cache of the current thread for the pool t_cacheOwner.  kNoCache means
+/// that the thread has no cache, e.g. it is exiting, and its blocks go to the
+/// shared pools directly.
+__thread ThreadCache * t_cache = NULL;
+/// Compared instead of t_cache->owner, so that the cache of another pool,
+/// possibly destroyed, is never dereferenced.
+__thread const SmallObjPool * t_cacheOwner = NULL;
+ThreadCache * const kNoCache = reinterpret_cast< ThreadCache * >( 1 );
+}
+#endif
 
-        /// Returns block size with which the FixedAllocator was initialized.
-        inline std::size_t BlockSize() const { return blockSize_; }
+    /** @class SmallObjPool
+        @ingroup SmallObjectGroupInternal
+     Holds the size classes, the lock which protects them, and the per-thread
+     caches.  Blocks move between a thread cache and the size classes in
+     batches, so the lock is taken once per batch.
+     */
+    class SmallObjPool
+    {
+    public:
+        SmallObjPool( std::size_t pageSize, std::size_t maxObjectSize,
+                      std::size_t objectAlignSize );
+        ~SmallObjPool();
 
-        /** Releases the memory used by the empty Chunk.  This will take
-         constant time under any situation.
-         @return True if empty chunk found and released, false if none empty.
-         */
-        bool TrimEmptyChunk( void );
+        /// Returns the size class for blocks of ( index + 1 ) * alignment
+        /// bytes.
+        inline std::size_t ClassOfIndex( std::size_t index ) const
+        { return classOfIndex_[ index ]; }
 
-        /** Releases unused spots from ChunkList.  This takes constant time
-         with respect to # of Chunks, but actual time depends on underlying
-         memory allocator.
-         @return False if no unused spots, true if some found and released.
-         */
-        bool TrimChunkList( void );
+        inline std::size_t ClassCount() const { return classCount_; }
 
-        /** Returns count of empty Chunks held by this allocator.  Complexity
-         is O(C) where C is the total number of Chunks - empty or used.
-         */
-        std::size_t CountEmptyChunks( void ) const;
+        /// Allocates a block of a size class.
+        void * Allocate( std::size_t classIndex );
 
-        /** Determines if FixedAllocator is corrupt.  Checks data members to
-         see if any have erroneous values, or violate class invariants.  It
-         also checks if any Chunk is corrupt.  Complexity is O(C) where C is
-         the number of Chunks.  If any data is corrupt, this will return true
-         in release mode, or assert in debug mode.
-         */
-        bool IsCorrupt( void ) const;
+        /// Deallocates a block of a size class.
+        void Deallocate( void * p, std::size_t classIndex );
 
-        /** Returns true if the block at address p is within a Chunk owned by
-         this FixedAllocator.  Complexity is O(C) where C is the total number
-         of Chunks - empty or used.
+        /** Deallocates a block of unknown size.
+         @return False if the block is not owned by any size class.
          */
-        const Chunk * HasBlock( void * p ) const;
-        inline Chunk * HasBlock( void * p )
-        {
-            return const_cast< Chunk * >(
-                const_cast< const FixedAllocator * >( this )->HasBlock( p ) );
-        }
+        bool Deallocate( void * p );
 
-    };
+        /// Moves the cache of the calling thread to the shared pool, and
+        /// releases empty slabs.
+        bool Trim( void );
 
-    unsigned char FixedAllocator::MinObjectsPerChunk_ = 8;
-    unsigned char FixedAllocator::MaxObjectsPerChunk_ = UCHAR_MAX;
+        bool IsCorrupt( void ) const;
 
-// Chunk::Init ----------------------------------------------------------------
+        bool GetStats( std::size_t classIndex, SmallObjStats * stats ) const;
 
-bool Chunk::Init( std::size_t blockSize, unsigned char blocks )
-{
-    assert(blockSize > 0);
-    assert(blocks > 0);
-    // Overflow check
-    const std::size_t allocSize = blockSize * blocks;
-    assert( allocSize / blockSize == blocks);
+        void ReportStats( void ) const;
 
-#ifdef USE_NEW_TO_ALLOCATE
-    // If this new operator fails, it will throw, and the exception will get
-    // caught one layer up.
-    pData_ = static_cast< unsigned char * >( ::operator new ( allocSize ) );
+    private:
+        /// Returns the cache of the calling thread, or NULL if it has none.
+        inline ThreadCache * GetThreadCache( void )
+        {
+#ifdef HAVE_PTHREAD
+            ThreadCache * cache = t_cache;
+            if ( kNoCache == cache )
+                return NULL;
+            return this == t_cacheOwner ? cache : FindThreadCache();
 #else
-    // malloc can't throw, so its only way to indicate an error is to return
-    // a NULL pointer, so we have to check for that.
-    pData_ = static_cast< unsigned char * >( ::std::malloc( allocSize ) );
-    if ( NULL == pData_ ) return false;
+            return NULL != mainCache_ ? mainCache_ : NewThreadCache();
 #endif
+        }
 
-    Reset( blockSize, blocks );
-    return true;
-}
-
-// Chunk::Reset ---------------------------------------------------------------
+        /// # of blocks moved between a thread cache and the shared pool.
+        inline std::size_t BatchSize( std::size_t classIndex ) const
+        {
+            const std::size_t batch =
+                classes_[ classIndex ].BlocksPerSlab() / 2;
+            return batch > kMaxCacheBatch ? kMaxCacheBatch : batch;
+        }
 
-void Chunk::Reset(std::size_t blockSize, unsigned char blocks)
-{
-    assert(blockSize > 0);
-    assert(blocks > 0);
-    // Overflow check
-    assert((blockSize * blocks) / blockSize == blocks);
+#ifdef HAVE_PTHREAD
+        /// Returns the cache of the calling thread when t_cache belongs to
+        /// another pool, and makes it t_cache.
+        ThreadCache * FindThreadCache( void );
+#endif
+        ThreadCache * NewThreadCache( void );
+        static void DeleteThreadCache( void * p );
 
-    firstAvailableBlock_ = 0;
-    blocksAvailable_ = blocks;
+        /// Moves blocks from the shared pool into a thread cache list.
+        bool Refill( ThreadCache::List * list, std::size_t classIndex );
 
-    unsigned char i = 0;
-    for ( unsigned char * p = pData_; i != blocks; p += blockSize )
-    {
-        *p = ++i;
-    }
-}
+        /// Moves count blocks from a thread cache list to the shared pool.
+        /// The caller must hold the lock.
+        void Drain( ThreadCache::List * list, std::size_t count );
 
-// Chunk::Release -------------------------------------------------------------
+        /// Moves all blocks of a thread cache to the shared pool.
+        void DrainAll( ThreadCache * cache );
 
-void Chunk::Release()
-{
-    assert( NULL != pData_ );
-#ifdef USE_NEW_TO_ALLOCATE
-    ::operator delete ( pData_ );
+        /// Not implemented.
+        SmallObjPool( const SmallObjPool & );
+        /// Not implemented.
+        SmallObjPool & operator = ( const SmallObjPool & );
+
+        std::size_t slabSize_;
+        /// Array of size classes, in the order of increasing block size.
+        SizeClass * classes_;
+        std::size_t classCount_;
+        /// Maps ( size - 1 ) / alignment to the index of the size class.
+        std::size_t * classOfIndex_;
+        /// All slabs of all size classes.
+        SlabSet slabs_;
+        /// Protects the size classes, slabs_ and caches_.
+        mutable Mutex mutex_;
+        /// List of all thread caches.
+        ThreadCache * caches_;
+#ifdef _DEBUG
+        std::size_t refillCount_;
+#endif
+#ifdef HAVE_PTHREAD
+        pthread_key_t cacheKey_;
 #else
-    ::std::free( static_cast< void * >( pData_ ) );
+        ThreadCache * mainCache_;
 #endif
-}
+    };
 
-// Chunk::Allocate ------------------------------------------------------------
+// SizeClass::SizeClass -------------------------------------------------------
 
-void* Chunk::Allocate(std::size_t blockSize)
+SizeClass::SizeClass()
+    : blockSize_( 0 )
+    , slabSize_( 0 )
+    , headerSize_( 0 )
+    , blocksPerSlab_( 0 )
+    , slabCount_( 0 )
+    , blocksInUse_( 0 )
+    , partial_( NULL )
+    , emptySlab_( NULL )
+    , slabs_( NULL )
 {
-    if ( IsFilled() ) return NULL;
-
-    assert((firstAvailableBlock_ * blockSize) / blockSize ==
-        firstAvailableBlock_);
-    unsigned char * pResult = pData_ + (firstAvailableBlock_ * blockSize);
-    firstAvailableBlock_ = *pResult;
-    --blocksAvailable_;
-
-    return pResult;
 }
 
-// Chunk::Deallocate ----------------------------------------------------------
+// SizeClass::~SizeClass ------------------------------------------------------
 
-void Chunk::Deallocate(void* p, std::size_t blockSize)
+SizeClass::~SizeClass()
 {
-    assert(p >= pData_);
-
-    unsigned char* toRelease = static_cast<unsigned char*>(p);
-    // Alignment check
-    assert((toRelease - pData_) % blockSize == 0);
-    unsigned char index = static_cast< unsigned char >(
-        ( toRelease - pData_ ) / blockSize);
-
-#if defined(DEBUG) || defined(_DEBUG)
-    // Check if block was already deleted.  Attempting to delete the same
-    // block more than once causes Chunk's linked-list of stealth indexes to
-    // become corrupt.  And causes count of blocksAvailable_ to be wrong.
-    if ( 0 < blocksAvailable_ )
-        assert( firstAvailableBlock_ != index );
-#endif
-
-    *toRelease = firstAvailableBlock_;
-    firstAvailableBlock_ = index;
-    // Truncation check
-    assert(firstAvailableBlock_ == (toRelease - pData_) / blockSize);
-
-    ++blocksAvailable_;
+    // Full slabs are not linked anywhere, so release through the slab set.
+    // Only slabs of this size class are released.
+    if ( NULL == slabs_ ) return;
+    for ( SlabSet::iterator it = slabs_->begin(); it != slabs_->end(); )
+    {
+        Slab * slab = static_cast< Slab * >( const_cast< void * >( *it ) );
+        ++it;
+        if ( slab->owner == this )
+            ReleaseSlab( slab );
+    }
 }
 
-// Chunk::IsCorrupt -----------------------------------------------------------
+// SizeClass::Initialize ------------------------------------------------------
 
-bool Chunk::IsCorrupt( unsigned char numBlocks, std::size_t blockSize,
-    bool checkIndexes ) const
+void SizeClass::Initialize( std::size_t blockSize, std::size_t slabSize,
+                            SlabSet * slabs )
 {
+    assert( blockSize >= sizeof( FreeBlock ) );
+    blockSize_ = blockSize;
+    slabSize_ = slabSize;
+    headerSize_ = RoundUp( sizeof( Slab ), 2 * sizeof( void * ) );
+    assert( slabSize > headerSize_ + blockSize );
+    blocksPerSlab_ = ( slabSize - headerSize_ ) / blockSize;
+    slabs_ = slabs;
+}
 
-    if ( numBlocks < blocksAvailable_ )
-    {
-        // Contents at this Chunk corrupted.  This might mean something has
-        // overwritten memory owned by the Chunks container.
-        assert( false );
-        return true;
-    }
-    if ( IsFilled() )
-        // Useless to do further corruption checks if all blocks allocated.
-        return false;
-    unsigned char index = firstAvailableBlock_;
-    if ( numBlocks <= index )
-    {
-        // Contents at this Chunk corrupted.  This might mean something has
-        // overwritten memory owned by the Chunks container.
-        assert( false );
-        return true;
-    }
-    if ( !checkIndexes )
-        // Caller chose to skip more complex corruption tests.
-        return false;
+// SizeClass::NewSlab ---------------------------------------------------------
 
-    /* If the bit at index was set in foundBlocks, then the stealth index was
-     found on the linked-list.
-     */
-    std::bitset< UCHAR_MAX > foundBlocks;
-    unsigned char * nextBlock = NULL;
-
-    /* The loop goes along singly linked-list of stealth indexes and makes sure
-     that each index is within bounds (0 <= index < numBlocks) and that the
-     index was not already found while traversing the linked-list.  The linked-
-     list should have exactly blocksAvailable_ nodes, so the for loop will not
-     check more than blocksAvailable_.  This loop can't check inside allocated
-     blocks for corruption since such blocks are not within the linked-list.
-     Contents of allocated blocks are not changed by Chunk.
-
-     Here are the types of corrupted link-lists which can be verified.  The
-     corrupt index is shown with asterisks in each example.
-
-     Type 1: Index is too big.
-      numBlocks == 64
-      blocksAvailable_ == 7
-      firstAvailableBlock_ -> 17 -> 29 -> *101*
-      There should be no indexes which are equal to or larger than the total
-      number of blocks.  Such an index would refer to a block beyond the
-      Chunk's allocated domain.
-
-     Type 2: Index is repeated.
-      numBlocks == 64
-      blocksAvailable_ == 5
-      firstAvailableBlock_ -> 17 -> 29 -> 53 -> *17* -> 29 -> 53 ...
-      No index should be repeated within the linked-list since that would
-      indicate the presence of a loop in the linked-list.
-     */
-    for ( unsigned char cc = 0; ; )
+Slab * SizeClass::NewSlab( void )
+{
+    void * p = NULL;
+    if ( 0 != posix_memalign( &p, slabSize_, slabSize_ ) )
+        return NULL;
+    try
     {
-        nextBlock = pData_ + ( index * blockSize );
-        foundBlocks.set( index, true );
-        ++cc;
-        if ( cc >= blocksAvailable_ )
-            // Successfully counted off number of nodes in linked-list.
-            break;
-        index = *nextBlock;
-        if ( numBlocks <= index )
-        {
-            /* This catches Type 1 corruptions as shown in above comments.
-             This implies that a block was corrupted due to a stray pointer
-             or an operation on a nearby block overran the size of the block.
-             */
-            assert( false );
-            return true;
-        }
-        if ( foundBlocks.test( index ) )
-        {
-            /* This catches Type 2 corruptions as shown in above comments.
-             This implies that a block was corrupted due to a stray pointer
-             or an operation on a nearby block overran the size of the block.
-             Or perhaps the program tried to delete a block more than once.
-             */
-            assert( false );
-            return true;
-        }
+        slabs_->insert( p );
     }
-    if ( foundBlocks.count() != blocksAvailable_ )
+    catch ( ... )
     {
-        /* This implies that the singly-linked-list of stealth indexes was
-         corrupted.  Ideally, this should have been detected within the loop.
-         */
-        assert( false );
-        return true;
+        ::std::free( p );
+        return NULL;
     }
 
-    return false;
+    Slab * slab = static_cast< Slab * >( p );
+    slab->owner = this;
+    slab->prev = slab->next = NULL;
+    slab->freeList = NULL;
+    slab->unused = static_cast< unsigned char * >( p ) + headerSize_;
+    slab->used = 0;
+    slab->magic = kSlabMagic;
+    ++slabCount_;
+    return slab;
 }
 
-// Chunk::IsBlockAvailable ----------------------------------------------------
+// SizeClass::ReleaseSlab -----------------------------------------------------
 
-bool Chunk::IsBlockAvailable( void * p, unsigned char numBlocks,
-    std::size_t blockSize ) const
+void SizeClass::ReleaseSlab( Slab * slab )
 {
-    (void) numBlocks;
-
-    if ( IsFilled() )
-        return false;
-
-    unsigned char * place = static_cast< unsigned char * >( p );
-    // Alignment check
-    assert( ( place - pData_ ) % blockSize == 0 );
-    unsigned char blockIndex = static_cast< unsigned char >(
-        ( place - pData_ ) / blockSize );
-
-    unsigned char index = firstAvailableBlock_;
-    assert( numBlocks > index );
-    if ( index == blockIndex )
-        return true;
-
-    /* If the bit at index was set in foundBlocks, then the stealth index was
-     found on the linked-list.
-     */
-    std::bitset< UCHAR_MAX > foundBlocks;
-    unsigned char * nextBlock = NULL;
-    for ( unsigned char cc = 0; ; )
-    {
-        nextBlock = pData_ + ( index * blockSize );
-        foundBlocks.set( index, true );
-        ++cc;
-        if ( cc >= blocksAvailable_ )
-            // Successfully counted off number of nodes in linked-list.
-            break;
-        index = *nextBlock;
-        if ( index == blockIndex )
-            return true;
-        assert( numBlocks > index );
-        assert( !foundBlocks.test( index ) );
-    }
-
-    return false;
+    assert( kSlabMagic == slab->magic );
+    slab->magic = 0;
+    slabs_->erase( slab );
+    --slabCount_;
+    ::std::free( slab );
 }
 
-// FixedAllocator::FixedAllocator ---------------------------------------------
+// SizeClass::Link ------------------------------------------------------------
 
-FixedAllocator::FixedAllocator()
-    : blockSize_( 0 )
-    , numBlocks_( 0 )
-    , chunks_( 0 )
-    , allocChunk_( NULL )
-    , deallocChunk_( NULL )
-    , emptyChunk_( NULL )
-#ifdef _DEBUG
-    , allocCount_( 0 )
-    , deallocCount_( 0 )
-#endif
+void SizeClass::Link( Slab * slab )
 {
+    slab->prev = NULL;
+    slab->next = partial_;
+    if ( NULL != partial_ )
+        partial_->prev = slab;
+    partial_ = slab;
 }
 
-// FixedAllocator::~FixedAllocator --------------------------------------------
+// SizeClass::Unlink ----------------------------------------------------------
 
-FixedAllocator::~FixedAllocator()
+void SizeClass::Unlink( Slab * slab )
 {
-#ifdef DO_EXTRA_LOKI_TESTS
-    TrimEmptyChunk();
-    assert( chunks_.empty() && "Memory leak detected!" );
-#endif
-    for ( ChunkIter i( chunks_.begin() ); i != chunks_.end(); ++i )
-       i->Release();
-}
-
-#ifdef _DEBUG
-void FixedAllocator::ReportStat() {
-  size_t active = allocCount_ - deallocCount_;
-  DLOG("FixedAllocator Stat: %zu %zu %zu %zu %zu %lf",
-       blockSize_, allocCount_, deallocCount_, active, chunks_.size(),
-       static_cast<double>(active) /
-       static_cast<double>((chunks_.size() * numBlocks_)));
+    if ( NULL != slab->prev )
+        slab->prev->next = slab->next;
+    else
+        partial_ = slab->next;
+    if ( NULL != slab->next )
+        slab->next->prev = slab->prev;
+    slab->prev = slab->next = NULL;
 }
-#endif
 
-// FixedAllocator::Initialize -------------------------------------------------
+// SizeClass::AllocateBatch ---------------------------------------------------
 
-void FixedAllocator::Initialize( std::size_t blockSize, std::size_t pageSize )
+std::size_t SizeClass::AllocateBatch( FreeBlock ** head, std::size_t count )
 {
-    assert( blockSize > 0 );
-    assert( pageSize >= blockSize );
-    blockSize_ = blockSize;
-
-    std::size_t numBlocks = pageSize / blockSize;
-    if ( numBlocks > MaxObjectsPerChunk_ ) numBlocks = MaxObjectsPerChunk_;
-    else if ( numBlocks < MinObjectsPerChunk_ ) numBlocks = MinObjectsPerChunk_;
+    std::size_t allocated = 0;
+    while ( allocated < count )
+    {
+        Slab * slab = partial_;
+        if ( NULL == slab )
+        {
+            if ( NULL != emptySlab_ )
+            {
+                slab = emptySlab_;
+                emptySlab_ = NULL;
+            }
+            else
+            {
+                slab = NewSlab();
+                if ( NULL == slab )
+                    break;
+            }
+            Link( slab );
+        }
 
-    numBlocks_ = static_cast<unsigned char>(numBlocks);
-    assert(numBlocks_ == numBlocks);
+        while ( allocated < count && slab->used < blocksPerSlab_ )
+        {
+            FreeBlock * block = slab->freeList;
+            if ( NULL != block )
+            {
+                slab->freeList = block->next;
+            }
+            else
+            {
+                block = reinterpret_cast< FreeBlock * >( slab->unused );
+                slab->unused += blockSize_;
+            }
+            block->next = *head;
+            *head = block;
+            ++slab->used;
+            ++allocated;
+        }
+        if ( slab->used == blocksPerSlab_ )
+            Unlink( slab );
+    }
+    blocksInUse_ += allocated;
+    return allocated;
 }
 
-// FixedAllocator::CountEmptyChunks -------------------------------------------
+// SizeClass::Deallocate ------------------------------------------------------
 
-std::size_t FixedAllocator::CountEmptyChunks( void ) const
+void SizeClass::Deallocate( void * p )
 {
-#ifdef DO_EXTRA_LOKI_TESTS
-    // This code is only used for specialized tests of the allocator.
-    // It is #ifdef-ed so that its O(C) complexity does not overwhelm the
-    // functions which call it.
-    std::size_t count = 0;
-    for ( ChunkCIter it( chunks_.begin() ); it != chunks_.end(); ++it )
+    Slab * slab = SlabOf( p );
+    assert( kSlabMagic == slab->magic );
+    assert( this == slab->owner );
+    assert( 0 == ( static_cast< unsigned char * >( p ) -
+                   reinterpret_cast< unsigned char * >( slab ) -
+                   headerSize_ ) % blockSize_ );
+    assert( 0 < slab->used );
+
+    const bool wasFull = ( slab->used == blocksPerSlab_ );
+    FreeBlock * block = static_cast< FreeBlock * >( p );
+    block->next = slab->freeList;
+    slab->freeList = block;
+    --slab->used;
+    --blocksInUse_;
+
+    if ( 0 == slab->used )
     {
-        const Chunk & chunk = *it;
-        if ( chunk.HasAvailable( numBlocks_ ) )
-            ++count;
+        if ( !wasFull )
+            Unlink( slab );
+        if ( NULL != emptySlab_ )
+        {
+            ReleaseSlab( slab );
+        }
+        else
+        {
+            // Forget the free list, so that the blocks are reused in the
+            // order of addresses.
+            slab->freeList = NULL;
+            slab->unused = reinterpret_cast< unsigned char * >( slab ) +
+                           headerSize_;
+            emptySlab_ = slab;
+        }
+    }
+    else if ( wasFull )
+    {
+        Link( slab );
     }
-    return count;
-#else
-    return ( NULL == emptyChunk_ ) ? 0 : 1;
-#endif
 }
 
-// FixedAllocator::IsCorrupt --------------------------------------------------
+// SizeClass::TrimEmptySlab ---------------------------------------------------
 
-bool FixedAllocator::IsCorrupt( void ) const
+bool SizeClass::TrimEmptySlab( void )
 {
-    const bool isEmpty = chunks_.empty();
-    ChunkCIter start( chunks_.begin() );
-    ChunkCIter last( chunks_.end() );
-    const size_t emptyChunkCount = CountEmptyChunks();
+    if ( NULL == emptySlab_ ) return false;
+    ReleaseSlab( emptySlab_ );
+    emptySlab_ = NULL;
+    return true;
+}
+
+// SizeClass::IsCorrupt -------------------------------------------------------
 
-    if ( isEmpty )
+bool SizeClass::IsCorrupt( void ) const
+{
+    std::size_t slabs = 0;
+    std::size_t used = 0;
+    for ( SlabSet::const_iterator it = slabs_->begin(); it != slabs_->end();
+          ++it )
     {
-        if ( start != last )
+        const Slab * slab = static_cast< const Slab * >( *it );
+        if ( kSlabMagic != slab->magic )
         {
             assert( false );
             return true;
         }
-        if ( 0 < emptyChunkCount )
+        if ( this != slab->owner )
+            continue;
+        ++slabs;
+        used += slab->used;
+
+        const unsigned char * begin =
+            reinterpret_cast< const unsigned char * >( slab ) + headerSize_;
+        const unsigned char * end = begin + blocksPerSlab_ * blockSize_;
+        if ( slab->used > blocksPerSlab_ ||
+             slab->unused < begin || slab->unused > end )
         {
             assert( false );
             return true;
         }
-        if ( NULL != deallocChunk_ )
+        std::size_t freeCount = 0;
+        for ( const FreeBlock * block = slab->freeList; NULL != block;
+              block = block->next )
         {
-            assert( false );
-            return true;
-        }
-        if ( NULL != allocChunk_ )
-        {
-            assert( false );
-            return true;
+            const unsigned char * pc =
+                reinterpret_cast< const unsigned char * >( block );
+            // A loop in the free list would make the count too big.
+            if ( pc < begin || pc >= slab->unused ||
+                 0 != ( pc - begin ) % blockSize_ ||
+                 ++freeCount > blocksPerSlab_ )
+            {
+                assert( false );
+                return true;
+            }
         }
-        if ( NULL != emptyChunk_ )
+        const std::size_t neverUsed = ( end - slab->unused ) / blockSize_;
+        if ( freeCount + neverUsed + slab->used != blocksPerSlab_ )
         {
             assert( false );
             return true;
         }
     }
 
-    else
+    if ( slabs != slabCount_ || used != blocksInUse_ ||
+         ( NULL != emptySlab_ && 0 != emptySlab_->used ) )
     {
-        const Chunk * front = &chunks_.front();
-        const Chunk * back  = &chunks_.back();
-        if ( start >= last )
-        {
-            assert( false );
-            return true;
-        }
-        if ( back < deallocChunk_ )
-        {
-            assert( false );
-            return true;
-        }
-        if ( back < allocChunk_ )
-        {
-            assert( false );
-            return true;
-        }
-        if ( front > deallocChunk_ )
-        {
-            assert( false );
-            return true;
-        }
-        if ( front > allocChunk_ )
+        assert( false );
+        return true;
+    }
+    for ( const Slab * slab = partial_; NULL != slab; slab = slab->next )
+    {
+        if ( 0 == slab->used || blocksPerSlab_ == slab->used ||
+             slab == emptySlab_ )
         {
             assert( false );
             return true;
         }
-
-        switch ( emptyChunkCount )
-        {
-            case 0:
-                if ( emptyChunk_ != NULL )
-                {
-                    assert( false );
-                    return true;
-                }
-                break;
-            case 1:
-                if ( emptyChunk_ == NULL )
-                {
-                    assert( false );
-                    return true;
-                }
-                if ( back < emptyChunk_ )
-                {
-                    assert( false );
-                    return true;
-                }
-                if ( front > emptyChunk_ )
-                {
-                    assert( false );
-                    return true;
-                }
-                if ( !emptyChunk_->HasAvailable( numBlocks_ ) )
-                {
-                    // This may imply somebody tried to delete a block twice.
-                    assert( false );
-                    return true;
-                }
-                break;
-            default:
-                assert( false );
-                return true;
-        }
-        for ( ChunkCIter it( start ); it != last; ++it )
-        {
-            const Chunk & chunk = *it;
-            if ( chunk.IsCorrupt( numBlocks_, blockSize_, true ) )
-                return true;
-        }
     }
-
     return false;
 }
 
-// FixedAllocator::HasBlock ---------------------------------------------------
+// SmallObjPool::SmallObjPool -------------------------------------------------
 
-const Chunk * FixedAllocator::HasBlock( void * p ) const
+SmallObjPool::SmallObjPool( std::size_t pageSize, std::size_t maxObjectSize,
+                            std::size_t objectAlignSize )
+    : slabSize_( 1 )
+    , classes_( NULL )
+    , classCount_( 0 )
+    , classOfIndex_( NULL )
+    , caches_( NULL )
+#ifdef _DEBUG
+    , refillCount_( 0 )
+#endif
+#ifndef HAVE_PTHREAD
+    , mainCache_( NULL )
+#endif
 {
-    const std::size_t chunkLength = numBlocks_ * blockSize_;
-    for ( ChunkCIter it( chunks_.begin() ); it != chunks_.end(); ++it )
+    // Blocks are at least large enough and aligned enough to hold the free
+    // list link.
+    const std::size_t minAlign = objectAlignSize < sizeof( FreeBlock ) ?
+                                 sizeof( FreeBlock ) : objectAlignSize;
+    const std::size_t maxBlockSize = RoundUp( maxObjectSize, minAlign );
+
+    // Slabs must be aligned to their size, and hold at least 8 blocks.
+    while ( slabSize_ < pageSize ||
+            slabSize_ < sizeof( Slab ) + 8 * maxBlockSize )
+        slabSize_ *= 2;
+
+    const std::size_t indexCount =
+        ( maxObjectSize + objectAlignSize - 1 ) / objectAlignSize;
+    classOfIndex_ = new std::size_t[ indexCount ];
+    classes_ = new SizeClass[ indexCount ];
+    std::size_t lastBlockSize = 0;
+    for ( std::size_t i = 0; i < indexCount; ++i )
     {
-        const Chunk & chunk = *it;
-        if ( chunk.HasBlock( p, chunkLength ) )
-            return &chunk;
+        const std::size_t blockSize = RoundUp( ( i + 1 ) * objectAlignSize,
+                                               minAlign );
+        if ( blockSize != lastBlockSize )
+        {
+            classes_[ classCount_++ ].Initialize( blockSize, slabSize_,
+                                                  &slabs_ );
+            lastBlockSize = blockSize;
+        }
+        classOfIndex_[ i ] = classCount_ - 1;
     }
-    return NULL;
+
+#ifdef HAVE_PTHREAD
+    pthread_key_create( &cacheKey_, DeleteThreadCache );
+#endif
 }
 
-// FixedAllocator::TrimEmptyChunk ---------------------------------------------
+// SmallObjPool::~SmallObjPool ------------------------------------------------
 
-bool FixedAllocator::TrimEmptyChunk( void )
+SmallObjPool::~SmallObjPool()
 {
-    // prove either emptyChunk_ points nowhere, or points to a truly empty Chunk.
-    assert( ( NULL == emptyChunk_ ) || ( emptyChunk_->HasAvailable( numBlocks_ ) ) );
-    if ( NULL == emptyChunk_ ) return false;
-
-    // If emptyChunk_ points to valid Chunk, then chunk list is not empty.
-    assert( !chunks_.empty() );
-    // And there should be exactly 1 empty Chunk.
-    assert( 1 == CountEmptyChunks() );
-
-    Chunk * lastChunk = &chunks_.back();
-    if ( lastChunk != emptyChunk_ )
-        std::swap( *emptyChunk_, *lastChunk );
-    assert( lastChunk->HasAvailable( numBlocks_ ) );
-    lastChunk->Release();
-    chunks_.pop_back();
-
-    if ( chunks_.empty() )
+#ifdef HAVE_PTHREAD
+    pthread_key_delete( cacheKey_ );
+    // Other threads can't be reached, and may keep t_cache pointing to a
+    // deleted cache, which is harmless unless a pool is created at the same
+    // address.
+    if ( this == t_cacheOwner )
     {
-        allocChunk_ = NULL;
-        deallocChunk_ = NULL;
+        if ( kNoCache != t_cache )
+            t_cache = NULL;
+        t_cacheOwner = NULL;
     }
-    else
+#endif
+    while ( NULL != caches_ )
     {
-        if ( deallocChunk_ == emptyChunk_ )
-        {
-            deallocChunk_ = &chunks_.front();
-            assert( deallocChunk_->blocksAvailable_ < numBlocks_ );
-        }
-        if ( allocChunk_ == emptyChunk_ )
-        {
-            allocChunk_ = &chunks_.back();
-            assert( allocChunk_->blocksAvailable_ < numBlocks_ );
-        }
+        ThreadCache * cache = caches_;
+        caches_ = cache->next;
+        delete [] cache->lists;
+        delete cache;
     }
-
-    emptyChunk_ = NULL;
-    assert( 0 == CountEmptyChunks() );
-
-    return true;
+    delete [] classes_;
+    delete [] classOfIndex_;
 }
 
-// FixedAllocator::TrimChunkList ----------------------------------------------
+#ifdef HAVE_PTHREAD
+// SmallObjPool::FindThreadCache ----------------------------------------------
 
-bool FixedAllocator::TrimChunkList( void )
+ThreadCache * SmallObjPool::FindThreadCache( void )
 {
-    if ( chunks_.empty() )
-    {
-        assert( NULL == allocChunk_ );
-        assert( NULL == deallocChunk_ );
-    }
-
-    if ( chunks_.size() == chunks_.capacity() )
-        return false;
-    // Use the "make-a-temp-and-swap" trick to remove excess capacity.
-    Chunks( chunks_ ).swap( chunks_ );
-
-    return true;
+    ThreadCache * cache =
+        static_cast< ThreadCache * >( pthread_getspecific( cacheKey_ ) );
+    if ( NULL == cache )
+        return NewThreadCache();
+    t_cache = cache;
+    t_cacheOwner = this;
+    return cache;
 }
+#endif
 
-// FixedAllocator::MakeNewChunk -----------------------------------------------
+// SmallObjPool::NewThreadCache -----------------------------------------------
 
-bool FixedAllocator::MakeNewChunk( void )
+ThreadCache * SmallObjPool::NewThreadCache( void )
 {
-    bool allocated = false;
-    try
+    ThreadCache * cache = new ( std::nothrow ) ThreadCache;
+    if ( NULL != cache )
     {
-        std::size_t size = chunks_.size();
-        // Calling chunks_.reserve *before* creating and initializing the new
-        // Chunk means that nothing is leaked by this function in case an
-        // exception is thrown from reserve.
-        if ( chunks_.capacity() == size )
+        cache->owner = this;
+        cache->lists = new ( std::nothrow ) ThreadCache::List[ classCount_ ];
+        if ( NULL == cache->lists )
         {
-            if ( 0 == size ) size = 4;
-            chunks_.reserve( size * 2 );
+            delete cache;
+            cache = NULL;
         }
-        Chunk newChunk;
-        allocated = newChunk.Init( blockSize_, numBlocks_ );
-        if ( allocated )
-            chunks_.push_back( newChunk );
     }
-    catch ( ... )
+    if ( NULL == cache )
     {
-        allocated = false;
+#ifdef HAVE_PTHREAD
+        t_cache = kNoCache;
+#endif
+        return NULL;
     }
-    if ( !allocated ) return false;
 
-    allocChunk_ = &chunks_.back();
-    deallocChunk_ = &chunks_.front();
-    return true;
+    for ( std::size_t i = 0; i < classCount_; ++i )
+    {
+        cache->lists[ i ].head = NULL;
+        cache->lists[ i ].count = 0;
+    }
+    {
+        ScopedLock lock( &mutex_ );
+        cache->prev = NULL;
+        cache->next = caches_;
+        if ( NULL != caches_ )
+            caches_->prev = cache;
+        caches_ = cache;
+    }
+
+#ifdef HAVE_PTHREAD
+    t_cache = cache;
+    t_cacheOwner = this;
+    // Returns the cache to the shared pool when the thread exits.
+    pthread_setspecific( cacheKey_, cache );
+#else
+    mainCache_ = cache;
+#endif
+    return cache;
 }
 
-// FixedAllocator::Allocate ---------------------------------------------------
+// SmallObjPool::DeleteThreadCache --------------------------------------------
 
-void * FixedAllocator::Allocate( void )
+void SmallObjPool::DeleteThreadCache( void * p )
 {
-    // prove either emptyChunk_ points nowhere, or points to a truly empty Chunk.
-    assert( ( NULL == emptyChunk_ ) || ( emptyChunk_->HasAvailable( numBlocks_ ) ) );
-    assert( CountEmptyChunks() < 2 );
-
-    if ( ( NULL == allocChunk_ ) || allocChunk_->IsFilled() )
+#ifdef HAVE_PTHREAD
+    // Objects deallocated by other thread-specific data destructors after
+    // this point go to the shared pool directly.
+    t_cache = kNoCache;
+#endif
+    ThreadCache * cache = static_cast< ThreadCache * >( p );
+    SmallObjPool * pool = cache->owner;
+    pool->DrainAll( cache );
     {
-        if ( NULL != emptyChunk_ )
-        {
-            allocChunk_ = emptyChunk_;
-            emptyChunk_ = NULL;
-        }
+        ScopedLock lock( &pool->mutex_ );
+        if ( NULL != cache->prev )
+            cache->prev->next = cache->next;
         else
-        {
-            for ( ChunkIter i( chunks_.begin() ); ; ++i )
-            {
-                if ( chunks_.end() == i )
-                {
-                    if ( !MakeNewChunk() )
-                        return NULL;
-                    break;
-                }
-                if ( !i->IsFilled() )
-                {
-                    allocChunk_ = &*i;
-                    break;
-                }
-            }
-        }
+            pool->caches_ = cache->next;
+        if ( NULL != cache->next )
+            cache->next->prev = cache->prev;
     }
-    else if ( allocChunk_ == emptyChunk_)
-        // detach emptyChunk_ from allocChunk_, because after
-        // calling allocChunk_->Allocate(blockSize_); the chunk
-        // is no longer empty.
-        emptyChunk_ = NULL;
-
-    assert( allocChunk_ != NULL );
-    assert( !allocChunk_->IsFilled() );
-    void * place = allocChunk_->Allocate( blockSize_ );
+    delete [] cache->lists;
+    delete cache;
+}
 
-    // prove either emptyChunk_ points nowhere, or points to a truly empty Chunk.
-    assert( ( NULL == emptyChunk_ ) || ( emptyChunk_->HasAvailable( numBlocks_ ) ) );
-    assert( CountEmptyChunks() < 2 );
+// SmallObjPool::Refill -------------------------------------------------------
 
-#ifdef TRACE_ALLOCS
-    VALGRIND_PRINTF_BACKTRACE("TRACE_ALLOC: %d", static_cast<int>(blockSize_));
+bool SmallObjPool::Refill( ThreadCache::List * list, std::size_t classIndex )
+{
+    assert( NULL == list->head && 0 == list->count );
+    const std::size_t batch = BatchSize( classIndex );
+#ifdef _DEBUG
+    bool report = false;
 #endif
-
+    {
+        ScopedLock lock( &mutex_ );
+        list->count = classes_[ classIndex ].AllocateBatch( &list->head,
+                                                            batch );
+#ifdef _DEBUG
+        report = ( ++refillCount_ % 10000 == 0 );
+#endif
+    }
 #ifdef _DEBUG
-    if (++allocCount_ % 10000 == 0)
-        ReportStat();
+    if ( report )
+        ReportStats();
 #endif
+    return 0 != list->count;
+}
 
-    return place;
+// SmallObjPool::Drain --------------------------------------------------------
+
+void SmallObjPool::Drain( ThreadCache::List * list, std::size_t count )
+{
+    for ( ; count > 0 && NULL != list->head; --count )
+    {
+        FreeBlock * block = list->head;
+        list->head = block->next;
+        --list->count;
+        SizeClass * sizeClass = classes_[ 0 ].SlabOf( block )->owner;
+        sizeClass->Deallocate( block );
+    }
 }
 
-// FixedAllocator::Deallocate -------------------------------------------------
+// SmallObjPool::DrainAll -----------------------------------------------------
 
-bool FixedAllocator::Deallocate( void * p, Chunk * hint )
+void SmallObjPool::DrainAll( ThreadCache * cache )
 {
-    assert(!chunks_.empty());
-    assert(&chunks_.front() <= deallocChunk_);
-    assert(&chunks_.back() >= deallocChunk_);
-    assert( &chunks_.front() <= allocChunk_ );
-    assert( &chunks_.back() >= allocChunk_ );
-    assert( CountEmptyChunks() < 2 );
-
-    Chunk * foundChunk = ( NULL == hint ) ? VicinityFind( p ) : hint;
-    if ( NULL == foundChunk )
-        return false;
+    ScopedLock lock( &mutex_ );
+    for ( std::size_t i = 0; i < classCount_; ++i )
+        Drain( &cache->lists[ i ], cache->lists[ i ].count );
+}
 
-    assert( foundChunk->HasBlock( p, numBlocks_ * blockSize_ ) );
-#ifdef LOKI_CHECK_FOR_CORRUPTION
-    if ( foundChunk->IsCorrupt( numBlocks_, blockSize_, true ) )
+// SmallObjPool::Allocate -----------------------------------------------------
+
+void * SmallObjPool::Allocate( std::size_t classIndex )
+{
+    ThreadCache * cache = GetThreadCache();
+    if ( NULL == cache )
     {
-        assert( false );
-        return false;
+        FreeBlock * block = NULL;
+        ScopedLock lock( &mutex_ );
+        classes_[ classIndex ].AllocateBatch( &block, 1 );
+        return block;
     }
-    if ( foundChunk->IsBlockAvailable( p, numBlocks_, blockSize_ ) )
+
+    ThreadCache::List * list = &cache->lists[ classIndex ];
+    if ( NULL == list->head && !Refill( list, classIndex ) )
+        return NULL;
+    FreeBlock * block = list->head;
+    list->head = block->next;
+    --list->count;
+    return block;
+}
+
+// SmallObjPool::Deallocate ---------------------------------------------------
+
+void SmallObjPool::Deallocate( void * p, std::size_t classIndex )
+{
+    assert( classes_[ classIndex ].SlabOf( p )->owner ==
+            &classes_[ classIndex ] );
+    ThreadCache * cache = GetThreadCache();
+    if ( NULL == cache )
     {
-        assert( false );
-        return false;
+        ScopedLock lock( &mutex_ );
+        classes_[ classIndex ].Deallocate( p );
+        return;
     }
-#endif
-    deallocChunk_ = foundChunk;
-    DoDeallocate(p);
-    assert( CountEmptyChunks() < 2 );
 
-#ifdef _DEBUG
-    if (++deallocCount_ % 10000 == 0)
-        ReportStat();
+    ThreadCache::List * list = &cache->lists[ classIndex ];
+    FreeBlock * block = static_cast< FreeBlock * >( p );
+    block->next = list->head;
+    list->head = block;
+    const std::size_t batch = BatchSize( classIndex );
+    if ( ++list->count > 2 * batch )
+    {
+        ScopedLock lock( &mutex_ );
+        Drain( list, batch );
+#ifdef LOKI_CHECK_FOR_CORRUPTION
+        assert( !classes_[ classIndex ].IsCorrupt() );
 #endif
-    return true;
+    }
 }
 
-// FixedAllocator::VicinityFind -----------------------------------------------
+// SmallObjPool::Deallocate ---------------------------------------------------
 
-Chunk * FixedAllocator::VicinityFind( void * p ) const
+bool SmallObjPool::Deallocate( void * p )
 {
-    if ( chunks_.empty() ) return NULL;
-    assert(deallocChunk_);
+    ScopedLock lock( &mutex_ );
+    // Finds the last slab which starts at or before p.
+    SlabSet::const_iterator it = slabs_.upper_bound( p );
+    if ( slabs_.begin() == it )
+        return false;
+    --it;
+    const unsigned char * start = static_cast< const unsigned char * >( *it );
+    if ( static_cast< unsigned char * >( p ) >= start + slabSize_ )
+        return false;
+    static_cast< const Slab * >( *it )->owner->Deallocate( p );
+    return true;
+}
 
-    const std::size_t chunkLength = numBlocks_ * blockSize_;
-    Chunk * lo = deallocChunk_;
-    Chunk * hi = deallocChunk_ + 1;
-    const Chunk * loBound = &chunks_.front();
-    const Chunk * hiBound = &chunks_.back() + 1;
+// SmallObjPool::Trim ---------------------------------------------------------
 
-    // Special case: deallocChunk_ is the last in the array
-    if (hi == hiBound) hi = NULL;
+bool SmallObjPool::Trim( void )
+{
+    ThreadCache * cache = GetThreadCache();
+    if ( NULL != cache )
+        DrainAll( cache );
 
-    for (;;)
+    bool found = false;
+    ScopedLock lock( &mutex_ );
+    for ( std::size_t i = 0; i < classCount_; ++i )
     {
-        if (lo)
-        {
-            if ( lo->HasBlock( p, chunkLength ) ) return lo;
-            if ( lo == loBound )
-            {
-                lo = NULL;
-                if ( NULL == hi ) break;
-            }
-            else --lo;
-        }
+        if ( classes_[ i ].TrimEmptySlab() )
+            found = true;
+    }
+    return found;
+}
 
-        if (hi)
-        {
-            if ( hi->HasBlock( p, chunkLength ) ) return hi;
-            if ( ++hi == hiBound )
-            {
-                hi = NULL;
-                if ( NULL == lo ) break;
-            }
-        }
+// SmallObjPool::IsCorrupt ----------------------------------------------------
+
+bool SmallObjPool::IsCorrupt( void ) const
+{
+    ScopedLock lock( &mutex_ );
+    for ( std::size_t i = 0; i < classCount_; ++i )
+    {
+        if ( classes_[ i ].IsCorrupt() )
+            return true;
     }
+    return false;
+}
+
+// SmallObjPool::GetStats -----------------------------------------------------
 
-    return NULL;
+bool SmallObjPool::GetStats( std::size_t classIndex,
+                             SmallObjStats * stats ) const
+{
+    if ( classIndex >= classCount_ )
+        return false;
+
+    ScopedLock lock( &mutex_ );
+    const SizeClass & sizeClass = classes_[ classIndex ];
+    std::size_t cached = 0;
+    for ( const ThreadCache * cache = caches_; NULL != cache;
+          cache = cache->next )
+        cached += cache->lists[ classIndex ].count;
+
+    const std::size_t inUse = sizeClass.BlocksInUse();
+    stats->blockSize = sizeClass.BlockSize();
+    stats->slabs = sizeClass.SlabCount();
+    // The counts of other threads may be a bit stale.
+    stats->cachedBlocks = cached < inUse ? cached : inUse;
+    stats->liveObjects = inUse - stats->cachedBlocks;
+    stats->freeBlocks = stats->slabs * sizeClass.BlocksPerSlab() - inUse;
+    stats->reservedBytes = stats->slabs * sizeClass.SlabSize();
+    return true;
 }
 
-// FixedAllocator::DoDeallocate -----------------------------------------------
+// SmallObjPool::ReportStats --------------------------------------------------
 
-void FixedAllocator::DoDeallocate(void* p)
+void SmallObjPool::ReportStats( void ) const
 {
-    // Show that deallocChunk_ really owns the block at address p.
-    assert( deallocChunk_->HasBlock( p, numBlocks_ * blockSize_ ) );
-    // Either of the next two assertions may fail if somebody tries to
-    // delete the same block twice.
-    assert( emptyChunk_ != deallocChunk_ );
-    assert( !deallocChunk_->HasAvailable( numBlocks_ ) );
-    // prove either emptyChunk_ points nowhere, or points to a truly empty Chunk.
-    assert( ( NULL == emptyChunk_ ) || ( emptyChunk_->HasAvailable( numBlocks_ ) ) );
-
-    // call into the chunk, will adjust the inner list but won't release memory
-    deallocChunk_->Deallocate(p, blockSize_);
-
-    if ( deallocChunk_->HasAvailable( numBlocks_ ) )
+    // Don't log with the lock held, because logging may allocate.
+    SmallObjStats stats;
+    for ( std::size_t i = 0; GetStats( i, &stats ); ++i )
     {
-        assert( emptyChunk_ != deallocChunk_ );
-        // deallocChunk_ is empty, but a Chunk is only released if there are 2
-        // empty chunks.  Since emptyChunk_ may only point to a previously
-        // cleared Chunk, if it points to something else besides deallocChunk_,
-        // then FixedAllocator currently has 2 empty Chunks.
-        if ( NULL != emptyChunk_ )
-        {
-            // If last Chunk is empty, just change what deallocChunk_
-            // points to, and release the last.  Otherwise, swap an empty
-            // Chunk with the last, and then release it.
-            Chunk * lastChunk = &chunks_.back();
-            if ( lastChunk == deallocChunk_ )
-                deallocChunk_ = emptyChunk_;
-            else if ( lastChunk != emptyChunk_ )
-                std::swap( *emptyChunk_, *lastChunk );
-            assert( lastChunk->HasAvailable( numBlocks_ ) );
-            lastChunk->Release();
-            chunks_.pop_back();
-            if ( ( allocChunk_ == lastChunk ) || allocChunk_->IsFilled() )
-                allocChunk_ = deallocChunk_;
-        }
-        emptyChunk_ = deallocChunk_;
+        if ( 0 == stats.slabs )
+            continue;
+        LOG( "SMALL_OBJ_STAT: %"PRIuS" %"PRIuS" %"PRIuS" %"PRIuS" %"PRIuS
+             " %"PRIuS" %.3f",
+             stats.blockSize, stats.liveObjects, stats.cachedBlocks,
+             stats.freeBlocks, stats.slabs, stats.reservedBytes,
+             stats.Fragmentation() );
     }
-
-    // prove either emptyChunk_ points nowhere, or points to a truly empty Chunk.
-    assert( ( NULL == emptyChunk_ ) || ( emptyChunk_->HasAvailable( numBlocks_ ) ) );
 }
 
 // GetOffset ------------------------------------------------------------------
 /// @ingroup SmallObjectGroupInternal
-/// Calculates index into array where a FixedAllocator of numBytes is located.
+/// Calculates index into array where the size class of numBytes is located.
 inline std::size_t GetOffset( std::size_t numBytes, std::size_t alignment )
 {
     const std::size_t alignExtra = alignment-1;
@@ -1053,7 +991,7 @@ inline std::size_t GetOffset( std::size_t numBytes, std::size_t alignment )
 /** @ingroup SmallObjectGroupInternal
  Calls the default allocator when SmallObjAllocator decides not to handle a
  request.  SmallObjAllocator calls this if the number of bytes is bigger than
- the size which can be handled by any FixedAllocator.
+ the size which can be handled by any size class.
  @param numBytes number of bytes
  @param doThrow True if this function should throw an exception, or false if it
   should indicate failure by returning a NULL pointer.
@@ -1097,17 +1035,15 @@ SmallObjAllocator::SmallObjAllocator( std::size_t pageSize,
     objectAlignSize_( objectAlignSize )
 {
     assert( 0 != objectAlignSize );
-    const std::size_t allocCount = GetOffset( maxObjectSize, objectAlignSize );
-    pool_ = new FixedAllocator[ allocCount ];
-    for ( std::size_t i = 0; i < allocCount; ++i )
-        pool_[ i ].Initialize( ( i+1 ) * objectAlignSize, pageSize );
+    assert( 0 == ( objectAlignSize & ( objectAlignSize - 1 ) ) );
+    pool_ = new SmallObjPool( pageSize, maxObjectSize, objectAlignSize );
 }
 
 // SmallObjAllocator::~SmallObjAllocator --------------------------------------
 
 SmallObjAllocator::~SmallObjAllocator( void )
 {
-    delete [] pool_;
+    delete pool_;
 }
 
 SmallObjAllocator & SmallObjAllocator::Instance( std::size_t pageSize,
@@ -1127,7 +1063,8 @@ SmallObjAllocator & SmallObjAllocator::Instance( std::size_t pageSize,
     } else if ( curPageSize != pageSize || curMaxObjectSize != maxObjectSize ||
                 curObjectAlignSize != objectAlignSize ) {
         LOG("Can't use multiple SmallObjAllocators with different parameters: "
-            "old: (%zd, %zd, %zd) new: (%zd, %zd, %zd)",
+            "old: (%"PRIuS", %"PRIuS", %"PRIuS") "
+            "new: (%"PRIuS", %"PRIuS", %"PRIuS")",
             curPageSize, curMaxObjectSize, curObjectAlignSize,
             pageSize, maxObjectSize, objectAlignSize);
         abort();
@@ -1140,21 +1077,8 @@ SmallObjAllocator & SmallObjAllocator::Instance( std::size_t pageSize,
 
 bool SmallObjAllocator::TrimExcessMemory( void )
 {
-    bool found = false;
-    const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
-    std::size_t i = 0;
-    for ( ; i < allocCount; ++i )
-    {
-        if ( pool_[ i ].TrimEmptyChunk() )
-            found = true;
-    }
-    for ( i = 0; i < allocCount; ++i )
-    {
-        if ( pool_[ i ].TrimChunkList() )
-            found = true;
-    }
-
-    return found;
+    assert( NULL != pool_ );
+    return pool_->Trim();
 }
 
 // SmallObjAllocator::Allocate ------------------------------------------------
@@ -1167,17 +1091,11 @@ void * SmallObjAllocator::Allocate( std::size_t numBytes, bool doThrow )
     assert( NULL != pool_ );
     if ( 0 == numBytes ) numBytes = 1;
     const std::size_t index = GetOffset( numBytes, GetAlignment() ) - 1;
-    const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
-    (void) allocCount;
-    assert( index < allocCount );
-
-    FixedAllocator & allocator = pool_[ index ];
-    assert( allocator.BlockSize() >= numBytes );
-    assert( allocator.BlockSize() < numBytes + GetAlignment() );
-    void * place = allocator.Allocate();
+    const std::size_t classIndex = pool_->ClassOfIndex( index );
+    void * place = pool_->Allocate( classIndex );
 
     if ( ( NULL == place ) && TrimExcessMemory() )
-        place = allocator.Allocate();
+        place = pool_->Allocate( classIndex );
 
     if ( ( NULL == place ) && doThrow )
     {
@@ -1189,6 +1107,12 @@ void * SmallObjAllocator::Allocate( std::size_t numBytes, bool doThrow )
         throw std::bad_alloc();
 #endif
     }
+
+#ifdef TRACE_ALLOCS
+    if ( NULL != place )
+        VALGRIND_PRINTF_BACKTRACE("TRACE_ALLOC: %d",
+                                  static_cast<int>(numBytes));
+#endif
     return place;
 }
 
@@ -1205,15 +1129,7 @@ void SmallObjAllocator::Deallocate( void * p, std::size_t numBytes )
     assert( NULL != pool_ );
     if ( 0 == numBytes ) numBytes = 1;
     const std::size_t index = GetOffset( numBytes, GetAlignment() ) - 1;
-    const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
-    (void) allocCount;
-    assert( index < allocCount );
-    FixedAllocator & allocator = pool_[ index ];
-    assert( allocator.BlockSize() >= numBytes );
-    assert( allocator.BlockSize() < numBytes + GetAlignment() );
-    const bool found = allocator.Deallocate( p, NULL );
-    (void) found;
-    assert( found );
+    pool_->Deallocate( p, pool_->ClassOfIndex( index ) );
 }
 
 // SmallObjAllocator::Deallocate ----------------------------------------------
@@ -1222,29 +1138,8 @@ void SmallObjAllocator::Deallocate( void * p )
 {
     if ( NULL == p ) return;
     assert( NULL != pool_ );
-    FixedAllocator * pAllocator = NULL;
-    const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
-    Chunk * chunk = NULL;
-
-    for ( std::size_t ii = 0; ii < allocCount; ++ii )
-    {
-        chunk = pool_[ ii ].HasBlock( p );
-        if ( NULL != chunk )
-        {
-            pAllocator = &pool_[ ii ];
-            break;
-        }
-    }
-    if ( NULL == pAllocator )
-    {
+    if ( !pool_->Deallocate( p ) )
         DefaultDeallocator( p );
-        return;
-    }
-
-    assert( NULL != chunk );
-    const bool found = pAllocator->Deallocate( p, chunk );
-    (void) found;
-    assert( found );
 }
 
 // SmallObjAllocator::IsCorrupt -----------------------------------------------
@@ -1266,13 +1161,30 @@ bool SmallObjAllocator::IsCorrupt( void ) const
         assert( false );
         return true;
     }
-    const std::size_t allocCount = GetOffset( GetMaxObjectSize(), GetAlignment() );
-    for ( std::size_t ii = 0; ii < allocCount; ++ii )
-    {
-        if ( pool_[ ii ].IsCorrupt() )
-            return true;
-    }
-    return false;
+    return pool_->IsCorrupt();
+}
+
+// SmallObjAllocator::GetSizeClassCount ---------------------------------------
+
+std::size_t SmallObjAllocator::GetSizeClassCount( void ) const
+{
+    return pool_->ClassCount();
+}
+
+// SmallObjAllocator::GetStats ------------------------------------------------
+
+bool SmallObjAllocator::GetStats( std::size_t index,
+                                  SmallObjStats * stats ) const
+{
+    assert( NULL != stats );
+    return pool_->GetStats( index, stats );
+}
+
+// SmallObjAllocator::ReportStats ---------------------------------------------
+
+void SmallObjAllocator::ReportStats( void ) const
+{
+    pool_->ReportStats();
 }
 
 } // end namespace ggadget
@@ -52,30 +52,65 @@ namespace ggadget
 {
 
 #if !defined(OS_WIN)
-    class FixedAllocator;
+    class SmallObjPool;
+
+    /** @struct SmallObjStats
+        @ingroup SmallObjectGroup
+     Statistics of one size class of SmallObjAllocator.
+     */
+    struct SmallObjStats
+    {
+        /// # of bytes of each block in the size class.
+        std::size_t blockSize;
+        /// # of slabs (pages) held by the size class.
+        std::size_t slabs;
+        /// # of blocks currently used by objects.
+        std::size_t liveObjects;
+        /// # of free blocks held in per-thread caches.
+        std::size_t cachedBlocks;
+        /// # of free blocks left in the slabs.
+        std::size_t freeBlocks;
+        /// # of bytes of all slabs, including slab headers.
+        std::size_t reservedBytes;
+
+        /** Returns the ratio of reserved bytes not used by live objects, in
+         the range of [0, 1].
+         */
+        inline double Fragmentation() const
+        {
+            return reservedBytes == 0 ? 0 :
+                1.0 - static_cast< double >( liveObjects * blockSize ) /
+                      static_cast< double >( reservedBytes );
+        }
+    };
 
     /** @class SmallObjAllocator
         @ingroup SmallObjectGroupInternal
      Manages pool of fixed-size allocators.
      Designed to be a non-templated base class of AllocatorSingleton so that
      implementation details can be safely hidden in the source code file.
+
+     Blocks are carved from page-aligned slabs, so the owner of a block is
+     found from its address in constant time.  Each thread keeps a small cache
+     of free blocks per size class, so that most allocations and deallocations
+     don't need to take the lock shared by all threads.
      */
     class SmallObjAllocator
     {
     protected:
         /** The only available constructor needs certain parameters in order to
-         initialize all the FixedAllocator's.  This throws only if
-         @param pageSize # of bytes in a page of memory.
+         initialize all the size classes.
+         @param pageSize # of bytes in a slab. Rounded up to a power of 2.
          @param maxObjectSize Max # of bytes which this may allocate.
          @param objectAlignSize # of bytes between alignment boundaries.
          */
         SmallObjAllocator( std::size_t pageSize, std::size_t maxObjectSize,
             std::size_t objectAlignSize );
 
-        /** Destructor releases all blocks, all Chunks, and FixedAllocator's.
-         Any outstanding blocks are unavailable, and should not be used after
-         this destructor is called.  The destructor is deliberately non-virtual
-         because it is protected, not public.
+        /** Destructor releases all slabs.  Any outstanding blocks are
+         unavailable, and should not be used after this destructor is called.
+         The destructor is deliberately non-virtual because it is protected,
+         not public.
          */
         ~SmallObjAllocator( void );
 
@@ -83,9 +118,10 @@ namespace ggadget
         static SmallObjAllocator & Instance( std::size_t pageSize,
             std::size_t maxObjectSize, std::size_t objectAlignSize );
     public:
-        /** Allocates a block of memory of requested size.  Complexity is often
-         constant-time, but might be O(C) where C is the number of Chunks in a
-         FixedAllocator.
+        /** Allocates a block of memory of requested size.  Complexity is
+         constant-time.  The block is normally taken from the cache of the
+         calling thread; the shared pool is locked only when the cache is
+         empty.
 
          @par Exception Safety Level
          Provides either strong-exception safety, or no-throw exception-safety
@@ -97,14 +133,7 @@ namespace ggadget
 
          @par Allocation Failure
          If it does not allocate, it will call TrimExcessMemory and attempt to
-         allocate again, before it decides to throw or return NULL.  Many
-         allocators loop through several new_handler functions, and terminate
-         if they can not allocate, but not this one.  It only makes one attempt
-         using its own implementation of the new_handler, and then returns NULL
-         or throws so that the program can decide what to do at a higher level.
-         (Side note: Even though the C++ Standard allows allocators and
-         new_handlers to terminate if they fail, the Loki allocator does not do
-         that since that policy is not polite to a host program.)
+         allocate again, before it decides to throw or return NULL.
 
          @param size # of bytes needed for allocation.
          @param doThrow True if this should throw if unable to allocate, false
@@ -115,14 +144,13 @@ namespace ggadget
         void * Allocate( std::size_t size, bool doThrow );
 
         /** Deallocates a block of memory at a given place and of a specific
-        size.  Complexity is almost always constant-time, and is O(C) only if
-        it has to search for which Chunk deallocates.  This never throws.
+        size.  Complexity is constant-time.  This never throws.  The block
+        may be deallocated from a thread other than the one allocated it.
          */
         void Deallocate( void * p, std::size_t size );
 
         /** Deallocates a block of memory at a given place but of unknown size
-        size.  Complexity is O(F + C) where F is the count of FixedAllocator's
-        in the pool, and C is the number of Chunks in all FixedAllocator's.  This
+        size.  Complexity is O(log S) where S is the count of all slabs.  This
         does not throw exceptions.  This overloaded version of Deallocate is
         called by the nothow delete operator - which is called when the nothrow
         new operator is used, but a constructor throws an exception.
@@ -136,25 +164,42 @@ namespace ggadget
         /// Returns # of bytes between allocation boundaries.
         inline std::size_t GetAlignment() const { return objectAlignSize_; }
 
-        /** Releases empty Chunks from memory.  Complexity is O(F + C) where F
-        is the count of FixedAllocator's in the pool, and C is the number of
-        Chunks in all FixedAllocator's.  This will never throw.  This is called
-        by AllocatorSingleto::ClearExtraMemory, the new_handler function for
-        Loki's allocator, and is called internally when an allocation fails.
+        /** Returns the cache of the calling thread to the shared pool, and
+        releases empty slabs from memory.  Complexity is O(F) where F is the
+        count of size classes.  This will never throw.  This is called
+        internally when an allocation fails.
         @return True if any memory released, or false if none released.
          */
         bool TrimExcessMemory( void );
 
         /** Returns true if anything in implementation is corrupt.  Complexity
-         is O(F + C + B) where F is the count of FixedAllocator's in the pool,
-         C is the number of Chunks in all FixedAllocator's, and B is the number
-         of blocks in all Chunks.  If it determines any data is corrupted, this
+         is O(S + B) where S is the count of all slabs and B is the number of
+         free blocks in them.  If it determines any data is corrupted, this
          will return true in release version, but assert in debug version at
          the line where it detects the corrupted data.  If it does not detect
          any corrupted data, it returns false.
          */
         bool IsCorrupt( void ) const;
 
+        /// Returns # of size classes.
+        std::size_t GetSizeClassCount( void ) const;
+
+        /** Gets the statistics of a size class.  The counts of cached blocks
+         are taken from all threads without stopping them, so the result is
+         only exact if no other thread is allocating at the same time.
+         @param index Index of the size class, in the range of
+          [0, GetSizeClassCount()), in the order of increasing block size.
+         @param stats Receives the statistics.
+         @return False if index is out of range.
+         */
+        bool GetStats( std::size_t index, SmallObjStats * stats ) const;
+
+        /** Logs the statistics of all size classes, one line per size class
+         with the "SMALL_OBJ_STAT:" prefix which utils/stat_trace_alloc.sh
+         recognizes.
+         */
+        void ReportStats( void ) const;
+
     private:
         /// Default-constructor is not implemented.
         SmallObjAllocator( void );
@@ -163,8 +208,8 @@ namespace ggadget
         /// Copy-assignment operator is not implemented.
         SmallObjAllocator & operator = ( const SmallObjAllocator & );
 
-        /// Pointer to array of fixed-size allocators.
-        FixedAllocator * pool_;
+        /// The size classes, the slabs and the per-thread caches.
+        SmallObjPool * pool_;
 
         /// Largest object size supported by allocators.
         const std::size_t maxSmallObjectSize_;
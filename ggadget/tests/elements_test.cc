@@ -15,11 +15,14 @@
 */
 
 #include <cstdio>
+#include <ctime>
 #include "unittest/gtest.h"
 #include "ggadget/basic_element.h"
 #include "ggadget/elements.h"
 #include "ggadget/view.h"
 #include "ggadget/element_factory.h"
+#include "ggadget/item_element.h"
+#include "ggadget/listbox_element.h"
 #include "ggadget/slot.h"
 #include "mocked_element.h"
 #include "mocked_timer_main_loop.h"
@@ -32,6 +35,8 @@ class MockedElementFactory : public ggadget::ElementFactory {
   MockedElementFactory() {
     RegisterElementClass("muffin", MuffinElement::CreateInstance);
     RegisterElementClass("pie", PieElement::CreateInstance);
+    RegisterElementClass("listbox", ggadget::ListBoxElement::CreateInstance);
+    RegisterElementClass("item", ggadget::ItemElement::CreateInstance);
   }
 };
 
@@ -389,6 +394,137 @@ TEST_F(ElementsTest, OnElementAddedRemovedSignal) {
   ASSERT_EQ(e1, element_just_removed_);
 }
 
+// Hit-tests the points of a grid of size x size children with 10x10 pixels
+// repeat times, and returns the element under each point.
+static void HitTestChildren(ggadget::Elements *elements, int size,
+                            int repeat, std::vector<BasicElement *> *result) {
+  result->clear();
+  for (int r = 0; r < repeat; ++r) {
+    for (int y = 0; y < size * 10; y += 3) {
+      for (int x = 0; x < size * 10; x += 3) {
+        ggadget::MouseEvent event(ggadget::Event::EVENT_MOUSE_MOVE,
+                                  x + 0.5, y + 0.5, 0, 0,
+                                  ggadget::MouseEvent::BUTTON_NONE, 0);
+        BasicElement *fired = NULL, *in = NULL;
+        ggadget::ViewInterface::HitTest hittest =
+            ggadget::ViewInterface::HT_CLIENT;
+        elements->OnMouseEvent(event, &fired, &in, &hittest);
+        if (r == 0)
+          result->push_back(in);
+      }
+    }
+  }
+}
+
+// Appends a grid of size x size children with 10x10 pixels, plus a rotated
+// child over them. The first child is invisible, so shouldn't be hit.
+static void AppendGrid(ggadget::Elements *elements, BasicElement *owner,
+                       int size) {
+  owner->SetPixelWidth(size * 10);
+  owner->SetPixelHeight(size * 10);
+  for (int i = 0; i < size * size; ++i) {
+    BasicElement *e = elements->AppendElement("muffin", NULL);
+    e->SetPixelX((i % size) * 10);
+    e->SetPixelY((i / size) * 10);
+    e->SetPixelWidth(10);
+    e->SetPixelHeight(10);
+  }
+  BasicElement *rotated = elements->AppendElement("pie", NULL);
+  rotated->SetPixelX(100);
+  rotated->SetPixelY(100);
+  rotated->SetPixelWidth(40);
+  rotated->SetPixelHeight(40);
+  rotated->SetRotation(45);
+  elements->GetItemByIndex(0)->SetVisible(false);
+  elements->Layout();
+}
+
+TEST_F(ElementsTest, HitTestIndex) {
+  const int kSize = 20;
+  AppendGrid(elements_, muffin_, kSize);
+
+  std::vector<BasicElement *> linear, indexed;
+  elements_->EnableHitTestIndex(false);
+  HitTestChildren(elements_, kSize, 1, &linear);
+  elements_->EnableHitTestIndex(true);
+  HitTestChildren(elements_, kSize, 1, &indexed);
+  ASSERT_TRUE(linear == indexed);
+  ASSERT_TRUE(linear[0] == NULL);
+  ASSERT_TRUE(linear[linear.size() - 1] ==
+              elements_->GetItemByIndex(kSize * kSize - 1));
+
+  // Moved children are found before the next Layout().
+  BasicElement *moved = elements_->GetItemByIndex(1);
+  moved->SetPixelX(0);
+  moved->SetPixelY(0);
+  HitTestChildren(elements_, kSize, 1, &indexed);
+  elements_->EnableHitTestIndex(false);
+  HitTestChildren(elements_, kSize, 1, &linear);
+  ASSERT_TRUE(linear == indexed);
+  ASSERT_TRUE(linear[0] == moved);
+}
+
+// Takes more than a second, so it doesn't run by default.
+TEST_F(ElementsTest, DISABLED_HitTestIndexBenchmark) {
+  const int kSize = 20;
+  const int kRepeat = 20;
+  AppendGrid(elements_, muffin_, kSize);
+  std::vector<BasicElement *> linear, indexed;
+  elements_->EnableHitTestIndex(false);
+  clock_t start = clock();
+  HitTestChildren(elements_, kSize, kRepeat, &linear);
+  clock_t linear_time = clock() - start;
+  elements_->EnableHitTestIndex(true);
+  start = clock();
+  HitTestChildren(elements_, kSize, kRepeat, &indexed);
+  clock_t indexed_time = clock() - start;
+  printf("Hit-test %d children: linear: %.3fs, indexed: %.3fs\n",
+         kSize * kSize + 1,
+         static_cast<double>(linear_time) / CLOCKS_PER_SEC,
+         static_cast<double>(indexed_time) / CLOCKS_PER_SEC);
+}
+
+static BasicElement *HitTest(ggadget::Elements *elements, double x, double y) {
+  ggadget::MouseEvent event(ggadget::Event::EVENT_MOUSE_MOVE, x, y, 0, 0,
+                            ggadget::MouseEvent::BUTTON_NONE, 0);
+  BasicElement *fired = NULL, *in = NULL;
+  ggadget::ViewInterface::HitTest hittest = ggadget::ViewInterface::HT_CLIENT;
+  elements->OnMouseEvent(event, &fired, &in, &hittest);
+  return in;
+}
+
+TEST_F(ElementsTest, HitTestIndexScrolled) {
+  const int kItems = 40;
+  ggadget::ListBoxElement *listbox = down_cast<ggadget::ListBoxElement *>(
+      view_elements_->AppendElement("listbox", NULL));
+  ASSERT_TRUE(listbox != NULL);
+  listbox->SetPixelWidth(100);
+  listbox->SetPixelHeight(100);
+  listbox->SetAutoscroll(true);
+  listbox->SetItemHeight(ggadget::Variant(20));
+  ggadget::Elements *items = listbox->GetChildren();
+  for (int i = 0; i < kItems; ++i)
+    ASSERT_TRUE(items->AppendElement("item", NULL) != NULL);
+  view_->Layout();
+
+  listbox->SetScrollYPosition(200);
+  ASSERT_EQ(200, listbox->GetScrollYPosition());
+  view_->Layout();
+  for (int y = 5; y < 100; y += 20) {
+    BasicElement *expected = items->GetItemByIndex(10 + y / 20);
+    ASSERT_TRUE(expected == HitTest(items, 20, y));
+    items->EnableHitTestIndex(false);
+    ASSERT_TRUE(expected == HitTest(items, 20, y));
+    items->EnableHitTestIndex(true);
+  }
+
+  // An item moved by script is found without Layout().
+  BasicElement *moved = items->GetItemByIndex(kItems - 1);
+  ASSERT_TRUE(items->GetItemByIndex(11) == HitTest(items, 20, 35));
+  moved->SetPixelY(230);
+  ASSERT_TRUE(moved == HitTest(items, 20, 35));
+}
+
 int main(int argc, char *argv[]) {
   ggadget::SetGlobalMainLoop(&main_loop);
   testing::ParseGTestFlags(&argc, argv);
@@ -16,7 +16,11 @@
 #include <set>
 #include <iostream>
 #include <clocale>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
 
 #include "ggadget/common.h"
 #include "ggadget/dir_file_manager.h"
@@ -29,15 +33,17 @@
 #include "ggadget/logger.h"
 #include "ggadget/scoped_ptr.h"
 #include "ggadget/slot.h"
+#include "ggadget/string_utils.h"
 #include "ggadget/system_file_functions.h"
 #include "ggadget/system_utils.h"
 #include "ggadget/zip_file_manager.h"
 #include "unittest/gtest.h"
 
+#include "third_party/unzip/zip.h"
+
 #if defined(OS_WIN)
 #include <time.h>
 #include <sys/stat.h>
-#include "third_party/unzip/zip.h"
 #endif
 
 using namespace ggadget;
@@ -477,6 +483,72 @@ TEST(FileManager, FileManagerWrapper) {
   ggadget::unlink(base_new_gg_path);
 }
 
+static bool CollectFileName(const char *file, std::vector<std::string> *files) {
+  files->push_back(file);
+  return true;
+}
+
+TEST(FileManager, ZipManyFiles) {
+  const char *kZipPackageName = "zip_many_files.gg";
+  const int kFileCount = 2000;
+  std::string path = BuildFilePath(GetCurrentDirectory().c_str(),
+                                   kZipPackageName, NULL);
+  ggadget::unlink(path.c_str());
+  zipFile zip_handle = ::zipOpen(path.c_str(), APPEND_STATUS_CREATE);
+  ASSERT_TRUE(zip_handle);
+  zip_fileinfo info;
+  memset(&info, 0, sizeof(info));
+  for (int i = 0; i < kFileCount; ++i) {
+    std::string name = StringPrintf("dir%d/file%d.txt", i % 10, i);
+    std::string content = StringPrintf("content of file %d", i);
+    // Both stored and deflated entries.
+    ASSERT_EQ(ZIP_OK, ::zipOpenNewFileInZip(zip_handle, name.c_str(), &info,
+                                            NULL, 0, NULL, 0, NULL,
+                                            i % 2 ? Z_DEFLATED : 0,
+                                            Z_DEFAULT_COMPRESSION));
+    ASSERT_EQ(ZIP_OK, ::zipWriteInFileInZip(
+        zip_handle, content.c_str(), static_cast<unsigned>(content.size())));
+    ::zipCloseFileInZip(zip_handle);
+  }
+  ::zipClose(zip_handle, NULL);
+
+  // Simulates the loading of a big gadget package: open the package,
+  // enumerate and read all files.
+  clock_t start = clock();
+  scoped_ptr<FileManagerInterface> fm(new ZipFileManager);
+  ASSERT_TRUE(fm->Init(path.c_str(), false));
+  std::vector<std::string> files;
+  ASSERT_TRUE(fm->EnumerateFiles("", NewSlot(CollectFileName, &files)));
+  ASSERT_EQ(static_cast<size_t>(kFileCount), files.size());
+  std::string data;
+  for (int i = 0; i < kFileCount; ++i) {
+    ASSERT_TRUE(fm->ReadFile(files[i].c_str(), &data));
+    ASSERT_EQ(StringPrintf("content of file %d", i), data);
+  }
+  printf("Load package of %d files: %.3fs\n", kFileCount,
+         static_cast<double>(clock() - start) / CLOCKS_PER_SEC);
+
+  files.clear();
+  ASSERT_TRUE(fm->EnumerateFiles("dir3", NewSlot(CollectFileName, &files)));
+  ASSERT_EQ(static_cast<size_t>(kFileCount / 10), files.size());
+  ASSERT_EQ(std::string("file3.txt"), files[0]);
+  ASSERT_TRUE(fm->FileExists("dir9/file1999.txt", NULL));
+  ASSERT_FALSE(fm->FileExists("dir9/file2000.txt", NULL));
+  ASSERT_FALSE(fm->ReadFile("dir9/file2000.txt", &data));
+  ASSERT_NE(0U, fm->GetLastModifiedTime("dir0/file0.txt"));
+
+  // Changes to the package are visible to later reads.
+  ASSERT_TRUE(fm->WriteFile("dir0/new.txt", "new", false));
+  ASSERT_TRUE(fm->ReadFile("dir0/new.txt", &data));
+  ASSERT_EQ(std::string("new"), data);
+  ASSERT_TRUE(fm->RemoveFile("dir0/file0.txt"));
+  ASSERT_FALSE(fm->FileExists("dir0/file0.txt", NULL));
+  ASSERT_TRUE(fm->ReadFile("dir0/file10.txt", &data));
+  ASSERT_EQ(std::string("content of file 10"), data);
+  fm.reset();
+  ggadget::unlink(path.c_str());
+}
+
 #if defined(OS_WIN)
 TEST(FileManager, OpenZipWithFileNameIncludingSlash) {
   const char* kZipPackageName = "zip_with_file_name_including_slash.zip";
@@ -37,8 +37,8 @@ class MockedGraphics : public ggadget::GraphicsInterface {
   class MockedImage : public ggadget::ImageInterface {
    public:
     MockedImage(MockedGraphics *gfx, const std::string &tag,
-                bool share, bool is_mask)
-      : gfx_(gfx), tag_(tag), is_mask_(is_mask) {
+                bool share, bool is_mask, size_t width)
+      : gfx_(gfx), tag_(tag), is_mask_(is_mask), width_(width) {
       if (share) {
         if (is_mask) {
           EXPECT_TRUE(gfx->mask_images_.find(tag_) == gfx->mask_images_.end());
@@ -61,10 +61,10 @@ class MockedGraphics : public ggadget::GraphicsInterface {
     virtual void StretchDraw(CanvasInterface *canvas,
                              double x, double y,
                              double width, double height) const { }
-    virtual double GetWidth() const { return 0; }
-    virtual double GetHeight() const { return 0; }
+    virtual double GetWidth() const { return static_cast<double>(width_); }
+    virtual double GetHeight() const { return width_ ? 1 : 0; }
     virtual ImageInterface *MultiplyColor(const Color &color) const {
-      return new MockedImage(gfx_, tag_.c_str(), false, is_mask_);
+      return new MockedImage(gfx_, tag_.c_str(), false, is_mask_, width_);
     }
     virtual bool GetPointValue(double x, double y,
                                Color *color, double *opacity) const {
@@ -76,16 +76,22 @@ class MockedGraphics : public ggadget::GraphicsInterface {
     MockedGraphics *gfx_;
     std::string tag_;
     bool is_mask_;
+    size_t width_;
   };
  public:
   virtual ggadget::CanvasInterface *NewCanvas(double w, double h) const {
     return NULL;
   }
+  virtual ggadget::CanvasInterface *NewScratchCanvas(double w,
+                                                     double h) const {
+    return NULL;
+  }
   virtual ggadget::ImageInterface *NewImage(const std::string &tag,
                                             const std::string &data,
                                             bool is_mask) const {
+    // The width of the image is the size of the data.
     return new MockedImage(const_cast<MockedGraphics*>(this), tag, true,
-                           is_mask);
+                           is_mask, data.size());
   }
   virtual ggadget::FontInterface *NewFont(
       const std::string &family, double pt_size,
@@ -182,6 +188,55 @@ TEST(ImageCache, LoadImage) {
   ASSERT_FALSE(img_cache.LoadImage(&gfx, NULL, "", false));
 }
 
+TEST(ImageCache, MemoryBudget) {
+  MockedGraphics gfx;
+  ImageCache img_cache;
+  img_cache.SetMemoryBudget(1000);
+  local->should_fail_ = false;
+  local->data_["image1"] = std::string(100, 'x');
+  local->data_["image2"] = std::string(100, 'x');
+  local->data_["image3"] = std::string(100, 'x');
+  size_t hits = img_cache.GetHitCount();
+  size_t misses = img_cache.GetMissCount();
+  size_t evictions = img_cache.GetEvictionCount();
+
+  // An unused image is kept and reused without decoding.
+  ImageInterface *img1 = img_cache.LoadImage(&gfx, &g_local_fm, "image1",
+                                             false);
+  ASSERT_EQ(misses + 1, img_cache.GetMissCount());
+  img1->Destroy();
+  ASSERT_EQ(400U, img_cache.GetCachedBytes());
+  ASSERT_TRUE(gfx.images_.count("image1"));
+  local->requested_file_.clear();
+  img1 = img_cache.LoadImage(&gfx, &g_local_fm, "image1", false);
+  ASSERT_TRUE(local->requested_file_.empty());
+  ASSERT_EQ(hits + 1, img_cache.GetHitCount());
+  ASSERT_EQ(misses + 1, img_cache.GetMissCount());
+  ASSERT_EQ(0U, img_cache.GetCachedBytes());
+
+  // The least recently unused image is evicted first.
+  ImageInterface *img2 = img_cache.LoadImage(&gfx, &g_local_fm, "image2",
+                                             false);
+  ImageInterface *img3 = img_cache.LoadImage(&gfx, &g_local_fm, "image3",
+                                             false);
+  ASSERT_EQ(misses + 3, img_cache.GetMissCount());
+  img2->Destroy();
+  img1->Destroy();
+  ASSERT_EQ(800U, img_cache.GetCachedBytes());
+  img3->Destroy();
+  ASSERT_EQ(800U, img_cache.GetCachedBytes());
+  ASSERT_EQ(evictions + 1, img_cache.GetEvictionCount());
+  ASSERT_FALSE(gfx.images_.count("image2"));
+  ASSERT_TRUE(gfx.images_.count("image1"));
+  ASSERT_TRUE(gfx.images_.count("image3"));
+
+  // Shrinking the budget evicts the images immediately.
+  img_cache.SetMemoryBudget(0);
+  ASSERT_EQ(0U, img_cache.GetCachedBytes());
+  ASSERT_EQ(evictions + 3, img_cache.GetEvictionCount());
+  ASSERT_TRUE(gfx.images_.empty());
+}
+
 int main(int argc, char *argv[]) {
   testing::ParseGTestFlags(&argc, argv);
 
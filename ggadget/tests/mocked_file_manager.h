@@ -52,6 +52,8 @@ class MockedFileManager : public ggadget::FileManagerInterface {
     return data_.find(file) != data_.end();
   }
   virtual bool IsDirectlyAccessible(const char *file, std::string *path) {
+    if (path)
+      *path = GetFullPath(file);
     return true;
   }
   virtual std::string GetFullPath(const char *file) {
@@ -113,10 +113,14 @@ class MockedTimerMainLoop : public ggadget::MainLoopInterface {
       if (info->interval != -1) {
         info->remaining -= time;
         if (info->remaining <= 0) {
-          LOG("MockedTimerMainLoop fire timer: %d id=%d", info->interval, i);
-          if (!info->callback->Call(this, i))
-            RemoveWatch(i);
-          else
+          int id = i + 1;
+          LOG("MockedTimerMainLoop fire timer: %d id=%d", info->interval, id);
+          // The callback may add timers and reallocate timers_.
+          bool ret = info->callback->Call(this, id);
+          info = &timers_[i];
+          if (!ret)
+            RemoveWatch(id);
+          else if (info->interval != -1)
             info->remaining = info->interval;
         }
       }
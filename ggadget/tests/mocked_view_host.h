@@ -107,6 +107,10 @@ class MockedGraphics : public ggadget::GraphicsInterface {
   virtual ggadget::CanvasInterface *NewCanvas(double w, double h) const {
     return new MockedCanvas(w, h);
   }
+  virtual ggadget::CanvasInterface *NewScratchCanvas(double w,
+                                                     double h) const {
+    return NewCanvas(w, h);
+  }
   virtual ggadget::ImageInterface *NewImage(const std::string &tag,
                                             const std::string &data,
                                             bool is_mask) const {
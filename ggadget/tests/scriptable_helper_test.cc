@@ -15,6 +15,7 @@
 */
 
 #include <set>
+#include <time.h>
 #include "ggadget/string_utils.h"
 #include "unittest/gtest.h"
 #include "scriptables.h"
@@ -443,6 +444,67 @@ TEST(ScriptableHelperTest, TestRemoveProperty) {
   delete scriptable;
 }
 
+// Many class-based properties to exercise the frozen property table.
+class ManyPropertiesScriptable : public ScriptableHelperNativeOwnedDefault {
+ public:
+  DEFINE_CLASS_ID(0x1d2b7e0c94a5f361, ScriptableInterface);
+  static const int kCount = 300;
+  static char names_[kCount][16];
+
+ protected:
+  virtual void DoClassRegister() {
+    for (int i = 0; i < kCount; i++) {
+      snprintf(names_[i], sizeof(names_[i]), "prop%d", i);
+      RegisterConstant(names_[i], i);
+    }
+  }
+};
+
+char ManyPropertiesScriptable::names_[kCount][16];
+
+TEST(ScriptableHelperTest, TestFrozenPropertyTable) {
+  ManyPropertiesScriptable *scriptable = new ManyPropertiesScriptable();
+  Variant prototype;
+  char name[16];
+  for (int i = 0; i < ManyPropertiesScriptable::kCount; i++) {
+    snprintf(name, sizeof(name), "PROP%d", i);
+    ASSERT_EQ(ScriptableInterface::PROPERTY_CONSTANT,
+              scriptable->GetPropertyInfo(name, &prototype));
+    ASSERT_EQ(Variant(i), prototype);
+  }
+  ASSERT_EQ(ScriptableInterface::PROPERTY_NOT_EXIST,
+            scriptable->GetPropertyInfo("prop", NULL));
+  ASSERT_EQ(ScriptableInterface::PROPERTY_NOT_EXIST,
+            scriptable->GetPropertyInfo("prop300", NULL));
+  ASSERT_EQ(ScriptableInterface::PROPERTY_NOT_EXIST,
+            scriptable->GetPropertyInfo("", NULL));
+
+  // Object-based properties take precedence over class-based ones.
+  scriptable->RegisterConstant("prop7", -7);
+  ASSERT_EQ(ScriptableInterface::PROPERTY_CONSTANT,
+            scriptable->GetPropertyInfo("Prop7", &prototype));
+  ASSERT_EQ(Variant(-7), prototype);
+
+  // Another instance shares the class-based table.
+  ManyPropertiesScriptable *scriptable1 = new ManyPropertiesScriptable();
+  ASSERT_EQ(ScriptableInterface::PROPERTY_CONSTANT,
+            scriptable1->GetPropertyInfo("prop7", &prototype));
+  ASSERT_EQ(Variant(7), prototype);
+
+  static const int kLookups = 1000000;
+  clock_t start = clock();
+  for (int i = 0; i < kLookups; i++) {
+    scriptable1->GetPropertyInfo(
+        ManyPropertiesScriptable::names_[i % ManyPropertiesScriptable::kCount],
+        NULL);
+  }
+  printf("%d property lookups: %.3fs\n", kLookups,
+         static_cast<double>(clock() - start) / CLOCKS_PER_SEC);
+
+  delete scriptable;
+  delete scriptable1;
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
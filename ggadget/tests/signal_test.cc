@@ -15,6 +15,7 @@
 */
 
 #include <stdio.h>
+#include <time.h>
 #include "ggadget/signals.h"
 #include "unittest/gtest.h"
 
@@ -149,6 +150,126 @@ TEST(signal, SignalSlotCompatibility) {
   ASSERT_TRUE(signal9.ConnectGeneral(meta_signal(8)) == NULL);
 }
 
+static int g_sum = 0;
+static void AddArgs0() { g_sum++; }
+static void AddArgs1(int a) { g_sum += a; }
+static int AddArgs2(int a, int b) { g_sum += a + b; return g_sum; }
+
+class SelfDisconnecter {
+ public:
+  SelfDisconnecter() : connection_(NULL), signal_(NULL), calls_(0) { }
+  void Disconnect(int) {
+    calls_++;
+    connection_->Disconnect();
+  }
+  void DeleteSignal(int) {
+    calls_++;
+    delete signal_;
+  }
+  Connection *connection_;
+  Signal1<void, int> *signal_;
+  int calls_;
+};
+
+TEST(signal, NativeEmit) {
+  Signal2<int, int, int> signal;
+  // No connection, the default value is returned.
+  ASSERT_EQ(0, signal(1, 2));
+
+  g_sum = 0;
+  Connection *native = signal.Connect(NewSlot(AddArgs2));
+  ASSERT_EQ(3, signal(1, 2));
+  // Slots connected in general way are called with Variants.
+  signal.ConnectGeneral(NewSlot(AddArgs2));
+  ASSERT_EQ(13, signal(2, 3));
+  ASSERT_EQ(13, g_sum);
+  Variant args[] = { Variant(2), Variant(0) };
+  ASSERT_EQ(Variant(17), signal.Emit(2, args).v());
+  // Reconnected slots are called with Variants.
+  native->Reconnect(NewSlot(AddArgs2));
+  ASSERT_EQ(19, signal(1, 0));
+  ASSERT_EQ(2U, signal.GetConnectionCount());
+}
+
+TEST(signal, DisconnectDuringEmit) {
+  SelfDisconnecter disconnecter;
+  Signal1<void, int> signal;
+  g_sum = 0;
+  signal.Connect(NewSlot(AddArgs1));
+  disconnecter.connection_ =
+      signal.Connect(NewSlot(&disconnecter, &SelfDisconnecter::Disconnect));
+  signal.Connect(NewSlot(AddArgs1));
+  ASSERT_EQ(3U, signal.GetConnectionCount());
+  signal(1);
+  ASSERT_EQ(2, g_sum);
+  ASSERT_EQ(1, disconnecter.calls_);
+  ASSERT_EQ(2U, signal.GetConnectionCount());
+  signal(1);
+  ASSERT_EQ(4, g_sum);
+  ASSERT_EQ(1, disconnecter.calls_);
+
+  // The signal can be deleted by its slot.
+  disconnecter.signal_ = new Signal1<void, int>();
+  disconnecter.signal_->Connect(
+      NewSlot(&disconnecter, &SelfDisconnecter::DeleteSignal));
+  disconnecter.signal_->Connect(NewSlot(AddArgs1));
+  (*disconnecter.signal_)(1);
+  ASSERT_EQ(2, disconnecter.calls_);
+  ASSERT_EQ(4, g_sum);
+}
+
+static void BenchmarkEmit(const char *name, int connections,
+                          Signal0<void> *signal0,
+                          Signal1<void, int> *signal1,
+                          Signal2<int, int, int> *signal2) {
+  const int kEmits = 1000000;
+  Variant args[2] = { Variant(1), Variant(2) };
+  double rates[5];
+  for (int test = 0; test < 5; test++) {
+    clock_t start = clock();
+    for (int i = 0; i < kEmits; i++) {
+      switch (test) {
+        case 0: (*signal0)(); break;
+        case 1: (*signal1)(1); break;
+        case 2: (*signal2)(1, 2); break;
+        case 3: signal1->Emit(1, args); break;
+        case 4: signal2->Emit(2, args); break;
+      }
+    }
+    double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    rates[test] = seconds > 0 ? kEmits / seconds / 1e6 : 0;
+  }
+  printf("%s slots, %d connection(s), million emits per second: "
+         "arity 0: %.1f, arity 1: %.1f, arity 2: %.1f, "
+         "Emit() arity 1: %.1f, Emit() arity 2: %.1f\n",
+         name, connections, rates[0], rates[1], rates[2], rates[3], rates[4]);
+}
+
+TEST(signal, EmitBenchmark) {
+  const int kConnections[] = { 0, 1, 4 };
+  for (size_t i = 0; i < arraysize(kConnections); i++) {
+    for (int native = 1; native >= 0; native--) {
+      Signal0<void> signal0;
+      Signal1<void, int> signal1;
+      Signal2<int, int, int> signal2;
+      for (int j = 0; j < kConnections[i]; j++) {
+        if (native) {
+          signal1.Connect(NewSlot(AddArgs1));
+          signal2.Connect(NewSlot(AddArgs2));
+        } else {
+          signal1.ConnectGeneral(NewSlot(AddArgs1));
+          signal2.ConnectGeneral(NewSlot(AddArgs2));
+        }
+        signal0.Connect(NewSlot(AddArgs0));
+      }
+      BenchmarkEmit(native ? "Native" : "General", kConnections[i],
+                    &signal0, &signal1, &signal2);
+      if (kConnections[i] == 0)
+        break;
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,253 @@
+/*
+  Copyright 2008 Google Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <vector>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "ggadget/format_macros.h"
+#include "ggadget/small_object.h"
+#include "unittest/gtest.h"
+
+using namespace ggadget;
+
+static SmallObjAllocator &GetAllocator() {
+  return AllocatorSingleton<>::Instance();
+}
+
+// Returns the index of the size class which serves blocks of size bytes.
+static size_t GetSizeClass(size_t size) {
+  SmallObjAllocator &allocator = GetAllocator();
+  SmallObjStats stats;
+  for (size_t i = 0; allocator.GetStats(i, &stats); i++) {
+    if (stats.blockSize >= size)
+      return i;
+  }
+  return allocator.GetSizeClassCount();
+}
+
+static size_t GetLiveObjects(size_t size) {
+  SmallObjStats stats;
+  EXPECT_TRUE(GetAllocator().GetStats(GetSizeClass(size), &stats));
+  return stats.liveObjects;
+}
+
+TEST(SmallObject, AllocateDeallocate) {
+  SmallObjAllocator &allocator = GetAllocator();
+  const size_t kCount = 20000;
+  std::vector<void *> blocks(kCount);
+  std::vector<size_t> sizes(kCount);
+  for (size_t i = 0; i < kCount; i++) {
+    sizes[i] = i % allocator.GetMaxObjectSize() + 1;
+    blocks[i] = allocator.Allocate(sizes[i], true);
+    ASSERT_TRUE(blocks[i] != NULL);
+    // Blocks are aligned to hold at least a pointer.
+    ASSERT_EQ(0U, reinterpret_cast<uintptr_t>(blocks[i]) % sizeof(void *));
+    memset(blocks[i], static_cast<int>(i & 0xff), sizes[i]);
+  }
+  // No two blocks overlap.
+  for (size_t i = 0; i < kCount; i++) {
+    const unsigned char *p = static_cast<const unsigned char *>(blocks[i]);
+    for (size_t j = 0; j < sizes[i]; j++)
+      ASSERT_EQ(i & 0xff, p[j]);
+  }
+  ASSERT_FALSE(allocator.IsCorrupt());
+
+  // Deallocates in an order different from the allocation order.
+  for (size_t i = 0; i < kCount; i += 2)
+    allocator.Deallocate(blocks[i], sizes[i]);
+  for (size_t i = kCount - 1; i < kCount; i -= 2)
+    allocator.Deallocate(blocks[i], sizes[i]);
+  ASSERT_FALSE(allocator.IsCorrupt());
+  allocator.TrimExcessMemory();
+  ASSERT_FALSE(allocator.IsCorrupt());
+}
+
+TEST(SmallObject, Stats) {
+  SmallObjAllocator &allocator = GetAllocator();
+  const size_t kSize = 24;
+  const size_t kCount = 1000;
+  size_t size_class = GetSizeClass(kSize);
+  ASSERT_LT(size_class, allocator.GetSizeClassCount());
+  size_t live = GetLiveObjects(kSize);
+
+  std::vector<void *> blocks(kCount);
+  for (size_t i = 0; i < kCount; i++)
+    blocks[i] = allocator.Allocate(kSize, true);
+  ASSERT_EQ(live + kCount, GetLiveObjects(kSize));
+
+  SmallObjStats stats;
+  ASSERT_TRUE(allocator.GetStats(size_class, &stats));
+  ASSERT_GE(stats.blockSize, kSize);
+  ASSERT_GT(stats.slabs, 0U);
+  ASSERT_GE(stats.reservedBytes,
+            (stats.liveObjects + stats.cachedBlocks + stats.freeBlocks) *
+            stats.blockSize);
+  ASSERT_GE(stats.Fragmentation(), 0.0);
+  ASSERT_LT(stats.Fragmentation(), 1.0);
+
+  for (size_t i = 0; i < kCount; i++)
+    allocator.Deallocate(blocks[i], kSize);
+  ASSERT_EQ(live, GetLiveObjects(kSize));
+  ASSERT_FALSE(allocator.GetStats(allocator.GetSizeClassCount(), &stats));
+  allocator.ReportStats();
+}
+
+TEST(SmallObject, DeallocateUnknownSize) {
+  SmallObjAllocator &allocator = GetAllocator();
+  const size_t kSize = 40;
+  size_t live = GetLiveObjects(kSize);
+  void *p = allocator.Allocate(kSize, true);
+  ASSERT_EQ(live + 1, GetLiveObjects(kSize));
+  allocator.Deallocate(p);
+  ASSERT_EQ(live, GetLiveObjects(kSize));
+
+  // Blocks not owned by the allocator go to free().
+  allocator.Deallocate(malloc(kSize));
+  p = allocator.Allocate(allocator.GetMaxObjectSize() + 1, true);
+  allocator.Deallocate(p);
+  ASSERT_FALSE(allocator.IsCorrupt());
+}
+
+// An allocator besides the singleton, which can be destroyed.
+class LocalAllocator : public SmallObjAllocator {
+ public:
+  LocalAllocator() : SmallObjAllocator(4096, 128, 8) { }
+  ~LocalAllocator() { }
+};
+
+static size_t GetLiveObjects(const SmallObjAllocator &allocator,
+                             size_t size) {
+  SmallObjStats stats;
+  for (size_t i = 0; allocator.GetStats(i, &stats); i++) {
+    if (stats.blockSize >= size)
+      return stats.liveObjects;
+  }
+  return 0;
+}
+
+TEST(SmallObject, MultipleAllocators) {
+  SmallObjAllocator &allocator = GetAllocator();
+  const size_t kSize = 24;
+  const size_t kCount = 1000;
+  size_t live = GetLiveObjects(kSize);
+  for (int round = 0; round < 2; round++) {
+    LocalAllocator local;
+    std::vector<void *> blocks, local_blocks;
+    // Interleaves the allocators, so that each one must find its own cache.
+    for (size_t i = 0; i < kCount; i++) {
+      blocks.push_back(allocator.Allocate(kSize, true));
+      local_blocks.push_back(local.Allocate(kSize, true));
+    }
+    ASSERT_EQ(live + kCount, GetLiveObjects(kSize));
+    ASSERT_EQ(kCount, GetLiveObjects(local, kSize));
+    for (size_t i = 0; i < kCount; i++) {
+      local.Deallocate(local_blocks[i], kSize);
+      allocator.Deallocate(blocks[i], kSize);
+    }
+    ASSERT_EQ(live, GetLiveObjects(kSize));
+    ASSERT_EQ(0U, GetLiveObjects(local, kSize));
+    ASSERT_FALSE(local.IsCorrupt());
+    ASSERT_FALSE(allocator.IsCorrupt());
+  }
+  // The cache of the destroyed allocators is not used any more.
+  void *p = allocator.Allocate(kSize, true);
+  allocator.Deallocate(p, kSize);
+  ASSERT_EQ(live, GetLiveObjects(kSize));
+}
+
+#ifdef HAVE_PTHREAD
+static const size_t kThreadBlockSize = 48;
+static const size_t kThreadBlocks = 10000;
+
+static void *AllocateDeallocateThread(void *arg) {
+  SmallObjAllocator &allocator = GetAllocator();
+  std::vector<void *> *foreign_blocks = static_cast<std::vector<void *> *>(arg);
+  std::vector<void *> blocks(kThreadBlocks);
+  for (int round = 0; round < 10; round++) {
+    for (size_t i = 0; i < kThreadBlocks; i++)
+      blocks[i] = allocator.Allocate(kThreadBlockSize, true);
+    for (size_t i = 0; i < kThreadBlocks; i++)
+      allocator.Deallocate(blocks[i], kThreadBlockSize);
+  }
+  // Blocks allocated by the main thread.
+  for (size_t i = 0; i < foreign_blocks->size(); i++)
+    allocator.Deallocate((*foreign_blocks)[i], kThreadBlockSize);
+  return NULL;
+}
+
+TEST(SmallObject, Threads) {
+  SmallObjAllocator &allocator = GetAllocator();
+  const int kThreads = 4;
+  size_t live = GetLiveObjects(kThreadBlockSize);
+
+  std::vector<void *> foreign_blocks[kThreads];
+  for (int i = 0; i < kThreads; i++) {
+    for (size_t j = 0; j < kThreadBlocks; j++)
+      foreign_blocks[i].push_back(allocator.Allocate(kThreadBlockSize, true));
+  }
+  ASSERT_EQ(live + kThreads * kThreadBlocks,
+            GetLiveObjects(kThreadBlockSize));
+
+  pthread_t threads[kThreads];
+  for (int i = 0; i < kThreads; i++) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, AllocateDeallocateThread,
+                                &foreign_blocks[i]));
+  }
+  for (int i = 0; i < kThreads; i++)
+    pthread_join(threads[i], NULL);
+
+  // The caches of the exited threads have been returned.
+  ASSERT_EQ(live, GetLiveObjects(kThreadBlockSize));
+  ASSERT_FALSE(allocator.IsCorrupt());
+}
+#endif
+
+// Only run on demand, as it measures rather than checks anything.
+TEST(SmallObject, DISABLED_Benchmark) {
+  SmallObjAllocator &allocator = GetAllocator();
+  const size_t kBatch = 1000;
+  const int kRounds = 2000;
+  void *blocks[kBatch];
+
+  clock_t start = clock();
+  for (int round = 0; round < kRounds; round++) {
+    for (size_t i = 0; i < kBatch; i++)
+      blocks[i] = allocator.Allocate(i % 64 + 8, true);
+    for (size_t i = 0; i < kBatch; i++)
+      allocator.Deallocate(blocks[i], i % 64 + 8);
+  }
+  double small_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (int round = 0; round < kRounds; round++) {
+    for (size_t i = 0; i < kBatch; i++)
+      blocks[i] = malloc(i % 64 + 8);
+    for (size_t i = 0; i < kBatch; i++)
+      free(blocks[i]);
+  }
+  double malloc_time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  printf("%" PRIuS " allocate/deallocate pairs: SmallObjAllocator %.3fs, "
+         "malloc %.3fs\n", kBatch * kRounds, small_time, malloc_time);
+}
+
+int main(int argc, char **argv) {
+  testing::ParseGTestFlags(&argc, argv);
+  return RUN_ALL_TESTS();
+}
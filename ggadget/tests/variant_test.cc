@@ -15,7 +15,10 @@
 */
 
 #include <cstdio>
+#include <ctime>
 #include "ggadget/scriptable_interface.h"
+#include "ggadget/signals.h"
+#include "ggadget/slot.h"
 #include "ggadget/variant.h"
 #include "unittest/gtest.h"
 
@@ -276,6 +279,109 @@ TEST(Variant, TestAny) {
   CheckVariant<const void *, Variant::TYPE_CONST_ANY>(NULL, NULL);
 }
 
+// String buffers are only counted in debug builds, by BasicVariantString.
+#if defined(_DEBUG) && !GGADGET_STD_STRING_SHARED
+#define ASSERT_STRING_ALLOCATIONS(expected) \
+  ASSERT_EQ(expected, GetVariantStringAllocationCount())
+#else
+#define ASSERT_STRING_ALLOCATIONS(expected) GGL_UNUSED((expected))
+#endif
+
+TEST(Variant, TestSmallString) {
+  size_t count = GetVariantStringAllocationCount();
+  Variant v("short string");
+  Variant v1(v);
+  Variant v2;
+  v2 = v1;
+  ASSERT_STREQ("short string", VariantValue<const char *>()(v2));
+  ASSERT_EQ(std::string("short string"), VariantValue<std::string>()(v2));
+  ASSERT_TRUE(v == v2);
+  ASSERT_STRING_ALLOCATIONS(count);
+
+  // Long strings and strings with embedded zeros are shared on the heap.
+  Variant v3("a string longer than the inline buffer");
+  Variant v4(v3);
+  ASSERT_STRING_ALLOCATIONS(count + 1);
+  ASSERT_TRUE(VariantValue<const char *>()(v3) ==
+              VariantValue<const char *>()(v4));
+  std::string zeros("a\0b", 3);
+  Variant v5(zeros);
+  ASSERT_STRING_ALLOCATIONS(count + 2);
+  ASSERT_EQ(zeros, VariantValue<std::string>()(v5));
+
+  UTF16Char utf16[] = { 'a', 'b', 'c', 0 };
+  Variant v6(utf16);
+  Variant v7(v6);
+  ASSERT_TRUE(UTF16String(utf16) == VariantValue<UTF16String>()(v7));
+  ASSERT_STRING_ALLOCATIONS(count + 2);
+}
+
+TEST(Variant, TestStringAtom) {
+  static const char kConstant[] = "a constant string longer than the buffer";
+  size_t count = GetVariantStringAllocationCount();
+  Variant v = Variant(StringAtom(kConstant));
+  ASSERT_EQ(Variant::TYPE_STRING, v.type());
+  Variant v1(v);
+  ASSERT_TRUE(kConstant == VariantValue<const char *>()(v1));
+  ASSERT_TRUE(v1 == Variant(std::string(kConstant)));
+  ASSERT_STRING_ALLOCATIONS(count + 1);
+
+  Variant v2(StringAtom(NULL));
+  ASSERT_TRUE(NULL == VariantValue<const char *>()(v2));
+
+  std::string str("interned");
+  StringAtom atom = StringAtom::Intern(str.c_str());
+  ASSERT_STREQ("interned", atom.value);
+  ASSERT_TRUE(atom.value != str.c_str());
+  ASSERT_TRUE(atom.value == StringAtom::Intern("interned").value);
+}
+
+static std::string ReturnShortString() {
+  return "horizontal";
+}
+
+static std::string ReturnLongString() {
+  return "a string which does not fit in the inline buffer";
+}
+
+static const char *ReturnConstant() {
+  return "horizontal";
+}
+
+template <typename R>
+static void BenchmarkEmit(const char *name, R (*func)()) {
+  const int kRounds = 200000;
+  Signal0<R> signal;
+  signal.Connect(NewSlot(func));
+  size_t count = GetVariantStringAllocationCount();
+  clock_t start = clock();
+  for (int i = 0; i < kRounds; i++)
+    signal.Emit(0, NULL);
+  double time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  printf("Emit %s: %.3fus, %.2f string allocations per call\n", name,
+         time * 1000000 / kRounds,
+         static_cast<double>(GetVariantStringAllocationCount() - count) /
+         kRounds);
+}
+
+TEST(Variant, Benchmark) {
+  BenchmarkEmit("short string", ReturnShortString);
+  BenchmarkEmit("long string", ReturnLongString);
+  BenchmarkEmit("const char *", ReturnConstant);
+
+  const int kRounds = 200000;
+  size_t count = GetVariantStringAllocationCount();
+  clock_t start = clock();
+  for (int i = 0; i < kRounds; i++)
+    ResultVariant result = ResultVariant(Variant(StringAtom("horizontal")));
+  double time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  printf("ResultVariant of atom: %.3fus, %.2f string allocations per call\n",
+         time * 1000000 / kRounds,
+         static_cast<double>(GetVariantStringAllocationCount() - count) /
+         kRounds);
+  ASSERT_STRING_ALLOCATIONS(count);
+}
+
 int main(int argc, char **argv) {
   testing::ParseGTestFlags(&argc, argv);
   return RUN_ALL_TESTS();
@@ -167,6 +167,117 @@ TEST(ViewTest, MinSize) {
   ASSERT_DOUBLE_EQ(200.0, view.GetHeight());
 }
 
+TEST(ViewTest, DrawDamagedRegionFromCache) {
+  MockedViewHost *host = new MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN);
+  View view(host, NULL, g_factory, NULL);
+  view.SetSize(100, 100);
+
+  // The first draw fills the canvas cache and copies the whole view.
+  host->GetQueuedDraw();
+  ASSERT_EQ(10000U, view.GetBlitPixelCount());
+
+  // Only the rectangles added by the host are copied from the cache.
+  view.Layout();
+  view.AddRectangleToClipRegion(ggadget::Rectangle(10, 10, 20, 20));
+  view.AddRectangleToClipRegion(ggadget::Rectangle(90, 90, 20, 20));
+  MockedCanvas canvas(100, 100);
+  view.Draw(&canvas);
+  ASSERT_EQ(500U, view.GetBlitPixelCount());
+
+  // Without any known damage the whole cache is copied.
+  view.Layout();
+  view.Draw(&canvas);
+  ASSERT_EQ(10000U, view.GetBlitPixelCount());
+}
+
+static int GetActiveTimerCount() {
+  int count = 0;
+  for (MockedTimerMainLoop::Timers::iterator it = main_loop.timers_.begin();
+       it != main_loop.timers_.end(); ++it) {
+    if (it->interval != -1)
+      count++;
+  }
+  return count;
+}
+
+class TimerCounter {
+ public:
+  TimerCounter() : count_(0) { }
+  void Count() { count_++; }
+  int count_;
+};
+
+TEST(ViewTest, FrameClock) {
+  MockedViewHost *host = new MockedViewHost(ViewHostInterface::VIEW_HOST_MAIN);
+  View view(host, NULL, g_factory, NULL);
+  view.EnableEvents(true);
+  int timers = GetActiveTimerCount();
+
+  // All animations and frame aligned intervals share one wakeup per frame.
+  // Other intervals keep their own watches.
+  TimerCounter animations, short_interval, frame_interval, long_interval;
+  for (int i = 0; i < 10; i++) {
+    ASSERT_GT(view.BeginAnimation(
+        ggadget::NewSlot(&animations, &TimerCounter::Count), 0, 1000, 400), 0);
+  }
+  ASSERT_EQ(timers + 1, GetActiveTimerCount());
+  int short_interval_token = view.SetInterval(
+      ggadget::NewSlot(&short_interval, &TimerCounter::Count), 10);
+  ASSERT_GT(short_interval_token, 0);
+  ASSERT_EQ(timers + 2, GetActiveTimerCount());
+  int frame_interval_token = view.SetInterval(
+      ggadget::NewSlot(&frame_interval, &TimerCounter::Count), 80);
+  ASSERT_GT(frame_interval_token, 0);
+  ASSERT_EQ(timers + 2, GetActiveTimerCount());
+  int long_interval_token = view.SetInterval(
+      ggadget::NewSlot(&long_interval, &TimerCounter::Count), 100);
+  ASSERT_GT(long_interval_token, 0);
+  ASSERT_NE(frame_interval_token, long_interval_token);
+  ASSERT_EQ(timers + 3, GetActiveTimerCount());
+
+  for (int i = 0; i < 20; i++)
+    main_loop.AdvanceTime(10);
+  ASSERT_EQ(5U, view.GetFrameClockWakeupCount());
+  ASSERT_EQ(0U, view.GetDroppedFrameCount());
+  ASSERT_EQ(50, animations.count_);
+  ASSERT_EQ(20, short_interval.count_);
+  ASSERT_EQ(2, frame_interval.count_);
+  ASSERT_EQ(2, long_interval.count_);
+
+  // A late wakeup drops the frames in between, and fires each timer once.
+  // The animations end now.
+  main_loop.AdvanceTime(200);
+  ASSERT_EQ(6U, view.GetFrameClockWakeupCount());
+  ASSERT_EQ(4U, view.GetDroppedFrameCount());
+  ASSERT_EQ(60, animations.count_);
+  ASSERT_EQ(21, short_interval.count_);
+  ASSERT_EQ(3, frame_interval.count_);
+  ASSERT_EQ(3, long_interval.count_);
+
+  // The clock keeps running for the interval, and idles when nothing is
+  // left.
+  main_loop.AdvanceTime(40);
+  ASSERT_EQ(3, frame_interval.count_);
+  main_loop.AdvanceTime(40);
+  ASSERT_EQ(60, animations.count_);
+  ASSERT_EQ(4, frame_interval.count_);
+  view.ClearInterval(short_interval_token);
+  view.ClearInterval(frame_interval_token);
+  view.ClearInterval(long_interval_token);
+  main_loop.AdvanceTime(40);
+  ASSERT_EQ(timers, GetActiveTimerCount());
+  uint64_t wakeups = view.GetFrameClockWakeupCount();
+  main_loop.AdvanceTime(40);
+  ASSERT_EQ(wakeups, view.GetFrameClockWakeupCount());
+
+  // The clock starts again for a new animation.
+  ASSERT_GT(view.BeginAnimation(
+      ggadget::NewSlot(&animations, &TimerCounter::Count), 0, 1, 40), 0);
+  main_loop.AdvanceTime(40);
+  ASSERT_EQ(wakeups + 1, view.GetFrameClockWakeupCount());
+  ASSERT_EQ(61, animations.count_);
+}
+
 int main(int argc, char *argv[]) {
   ggadget::SetGlobalMainLoop(&main_loop);
   testing::ParseGTestFlags(&argc, argv);
@@ -14,8 +14,11 @@
   limitations under the License.
 */
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <locale.h>
+#include <time.h>
 
 #include "ggadget/logger.h"
 #include "ggadget/xml_parser_interface.h"
@@ -67,6 +70,35 @@ TEST(XMLParser, ParseXMLIntoXPathMap) {
 
 }
 
+TEST(XMLParser, ParseXMLIntoXPathMap_Sequences) {
+  const char *xml =
+    "<!DOCTYPE a [<!ENTITY e 'ee'>]>"
+    "<a x='&e;'><b>t1<c>t2</c>t3</b><b/><b><b>x</b><b>y</b></b>"
+    "<p:d xmlns:p='u' p:y='2'>d<![CDATA[cd]]><!--c--><?pi z?>&e;</p:d>"
+    "<f><g/><g/><h/><g>q</g></f></a>";
+  StringMap map;
+  map["b"] = "existing";
+  XMLParserInterface *xml_parser = GetXMLParser();
+  ASSERT_TRUE(xml_parser->ParseXMLIntoXPathMap(xml, NULL, "TheFileName", "a",
+                                               NULL, NULL, &map));
+  ASSERT_EQ(15U, map.size());
+  EXPECT_STREQ("ee", map.find("@x")->second.c_str());
+  EXPECT_STREQ("existing", map.find("b")->second.c_str());
+  EXPECT_STREQ("t1t2t3", map.find("b[1]")->second.c_str());
+  EXPECT_STREQ("t2", map.find("b[1]/c")->second.c_str());
+  EXPECT_STREQ("", map.find("b[2]")->second.c_str());
+  EXPECT_STREQ("xy", map.find("b[3]")->second.c_str());
+  EXPECT_STREQ("x", map.find("b[3]/b")->second.c_str());
+  EXPECT_STREQ("y", map.find("b[3]/b[2]")->second.c_str());
+  EXPECT_STREQ("dcdee", map.find("d")->second.c_str());
+  EXPECT_STREQ("2", map.find("d@y")->second.c_str());
+  EXPECT_STREQ("q", map.find("f")->second.c_str());
+  EXPECT_STREQ("", map.find("f/g")->second.c_str());
+  EXPECT_STREQ("", map.find("f/g[2]")->second.c_str());
+  EXPECT_STREQ("", map.find("f/h")->second.c_str());
+  EXPECT_STREQ("q", map.find("f/g[3]")->second.c_str());
+}
+
 TEST(XMLParser, ParseXMLIntoXPathMap_InvalidRoot) {
   StringMap map;
   XMLParserInterface *xml_parser = GetXMLParser();
@@ -80,6 +112,11 @@ TEST(XMLParser, ParseXMLIntoXPathMap_InvalidXML) {
   XMLParserInterface *xml_parser = GetXMLParser();
   ASSERT_FALSE(xml_parser->ParseXMLIntoXPathMap("<a></b>", NULL, "Bad", "a",
                                                 NULL, NULL, &map));
+  // The table is not changed if the error is after some valid content.
+  ASSERT_FALSE(xml_parser->ParseXMLIntoXPathMap("<a><b>t</b><c></a>", NULL,
+                                                "Bad", "a", NULL, NULL,
+                                                &map));
+  ASSERT_EQ(0U, map.size());
 }
 
 TEST(XMLParser, CheckXMLName) {
@@ -258,6 +295,110 @@ TEST(XMLParser, ParseXMLIntoDOM_InvalidXML) {
   domdoc->Unref();
 }
 
+// Parses content into a DOM with the DOM builder, in chunks of chunk_size.
+static bool BuildDOM(const std::string &content, size_t chunk_size,
+                     DOMDocumentInterface *domdoc, std::string *encoding) {
+  XMLDOMBuilderInterface *builder =
+      GetXMLParser()->CreateDOMBuilder(&g_strings, "TheFileName", NULL, domdoc);
+  EXPECT_TRUE(builder);
+  bool result = true;
+  for (size_t i = 0; result && i < content.size(); i += chunk_size) {
+    size_t size = std::min(chunk_size, content.size() - i);
+    result = builder->Write(content.c_str() + i, size) == size;
+  }
+  result = builder->Finish(encoding) && result;
+  builder->Destroy();
+  return result;
+}
+
+TEST(XMLParser, DOMBuilder) {
+  XMLParserInterface *xml_parser = GetXMLParser();
+  for (int preserve_white_space = 0; preserve_white_space < 2;
+       preserve_white_space++) {
+    DOMDocumentInterface *expected = xml_parser->CreateDOMDocument();
+    expected->Ref();
+    expected->SetPreserveWhiteSpace(preserve_white_space);
+    ASSERT_TRUE(xml_parser->ParseContentIntoDOM(xml, &g_strings, "TheFileName",
+                                                NULL, NULL, NULL,
+                                                expected, NULL, NULL));
+
+    static const size_t kChunkSizes[] = { 1, 7, 4096 };
+    for (size_t i = 0; i < arraysize(kChunkSizes); i++) {
+      DOMDocumentInterface *domdoc = xml_parser->CreateDOMDocument();
+      domdoc->Ref();
+      domdoc->SetPreserveWhiteSpace(preserve_white_space);
+      std::string encoding;
+      ASSERT_TRUE(BuildDOM(xml, kChunkSizes[i], domdoc, &encoding));
+      EXPECT_STREQ("iso8859-1", encoding.c_str());
+      EXPECT_EQ(expected->GetXML(), domdoc->GetXML());
+      ASSERT_EQ(1, domdoc->GetRefCount());
+      domdoc->Unref();
+    }
+    expected->Unref();
+  }
+}
+
+TEST(XMLParser, DOMBuilder_InvalidXML) {
+  XMLParserInterface *xml_parser = GetXMLParser();
+  DOMDocumentInterface *domdoc = xml_parser->CreateDOMDocument();
+  domdoc->Ref();
+  ASSERT_FALSE(BuildDOM("<a><b>text</b></c>", 4, domdoc, NULL));
+  ASSERT_FALSE(domdoc->HasChildNodes());
+  ASSERT_FALSE(BuildDOM("", 4, domdoc, NULL));
+  ASSERT_FALSE(domdoc->HasChildNodes());
+  ASSERT_EQ(1, domdoc->GetRefCount());
+  domdoc->Unref();
+}
+
+TEST(XMLParser, ParseLargeFeedBenchmark) {
+  std::string feed("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                   "<rss version=\"2.0\"><channel><title>Feed</title>\n");
+  const int kItems = 5000;
+  for (int i = 0; i < kItems; i++) {
+    StringAppendPrintf(&feed,
+        "<item><title>Item %d &amp; more</title>"
+        "<link>http://www.example.com/item?id=%d</link>"
+        "<description><![CDATA[<p>Description of item %d, "
+        "which is long enough to look like a real one.</p>]]></description>"
+        "<pubDate>Mon, 01 Jan 2008 00:00:00 GMT</pubDate>"
+        "<guid isPermaLink=\"false\">%d</guid></item>\n", i, i, i, i);
+  }
+  feed += "</channel></rss>\n";
+
+  XMLParserInterface *xml_parser = GetXMLParser();
+  const int kRounds = 5;
+  clock_t start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    DOMDocumentInterface *domdoc = xml_parser->CreateDOMDocument();
+    domdoc->Ref();
+    ASSERT_TRUE(xml_parser->ParseContentIntoDOM(feed, NULL, "feed", NULL, NULL,
+                                                NULL, domdoc, NULL, NULL));
+    domdoc->Unref();
+  }
+  double content_time =
+      static_cast<double>(clock() - start) / CLOCKS_PER_SEC / kRounds;
+
+  start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    DOMDocumentInterface *domdoc = xml_parser->CreateDOMDocument();
+    domdoc->Ref();
+    ASSERT_TRUE(BuildDOM(feed, 16384, domdoc, NULL));
+    DOMNodeListInterface *items = domdoc->GetElementsByTagName("item");
+    items->Ref();
+    ASSERT_EQ(static_cast<size_t>(kItems), items->GetLength());
+    items->Unref();
+    domdoc->Unref();
+  }
+  double builder_time =
+      static_cast<double>(clock() - start) / CLOCKS_PER_SEC / kRounds;
+
+  double mega_bytes = feed.size() / 1048576.0;
+  printf("Parse %.2fMB feed: ParseContentIntoDOM %.3fs (%.1fMB/s), "
+         "DOM builder %.3fs (%.1fMB/s)\n", mega_bytes,
+         content_time, mega_bytes / content_time,
+         builder_time, mega_bytes / builder_time);
+}
+
 TEST(XMLParser, ConvertStringToUTF8) {
   XMLParserInterface *xml_parser = GetXMLParser();
   const char *src = "ASCII string, no BOM";
@@ -18,6 +18,7 @@
 #include <cmath>
 #include <cstring>
 #include <cstdlib>
+#include <set>
 #include "common.h"  // It defines some int types.
 #include "format_macros.h"  // It defines PRId64/PRIu64/PRIx64.
 #include "logger.h"
@@ -40,6 +41,29 @@ static const UTF16Char kNullUTF16StringValue[] =
 const UTF16String VariantUTF16String::kNullString(kNullUTF16StringValue);
 #endif
 
+// Only counted in debug builds, as it isn't thread safe, and is only needed
+// by the tests.
+static size_t g_string_allocation_count = 0;
+
+size_t GetVariantStringAllocationCount() {
+  return g_string_allocation_count;
+}
+
+namespace internal {
+void CountVariantStringAllocation() {
+  g_string_allocation_count++;
+}
+} // namespace internal
+
+StringAtom StringAtom::Intern(const char *str) {
+  if (!str)
+    return StringAtom(NULL);
+  // Atoms must stay valid until the program exits, so the table is never
+  // freed.
+  static std::set<std::string> *atoms = new std::set<std::string>;
+  return StringAtom(atoms->insert(str).first->c_str());
+}
+
 Variant::Variant() : type_(TYPE_VOID) {
   memset(&v_, 0, sizeof(v_));
 }
@@ -18,6 +18,7 @@
 // #define VIEW_VERBOSE_DEBUG
 // #define EVENT_VERBOSE_DEBUG
 
+#include <climits>
 #include <vector>
 #include <algorithm>
 
@@ -73,6 +74,9 @@ class View::Impl : public SmallObject<> {
    * if duration > 0 then it's a animation timer.
    * else if duration == 0 then it's a timeout timer.
    * else if duration < 0 then it's a interval timer.
+   *
+   * A timer either has its own main loop watch, or is fired by the frame
+   * clock of the view if its watch id is 0.
    */
   class TimerWatchCallback : public WatchCallbackInterface {
    public:
@@ -90,6 +94,9 @@ class View::Impl : public SmallObject<> {
         end_(end),
         duration_(duration),
         last_value_(start),
+        watch_id_(0),
+        frame_period_(1),
+        frames_left_(1),
         is_event_(is_event) {
       destroy_connection_ = impl_->on_destroy_signal_.Connect(
           NewSlot(this, &TimerWatchCallback::OnDestroy));
@@ -100,19 +107,45 @@ class View::Impl : public SmallObject<> {
       delete slot_;
     }
 
+    int GetToken() const {
+      return event_.GetToken();
+    }
+
+    void SetToken(int token) {
+      event_.SetToken(token);
+    }
+
+    int GetWatchId() const {
+      return watch_id_;
+    }
+
     void SetWatchId(int watch_id) {
-      event_.SetToken(watch_id);
+      watch_id_ = watch_id;
     }
 
-    virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
-      GGL_UNUSED(watch_id);
-      ASSERT(event_.GetToken() == watch_id);
+    // Sets the number of frames between two firings by the frame clock.
+    void SetFramePeriod(int frames) {
+      frame_period_ = frames_left_ = frames;
+    }
+
+    // Counts the frames elapsed since the last frame. Returns true if the
+    // timer is due in this frame. A late frame fires the timer only once.
+    bool CountFrames(uint64_t frames) {
+      if (static_cast<uint64_t>(frames_left_) > frames) {
+        frames_left_ -= static_cast<int>(frames);
+        return false;
+      }
+      frames_left_ = frame_period_;
+      return true;
+    }
+
+    // Fires the timer. Returns false if the timer has finished.
+    bool Fire(uint64_t current_time) {
       ScopedLogContext log_context(impl_->gadget_);
 
       bool fire = true;
       bool ret = true;
       int value = end_; // In case of duration <= 0.
-      uint64_t current_time = main_loop->GetCurrentTime();
 
       // Animation timer
       if (duration_ > 0) {
@@ -147,19 +180,26 @@ class View::Impl : public SmallObject<> {
         }
       }
 
-      last_finished_time_ = main_loop->GetCurrentTime();
+      last_finished_time_ = impl_->main_loop_->GetCurrentTime();
       return ret;
     }
 
+    virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+      GGL_UNUSED(watch_id);
+      ASSERT(watch_id_ == watch_id);
+      return Fire(main_loop->GetCurrentTime());
+    }
+
     virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
       GGL_UNUSED(main_loop);
       GGL_UNUSED(watch_id);
-      ASSERT(event_.GetToken() == watch_id);
+      ASSERT(watch_id_ == watch_id);
+      impl_->timers_.erase(GetToken());
       delete this;
     }
 
     void OnDestroy() {
-      impl_->RemoveTimer(event_.GetToken());
+      impl_->RemoveTimer(GetToken());
     }
 
    private:
@@ -174,9 +214,38 @@ class View::Impl : public SmallObject<> {
     int end_;
     int duration_;
     int last_value_;
+    int watch_id_;
+    int frame_period_;
+    int frames_left_;
     bool is_event_;
   };
 
+  /**
+   * The main loop watch of the frame clock, which fires all animations and
+   * frame aligned intervals of the view together, so that they cost one
+   * wakeup per frame, and the draws they queue are done in one layout and
+   * draw pass.
+   */
+  class FrameClockCallback : public WatchCallbackInterface {
+   public:
+    FrameClockCallback(Impl *impl) : impl_(impl) { }
+
+    virtual bool Call(MainLoopInterface *main_loop, int watch_id) {
+      GGL_UNUSED(watch_id);
+      return impl_->TickFrame(main_loop->GetCurrentTime());
+    }
+
+    virtual void OnRemove(MainLoopInterface *main_loop, int watch_id) {
+      GGL_UNUSED(main_loop);
+      GGL_UNUSED(watch_id);
+      impl_->frame_clock_watch_ = 0;
+      delete this;
+    }
+
+   private:
+    Impl *impl_;
+  };
+
   Impl(View *owner,
        ViewHostInterface *view_host,
        GadgetInterface *gadget,
@@ -205,7 +274,9 @@ class View::Impl : public SmallObject<> {
       graphics_(NULL),
       scriptable_view_(NULL),
       clip_region_(0.9),
+      blit_region_(0.9),
       children_(element_factory, NULL, owner),
+      blit_pixel_count_(0),
 #ifdef _DEBUG
       draw_count_(0),
       view_draw_count_(0),
@@ -229,7 +300,14 @@ class View::Impl : public SmallObject<> {
       safe_to_destroy_(true),
       content_changed_(true),
       auto_width_(false),
-      auto_height_(false) {
+      auto_height_(false),
+      firing_timer_(NULL),
+      last_timer_token_(0),
+      frame_clock_watch_(0),
+      last_frame_time_(0),
+      frame_clock_wakeups_(0),
+      dropped_frames_(0),
+      in_frame_(false) {
     ASSERT(main_loop_);
 
     if (gadget_) {
@@ -243,6 +321,8 @@ class View::Impl : public SmallObject<> {
     ASSERT(event_stack_.empty());
 
     on_destroy_signal_.Emit(0, NULL);
+    if (frame_clock_watch_)
+      main_loop_->RemoveWatch(frame_clock_watch_);
 
     if (onoptionchanged_connection_) {
       onoptionchanged_connection_->Disconnect();
@@ -1259,7 +1339,7 @@ class View::Impl : public SmallObject<> {
 #if defined(_DEBUG) && defined(VIEW_VERBOSE_DEBUG)
       DLOG("Draw View(%p) from canvas cache.", owner_);
 #endif
-      canvas->DrawCanvas(0, 0, canvas_cache_);
+      DrawCanvasCache(canvas, NULL);
       return;
 #if defined(_DEBUG) && defined(VIEW_VERBOSE_DEBUG)
     } else {
@@ -1339,7 +1419,9 @@ class View::Impl : public SmallObject<> {
     target->PopState();
 
     if (target == canvas_cache_)
-      canvas->DrawCanvas(0, 0, canvas_cache_);
+      DrawCanvasCache(canvas, &clip_region_);
+    else
+      blit_pixel_count_ = CountRegionPixels(clip_region_);
 
 #ifdef _DEBUG
     if (owner_->GetDebugMode() & DEBUG_CLIP_REGION)
@@ -1362,6 +1444,47 @@ class View::Impl : public SmallObject<> {
 #endif
   }
 
+  // Composites canvas_cache_ onto the host canvas. Only the damaged part of
+  // the view, that is the changed region plus the rectangles added by the
+  // host, is copied. The whole cache is copied if no damage is known.
+  void DrawCanvasCache(CanvasInterface *canvas, const ClipRegion *changed) {
+    ClipRegion damage(blit_region_);
+    blit_region_.Clear();
+    if (changed) {
+      size_t count = changed->GetRectangleCount();
+      for (size_t i = 0; i < count; ++i)
+        damage.AddRectangle(changed->GetRectangle(i));
+    }
+
+    if (damage.IsEmpty()) {
+      canvas->DrawCanvas(0, 0, canvas_cache_);
+    } else {
+      canvas->PushState();
+      canvas->IntersectGeneralClipRegion(damage);
+      canvas->DrawCanvas(0, 0, canvas_cache_);
+      canvas->PopState();
+    }
+    blit_pixel_count_ = CountRegionPixels(damage);
+  }
+
+  // Returns the number of view pixels covered by a clip region. An empty
+  // region stands for the whole view.
+  size_t CountRegionPixels(const ClipRegion &region) const {
+    Rectangle boundary(0, 0, width_, height_);
+    boundary.Integerize(true);
+    size_t count = region.GetRectangleCount();
+    if (!count)
+      return static_cast<size_t>(boundary.w * boundary.h);
+
+    double pixels = 0;
+    for (size_t i = 0; i < count; ++i) {
+      Rectangle rect = region.GetRectangle(i);
+      if (rect.Intersect(boundary))
+        pixels += rect.w * rect.h;
+    }
+    return static_cast<size_t>(pixels);
+  }
+
 #ifdef _DEBUG
   static bool DrawRectOnCanvasCallback(double x, double y, double w, double h,
                                        CanvasInterface *canvas) {
@@ -1581,6 +1704,84 @@ class View::Impl : public SmallObject<> {
     }
   }
 
+  // Adds a timer with its own main loop watch, or to the frame clock if
+  // interval is 0. Returns the token of the timer, or 0 on failure.
+  int AddTimer(TimerWatchCallback *timer, int interval) {
+    if (interval == 0 && !frame_clock_watch_) {
+      frame_clock_watch_ = main_loop_->AddTimeoutWatch(
+          kAnimationInterval, new FrameClockCallback(this));
+      if (frame_clock_watch_ <= 0) {
+        frame_clock_watch_ = 0;
+        delete timer;
+        return 0;
+      }
+      last_frame_time_ = main_loop_->GetCurrentTime();
+    }
+
+    int token;
+    do {
+      last_timer_token_ = last_timer_token_ < INT_MAX ?
+                          last_timer_token_ + 1 : 1;
+      token = last_timer_token_;
+    } while (timers_.find(token) != timers_.end());
+
+    if (interval > 0) {
+      int id = main_loop_->AddTimeoutWatch(interval, timer);
+      if (id <= 0) {
+        delete timer;
+        return 0;
+      }
+      timer->SetWatchId(id);
+    } else {
+      frame_timers_.insert(token);
+    }
+    timer->SetToken(token);
+    timers_[token] = timer;
+    return token;
+  }
+
+  bool TickFrame(uint64_t current_time) {
+    // Don't tick again in a nested main loop, e.g. of a modal dialog opened
+    // by a timer.
+    if (in_frame_)
+      return true;
+
+    ++frame_clock_wakeups_;
+    uint64_t frames = (current_time - last_frame_time_) / kAnimationInterval;
+    if (frames > 1)
+      dropped_frames_ += frames - 1;
+    else
+      frames = 1;
+    last_frame_time_ = current_time;
+
+    // The timers may add or remove timers when fired.
+    std::vector<int> tokens(frame_timers_.begin(), frame_timers_.end());
+    in_frame_ = true;
+    for (std::vector<int>::iterator it = tokens.begin();
+         it != tokens.end(); ++it) {
+      TimerMap::iterator timer_it = timers_.find(*it);
+      if (timer_it == timers_.end())
+        continue;
+      TimerWatchCallback *timer = timer_it->second;
+      if (!timer->CountFrames(frames))
+        continue;
+      firing_timer_ = timer;
+      bool ret = timer->Fire(current_time);
+      if (!firing_timer_) {
+        // Removed when fired.
+        delete timer;
+      } else if (!ret) {
+        firing_timer_ = NULL;
+        RemoveTimer(*it);
+      }
+    }
+    firing_timer_ = NULL;
+    in_frame_ = false;
+
+    // Idle until the next animation or frame aligned interval is added.
+    return !frame_timers_.empty();
+  }
+
   int BeginAnimation(Slot *slot, int start_value, int end_value,
                      int duration) {
     if (!slot) {
@@ -1598,13 +1799,9 @@ class View::Impl : public SmallObject<> {
     TimerWatchCallback *watch =
         new TimerWatchCallback(this, slot, start_value, end_value,
                                duration, current_time, true);
-    int id = main_loop_->AddTimeoutWatch(kAnimationInterval, watch);
-    if (id > 0) {
-      watch->SetWatchId(id);
-    } else {
+    int id = AddTimer(watch, 0);
+    if (id == 0)
       DLOG("Failed to add animation timer.");
-      delete watch;
-    }
     return id;
   }
 
@@ -1625,13 +1822,9 @@ class View::Impl : public SmallObject<> {
 
     TimerWatchCallback *watch =
         new TimerWatchCallback(this, slot, 0, 0, 0, 0, true);
-    int id = main_loop_->AddTimeoutWatch(timeout, watch);
-    if (id > 0) {
-      watch->SetWatchId(id);
-    } else {
+    int id = AddTimer(watch, timeout);
+    if (id == 0)
       DLOG("Failed to add timeout timer.");
-      delete watch;
-    }
     return id;
   }
 
@@ -1652,19 +1845,36 @@ class View::Impl : public SmallObject<> {
 
     TimerWatchCallback *watch =
         new TimerWatchCallback(this, slot, 0, 0, -1, 0, true);
-    int id = main_loop_->AddTimeoutWatch(interval, watch);
-    if (id > 0) {
-      watch->SetWatchId(id);
-    } else {
+    // Intervals of whole frames are fired by the frame clock. Others keep
+    // their own watches, so that they aren't fired more or less often.
+    if (interval % kAnimationInterval == 0) {
+      watch->SetFramePeriod(interval / kAnimationInterval);
+      interval = 0;
+    }
+    int id = AddTimer(watch, interval);
+    if (id == 0)
       DLOG("Failed to add interval timer.");
-      delete watch;
-    }
     return id;
   }
 
   void RemoveTimer(int token) {
-    if (token > 0)
-      main_loop_->RemoveWatch(token);
+    TimerMap::iterator it = timers_.find(token);
+    if (it == timers_.end())
+      return;
+
+    TimerWatchCallback *timer = it->second;
+    if (timer->GetWatchId() > 0) {
+      // The timer will be deleted in its OnRemove().
+      main_loop_->RemoveWatch(timer->GetWatchId());
+    } else {
+      timers_.erase(it);
+      frame_timers_.erase(token);
+      // A timer being fired is deleted by TickFrame() after firing.
+      if (timer == firing_timer_)
+        firing_timer_ = NULL;
+      else
+        delete timer;
+    }
   }
 
   ImageInterface *LoadImage(const Variant &src, bool is_mask) {
@@ -1850,8 +2060,12 @@ class View::Impl : public SmallObject<> {
   ElementsMap all_elements_;
 
   ClipRegion clip_region_;
+  // Rectangles added by the host while the canvas cache is enabled. They need
+  // no redrawing, but must be copied from the cache onto the host's canvas.
+  ClipRegion blit_region_;
 
   Elements children_;
+  size_t blit_pixel_count_;
 
   ElementHolder focused_element_;
   ElementHolder mouseover_element_;
@@ -1906,6 +2120,19 @@ class View::Impl : public SmallObject<> {
   bool auto_width_              : 1;
   bool auto_height_             : 1;
 
+  typedef LightMap<int, TimerWatchCallback *> TimerMap;
+  TimerMap timers_;
+  // Tokens of the timers fired by the frame clock.
+  LightSet<int> frame_timers_;
+  TimerWatchCallback *firing_timer_;
+  int last_timer_token_;
+  int frame_clock_watch_;
+  uint64_t last_frame_time_;
+  uint64_t frame_clock_wakeups_;
+  uint64_t dropped_frames_;
+  bool in_frame_;
+
+  // The interval of the frame clock.
   static const int kAnimationInterval = 40;
   static const int kMinTimeout = 10;
   static const int kMinInterval = 10;
@@ -2254,10 +2481,14 @@ bool View::IsClipRegionEnabled() const {
 }
 
 void View::AddRectangleToClipRegion(const Rectangle &rect) {
-  if (!impl_->enable_cache_) {
-    Rectangle view_rect(0, 0, impl_->width_, impl_->height_);
-    if (view_rect.Intersect(rect)) {
-      view_rect.Integerize(true);
+  Rectangle view_rect(0, 0, impl_->width_, impl_->height_);
+  if (view_rect.Intersect(rect)) {
+    view_rect.Integerize(true);
+    if (impl_->enable_cache_) {
+      // Content of the rectangle is still valid in the canvas cache, so it
+      // only needs to be copied onto the host's canvas by next Draw().
+      impl_->blit_region_.AddRectangle(view_rect);
+    } else {
       impl_->clip_region_.AddRectangle(view_rect);
       if (impl_->on_add_rectangle_to_clip_region_.HasActiveConnections()) {
         impl_->on_add_rectangle_to_clip_region_(
@@ -2267,6 +2498,10 @@ void View::AddRectangleToClipRegion(const Rectangle &rect) {
   }
 }
 
+size_t View::GetBlitPixelCount() const {
+  return impl_->blit_pixel_count_;
+}
+
 void View::IncreaseDrawCount() {
 #ifdef _DEBUG
   impl_->draw_count_++;
@@ -2300,6 +2535,14 @@ void View::ClearInterval(int token) {
   impl_->RemoveTimer(token);
 }
 
+uint64_t View::GetFrameClockWakeupCount() const {
+  return impl_->frame_clock_wakeups_;
+}
+
+uint64_t View::GetDroppedFrameCount() const {
+  return impl_->dropped_frames_;
+}
+
 ImageInterface *View::LoadImage(const Variant &src, bool is_mask) const {
   return impl_->LoadImage(src, is_mask);
 }
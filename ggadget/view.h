@@ -164,6 +164,7 @@ class View : public ViewInterface {
 
   virtual const ClipRegion *GetClipRegion() const;
   virtual void AddRectangleToClipRegion(const Rectangle &rect);
+  virtual size_t GetBlitPixelCount() const;
 
   virtual EventResult OnMouseEvent(const MouseEvent &event);
   virtual EventResult OnKeyEvent(const KeyboardEvent &event);
@@ -348,7 +349,8 @@ class View : public ViewInterface {
    * Creates a run-forever timer.
    * @param slot the call target of the timer. This @c ViewInterface instance
    *     becomes the owner of this slot after this call.
-   * @param duration the period between calls in milliseconds.
+   * @param duration the period between calls in milliseconds. Intervals not
+   *     longer than a frame of the animations are fired once per frame.
    * @return the interval token than can be used in @c ClearInterval().
    */
   int SetInterval(Slot0<void> *slot, int duration);
@@ -359,6 +361,23 @@ class View : public ViewInterface {
    */
   void ClearInterval(int token);
 
+  /**
+   * Returns the number of times the frame clock of the view has woken up.
+   *
+   * Animations, and intervals of whole multiples of a frame (40ms), are
+   * fired together by the frame clock, which only runs while there are such
+   * timers. The
+   * number of wakeups per second is the increase of this counter divided
+   * by the elapsed time.
+   */
+  uint64_t GetFrameClockWakeupCount() const;
+
+  /**
+   * Returns the number of frames the frame clock has skipped because it
+   * woke up late, e.g. when the main loop was busy.
+   */
+  uint64_t GetDroppedFrameCount() const;
+
  public:  // Other utilities.
   /**
    * Load an image from the gadget file.
@@ -280,6 +280,17 @@ class ViewInterface {
    */
   virtual void AddRectangleToClipRegion(const Rectangle &rect) = 0;
 
+  /**
+   * Gets the number of pixels copied onto the host's canvas by the last
+   * Draw() call.
+   *
+   * If the view draws from an internal canvas cache, then only the damaged
+   * area, that is the clip region plus the rectangles added by
+   * AddRectangleToClipRegion(), will be copied. View host can use this value
+   * to measure the cost of each frame.
+   */
+  virtual size_t GetBlitPixelCount() const = 0;
+
  public: // Event handlers.
   /** Handler of the mouse events. */
   virtual EventResult OnMouseEvent(const MouseEvent &event) = 0;
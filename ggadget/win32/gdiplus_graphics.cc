@@ -75,6 +75,10 @@ CanvasInterface* GdiplusGraphics::NewCanvas(double w, double h) const {
   return canvas.release();
 }
 
+CanvasInterface* GdiplusGraphics::NewScratchCanvas(double w, double h) const {
+  return NewCanvas(w, h);
+}
+
 ImageInterface* GdiplusGraphics::NewImage(const std::string& tag,
                                           const std::string& data,
                                           bool is_mask) const {
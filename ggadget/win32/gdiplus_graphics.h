@@ -54,6 +54,7 @@ class GdiplusGraphics : public GraphicsInterface {
   virtual ~GdiplusGraphics();
   Connection* ConnectOnZoom(Slot1<void, double>* slot) const;
   virtual CanvasInterface* NewCanvas(double w, double h) const;
+  virtual CanvasInterface* NewScratchCanvas(double w, double h) const;
   virtual ImageInterface* NewImage(const std::string& tag,
                                    const std::string& data,
                                    bool is_mask) const;
@@ -909,6 +909,15 @@ bool XMLParser::ParseContentIntoDOM(const std::string& content,
   return result;
 }
 
+XMLDOMBuilderInterface* XMLParser::CreateDOMBuilder(
+    const StringMap* extra_entities,
+    const char* filename,
+    const char* encoding_hint,
+    DOMDocumentInterface* domdoc) {
+  // MSXML DOM documents can only be loaded from the whole content.
+  return NULL;
+}
+
 bool XMLParser::ParseXMLIntoXPathMap(const std::string& xml,
                                      const StringMap* extra_entities,
                                      const char* filename,
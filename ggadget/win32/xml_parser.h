@@ -53,6 +53,12 @@ class XMLParser : public XMLParserInterface {
                                    std::string* encoding,
                                    std::string* utf8_content);
 
+  virtual XMLDOMBuilderInterface* CreateDOMBuilder(
+      const StringMap* extra_entities,
+      const char* filename,
+      const char* encoding_hint,
+      DOMDocumentInterface* domdoc);
+
   virtual bool ParseXMLIntoXPathMap(const std::string& xml,
                                     const StringMap* extra_entities,
                                     const char* filename,
@@ -15,6 +15,7 @@
 */
 
 #include <algorithm>
+#include <set>
 #include <vector>
 #include <ggadget/gadget_consts.h>
 #include <ggadget/logger.h>
@@ -192,6 +193,19 @@ class DOMNodeImplCallbacks {
   virtual void UpdateChildren() = 0;
 };
 
+// Each distinct node name of a document is stored only once, in the name
+// table owned by the document. Nodes refer to the strings in the table, which
+// live as long as the document.
+class DOMNameTable : public SmallObject<> {
+ public:
+  const std::string *Intern(const std::string &name) {
+    return &*names_.insert(name).first;
+  }
+
+ private:
+  std::set<std::string> names_;
+};
+
 class DOMNodeImpl : public SmallObject<> {
  public:
   typedef std::vector<DOMNodeInterface *> Children;
@@ -203,22 +217,29 @@ class DOMNodeImpl : public SmallObject<> {
       : node_(node),
         callbacks_(callbacks),
         owner_document_(owner_document),
+        name_table_(NULL),
+        name_(NULL),
+        local_name_offset_(0),
         parent_(NULL),
         owner_node_(NULL),
         previous_sibling_(NULL), next_sibling_(NULL),
         row_(0), column_(0) {
     ASSERT(!name.empty());
-    if (!SplitString(name, ":", &prefix_, &local_name_)) {
-      ASSERT(local_name_.empty());
-      local_name_.swap(prefix_);
-    }
     // Pointer comparison is intended here.
     if (name != kDOMDocumentName) {
       ASSERT(owner_document_);
       // Any newly created node has no parent and thus is orphan. Increase the
       // document orphan count.
       owner_document_->Ref();
+    } else {
+      name_table_ = new DOMNameTable();
     }
+    std::string prefix, local_name;
+    if (!SplitString(name, ":", &prefix, &local_name)) {
+      ASSERT(local_name.empty());
+      local_name.swap(prefix);
+    }
+    SetName(prefix, local_name);
   }
 
   virtual ~DOMNodeImpl() {
@@ -235,6 +256,8 @@ class DOMNodeImpl : public SmallObject<> {
     }
     children_.clear();
     ASSERT(on_element_tree_changed_.GetConnectionCount() == 0);
+    // Deleted after the children, which may still refer to the names.
+    delete name_table_;
   }
 
   DOMNodeListInterface *GetChildNodes() {
@@ -438,18 +461,24 @@ class DOMNodeImpl : public SmallObject<> {
     return result;
   }
 
-  std::string GetNodeName() {
-    return prefix_.empty() ? local_name_ : prefix_ + ":" + local_name_;
+  const std::string &GetNodeName() const {
+    return *name_;
+  }
+
+  std::string GetPrefix() const {
+    return local_name_offset_ ?
+           name_->substr(0, local_name_offset_ - 1) : std::string();
+  }
+
+  std::string GetLocalName() const {
+    return name_->substr(local_name_offset_);
   }
 
   DOMExceptionCode SetPrefix(const std::string &prefix) {
-    if (prefix.empty()) {
-      prefix_.clear();
-    } else if (owner_document_->GetXMLParser()->CheckXMLName(prefix.c_str())) {
-      prefix_ = prefix;
-    } else {
+    if (!prefix.empty() &&
+        !owner_document_->GetXMLParser()->CheckXMLName(prefix.c_str()))
       return DOM_INVALID_CHARACTER_ERR;
-    }
+    SetName(prefix, GetLocalName());
     return DOM_NO_ERR;
   }
 
@@ -867,6 +896,25 @@ class DOMNodeImpl : public SmallObject<> {
     bool first_only_;
   };
 
+  // Returns the string equal to name in the name table of the document.
+  const std::string *InternName(const std::string &name) {
+    DOMNameTable *name_table = owner_document_ ?
+                               owner_document_->GetImpl()->name_table_ :
+                               name_table_;
+    ASSERT(name_table);
+    return name_table->Intern(name);
+  }
+
+  void SetName(const std::string &prefix, const std::string &local_name) {
+    if (prefix.empty()) {
+      name_ = InternName(local_name);
+      local_name_offset_ = 0;
+    } else {
+      name_ = InternName(prefix + ":" + local_name);
+      local_name_offset_ = prefix.length() + 1;
+    }
+  }
+
   void OnElementTreeChanged() {
     on_element_tree_changed_();
     // Pass up the message to ancestors.
@@ -878,8 +926,12 @@ class DOMNodeImpl : public SmallObject<> {
   DOMNodeInterface *node_;
   DOMNodeImplCallbacks *callbacks_;
   DOMDocumentInterface *owner_document_;
-  std::string prefix_;
-  std::string local_name_;
+  // Only the document node owns a name table.
+  DOMNameTable *name_table_;
+  // The qualified name in the name table of the document.
+  const std::string *name_;
+  // Where the local name starts in name_, 0 if there is no prefix.
+  size_t local_name_offset_;
   DOMNodeInterface *parent_;
   // In most cases, owner_node_ == parent_, but for DOMAttr, owner_node_ is the
   // owner element.
@@ -1158,7 +1210,7 @@ class DOMNodeBase : public ScriptableHelper<Interface>,
   }
 
   virtual std::string GetPrefix() const {
-    return impl_->prefix_;
+    return impl_->GetPrefix();
   }
 
   virtual DOMExceptionCode SetPrefix(const std::string &prefix) {
@@ -1167,7 +1219,7 @@ class DOMNodeBase : public ScriptableHelper<Interface>,
   }
 
   virtual std::string GetLocalName() const {
-    return impl_->local_name_;
+    return impl_->GetLocalName();
   }
 
   virtual DOMNodeInterface *SelectSingleNode(const char *xpath) {
@@ -1203,110 +1255,150 @@ class DOMNodeBase : public ScriptableHelper<Interface>,
   DOMNodeImpl *impl_;
 };
 
+// Walks at most count UTF-16 code units of a UTF-8 string from the byte
+// offset start, without converting it, and sets *end to the byte offset
+// reached. Returns the number of code units walked, which is less than count
+// if the string ends first, or count + 1 if count ends in the middle of a
+// surrogate pair, in which case *end is after the pair.
+static size_t WalkUTF16Units(const std::string &utf8, size_t start,
+                             size_t count, size_t *end) {
+  ASSERT(start <= utf8.length());
+  const char *src = utf8.c_str() + start;
+  size_t src_length = utf8.length() - start;
+  size_t walked = 0;
+  UTF32Char utf32;
+  UTF16Char utf16[2];
+  // Stops at the same places as ConvertStringUTF8ToUTF16().
+  while (walked < count && src_length && *src) {
+    size_t utf8_length = ConvertCharUTF8ToUTF32(src, src_length, &utf32);
+    if (!utf8_length)
+      break;
+    size_t utf16_length = ConvertCharUTF32ToUTF16(utf32, utf16, 2);
+    if (!utf16_length)
+      break;
+    walked += utf16_length;
+    src += utf8_length;
+    src_length -= utf8_length;
+  }
+  *end = src - utf8.c_str();
+  return walked;
+}
+
+// Returns the length of the UTF-16 string converted from a UTF-8 string,
+// without actually converting it.
+static size_t GetUTF16Length(const std::string &utf8) {
+  size_t end;
+  return WalkUTF16Units(utf8, 0, std::string::npos, &end);
+}
+
+// Character data is only stored in UTF-8, which is what the parser produces
+// and what serialization needs. The UTF-16 form used by scripts is converted
+// on each access instead of being cached, to avoid holding two copies of
+// every text in a large document.
 class DOMCharacterDataImpl : public SmallObject<> {
  public:
-  DOMCharacterDataImpl(const UTF16String &data)
-      : utf16_data_(data) {
+  DOMCharacterDataImpl(const UTF16String &data) {
+    ConvertStringUTF16ToUTF8(data, &data_);
   }
 
   DOMCharacterDataImpl(const std::string &data)
-      : utf8_data_(data) {
+      : data_(data) {
   }
 
   std::string GetNodeValue() const {
-    EnsureUTF8Data();
-    return utf8_data_;
+    return data_;
   }
   void SetNodeValue(const std::string &value) {
-    utf8_data_ = value;
-    utf16_data_.clear();
+    data_ = value;
   }
 
   UTF16String GetData() const {
-    EnsureUTF16Data();
-    return utf16_data_;
+    UTF16String result;
+    ConvertStringUTF8ToUTF16(data_, &result);
+    return result;
   }
   void SetData(const UTF16String &data) {
-    utf16_data_ = data;
-    utf8_data_.clear();
+    ConvertStringUTF16ToUTF8(data, &data_);
   }
 
   size_t GetLength() const {
-    if (utf16_data_.empty() && utf8_data_.empty())
-      return 0;
-    EnsureUTF16Data();
-    return utf16_data_.length();
+    return GetUTF16Length(data_);
   }
 
   bool IsEmpty() const {
-    return utf16_data_.empty() && utf8_data_.empty();
+    return data_.empty();
   }
 
+  // Only the affected range of the data is converted, so that editing a long
+  // text doesn't convert all of it to UTF-16 and back.
   DOMExceptionCode SubstringData(size_t offset, size_t count,
                                  UTF16String *result) const {
     ASSERT(result);
-    EnsureUTF16Data();
     result->clear();
-    if (offset > utf16_data_.length())
+    size_t begin, end;
+    bool split;
+    if (!GetUTF8Range(offset, count, &begin, &end, &split))
       return DOM_INDEX_SIZE_ERR;
-    count = std::min(utf16_data_.length() - offset, count);
-    *result = utf16_data_.substr(offset, count);
+    if (split) {
+      UTF16String data = GetData();
+      count = std::min(data.length() - offset, count);
+      *result = data.substr(offset, count);
+    } else {
+      ConvertStringUTF8ToUTF16(data_.c_str() + begin, end - begin, result);
+    }
     return DOM_NO_ERR;
   }
 
   void AppendData(const UTF16String &arg) {
-    EnsureUTF16Data();
-    utf16_data_ += arg;
-    utf8_data_.clear();
+    std::string utf8_arg;
+    ConvertStringUTF16ToUTF8(arg, &utf8_arg);
+    data_ += utf8_arg;
   }
 
   DOMExceptionCode InsertData(size_t offset, const UTF16String &arg) {
-    EnsureUTF16Data();
-    if (offset > utf16_data_.length())
-      return DOM_INDEX_SIZE_ERR;
-
-    utf16_data_.insert(offset, arg);
-    utf8_data_.clear();
-    return DOM_NO_ERR;
+    return ReplaceData(offset, 0, arg);
   }
 
   DOMExceptionCode DeleteData(size_t offset, size_t count) {
-    EnsureUTF16Data();
-    if (offset > utf16_data_.length())
-      return DOM_INDEX_SIZE_ERR;
-    count = std::min(utf16_data_.length() - offset, count);
-
-    utf16_data_.erase(offset, count);
-    utf8_data_.clear();
-    return DOM_NO_ERR;
+    return ReplaceData(offset, count, UTF16String());
   }
 
   DOMExceptionCode ReplaceData(size_t offset, size_t count,
                                const UTF16String &arg) {
-    EnsureUTF16Data();
-    if (offset > utf16_data_.length())
+    size_t begin, end;
+    bool split;
+    if (!GetUTF8Range(offset, count, &begin, &end, &split))
       return DOM_INDEX_SIZE_ERR;
-    count = std::min(utf16_data_.length() - offset, count);
-
-    utf16_data_.replace(offset, count, arg);
-    utf8_data_.clear();
+    if (split) {
+      UTF16String data = GetData();
+      count = std::min(data.length() - offset, count);
+      data.replace(offset, count, arg);
+      SetData(data);
+    } else {
+      std::string utf8_arg;
+      ConvertStringUTF16ToUTF8(arg, &utf8_arg);
+      data_.replace(begin, end - begin, utf8_arg);
+    }
     return DOM_NO_ERR;
   }
 
  private:
-  void EnsureUTF16Data() const {
-    if (utf16_data_.empty() && !utf8_data_.empty())
-      ConvertStringUTF8ToUTF16(utf8_data_, &utf16_data_);
-  }
-
-  void EnsureUTF8Data() const {
-    if (utf8_data_.empty() && !utf16_data_.empty())
-      ConvertStringUTF16ToUTF8(utf16_data_, &utf8_data_);
+  // Gets the UTF-8 byte range of the UTF-16 range [offset, offset + count),
+  // with count clamped to the end of the data. Returns false if offset is
+  // beyond the end. *split is set if either end of the range is in the
+  // middle of a surrogate pair, which can only be handled in UTF-16.
+  bool GetUTF8Range(size_t offset, size_t count,
+                    size_t *begin, size_t *end, bool *split) const {
+    size_t walked = WalkUTF16Units(data_, 0, offset, begin);
+    if (walked < offset)
+      return false;
+    *split = walked > offset;
+    if (!*split)
+      *split = WalkUTF16Units(data_, *begin, count, end) > count;
+    return true;
   }
 
-  // data_ and utf8_data_ cache each other.
-  mutable UTF16String utf16_data_;
-  mutable std::string utf8_data_;
+  std::string data_;
 };
 
 template <typename Interface1>
@@ -1510,9 +1602,18 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
  public:
   DEFINE_CLASS_ID(0x721f40f59a3f48a9, DOMElementInterface);
   typedef DOMNodeBase<DOMElementInterface> Super;
-  typedef std::vector<DOMAttr *> Attrs;
-  // Maps attribute name to the index of Attrs.
-  typedef LightMap<std::string, size_t> AttrsMap;
+
+  // Most attributes of a parsed document are only read with GetAttribute()
+  // or never touched at all, so an attribute is only stored as its name and
+  // value until it is accessed as a node. The DOMAttr is then created and
+  // holds the value from then on.
+  struct Attr {
+    // The name in the name table of the owner document.
+    const std::string *name;
+    std::string value;
+    DOMAttr *node;
+  };
+  typedef std::vector<Attr> Attrs;
 
   DOMElement(DOMDocumentInterface *owner_document, const std::string &tag_name)
       : Super(owner_document, tag_name) {
@@ -1537,9 +1638,8 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
   }
 
   ~DOMElement() {
-    ASSERT(attrs_.size() == attrs_map_.size());
     for (Attrs::iterator it = attrs_.begin(); it != attrs_.end(); ++it)
-      delete (*it);
+      delete it->node;
   }
 
   virtual NodeType GetNodeType() const { return ELEMENT_NODE; }
@@ -1547,14 +1647,19 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
 
   virtual void Normalize() {
     Super::Normalize();
-    for (Attrs::iterator it = attrs_.begin(); it != attrs_.end(); ++it)
-      (*it)->Normalize();
+    for (Attrs::iterator it = attrs_.begin(); it != attrs_.end(); ++it) {
+      if (it->node)
+        it->node->Normalize();
+    }
   }
 
   virtual std::string GetAttribute(const std::string &name) const {
-    const DOMAttrInterface *attr = GetAttributeNode(name);
+    size_t index = FindAttr(name);
     // TODO: Default value logic.
-    return attr ? attr->GetValue() : "";
+    if (index == kNotFound)
+      return "";
+    const Attr &attr = attrs_[index];
+    return attr.node ? attr.node->GetValue() : attr.value;
   }
 
   virtual DOMExceptionCode SetAttribute(const std::string &name,
@@ -1562,18 +1667,13 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
     if (!CheckXMLName(name.c_str()))
       return DOM_INVALID_CHARACTER_ERR;
 
-    AttrsMap::iterator it = attrs_map_.find(name);
-    if (it == attrs_map_.end()) {
-      DOMAttr *attr = new DOMAttr(GetOwnerDocument(), name, this);
-      attrs_map_[attr->GetName()] = attrs_.size();
-      attrs_.push_back(attr);
-      attr->SetValue(value);
-      attr->SetRow(GetRow());
-      // Don't set column, because it is inaccurate.
-      ASSERT(attrs_map_.size() == attrs_.size());
+    size_t index = FindAttr(name);
+    if (index == kNotFound) {
+      AddAttr(GetImpl()->InternName(name), value, NULL);
+    } else if (attrs_[index].node) {
+      attrs_[index].node->SetValue(value);
     } else {
-      ASSERT(it->second < attrs_.size());
-      attrs_[it->second]->SetValue(value);
+      attrs_[index].value = value;
     }
     return DOM_NO_ERR;
   }
@@ -1589,9 +1689,8 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
 
   virtual const DOMAttrInterface *GetAttributeNode(
       const std::string &name) const {
-    AttrsMap::const_iterator it = attrs_map_.find(name);
-    ASSERT(it == attrs_map_.end() || it->second < attrs_.size());
-    return it == attrs_map_.end() ? NULL : attrs_[it->second];
+    size_t index = FindAttr(name);
+    return index == kNotFound ? NULL : GetAttrNode(index);
   }
 
   virtual DOMExceptionCode SetAttributeNode(DOMAttrInterface *new_attr) {
@@ -1606,16 +1705,17 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
 
     DOMAttr *new_attr_internal = down_cast<DOMAttr *>(new_attr);
     new_attr_internal->SetOwnerElement(this);
-    AttrsMap::iterator it = attrs_map_.find(new_attr->GetName());
-    if (it != attrs_map_.end()) {
-      ASSERT(it->second < attrs_.size());
-      attrs_[it->second]->SetOwnerElement(NULL);
-      attrs_[it->second] = new_attr_internal;
-      // No need to change attr_map_.
+    const std::string *name = &new_attr_internal->GetImpl()->GetNodeName();
+    size_t index = FindAttr(*name);
+    if (index != kNotFound) {
+      Attr &attr = attrs_[index];
+      if (attr.node)
+        attr.node->SetOwnerElement(NULL);
+      attr.name = name;
+      std::string().swap(attr.value);
+      attr.node = new_attr_internal;
     } else {
-      attrs_map_[new_attr->GetName()] = attrs_.size();
-      attrs_.push_back(new_attr_internal);
-      ASSERT(attrs_map_.size() == attrs_.size());
+      AddAttr(name, std::string(), new_attr_internal);
     }
     return DOM_NO_ERR;
   }
@@ -1645,7 +1745,14 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
     xml->append(GetNodeName());
     for (Attrs::iterator it = attrs_.begin(); it != attrs_.end(); ++it) {
       xml->append(1, ' ');
-      (*it)->AppendXML(indent, xml);
+      if (it->node) {
+        it->node->AppendXML(indent, xml);
+      } else {
+        xml->append(*it->name);
+        xml->append("=\"");
+        xml->append(EncodeXMLString(it->value));
+        xml->append(1, '"');
+      }
       if (xml->size() - line_begin > kLineLengthThreshold) {
         line_begin = xml->length();
         AppendIndentNewLine(indent + kIndent, xml);
@@ -1674,9 +1781,14 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
   virtual DOMNodeInterface *CloneSelf(DOMDocumentInterface *owner_document) {
     DOMElement *element = new DOMElement(owner_document, GetTagName());
     for (Attrs::iterator it = attrs_.begin(); it != attrs_.end(); ++it) {
-      DOMAttrInterface *cloned_attr = down_cast<DOMAttrInterface *>(
-          (*it)->GetImpl()->CloneNode(owner_document, true));
-      element->SetAttributeNode(cloned_attr);
+      if (it->node) {
+        DOMAttrInterface *cloned_attr = down_cast<DOMAttrInterface *>(
+            it->node->GetImpl()->CloneNode(owner_document, true));
+        element->SetAttributeNode(cloned_attr);
+      } else {
+        element->AddAttr(element->GetImpl()->InternName(*it->name),
+                         it->value, NULL);
+      }
     }
     return element;
   }
@@ -1684,6 +1796,42 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
   virtual bool AllowPrefix() const { return true; }
 
  private:
+  static const size_t kNotFound = static_cast<size_t>(-1);
+
+  // Elements seldom have more than a few attributes, for which a linear
+  // search is faster and much smaller than a map.
+  size_t FindAttr(const std::string &name) const {
+    for (size_t i = 0; i < attrs_.size(); i++) {
+      if (*attrs_[i].name == name)
+        return i;
+    }
+    return kNotFound;
+  }
+
+  void AddAttr(const std::string *name, const std::string &value,
+               DOMAttr *node) {
+    Attr attr;
+    attr.name = name;
+    attr.value = value;
+    attr.node = node;
+    attrs_.push_back(attr);
+  }
+
+  // Creates the DOMAttr of an attribute when it is accessed as a node.
+  DOMAttr *GetAttrNode(size_t index) const {
+    ASSERT(index < attrs_.size());
+    Attr &attr = attrs_[index];
+    if (!attr.node) {
+      DOMElement *self = const_cast<DOMElement *>(this);
+      attr.node = new DOMAttr(self->GetOwnerDocument(), *attr.name, self);
+      attr.node->SetValue(attr.value);
+      attr.node->SetRow(GetRow());
+      // Don't set column, because it is inaccurate.
+      std::string().swap(attr.value);
+    }
+    return attr.node;
+  }
+
   DOMAttrInterface *GetAttributeNodeNotConst(const std::string &name) {
     return GetAttributeNode(name);
   }
@@ -1731,10 +1879,12 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
              DOM_NO_ERR : DOM_NOT_FOUND_ERR;
     }
     virtual DOMNodeInterface *GetItem(size_t index) {
-      return index < element_->attrs_.size() ? element_->attrs_[index] : NULL;
+      return index < element_->attrs_.size() ?
+             element_->GetAttrNode(index) : NULL;
     }
     virtual const DOMNodeInterface *GetItem(size_t index) const {
-      return index < element_->attrs_.size() ? element_->attrs_[index] : NULL;
+      return index < element_->attrs_.size() ?
+             element_->GetAttrNode(index) : NULL;
     }
     virtual size_t GetLength() const {
       return element_->attrs_.size();
@@ -1807,28 +1957,24 @@ class DOMElement : public DOMNodeBase<DOMElementInterface> {
   }
 
   bool RemoveAttributeInternal(const std::string &name) {
-    AttrsMap::iterator it = attrs_map_.find(name);
-    if (it != attrs_map_.end()) {
-      size_t index = it->second;
-      attrs_[index]->SetOwnerElement(NULL);
+    size_t index = FindAttr(name);
+    if (index != kNotFound) {
+      if (attrs_[index].node)
+        attrs_[index].node->SetOwnerElement(NULL);
       if (index < attrs_.size() - 1) {
-        // Move the last element to the new blank slot and update the index,
-        // ensuring that attrs_ contains no blank slot.
-        DOMAttr *last_attr = attrs_.back();
-        attrs_[index] = last_attr;
-        attrs_map_[last_attr->GetName()] = index;
+        // Move the last element to the new blank slot, ensuring that attrs_
+        // contains no blank slot.
+        attrs_[index] = attrs_.back();
       }
       attrs_.pop_back();
-      attrs_map_.erase(it);
       return true;
     }
     return false;
     // TODO: Deal with default values if we support DTD.
   }
 
-  std::string tag_name_;
-  Attrs attrs_;
-  AttrsMap attrs_map_;
+  // Mutable because DOMAttrs are created in const accessors.
+  mutable Attrs attrs_;
 };
 
 DOMElementInterface *DOMAttr::GetOwnerElement() {
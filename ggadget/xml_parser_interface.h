@@ -29,6 +29,38 @@ class DOMDocumentInterface;
  * @{
  */
 
+/**
+ * Builds a DOM document from XML content which is received in chunks, for
+ * example, from XMLHttpRequestInterface::ConnectOnDataReceived(). The DOM
+ * nodes are created while the chunks are parsed, so the whole content needs
+ * not to be kept in memory.
+ */
+class XMLDOMBuilderInterface {
+ public:
+  /** Destroys the builder. The DOM document is not affected. */
+  virtual void Destroy() = 0;
+
+  /**
+   * Parses a chunk of the content. The signature matches the receiver of
+   * XMLHttpRequestInterface::ConnectOnDataReceived(), so the method can be
+   * connected to the request directly.
+   * @return @a size if succeeds, or 0 if the content is not well-formed.
+   */
+  virtual size_t Write(const void *data, size_t size) = 0;
+
+  /**
+   * Finishes parsing after all chunks are written.
+   * @param[out] encoding contains the encoding of the content. Can be
+   *     @c NULL if the caller doesn't need it.
+   * @return @c true if the content is well-formed and has a root element.
+   *     On failure, the DOM document is left blank.
+   */
+  virtual bool Finish(std::string *encoding) = 0;
+
+ protected:
+  virtual ~XMLDOMBuilderInterface() { }
+};
+
 /**
  * Interface class for real XML parser implementation.
  */
@@ -121,6 +153,28 @@ class XMLParserInterface {
                                    std::string *encoding,
                                    std::string *utf8_content) = 0;
 
+  /**
+   * Creates a builder to parse XML content received in chunks into a DOM
+   * document. Unlike ParseContentIntoDOM(), the content must be XML, and
+   * the encoding can't fall back to another one if conversion fails.
+   *
+   * @param extra_entities extra entites defined in other places that this
+   *     XML file may reference. Must be alive until the builder is destroyed.
+   * @param filename the name of the XML file (only for logging).
+   * @param encoding_hint the hint of encoding if the input xml has no
+   *     Unicode BOF. If @c NULL or blank, the parser will detect the
+   *     encoding.
+   * @param domdoc the DOM document. It must be blank before calling this
+   *     function.
+   * @return the builder, or @c NULL if the parser doesn't support
+   *     incremental parsing. The caller should call Destroy() after use.
+   */
+  virtual XMLDOMBuilderInterface *CreateDOMBuilder(
+      const StringMap *extra_entities,
+      const char *filename,
+      const char *encoding_hint,
+      DOMDocumentInterface *domdoc) = 0;
+
   /**
    * Parses an XML file and store the result into a string map.
    *
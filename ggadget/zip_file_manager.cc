@@ -18,6 +18,11 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#if defined(OS_POSIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include <cstring>
 #include <vector>
 #include <string>
@@ -39,16 +44,21 @@
 
 namespace ggadget {
 
-#ifdef GADGET_CASE_SENSITIVE
-static const int kZipCaseSensitivity = 1;
-#else
-static const int kZipCaseSensitivity = 2;
-#endif
-
 static const uLong kMaxFieldSize = 200000;
 static const char kZipGlobalComment[] = "Created by Google Gadgets for Linux.";
 static const char kZipReadMeFile[] = ".readme";
 static const char kTempZipFile[] = "%%Temp%%.zip";
+static const size_t kNoEntry = static_cast<size_t>(-1);
+
+// Zip format signatures and offsets, used to serve stored entries directly
+// from the memory mapped archive.
+static const uint32_t kZipCentralHeaderSignature = 0x02014b50;
+static const uint32_t kZipLocalHeaderSignature = 0x04034b50;
+static const size_t kZipCentralHeaderSize = 46;
+static const size_t kZipCentralHeaderLocalOffset = 42;
+static const size_t kZipLocalHeaderSize = 30;
+static const size_t kZipLocalHeaderNameLength = 26;
+static const size_t kZipLocalHeaderExtraLength = 28;
 
 namespace {
 #if defined(OS_WIN)
@@ -71,18 +81,6 @@ void StringReplace(char* path, char old_char, char new_char) {
 }
 #endif
 
-int UnzLocateFile(unzFile file, const char* szFileName, int iCaseSensitivity) {
-#if defined(OS_WIN)
-  int name_buffer_length = strlen(szFileName) + 1;
-  scoped_array<char> file_name(new char[name_buffer_length]);
-  strcpy_s(file_name.get(), name_buffer_length, szFileName);
-  StringReplace(file_name.get(), '\\', '/');
-  return ::unzLocateFile(file, file_name.get(), iCaseSensitivity);
-#elif defined(OS_POSIX)
-  return ::unzLocateFile(file, szFileName, iCaseSensitivity);
-#endif
-}
-
 int UnzGetCurrentFileInfo(unzFile file, unz_file_info* pfile_info,
                           char* szFileName, uLong fileNameBufferSize,
                           void* extraField, uLong extraFieldBufferSize,
@@ -130,7 +128,9 @@ int ZipOpenNewFileInZip(zipFile file,
 
 class ZipFileManager::Impl : public SmallObject<> {
  public:
-  Impl() : unzip_handle_(NULL), zip_handle_(NULL) {
+  Impl()
+      : unzip_handle_(NULL), zip_handle_(NULL), index_valid_(false),
+        map_data_(NULL), map_size_(0) {
   }
 
   ~Impl() {
@@ -144,6 +144,7 @@ class ZipFileManager::Impl : public SmallObject<> {
     temp_dir_.clear();
     base_path_.clear();
 
+    InvalidateIndex();
     if (unzip_handle_)
       unzClose(unzip_handle_);
     if (zip_handle_)
@@ -153,6 +154,186 @@ class ZipFileManager::Impl : public SmallObject<> {
     zip_handle_ = NULL;
   }
 
+  // An entry of the central directory of the archive.
+  struct Entry {
+    std::string name;
+    std::string key;  // Name for lookup, see GetEntryKey().
+    unz_file_pos pos;
+    unz_file_info info;
+    size_t next;  // Next entry in the same hash bucket.
+  };
+
+  // Returns the name used to look up an entry, which follows the file name
+  // comparison rule of GadgetStrCmp().
+  static std::string GetEntryKey(const char *name) {
+#ifdef GADGET_CASE_SENSITIVE
+    std::string key(name);
+#else
+    std::string key(ToLower(name));
+#endif
+#if defined(OS_WIN)
+    if (!key.empty())
+      StringReplace(&key[0], '/', '\\');
+#endif
+    return key;
+  }
+
+  static size_t HashEntryKey(const std::string &key) {
+    // FNV-1a.
+    size_t hash = 2166136261U;
+    for (size_t i = 0; i < key.size(); ++i)
+      hash = (hash ^ static_cast<unsigned char>(key[i])) * 16777619U;
+    return hash;
+  }
+
+  // Reads the whole central directory into entries_ and hashes the entries
+  // by name, so that files can be located without scanning the directory.
+  // The archive is also mapped into memory for reading stored entries.
+  bool BuildIndex() {
+    ASSERT(unzip_handle_);
+    InvalidateIndex();
+
+    std::vector<char> filename(256);
+    int res = unzGoToFirstFile(unzip_handle_);
+    while (res == UNZ_OK) {
+      Entry entry;
+      res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, &entry.info,
+                                           &filename[0], filename.size(),
+                                           NULL, 0, NULL, 0);
+      if (res != UNZ_OK)
+        break;
+      if (entry.info.size_filename + 1 > filename.size()) {
+        filename.resize(entry.info.size_filename + 1);
+        res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, &entry.info,
+                                             &filename[0], filename.size(),
+                                             NULL, 0, NULL, 0);
+        if (res != UNZ_OK)
+          break;
+      }
+      res = unzGetFilePos(unzip_handle_, &entry.pos);
+      if (res != UNZ_OK)
+        break;
+      entry.name = &filename[0];
+      entry.key = GetEntryKey(entry.name.c_str());
+      entries_.push_back(entry);
+      res = unzGoToNextFile(unzip_handle_);
+    }
+    if (res != UNZ_END_OF_LIST_OF_FILE) {
+      LOG("Failed to read the central directory of zip archive %s.",
+          base_path_.c_str());
+      entries_.clear();
+      return false;
+    }
+
+    size_t bucket_count = 16;
+    while (bucket_count < entries_.size())
+      bucket_count *= 2;
+    buckets_.assign(bucket_count, kNoEntry);
+    // Inserts in reverse order, so that the first one of entries with the
+    // same name is found first, as unzLocateFile() does.
+    for (size_t i = entries_.size(); i > 0; --i) {
+      size_t bucket = HashEntryKey(entries_[i - 1].key) & (bucket_count - 1);
+      entries_[i - 1].next = buckets_[bucket];
+      buckets_[bucket] = i - 1;
+    }
+    MapArchive();
+    index_valid_ = true;
+    return true;
+  }
+
+  void InvalidateIndex() {
+    index_valid_ = false;
+    entries_.clear();
+    buckets_.clear();
+    UnmapArchive();
+  }
+
+  const Entry *FindEntry(const std::string &relative_path) {
+    if (!index_valid_ || buckets_.empty())
+      return NULL;
+    std::string key = GetEntryKey(relative_path.c_str());
+    for (size_t i = buckets_[HashEntryKey(key) & (buckets_.size() - 1)];
+         i != kNoEntry; i = entries_[i].next) {
+      if (entries_[i].key == key)
+        return &entries_[i];
+    }
+    return NULL;
+  }
+
+  // Finds the entry and makes it the current file of the unzip handle.
+  const Entry *LocateEntry(const std::string &relative_path) {
+    const Entry *entry = FindEntry(relative_path);
+    if (entry &&
+        unzGoToFilePos(unzip_handle_, const_cast<unz_file_pos *>(&entry->pos))
+            != UNZ_OK) {
+      return NULL;
+    }
+    return entry;
+  }
+
+  void MapArchive() {
+#if defined(OS_POSIX)
+    int fd = open(base_path_.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat stat_value;
+    if (fstat(fd, &stat_value) == 0 && stat_value.st_size > 0) {
+      void *data = mmap(NULL, static_cast<size_t>(stat_value.st_size),
+                        PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        map_data_ = static_cast<const char *>(data);
+        map_size_ = static_cast<size_t>(stat_value.st_size);
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  void UnmapArchive() {
+#if defined(OS_POSIX)
+    if (map_data_)
+      munmap(const_cast<char *>(map_data_), map_size_);
+#endif
+    map_data_ = NULL;
+    map_size_ = 0;
+  }
+
+  uint32_t GetMappedValue(size_t offset, size_t size) {
+    uint32_t value = 0;
+    // Values in zip headers are little endian.
+    for (size_t i = size; i > 0; --i) {
+      value = (value << 8) |
+              static_cast<unsigned char>(map_data_[offset + i - 1]);
+    }
+    return value;
+  }
+
+  // Returns the content of a stored (uncompressed) entry in the mapped
+  // archive, or NULL if the entry can't be read directly.
+  const char *GetStoredContent(const Entry &entry) {
+    if (!map_data_ || entry.info.compression_method != 0 ||
+        (entry.info.flag & 1) ||  // Encrypted.
+        entry.info.compressed_size != entry.info.uncompressed_size)
+      return NULL;
+
+    // Archives with data before the zip content (e.g. self-extracting ones)
+    // don't pass the signature checks, and are read through unzip instead.
+    size_t central = entry.pos.pos_in_zip_directory;
+    if (central > map_size_ || map_size_ - central < kZipCentralHeaderSize ||
+        GetMappedValue(central, 4) != kZipCentralHeaderSignature)
+      return NULL;
+    size_t local = GetMappedValue(central + kZipCentralHeaderLocalOffset, 4);
+    if (local > map_size_ || map_size_ - local < kZipLocalHeaderSize ||
+        GetMappedValue(local, 4) != kZipLocalHeaderSignature)
+      return NULL;
+    size_t start = local + kZipLocalHeaderSize +
+                   GetMappedValue(local + kZipLocalHeaderNameLength, 2) +
+                   GetMappedValue(local + kZipLocalHeaderExtraLength, 2);
+    if (start > map_size_ || map_size_ - start < entry.info.uncompressed_size)
+      return NULL;
+    return map_data_ + start;
+  }
+
   bool IsValid() {
     return !base_path_.empty() && (zip_handle_ || unzip_handle_);
   }
@@ -211,6 +392,8 @@ class ZipFileManager::Impl : public SmallObject<> {
     unzip_handle_ = unzip_handle;
     zip_handle_ = zip_handle;
     base_path_ = path;
+    if (unzip_handle_)
+      BuildIndex();
     return true;
   }
 
@@ -225,9 +408,27 @@ class ZipFileManager::Impl : public SmallObject<> {
     if (!SwitchToRead())
       return false;
 
-    if (ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                               kZipCaseSensitivity) != UNZ_OK)
+    const Entry *entry = LocateEntry(relative_path);
+    if (!entry)
+      return false;
+
+    if (entry->info.uncompressed_size > kMaxFileSize) {
+      LOG("File %s is too big", relative_path.c_str());
       return false;
+    }
+
+    const char *content = GetStoredContent(*entry);
+    if (content) {
+      uInt size = static_cast<uInt>(entry->info.uncompressed_size);
+      if (crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef *>(content),
+                size) != entry->info.crc) {
+        LOG("CRC error in file: %s in zip file: %s",
+            relative_path.c_str(), base_path_.c_str());
+        return false;
+      }
+      data->assign(content, size);
+      return true;
+    }
 
     if (unzOpenCurrentFile(unzip_handle_) != UNZ_OK) {
       LOG("Can't open file %s for reading in zip archive %s.",
@@ -235,8 +436,9 @@ class ZipFileManager::Impl : public SmallObject<> {
       return false;
     }
 
+    data->reserve(entry->info.uncompressed_size);
     bool result = true;
-    const int kChunkSize = 2048;
+    const int kChunkSize = 8192;
     char buffer[kChunkSize];
     while (true) {
       int read_size = unzReadCurrentFile(unzip_handle_, buffer, kChunkSize);
@@ -301,6 +503,8 @@ class ZipFileManager::Impl : public SmallObject<> {
         return true;
       }
 
+      if (!impl_->LocateEntry(filename))
+        return false;
       unz_file_info unz_info;
       if (ggadget::UnzGetCurrentFileInfo(impl_->unzip_handle_, &unz_info,
                                          NULL, 0, NULL, 0, NULL, 0) != UNZ_OK ||
@@ -382,6 +586,7 @@ class ZipFileManager::Impl : public SmallObject<> {
 
     if (res) {
       // Copy the temp zip file over the original zip.
+      InvalidateIndex();
       unzClose(unzip_handle_);
       unzip_handle_ = NULL;
       res = ggadget::unlink(base_path_.c_str()) == 0 &&
@@ -402,11 +607,7 @@ class ZipFileManager::Impl : public SmallObject<> {
     if (!CheckFilePath(file, &relative_path, NULL))
       return false;
 
-    if (!SwitchToRead())
-      return false;
-
-    if (ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                               kZipCaseSensitivity) != UNZ_OK)
+    if (!SwitchToRead() || !LocateEntry(relative_path))
       return false;
 
     if (into_file->empty()) {
@@ -478,9 +679,7 @@ class ZipFileManager::Impl : public SmallObject<> {
     bool result = CheckFilePath(file, &relative_path, &full_path);
     if (path) *path = full_path;
 
-    return result && SwitchToRead() &&
-           ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                                  kZipCaseSensitivity) == UNZ_OK;
+    return result && SwitchToRead() && FindEntry(relative_path);
   }
 
   bool IsDirectlyAccessible(const char *file, std::string *path) {
@@ -501,12 +700,10 @@ class ZipFileManager::Impl : public SmallObject<> {
     std::string full_path, relative_path;
     bool result = CheckFilePath(file, &relative_path, &full_path);
 
-    unz_file_info file_info;
+    const Entry *entry;
     if (result && SwitchToRead() &&
-        ggadget::UnzLocateFile(unzip_handle_, relative_path.c_str(),
-                               kZipCaseSensitivity) == UNZ_OK &&
-        ggadget::UnzGetCurrentFileInfo(unzip_handle_, &file_info,
-                                       NULL, 0, NULL, 0, NULL, 0) == UNZ_OK) {
+        (entry = FindEntry(relative_path)) != NULL) {
+      const unz_file_info &file_info = entry->info;
       struct tm tm;
       memset(&tm, 0, sizeof(tm));
       tm.tm_year = file_info.tmu_date.tm_year - 1900;
@@ -532,42 +729,28 @@ class ZipFileManager::Impl : public SmallObject<> {
     if (!dir_name.empty() && dir_name[dir_name.size() - 1] != kDirSeparator)
       dir_name += kDirSeparator;
 
-    if (!SwitchToRead())
+    if (!SwitchToRead()) {
+      delete callback;
       return -1;
+    }
 
-    int res = unzGoToFirstFile(unzip_handle_);
-    while (res == UNZ_OK) {
-      unz_file_info file_info;
-      char filename[256];
-      res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, &file_info,
-                                           filename, sizeof(filename),
-                                           NULL, 0, NULL, 0);
-      if (res != UNZ_OK)
-        break;
-      char *filename_ptr = filename;
-      size_t filename_size = static_cast<size_t>(file_info.size_filename + 1);
-      // In most cases filename buffer is big enough to contain the file name.
-      if (filename_size > sizeof(filename)) {
-        filename_ptr = new char[filename_size];
-        res = ggadget::UnzGetCurrentFileInfo(unzip_handle_, &file_info,
-                                             filename_ptr, filename_size,
-                                             NULL, 0, NULL, 0);
-        if (res != UNZ_OK)
-          break;
-      }
-      if (filename_ptr[filename_size - 1] != kDirSeparator &&
-          strcmp(filename_ptr, kZipReadMeFile) != 0 &&
-          GadgetStrNCmp(dir_name.c_str(), filename_ptr, dir_name.size()) == 0 &&
-          !(*callback)(filename_ptr + dir_name.size())) {
-        if (filename_ptr != filename) delete [] filename_ptr;
+    // Copies the names, because the callback may change the archive.
+    std::vector<std::string> names;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      const std::string &name = entries_[i].name;
+      if (!name.empty() && name[name.size() - 1] != kDirSeparator &&
+          name != kZipReadMeFile &&
+          GadgetStrNCmp(dir_name.c_str(), name.c_str(), dir_name.size()) == 0)
+        names.push_back(name);
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (!(*callback)(names[i].c_str() + dir_name.size())) {
         delete callback;
         return 1;
       }
-      if (filename_ptr != filename) delete [] filename_ptr;
-      res = unzGoToNextFile(unzip_handle_);
     }
     delete callback;
-    return res == UNZ_OK || res == UNZ_END_OF_LIST_OF_FILE ? 0 : -1;
+    return 0;
   }
 
   // Check if the given file path is valid and return the full path and
@@ -633,7 +816,8 @@ class ZipFileManager::Impl : public SmallObject<> {
 
     if (unzip_handle_) {
       // unzGoToFirstFile can reset error flags of the handle.
-      if (unzGoToFirstFile(unzip_handle_) == UNZ_OK)
+      if (unzGoToFirstFile(unzip_handle_) == UNZ_OK &&
+          (index_valid_ || BuildIndex()))
         return true;
       // The unzip handle is not usable. Reopen it.
       unzClose(unzip_handle_);
@@ -645,10 +829,11 @@ class ZipFileManager::Impl : public SmallObject<> {
     }
 
     unzip_handle_ = unzOpen(base_path_.c_str());
-    if (!unzip_handle_)
+    if (!unzip_handle_) {
       LOG("Can't open zip archive %s for reading.", base_path_.c_str());
-
-    return unzip_handle_ != NULL;
+      return false;
+    }
+    return BuildIndex();
   }
 
   bool SwitchToWrite() {
@@ -659,6 +844,7 @@ class ZipFileManager::Impl : public SmallObject<> {
       return true;
 
     if (unzip_handle_) {
+      InvalidateIndex();
       unzClose(unzip_handle_);
       unzip_handle_ = NULL;
     }
@@ -720,6 +906,13 @@ class ZipFileManager::Impl : public SmallObject<> {
 
   unzFile unzip_handle_;
   zipFile zip_handle_;
+
+  // Index of the central directory, only valid when reading.
+  bool index_valid_;
+  std::vector<Entry> entries_;
+  std::vector<size_t> buckets_;  // Heads of hash buckets in entries_.
+  const char *map_data_;
+  size_t map_size_;
 };
 
 
@@ -1,4 +1,7 @@
 #!/bin/sh
+# Summarizes the output of a program run under valgrind with TRACE_ALLOCS
+# defined in ggadget/small_object.cc, and the SMALL_OBJ_STAT lines logged by
+# SmallObjAllocator::ReportStats().
 awk '
 flag == 1 && ! /valgrind/ && ! /small_object/ {
   count[$0]++;
@@ -9,10 +12,27 @@ flag == 1 && ! /valgrind/ && ! /small_object/ {
   flag = 1;
 }
 
+# Fields: block size, live objects, cached blocks, free blocks, slabs,
+# reserved bytes, fragmentation. Only the last report is kept.
+/SMALL_OBJ_STAT:/ {
+  sub(/.*SMALL_OBJ_STAT: */, "");
+  if (!($1 in stat))
+    nstat++;
+  stat[$1] = $0;
+}
+
 END {
   for (i in count) {
-    print count[i], i;
+    print count[i], i | "sort -n -r";
+  }
+  close("sort -n -r");
+  if (nstat > 0) {
+    print "";
+    print "block live cached free slabs reserved fragmentation";
+    for (i in stat) {
+      print stat[i] | "sort -n";
+    }
+    close("sort -n");
   }
 }
-' < $1 | sort -n -r
-
+' < $1